@@ -146,6 +146,7 @@ public:
 
 protected:
 	friend class b2ContactManager;
+	friend class b2ContactUpdateTask;
 	friend class b2World;
 	friend class b2ContactSolver;
 	friend class b2Body;
@@ -189,6 +190,13 @@ protected:
 
 	void Update(b2ContactListener* listener);
 
+	// Update splits into the narrow phase, which only touches this contact
+	// and so may run concurrently with other contacts, followed by waking
+	// the bodies and calling the listener, which must be done in order.
+	// UpdateManifold returns whether the contact was touching before.
+	bool UpdateManifold(b2Manifold* oldManifold);
+	void FinishUpdate(b2ContactListener* listener, const b2Manifold& oldManifold, bool wasTouching);
+
 	static b2ContactRegister s_registers[b2Shape::e_typeCount][b2Shape::e_typeCount];
 	static bool s_initialized;
 
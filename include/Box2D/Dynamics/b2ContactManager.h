@@ -25,6 +25,7 @@ class b2Contact;
 class b2ContactFilter;
 class b2ContactListener;
 class b2BlockAllocator;
+class b2TaskExecutor;
 
 // Delegate of b2World.
 class b2ContactManager
@@ -47,6 +48,9 @@ public:
 	b2ContactFilter* m_contactFilter;
 	b2ContactListener* m_contactListener;
 	b2BlockAllocator* m_allocator;
+
+	// When set, the narrow phase of Collide runs on the executor.
+	b2TaskExecutor* m_taskExecutor;
 };
 
 #endif
@@ -27,6 +27,7 @@ class b2Contact;
 class b2Joint;
 class b2StackAllocator;
 class b2ContactListener;
+struct b2ContactImpulse;
 struct b2ContactVelocityConstraint;
 struct b2Profile;
 
@@ -74,6 +75,11 @@ public:
 	b2StackAllocator* m_allocator;
 	b2ContactListener* m_listener;
 
+	// If set, Report stores the impulse of each contact here instead of
+	// calling the listener, so that islands solved in parallel can be
+	// reported afterwards in order.
+	b2ContactImpulse* m_impulses;
+
 	b2Body** m_bodies;
 	b2Contact** m_contacts;
 	b2Joint** m_joints;
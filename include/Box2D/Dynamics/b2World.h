@@ -34,6 +34,8 @@ class b2Body;
 class b2Draw;
 class b2Fixture;
 class b2Joint;
+class b2Island;
+class b2IslandSolveTask;
 
 /// The world class manages all physics entities, dynamic simulation,
 /// and asynchronous queries. The world also contains efficient memory
@@ -66,6 +68,12 @@ public:
 	/// by you and must remain in scope.
 	void SetDebugDraw(b2Draw* debugDraw);
 
+	/// Register an executor to solve islands and update contacts on several
+	/// threads, or NULL to do everything on the calling thread. Listeners are
+	/// still only called from the thread calling Step. The executor is owned
+	/// by you and must remain in scope.
+	void SetTaskExecutor(b2TaskExecutor* executor);
+
 	/// Create a rigid body given a definition. No reference to the definition
 	/// is retained.
 	/// @warning This function is locked during callbacks.
@@ -226,6 +234,8 @@ private:
 
 	void Solve(const b2TimeStep& step);
 	void SolveTOI(const b2TimeStep& step);
+	void BuildIsland(b2Body* seed, b2Island* island, b2Body** stack);
+	void SolveIslands(const b2TimeStep& step, b2IslandSolveTask* task, int32 islandCount, int32 bodyTotal, int32 contactTotal);
 
 	void DrawJoint(b2Joint* joint);
 	void DrawShape(b2Fixture* shape, const b2Transform& xf, const b2Color& color);
@@ -261,6 +271,12 @@ private:
 	bool m_stepComplete;
 
 	b2Profile m_profile;
+
+	b2TaskExecutor* m_taskExecutor;
+
+	// One per worker of the task executor.
+	b2StackAllocator* m_workerAllocators;
+	int32 m_workerAllocatorCount;
 };
 
 inline b2Body* b2World::GetBodyList()
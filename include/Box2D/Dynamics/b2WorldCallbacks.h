@@ -152,4 +152,35 @@ public:
 									const b2Vec2& normal, float32 fraction) = 0;
 };
 
+/// A range of work handed to a b2TaskExecutor.
+class b2Task
+{
+public:
+	virtual ~b2Task() {}
+
+	/// Do the items [begin, end). Ranges of the same task may run concurrently.
+	/// @param worker which of the executor's workers is running the range, in
+	/// [0, b2TaskExecutor::GetWorkerCount()). No two ranges run concurrently
+	/// on the same worker, so per-worker scratch memory needs no locking.
+	virtual void Run(int32 begin, int32 end, int32 worker) = 0;
+};
+
+/// Implement this class to let the world solve islands and update contacts
+/// on several threads. Islands are solved independently and their results
+/// applied in a fixed order, so a step gives the same result whatever the
+/// number of workers.
+/// See b2World::SetTaskExecutor
+class b2TaskExecutor
+{
+public:
+	virtual ~b2TaskExecutor() {}
+
+	/// The number of workers ranges may be run on, including the calling thread.
+	virtual int32 GetWorkerCount() const = 0;
+
+	/// Run the items [0, count) of the task, split into ranges of at least
+	/// minRange items, and return once all have been run.
+	virtual void ParallelFor(b2Task* task, int32 count, int32 minRange) = 0;
+};
+
 #endif
@@ -25,6 +25,42 @@
 b2ContactFilter b2_defaultFilter;
 b2ContactListener b2_defaultListener;
 
+// A contact whose narrow phase is run in parallel, with what is needed to
+// finish its update afterwards.
+struct b2ContactUpdate
+{
+	b2Contact* contact;
+	b2Manifold oldManifold;
+	bool wasTouching;
+
+	// Both bodies were asleep, but an earlier contact may yet wake them.
+	bool asleep;
+};
+
+class b2ContactUpdateTask : public b2Task
+{
+public:
+	explicit b2ContactUpdateTask(b2ContactUpdate* updates) : m_updates(updates) {}
+
+	void Run(int32 begin, int32 end, int32 worker)
+	{
+		B2_NOT_USED(worker);
+		for (int32 i = begin; i < end; ++i)
+		{
+			b2ContactUpdate* u = m_updates + i;
+			if (u->asleep)
+			{
+				continue;
+			}
+
+			u->wasTouching = u->contact->UpdateManifold(&u->oldManifold);
+		}
+	}
+
+private:
+	b2ContactUpdate* m_updates;
+};
+
 b2ContactManager::b2ContactManager()
 {
 	m_contactList = NULL;
@@ -32,6 +68,7 @@ b2ContactManager::b2ContactManager()
 	m_contactFilter = &b2_defaultFilter;
 	m_contactListener = &b2_defaultListener;
 	m_allocator = NULL;
+	m_taskExecutor = NULL;
 }
 
 void b2ContactManager::Destroy(b2Contact* c)
@@ -104,6 +141,18 @@ void b2ContactManager::Destroy(b2Contact* c)
 // contact list.
 void b2ContactManager::Collide()
 {
+	// With an executor, the surviving contacts are gathered and their
+	// manifolds computed in parallel. Waking bodies and the listener calls
+	// then follow in list order, as they would serially, and contacts
+	// between sleeping bodies are checked again in case an earlier contact
+	// woke them. The result is the same as updating serially.
+	b2ContactUpdate* updates = NULL;
+	int32 updateCount = 0;
+	if (m_taskExecutor && m_contactCount > 0)
+	{
+		updates = (b2ContactUpdate*)b2Alloc(m_contactCount * sizeof(b2ContactUpdate));
+	}
+
 	// Update awake contacts.
 	b2Contact* c = m_contactList;
 	while (c)
@@ -146,6 +195,11 @@ void b2ContactManager::Collide()
 		// At least one body must be awake and it must be dynamic or kinematic.
 		if (activeA == false && activeB == false)
 		{
+			if (updates)
+			{
+				updates[updateCount].contact = c;
+				updates[updateCount++].asleep = true;
+			}
 			c = c->GetNext();
 			continue;
 		}
@@ -164,9 +218,57 @@ void b2ContactManager::Collide()
 		}
 
 		// The contact persists.
-		c->Update(m_contactListener);
+		if (updates)
+		{
+			updates[updateCount].contact = c;
+			updates[updateCount++].asleep = false;
+		}
+		else
+		{
+			c->Update(m_contactListener);
+		}
 		c = c->GetNext();
 	}
+
+	if (updates)
+	{
+		b2ContactUpdateTask task(updates);
+		m_taskExecutor->ParallelFor(&task, updateCount, 64);
+
+		for (int32 i = 0; i < updateCount; ++i)
+		{
+			b2ContactUpdate* u = updates + i;
+			if (u->asleep == false)
+			{
+				u->contact->FinishUpdate(m_contactListener, u->oldManifold, u->wasTouching);
+				continue;
+			}
+
+			c = u->contact;
+			b2Fixture* fixtureA = c->GetFixtureA();
+			b2Fixture* fixtureB = c->GetFixtureB();
+			b2Body* bodyA = fixtureA->GetBody();
+			b2Body* bodyB = fixtureB->GetBody();
+			bool activeA = bodyA->IsAwake() && bodyA->m_type != b2_staticBody;
+			bool activeB = bodyB->IsAwake() && bodyB->m_type != b2_staticBody;
+			if (activeA == false && activeB == false)
+			{
+				continue;
+			}
+
+			int32 proxyIdA = fixtureA->m_proxies[c->GetChildIndexA()].proxyId;
+			int32 proxyIdB = fixtureB->m_proxies[c->GetChildIndexB()].proxyId;
+			if (m_broadPhase.TestOverlap(proxyIdA, proxyIdB) == false)
+			{
+				Destroy(c);
+				continue;
+			}
+
+			c->Update(m_contactListener);
+		}
+
+		b2Free(updates);
+	}
 }
 
 void b2ContactManager::FindNewContacts()
@@ -60,6 +60,10 @@ b2World::b2World(const b2Vec2& gravity)
 
 	m_contactManager.m_allocator = &m_blockAllocator;
 
+	m_taskExecutor = NULL;
+	m_workerAllocators = NULL;
+	m_workerAllocatorCount = 0;
+
 	memset(&m_profile, 0, sizeof(b2Profile));
 }
 
@@ -82,6 +86,8 @@ b2World::~b2World()
 
 		b = bNext;
 	}
+
+	delete [] m_workerAllocators;
 }
 
 void b2World::SetDestructionListener(b2DestructionListener* listener)
@@ -104,6 +110,22 @@ void b2World::SetDebugDraw(b2Draw* debugDraw)
 	m_debugDraw = debugDraw;
 }
 
+void b2World::SetTaskExecutor(b2TaskExecutor* executor)
+{
+	b2Assert(IsLocked() == false);
+	m_taskExecutor = executor;
+	m_contactManager.m_taskExecutor = executor;
+
+	delete [] m_workerAllocators;
+	m_workerAllocators = NULL;
+	m_workerAllocatorCount = 0;
+	if (executor)
+	{
+		m_workerAllocatorCount = executor->GetWorkerCount();
+		m_workerAllocators = new b2StackAllocator[m_workerAllocatorCount];
+	}
+}
+
 b2Body* b2World::CreateBody(const b2BodyDef* def)
 {
 	b2Assert(IsLocked() == false);
@@ -382,6 +404,54 @@ void b2World::SetAllowSleeping(bool flag)
 	}
 }
 
+// Where an island's bodies, contacts and joints lie in the arrays built
+// for solving islands in parallel.
+struct b2IslandRange
+{
+	int32 bodyStart, bodyCount;
+	int32 contactStart, contactCount;
+	int32 jointStart, jointCount;
+};
+
+class b2IslandSolveTask : public b2Task
+{
+public:
+	const b2IslandRange* ranges;
+	b2Body** bodies;
+	b2Contact** contacts;
+	b2Joint** joints;
+	b2ContactImpulse* impulses;
+	b2Profile* profiles;
+	b2StackAllocator* allocators;
+	int32 staticCount;
+	b2TimeStep step;
+	b2Vec2 gravity;
+	bool allowSleep;
+
+	void Run(int32 begin, int32 end, int32 worker)
+	{
+		for (int32 i = begin; i < end; ++i)
+		{
+			const b2IslandRange& r = ranges[i];
+
+			// The shared static bodies come first in the state arrays.
+			b2Island island(staticCount + r.bodyCount, r.contactCount, r.jointCount, allocators + worker, NULL);
+			memcpy(island.m_bodies, bodies + r.bodyStart, r.bodyCount * sizeof(b2Body*));
+			memcpy(island.m_contacts, contacts + r.contactStart, r.contactCount * sizeof(b2Contact*));
+			memcpy(island.m_joints, joints + r.jointStart, r.jointCount * sizeof(b2Joint*));
+			island.m_bodyCount = r.bodyCount;
+			island.m_contactCount = r.contactCount;
+			island.m_jointCount = r.jointCount;
+			if (impulses)
+			{
+				island.m_impulses = impulses + r.contactStart;
+			}
+
+			island.Solve(profiles + i, step, gravity, allowSleep);
+		}
+	}
+};
+
 // Find islands, integrate and solve constraints, solve position constraints
 void b2World::Solve(const b2TimeStep& step)
 {
@@ -410,9 +480,25 @@ void b2World::Solve(const b2TimeStep& step)
 		j->m_islandFlag = false;
 	}
 
-	// Build and simulate all awake islands.
 	int32 stackSize = m_bodyCount;
 	b2Body** stack = (b2Body**)m_stackAllocator.Allocate(stackSize * sizeof(b2Body*));
+
+	// With an executor, islands are gathered here and solved afterwards.
+	// A static body may appear in several islands, but never more often
+	// than there are contacts and joints.
+	b2IslandSolveTask task;
+	int32 islandCount = 0;
+	int32 bodyTotal = 0, contactTotal = 0, jointTotal = 0;
+	b2IslandRange* ranges = NULL;
+	if (m_taskExecutor)
+	{
+		task.ranges = ranges = (b2IslandRange*)m_stackAllocator.Allocate(m_bodyCount * sizeof(b2IslandRange));
+		task.bodies = (b2Body**)m_stackAllocator.Allocate((m_bodyCount + m_contactManager.m_contactCount + m_jointCount) * sizeof(b2Body*));
+		task.contacts = (b2Contact**)m_stackAllocator.Allocate(m_contactManager.m_contactCount * sizeof(b2Contact*));
+		task.joints = (b2Joint**)m_stackAllocator.Allocate(m_jointCount * sizeof(b2Joint*));
+	}
+
+	// Build and simulate all awake islands.
 	for (b2Body* seed = m_bodyList; seed; seed = seed->m_next)
 	{
 		if (seed->m_flags & b2Body::e_islandFlag)
@@ -433,105 +519,32 @@ void b2World::Solve(const b2TimeStep& step)
 
 		// Reset island and stack.
 		island.Clear();
-		int32 stackCount = 0;
-		stack[stackCount++] = seed;
-		seed->m_flags |= b2Body::e_islandFlag;
+		BuildIsland(seed, &island, stack);
 
-		// Perform a depth first search (DFS) on the constraint graph.
-		while (stackCount > 0)
+		if (ranges)
 		{
-			// Grab the next body off the stack and add it to the island.
-			b2Body* b = stack[--stackCount];
-			b2Assert(b->IsActive() == true);
-			island.Add(b);
-
-			// Make sure the body is awake.
-			b->SetAwake(true);
-
-			// To keep islands as small as possible, we don't
-			// propagate islands across static bodies.
-			if (b->GetType() == b2_staticBody)
-			{
-				continue;
-			}
-
-			// Search all contacts connected to this body.
-			for (b2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
-			{
-				b2Contact* contact = ce->contact;
-
-				// Has this contact already been added to an island?
-				if (contact->m_flags & b2Contact::e_islandFlag)
-				{
-					continue;
-				}
-
-				// Is this contact solid and touching?
-				if (contact->IsEnabled() == false ||
-					contact->IsTouching() == false)
-				{
-					continue;
-				}
-
-				// Skip sensors.
-				bool sensorA = contact->m_fixtureA->m_isSensor;
-				bool sensorB = contact->m_fixtureB->m_isSensor;
-				if (sensorA || sensorB)
-				{
-					continue;
-				}
-
-				island.Add(contact);
-				contact->m_flags |= b2Contact::e_islandFlag;
-
-				b2Body* other = ce->other;
-
-				// Was the other body already added to this island?
-				if (other->m_flags & b2Body::e_islandFlag)
-				{
-					continue;
-				}
-
-				b2Assert(stackCount < stackSize);
-				stack[stackCount++] = other;
-				other->m_flags |= b2Body::e_islandFlag;
-			}
-
-			// Search all joints connect to this body.
-			for (b2JointEdge* je = b->m_jointList; je; je = je->next)
-			{
-				if (je->joint->m_islandFlag == true)
-				{
-					continue;
-				}
-
-				b2Body* other = je->other;
-
-				// Don't simulate joints connected to inactive bodies.
-				if (other->IsActive() == false)
-				{
-					continue;
-				}
-
-				island.Add(je->joint);
-				je->joint->m_islandFlag = true;
-
-				if (other->m_flags & b2Body::e_islandFlag)
-				{
-					continue;
-				}
-
-				b2Assert(stackCount < stackSize);
-				stack[stackCount++] = other;
-				other->m_flags |= b2Body::e_islandFlag;
-			}
+			b2IslandRange& r = ranges[islandCount++];
+			r.bodyStart = bodyTotal;
+			r.bodyCount = island.m_bodyCount;
+			r.contactStart = contactTotal;
+			r.contactCount = island.m_contactCount;
+			r.jointStart = jointTotal;
+			r.jointCount = island.m_jointCount;
+			memcpy(task.bodies + bodyTotal, island.m_bodies, island.m_bodyCount * sizeof(b2Body*));
+			memcpy(task.contacts + contactTotal, island.m_contacts, island.m_contactCount * sizeof(b2Contact*));
+			memcpy(task.joints + jointTotal, island.m_joints, island.m_jointCount * sizeof(b2Joint*));
+			bodyTotal += island.m_bodyCount;
+			contactTotal += island.m_contactCount;
+			jointTotal += island.m_jointCount;
+		}
+		else
+		{
+			b2Profile profile;
+			island.Solve(&profile, step, m_gravity, m_allowSleep);
+			m_profile.solveInit += profile.solveInit;
+			m_profile.solveVelocity += profile.solveVelocity;
+			m_profile.solvePosition += profile.solvePosition;
 		}
-
-		b2Profile profile;
-		island.Solve(&profile, step, m_gravity, m_allowSleep);
-		m_profile.solveInit += profile.solveInit;
-		m_profile.solveVelocity += profile.solveVelocity;
-		m_profile.solvePosition += profile.solvePosition;
 
 		// Post solve cleanup.
 		for (int32 i = 0; i < island.m_bodyCount; ++i)
@@ -545,6 +558,15 @@ void b2World::Solve(const b2TimeStep& step)
 		}
 	}
 
+	if (ranges)
+	{
+		SolveIslands(step, &task, islandCount, bodyTotal, contactTotal);
+		m_stackAllocator.Free(task.joints);
+		m_stackAllocator.Free(task.contacts);
+		m_stackAllocator.Free(task.bodies);
+		m_stackAllocator.Free(ranges);
+	}
+
 	m_stackAllocator.Free(stack);
 
 	{
@@ -573,6 +595,185 @@ void b2World::Solve(const b2TimeStep& step)
 	}
 }
 
+
+// Add the seed and everything connected to it to the island.
+void b2World::BuildIsland(b2Body* seed, b2Island* island, b2Body** stack)
+{
+	int32 stackCount = 0;
+	stack[stackCount++] = seed;
+	seed->m_flags |= b2Body::e_islandFlag;
+
+	// Perform a depth first search (DFS) on the constraint graph.
+	while (stackCount > 0)
+	{
+		// Grab the next body off the stack and add it to the island.
+		b2Body* b = stack[--stackCount];
+		b2Assert(b->IsActive() == true);
+		island->Add(b);
+
+		// Make sure the body is awake.
+		b->SetAwake(true);
+
+		// To keep islands as small as possible, we don't
+		// propagate islands across static bodies.
+		if (b->GetType() == b2_staticBody)
+		{
+			continue;
+		}
+
+		// Search all contacts connected to this body.
+		for (b2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+		{
+			b2Contact* contact = ce->contact;
+
+			// Has this contact already been added to an island?
+			if (contact->m_flags & b2Contact::e_islandFlag)
+			{
+				continue;
+			}
+
+			// Is this contact solid and touching?
+			if (contact->IsEnabled() == false ||
+				contact->IsTouching() == false)
+			{
+				continue;
+			}
+
+			// Skip sensors.
+			bool sensorA = contact->m_fixtureA->m_isSensor;
+			bool sensorB = contact->m_fixtureB->m_isSensor;
+			if (sensorA || sensorB)
+			{
+				continue;
+			}
+
+			island->Add(contact);
+			contact->m_flags |= b2Contact::e_islandFlag;
+
+			b2Body* other = ce->other;
+
+			// Was the other body already added to this island?
+			if (other->m_flags & b2Body::e_islandFlag)
+			{
+				continue;
+			}
+
+			b2Assert(stackCount < m_bodyCount);
+			stack[stackCount++] = other;
+			other->m_flags |= b2Body::e_islandFlag;
+		}
+
+		// Search all joints connect to this body.
+		for (b2JointEdge* je = b->m_jointList; je; je = je->next)
+		{
+			if (je->joint->m_islandFlag == true)
+			{
+				continue;
+			}
+
+			b2Body* other = je->other;
+
+			// Don't simulate joints connected to inactive bodies.
+			if (other->IsActive() == false)
+			{
+				continue;
+			}
+
+			island->Add(je->joint);
+			je->joint->m_islandFlag = true;
+
+			if (other->m_flags & b2Body::e_islandFlag)
+			{
+				continue;
+			}
+
+			b2Assert(stackCount < m_bodyCount);
+			stack[stackCount++] = other;
+			other->m_flags |= b2Body::e_islandFlag;
+		}
+	}
+}
+
+// Solve the islands gathered by Solve on the task executor. Other than
+// static bodies, each body belongs to one island, so no two threads write
+// the same body; static bodies may be shared but are only read. To keep
+// each body's solver state at a fixed place whichever island reads it, the
+// static bodies are numbered first and every island's own bodies after
+// them. Impulses are reported once all islands are solved, in the order
+// the serial solver reports them.
+void b2World::SolveIslands(const b2TimeStep& step, b2IslandSolveTask* task, int32 islandCount, int32 bodyTotal, int32 contactTotal)
+{
+	for (int32 i = 0; i < bodyTotal; ++i)
+	{
+		if (task->bodies[i]->GetType() == b2_staticBody)
+		{
+			task->bodies[i]->m_islandIndex = -1;
+		}
+	}
+
+	int32 staticCount = 0;
+	for (int32 i = 0; i < bodyTotal; ++i)
+	{
+		b2Body* b = task->bodies[i];
+		if (b->GetType() == b2_staticBody && b->m_islandIndex == -1)
+		{
+			b->m_islandIndex = staticCount++;
+		}
+	}
+
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		const b2IslandRange& r = task->ranges[i];
+		int32 index = staticCount;
+		for (int32 j = r.bodyStart; j < r.bodyStart + r.bodyCount; ++j)
+		{
+			b2Body* b = task->bodies[j];
+			if (b->GetType() != b2_staticBody)
+			{
+				b->m_islandIndex = index++;
+			}
+		}
+	}
+
+	b2ContactListener* listener = m_contactManager.m_contactListener;
+	task->impulses = NULL;
+	if (listener)
+	{
+		task->impulses = (b2ContactImpulse*)m_stackAllocator.Allocate(contactTotal * sizeof(b2ContactImpulse));
+	}
+
+	task->profiles = (b2Profile*)m_stackAllocator.Allocate(islandCount * sizeof(b2Profile));
+	task->allocators = m_workerAllocators;
+	task->staticCount = staticCount;
+	task->step = step;
+	task->gravity = m_gravity;
+	task->allowSleep = m_allowSleep;
+
+	b2Assert(m_taskExecutor->GetWorkerCount() <= m_workerAllocatorCount);
+	m_taskExecutor->ParallelFor(task, islandCount, 4);
+
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		m_profile.solveInit += task->profiles[i].solveInit;
+		m_profile.solveVelocity += task->profiles[i].solveVelocity;
+		m_profile.solvePosition += task->profiles[i].solvePosition;
+	}
+
+	if (listener)
+	{
+		for (int32 i = 0; i < contactTotal; ++i)
+		{
+			listener->PostSolve(task->contacts[i], task->impulses + i);
+		}
+	}
+
+	m_stackAllocator.Free(task->profiles);
+	if (task->impulses)
+	{
+		m_stackAllocator.Free(task->impulses);
+	}
+}
+
 // Find TOI contacts and solve them.
 void b2World::SolveTOI(const b2TimeStep& step)
 {
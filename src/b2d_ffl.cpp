@@ -14,16 +14,27 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
 #include "asserts.hpp"
 #include "b2d_ffl.hpp"
+#include "custom_object.hpp"
+#include "foreach.hpp"
 #include "graphics.hpp"			// -- needed for debug functions
 #include "json_parser.hpp"
 #include "level.hpp"
+#include "preferences.hpp"
 #include "raster.hpp"
+#include "thread.hpp"
+#include "unit_test.hpp"
 #include "variant_utils.hpp"
 
 #ifdef USE_BOX2D
 
+PREF_INT(physics_threads, 4, "Number of threads, including the main thread, used to step Box2D worlds which are set to run in parallel");
+
 namespace box2d
 {
 	class joint_factory
@@ -55,6 +66,119 @@ namespace box2d
 		}
 	}
 
+	//Runs the ranges of a Box2D task on a set of worker threads and the
+	//calling thread. The threads wait between tasks, since a world hands
+	//over two tasks every step.
+	class task_pool : public b2TaskExecutor
+	{
+	public:
+		explicit task_pool(int nworkers)
+		  : task_(NULL), count_(0), range_(0), job_(0), pending_(0), quit_(false)
+		{
+			SDL_AtomicSet(&next_, 0);
+			for(int n = 1; n < nworkers; ++n) {
+				threads_.push_back(boost::shared_ptr<threading::thread>(new threading::thread("box2d_worker", boost::bind(&task_pool::worker_loop, this, n))));
+			}
+		}
+
+		~task_pool()
+		{
+			{
+				threading::lock l(mutex_);
+				quit_ = true;
+				work_cond_.notify_all();
+			}
+
+			//joins the workers.
+			threads_.clear();
+		}
+
+		int32 GetWorkerCount() const { return threads_.size() + 1; }
+
+		void ParallelFor(b2Task* task, int32 count, int32 min_range)
+		{
+			if(count <= 0) {
+				return;
+			}
+
+			const int range = std::max<int>(std::max<int>(min_range, 1), count/(GetWorkerCount()*4));
+			if(threads_.empty() || count <= range) {
+				task->Run(0, count, 0);
+				return;
+			}
+
+			{
+				threading::lock l(mutex_);
+				task_ = task;
+				count_ = count;
+				range_ = range;
+				SDL_AtomicSet(&next_, 0);
+				pending_ = threads_.size();
+				++job_;
+				work_cond_.notify_all();
+			}
+
+			run_ranges(task, count, range, 0);
+
+			//every worker takes part in every job, even if it only finds
+			//the ranges gone, so none can still be reading this one when
+			//the next is handed out.
+			threading::lock l(mutex_);
+			while(pending_ > 0) {
+				done_cond_.wait(mutex_);
+			}
+		}
+
+	private:
+		void run_ranges(b2Task* task, int count, int range, int worker)
+		{
+			int begin;
+			while((begin = SDL_AtomicAdd(&next_, range)) < count) {
+				task->Run(begin, std::min(begin + range, count), worker);
+			}
+		}
+
+		void worker_loop(int worker)
+		{
+			int seen_job = 0;
+			for(;;) {
+				b2Task* task;
+				int count, range;
+				{
+					threading::lock l(mutex_);
+					while(!quit_ && job_ == seen_job) {
+						work_cond_.wait(mutex_);
+					}
+
+					if(quit_) {
+						return;
+					}
+
+					seen_job = job_;
+					task = task_;
+					count = count_;
+					range = range_;
+				}
+
+				run_ranges(task, count, range, worker);
+
+				threading::lock l(mutex_);
+				if(--pending_ == 0) {
+					done_cond_.notify_one();
+				}
+			}
+		}
+
+		threading::mutex mutex_;
+		threading::condition work_cond_, done_cond_;
+		b2Task* task_;
+		int count_, range_;
+		SDL_atomic_t next_;
+		int job_, pending_;
+		bool quit_;
+		std::vector<boost::shared_ptr<threading::thread> > threads_;
+	};
+
 	struct body_destructor
 	{
 		void operator()(b2Body* b) const 
@@ -62,6 +186,9 @@ namespace box2d
 			// if the world has destructed the body will already have been destroyed.
 			if(current_world != NULL) {
 				std::cerr << "body_destructor: " << b << std::endl;
+				if(this_world) {
+					this_world->body_destroyed(b);
+				}
 				current_world->DestroyBody(b);
 			}
 		}
@@ -112,8 +239,15 @@ namespace box2d
 		: world_(b2Vec2(0.0f, -10.0f)), velocity_iterations_(8), position_iterations_(3),
 		world_x1_(0.0f), world_y1_(0.0f),
 		world_x2_(10.0f), world_y2_(10.0f),
-		pixel_scale_(w["scale"].as_int(10))
+		pixel_scale_(w["scale"].as_int(10)),
+		fixed_time_step_(float(w["time_step"].as_decimal(decimal(1.0/50.0)).as_float())),
+		steps_per_cycle_(w["steps_per_cycle"].as_int(1)),
+		interpolate_(w["interpolate"].as_bool(false)),
+		alpha_(1.0f)
 	{
+		ASSERT_LOG(fixed_time_step_ > 0.0f, "world time_step must be positive");
+		ASSERT_LOG(steps_per_cycle_ > 0, "world steps_per_cycle must be positive");
+		set_parallel(w["parallel"].as_bool(false));
 		if(w.has_key("gravity") && w["gravity"].is_list() && w["gravity"].num_elements() == 2) {
 			b2Vec2 gravity;
 			gravity.x = float(w["gravity"][0].as_decimal().as_float());
@@ -152,6 +286,21 @@ namespace box2d
 		clear_current_world();
 	}
 
+	void world::set_parallel(bool parallel)
+	{
+		if(parallel == (task_pool_ != NULL)) {
+			return;
+		}
+
+		if(parallel) {
+			task_pool_.reset(new task_pool(std::max(g_physics_threads, 1)));
+			world_.SetTaskExecutor(task_pool_.get());
+		} else {
+			world_.SetTaskExecutor(NULL);
+			task_pool_.reset();
+		}
+	}
+
 	const world& world::our_world()
 	{
 		return *this_world;
@@ -174,6 +323,63 @@ namespace box2d
 		get_world().Step(time_step, velocity_iterations_, position_iterations_);
 	}
 
+	void world::advance()
+	{
+		record_body_states();
+		for(int n = 0; n != steps_per_cycle_; ++n) {
+			step(fixed_time_step_);
+		}
+
+		sync_objects();
+	}
+
+	void world::record_body_states()
+	{
+		previous_states_.clear();
+		for(b2Body* b = world_.GetBodyList(); b != NULL; b = b->GetNext()) {
+			if(b->GetUserData() == NULL) {
+				continue;
+			}
+
+			custom_object* obj = dynamic_cast<custom_object*>(static_cast<entity*>(b->GetUserData()));
+			if(obj) {
+				const body_state state = { b, obj, b->GetPosition(), b->GetAngle() };
+				previous_states_.push_back(state);
+			}
+		}
+	}
+
+	void world::sync_objects()
+	{
+		//objects are placed exactly on their bodies, sleeping or not.
+		foreach(const body_state& state, previous_states_) {
+			const b2Vec2& pos = state.body->GetPosition();
+			state.obj->set_body_transform(pos.x*pixel_scale_, pos.y*pixel_scale_, state.body->GetAngle());
+		}
+
+		set_draw_interpolation(1.0f);
+	}
+
+	void world::set_draw_interpolation(float fraction)
+	{
+		alpha_ = interpolate_ ? std::min(std::max(fraction, 0.0f), 1.0f) : 1.0f;
+		foreach(const body_state& state, previous_states_) {
+			const b2Vec2 behind = (1.0f - alpha_)*(state.position - state.body->GetPosition());
+			state.obj->set_body_draw_offset(int(behind.x*pixel_scale_), int(behind.y*pixel_scale_));
+		}
+	}
+
+	void world::body_destroyed(const b2Body* b)
+	{
+		for(std::vector<body_state>::iterator i = previous_states_.begin(); i != previous_states_.end(); ) {
+			if(i->body == b) {
+				i = previous_states_.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
+
 	void world::finish_loading()
 	{
 		set_as_current_world();
@@ -230,6 +436,14 @@ namespace box2d
 			return variant::from_bool(draw_debug_data());
 		} else if(key == "joints") {
 			return variant(new joints_command);
+		} else if(key == "time_step") {
+			return variant(decimal(fixed_time_step_));
+		} else if(key == "steps_per_cycle") {
+			return variant(steps_per_cycle_);
+		} else if(key == "interpolate") {
+			return variant::from_bool(interpolate_);
+		} else if(key == "parallel") {
+			return variant::from_bool(parallel());
 		}
 		return variant();
 	}
@@ -261,6 +475,16 @@ namespace box2d
 			enable_draw_debug_data(value.as_bool());
 		} else if(key == "joints") {
 			joint_factory j(value);
+		} else if(key == "time_step") {
+			fixed_time_step_ = float(value.as_decimal().as_float());
+			ASSERT_LOG(fixed_time_step_ > 0.0f, "world time_step must be positive");
+		} else if(key == "steps_per_cycle") {
+			steps_per_cycle_ = value.as_int();
+			ASSERT_LOG(steps_per_cycle_ > 0, "world steps_per_cycle must be positive");
+		} else if(key == "interpolate") {
+			interpolate_ = value.as_bool();
+		} else if(key == "parallel") {
+			set_parallel(value.as_bool());
 		}
 	}
 
@@ -278,6 +502,10 @@ namespace box2d
 		res.add("allow_sleeping", get_value("allow_sleeping"));
 		res.add("iterations", get_value("iterations"));
 		res.add("viewport", get_value("viewport"));
+		res.add("time_step", get_value("time_step"));
+		res.add("steps_per_cycle", get_value("steps_per_cycle"));
+		res.add("interpolate", get_value("interpolate"));
+		res.add("parallel", get_value("parallel"));
 		foreach(const joint_factory_pair& j, get_joint_defs()) {
 			res.add("joints", j.second->write());
 		}
@@ -1825,6 +2053,115 @@ namespace box2d
 #endif
 	}
 
+	namespace
+	{
+		//a world like the phydemo module's, with stacks of crates on the
+		//ground. Sleeping is off so every body is simulated every step.
+		world_ptr create_stress_world(int nstacks, int stack_height, bool parallel=false)
+		{
+			world_ptr w(new world(json::parse(
+				"{ iterations: { velocity: 6, position: 2 }, gravity: [0, 10], scale: 10, allow_sleeping: false }")));
+			w->set_parallel(parallel);
+
+			b2BodyDef ground_def;
+			ground_def.position.Set(0.0f, 0.0f);
+			b2PolygonShape ground_shape;
+			ground_shape.SetAsBox(nstacks*4.0f + 10.0f, 1.0f);
+			w->get_world().CreateBody(&ground_def)->CreateFixture(&ground_shape, 0.0f);
+
+			b2PolygonShape crate_shape;
+			crate_shape.SetAsBox(1.6f, 1.6f);
+			for(int stack = 0; stack != nstacks; ++stack) {
+				for(int n = 0; n != stack_height; ++n) {
+					b2BodyDef crate_def;
+					crate_def.type = b2_dynamicBody;
+					crate_def.position.Set(stack*4.0f - nstacks*2.0f, -2.6f - n*3.2f);
+					w->get_world().CreateBody(&crate_def)->CreateFixture(&crate_shape, 1.0f);
+				}
+			}
+
+			return w;
+		}
+
+		//worlds made here mustn't replace the game's world when destroyed.
+		struct current_world_scope
+		{
+			current_world_scope() : saved_(current_world) {}
+			~current_world_scope() { current_world = saved_; }
+			b2World* saved_;
+		};
+	}
+
+	UNIT_TEST(box2d_fixed_time_step)
+	{
+		const current_world_scope scope;
+		world_ptr w = create_stress_world(1, 1);
+		b2Body* crate = w->get_world().GetBodyList();
+		CHECK(crate->GetType() == b2_dynamicBody, "expected the crate first in the body list");
+
+		//advancing a cycle runs exactly steps_per_cycle steps, so it ends
+		//where stepping by hand does.
+		world_ptr stepped = create_stress_world(1, 1);
+		b2Body* stepped_crate = stepped->get_world().GetBodyList();
+		w->set_value("steps_per_cycle", variant(3));
+		for(int cycle = 0; cycle != 10; ++cycle) {
+			w->advance();
+			for(int n = 0; n != 3; ++n) {
+				stepped->step(stepped->time_step());
+			}
+
+			CHECK_EQ(crate->GetPosition().x, stepped_crate->GetPosition().x);
+			CHECK_EQ(crate->GetPosition().y, stepped_crate->GetPosition().y);
+		}
+
+		CHECK(w->interpolation() == 1.0f, "bad interpolation: " << w->interpolation());
+	}
+
+	UNIT_TEST(box2d_parallel_matches_serial)
+	{
+		const current_world_scope scope;
+		world_ptr serial = create_stress_world(8, 10);
+		world_ptr parallel = create_stress_world(8, 10, true);
+		for(int n = 0; n != 100; ++n) {
+			serial->step(serial->time_step());
+			parallel->step(parallel->time_step());
+		}
+
+		const b2Body* a = serial->get_world().GetBodyList();
+		const b2Body* b = parallel->get_world().GetBodyList();
+		for(; a != NULL && b != NULL; a = a->GetNext(), b = b->GetNext()) {
+			CHECK_EQ(a->GetPosition().x, b->GetPosition().x);
+			CHECK_EQ(a->GetPosition().y, b->GetPosition().y);
+			CHECK_EQ(a->GetAngle(), b->GetAngle());
+		}
+
+		CHECK(a == NULL && b == NULL, "worlds have different numbers of bodies");
+	}
+
+	BENCHMARK_ARG(box2d_stress, int nstacks)
+	{
+		const current_world_scope scope;
+		world_ptr w = create_stress_world(nstacks, 20);
+		BENCHMARK_LOOP {
+			w->advance();
+		}
+	}
+
+	BENCHMARK_ARG_CALL(box2d_stress, stacks_10, 10);
+	BENCHMARK_ARG_CALL(box2d_stress, stacks_50, 50);
+	BENCHMARK_ARG_CALL(box2d_stress, stacks_200, 200);
+
+	BENCHMARK_ARG(box2d_parallel_stress, int nstacks)
+	{
+		const current_world_scope scope;
+		world_ptr w = create_stress_world(nstacks, 20, true);
+		BENCHMARK_LOOP {
+			w->advance();
+		}
+	}
+
+	BENCHMARK_ARG_CALL(box2d_parallel_stress, parallel_stacks_50, 50);
+	BENCHMARK_ARG_CALL(box2d_parallel_stress, parallel_stacks_200, 200);
 }
 
 #endif
@@ -32,6 +32,8 @@
 #include "geometry.hpp"
 #include "variant.hpp"
 
+class custom_object;
+
 namespace box2d
 {
 	class manager
@@ -41,6 +43,7 @@ namespace box2d
 		~manager();
 	};
 
+	class task_pool;
 	class world;
 	typedef boost::intrusive_ptr<world> world_ptr;
 	typedef boost::intrusive_ptr<const world> const_world_ptr;
@@ -132,6 +135,33 @@ namespace box2d
 		void finish_loading();
 		void step(float time_step);
 
+		//advances the simulation by one game cycle, which is always
+		//steps_per_cycle() steps of time_step(), and then moves the objects
+		//attached to bodies to them. Timing never changes how far the
+		//simulation runs, so games and replays play out the same.
+		void advance();
+
+		//with interpolation on, objects are drawn 'fraction' of the way
+		//from where their bodies were before the last advance() to where
+		//they are now. Only where they are drawn changes, never their
+		//positions in the game.
+		void set_draw_interpolation(float fraction);
+
+		//with parallel set, islands of bodies are solved and contacts
+		//updated on a pool of threads. Results don't depend on the number
+		//of threads.
+		void set_parallel(bool parallel);
+		bool parallel() const { return task_pool_ != NULL; }
+
+		float time_step() const { return fixed_time_step_; }
+		int steps_per_cycle() const { return steps_per_cycle_; }
+
+		//how far between the last two steps objects are drawn, from 0 to 1.
+		float interpolation() const { return alpha_; }
+
+		//called when a body is destroyed, so it isn't synced afterwards.
+		void body_destroyed(const b2Body* b);
+
 		joint_ptr find_joint_by_id(const std::string& key) const;
 
 		float x1() const { return world_x1_; }
@@ -178,6 +208,26 @@ namespace box2d
 		debug_draw debug_draw_;
 
 		destruction_listener destruction_listener_;
+
+		void record_body_states();
+		void sync_objects();
+
+		//the transform a body attached to an object had before the last
+		//advance(). Objects are synced from these in a single pass.
+		struct body_state {
+			b2Body* body;
+			custom_object* obj;
+			b2Vec2 position;
+			float angle;
+		};
+		std::vector<body_state> previous_states_;
+
+		float fixed_time_step_;
+		int steps_per_cycle_;
+		bool interpolate_;
+		float alpha_;
+
+		boost::shared_ptr<task_pool> task_pool_;
 	};
 }
 
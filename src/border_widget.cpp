@@ -51,6 +51,7 @@ border_widget::border_widget(const variant& v, game_logic::formula_callable* e)
 void border_widget::set_color(const graphics::color& col)
 {
 	color_ = col;
+	invalidate();
 }
 
 void border_widget::set_color(const SDL_Color& col)
@@ -38,6 +38,7 @@ public:
 protected:
 	virtual void handle_draw() const;
 	virtual void handle_process();
+	virtual bool is_render_cacheable() const { return true; }
 private:
 	bool handle_event(const SDL_Event& event, bool claimed);
 
@@ -205,6 +205,7 @@ void button::do_execute()
 void button::set_label(widget_ptr label)
 {
 	label_ = label;
+	invalidate();
 	if(width() == 0 && height() == 0) {
 		set_dim(label_->width()+hpadding_*2,label_->height()+vpadding_*2);
 	}
@@ -232,6 +233,11 @@ void button::handle_draw() const
 	graphics::color(255, 255, 255, 255).set_as_current_color();
 }
 
+unsigned int button::render_state() const
+{
+	return static_cast<unsigned int>(reinterpret_cast<size_t>(current_button_image_set_.get()));
+}
+
 void button::handle_process()
 {
 	widget::handle_process();
@@ -62,6 +62,9 @@ protected:
 	BUTTON_RESOLUTION button_resolution() const { return button_resolution_; }
 	virtual widget_settings_dialog* settings_dialog(int x, int y, int w, int h);
 
+	virtual bool is_render_cacheable() const { return true; }
+	virtual unsigned int render_state() const;
+
 	DECLARE_CALLABLE(button);
 private:
 	virtual void visit_values(game_logic::formula_callable_visitor& visitor);
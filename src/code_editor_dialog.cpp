@@ -414,7 +414,11 @@ void code_editor_dialog::process()
 {
 	using namespace gui;
 
-	if(invalidated_ && SDL_GetTicks() > invalidated_ + 200) {
+	editor_->update_parse();
+
+	//the text is checked with the editor's background parse, so it waits
+	//for that to catch up.
+	if(invalidated_ && SDL_GetTicks() > invalidated_ + 200 && editor_->is_parse_current()) {
 		try {
 			custom_object::reset_current_debug_error();
 
@@ -425,7 +429,7 @@ void code_editor_dialog::process()
 			has_error_ = true;
 			file_contents_set_ = true;
 			if(op_fn_) {
-				json::parse(editor_->text());
+				editor_->check_parse();
 				json::set_file_contents(fname_, editor_->text());
 
 				if(strstr(fname_.c_str(), "/objects/")) {
@@ -434,7 +438,7 @@ void code_editor_dialog::process()
 
 				op_fn_();
 			} else if(strstr(fname_.c_str(), "/level/")) {
-				json::parse(editor_->text());
+				editor_->check_parse();
 				json::set_file_contents(fname_, editor_->text());
 
 				level_runner::get_current()->replay_level_from_start();
@@ -445,7 +449,7 @@ void code_editor_dialog::process()
 				const std::string old_contents = json::get_file_contents(fname_);
 
 				//verify the text is parseable before we bother setting it.
-				json::parse(editor_->text());
+				editor_->check_parse();
 				json::set_file_contents(fname_, editor_->text());
 				const variant tiles_data = json::parse_from_file("data/tiles.cfg");
 				tile_map::prepare_rebuild_all();
@@ -488,7 +492,7 @@ void code_editor_dialog::process()
 				}
 				std::string::const_iterator end = fname_.end()-4;
 				const std::string class_name(slash+1, end);;
-				json::parse(editor_->text());
+				editor_->check_parse();
 				json::set_file_contents(fname_, editor_->text());
 				game_logic::invalidate_class_definition(class_name);
 				game_logic::formula_object::try_load_class(class_name);
@@ -682,10 +686,20 @@ void code_editor_dialog::process()
 			suggestions_grid->allow_selection(true);
 			suggestions_grid->set_show_background(true);
 			suggestions_grid->set_max_height(160);
-			foreach(const Suggestion& s, suggestions_) {
-				suggestions_grid->add_col(widget_ptr(new label(s.suggestion_text.empty() ? s.suggestion : s.suggestion_text)));
+
+			//there may be thousands of suggestions, so only the rows in view
+			//get labels. The longest suggestion gives the column width.
+			int longest = 0;
+			for(int n = 1; n != suggestions_.size(); ++n) {
+				if(suggestions_[n].text().size() > suggestions_[longest].text().size()) {
+					longest = n;
+				}
 			}
 
+			const widget_ptr measure(new label(suggestions_[longest].text()));
+			suggestions_grid->set_col_width(0, measure->width());
+			suggestions_grid->set_virtual_rows(suggestions_.size(), boost::bind(&code_editor_dialog::make_suggestion_row, this, _1, _2), measure->height());
+
 			suggestions_grid_.reset(new border_widget(suggestions_grid, graphics::color(255,255,255,255)));
 		}
 		std::cerr << "SUGGESTIONS: " << suggestions_.size() << ":\n";
@@ -988,6 +1002,17 @@ void code_editor_dialog::save_and_close()
 	close();
 }
 
+void code_editor_dialog::make_suggestion_row(int row, std::vector<gui::widget_ptr>* cells) const
+{
+	using namespace gui;
+	const std::string& text = suggestions_[row].text();
+	if(cells->empty()) {
+		cells->push_back(widget_ptr(new label(text)));
+	} else {
+		static_cast<label*>(cells->front().get())->set_text(text);
+	}
+}
+
 void code_editor_dialog::select_suggestion(int index)
 {
 	if(index >= 0 && index < suggestions_.size()) {
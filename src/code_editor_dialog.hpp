@@ -131,8 +131,14 @@ private:
 		int postfix_index;
 		bool operator==(const Suggestion& o) const { return o.suggestion == suggestion && o.postfix == postfix && o.postfix_index == postfix_index; }
 		bool operator<(const Suggestion& o) const { return suggestion < o.suggestion; }
+
+		//the text the suggestion is listed under.
+		const std::string& text() const { return suggestion_text.empty() ? suggestion : suggestion_text; }
 	};
 
+	//the suggestions grid creates the labels of the rows in view with this.
+	void make_suggestion_row(int row, std::vector<gui::widget_ptr>* cells) const;
+
 	std::vector<Suggestion> suggestions_;
 	gui::widget_ptr suggestions_grid_;
 	int suggestions_prefix_;
@@ -21,11 +21,14 @@
 #include "formula_tokenizer.hpp"
 #include "json_parser.hpp"
 #include "label.hpp"
+#include "preferences.hpp"
 #include "string_utils.hpp"
+#include "thread.hpp"
 #include "utility_query.hpp"
 
 #include <boost/bind.hpp>
 #include <boost/regex.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <stack>
 
@@ -35,14 +38,16 @@ namespace gui
 code_editor_widget::code_editor_widget(int width, int height)
   : text_editor_widget(width, height),
   row_slider_(0), begin_col_slider_(0), end_col_slider_(0),
-  slider_decimal_(false), slider_magnitude_(0), is_formula_(false)
+  slider_decimal_(false), slider_magnitude_(0),
+  text_generation_(0), submitted_generation_(0), parsed_generation_(0), parse_due_(0), is_formula_(false)
 {
 	set_environment();
 }
 
 code_editor_widget::code_editor_widget(const variant& v, game_logic::formula_callable* e) 
 	: text_editor_widget(v,e), row_slider_(0), begin_col_slider_(0), 
-	end_col_slider_(0),	slider_decimal_(false), slider_magnitude_(0), is_formula_(false)
+	end_col_slider_(0),	slider_decimal_(false), slider_magnitude_(0),
+	text_generation_(0), submitted_generation_(0), parsed_generation_(0), parse_due_(0), is_formula_(false)
 {
 }
 
@@ -53,79 +58,10 @@ void code_editor_widget::on_move_cursor(bool auto_shift)
 	ObjectInfo info = get_current_object();
 }
 
-void code_editor_widget::on_change()
-{
-	generate_tokens();
-
-	bracket_match_.clear();
-	colors_.clear();
-	colors_.resize(colors_.size()+1);
-	const std::string s = (is_formula_ ? "\"" : "") + text() + (is_formula_ ? "\"" : "");
-	std::string::const_iterator i = s.begin();
-	while(i != s.end()) {
-		if(*i == '"') {
-			std::vector<std::vector<std::pair<int, int> > > opening_brackets;
-
-			if(!is_formula_) {
-				colors_.back().push_back(graphics::color(196, 196, 196));
-			}
-			++i;
-			std::string::const_iterator end = i;
-			while(end != s.end() && *end != '"') {
-				if(*end == '\\') {
-					++end;
-				}
-
-				++end;
-			}
-
-			if(end != s.end()) {
-				while(i != end) {
-					std::string::const_iterator begin = i;
-					try {
-						formula_tokenizer::token t = formula_tokenizer::get_token(i, end);
-
-						bool error_color = false;
-						switch(t.type) {
-						case formula_tokenizer::TOKEN_LPARENS:
-						case formula_tokenizer::TOKEN_LSQUARE:
-						case formula_tokenizer::TOKEN_LBRACKET:
-							opening_brackets.resize(opening_brackets.size()+1);
-							opening_brackets.back().push_back(std::pair<int,int>(colors_.size()-1, colors_.back().size()));
-							break;
-						case formula_tokenizer::TOKEN_RPARENS:
-						case formula_tokenizer::TOKEN_RSQUARE:
-						case formula_tokenizer::TOKEN_RBRACKET:
-							if(opening_brackets.empty()) {
-								error_color = true;
-							} else {
-								opening_brackets.back().push_back(std::pair<int,int>(colors_.size()-1, colors_.back().size()));
-								std::pair<int,int> key(colors_.size()-1, colors_.back().size());
-								for(int n = 0; n != opening_brackets.back().size(); ++n) {
-									bracket_match_[opening_brackets.back()[n]] = opening_brackets.back();
-								}
-								opening_brackets.pop_back();
-							}
-							break;
-						case formula_tokenizer::TOKEN_COMMA:
-							if(opening_brackets.empty() == false) {
-								opening_brackets.back().push_back(std::pair<int,int>(colors_.size()-1, colors_.back().size()));
-							}
-							break;
-						default:
-							break;
-						}
-
-						if(t.type == formula_tokenizer::TOKEN_OPERATOR && util::c_isalpha(*t.begin)) {
-							t.type = formula_tokenizer::TOKEN_KEYWORD;
+namespace {
+PREF_INT(code_editor_parse_delay, 150, "Milliseconds the code editor waits after the text last changed before parsing it again");
 
-						}
-						
-						while(begin != i) {
-							if(*begin == '\n') {
-								colors_.resize(colors_.size()+1);
-							} else {
-static const graphics::color TokenColors[] = {
+const graphics::color TokenColors[] = {
 	graphics::color(128, 128, 255), //operator
 	graphics::color(64, 255, 64), //string literal
 	graphics::color(196, 196, 196), //const identifier
@@ -146,65 +82,386 @@ static const graphics::color TokenColors[] = {
 	graphics::color(64, 255, 64), //comment
 	graphics::color(255, 255, 255), //pointer
 };
-								graphics::color col(255, 255, 255);
-								if(t.type >= 0 && t.type < sizeof(TokenColors)/sizeof(TokenColors[0])) {
-									col = TokenColors[t.type];
-								}
 
-								if(error_color) {
-									col = graphics::color(255, 0, 0);
-								}
+//finds the quote closing a string which begins at (*row, *col). A
+//backslash escapes the character after it, which may be the end of a line.
+bool find_string_end(const std::vector<std::string>& rows, int* row, int* col)
+{
+	int r = *row, c = *col;
+	for(;;) {
+		if(c >= rows[r].size()) {
+			if(r+1 == rows.size()) {
+				return false;
+			}
 
-								colors_.back().push_back(col);
-							}
-							++begin;
-						}
+			++r;
+			c = 0;
+			continue;
+		}
 
-					} catch(formula_tokenizer::token_error&) {
-						i = begin;
-						break;
-					}
+		if(rows[r][c] == '"') {
+			*row = r;
+			*col = c;
+			return true;
+		}
+
+		if(rows[r][c] == '\\' && ++c >= rows[r].size()) {
+			//the escaped character is the end of the line.
+			continue;
+		}
+
+		++c;
+	}
+}
+}
+
+namespace {
+struct parse_job
+{
+	parse_job(const std::string& text, int generation)
+	  : text(text), generation(generation), plain(false)
+	{}
+
+	std::string text;
+	int generation;
+	variant doc;
+	bool plain;
+
+	//set if the text doesn't parse.
+	boost::shared_ptr<json::parse_error> error;
+};
+
+typedef boost::shared_ptr<parse_job> parse_job_ptr;
+}
+
+//parses the editor's text on one thread which lives as long as the
+//parser. There is a single slot for a job waiting to be parsed, so a job
+//submitted while another waits replaces it, as only the newest text
+//matters. A job belongs to one thread at a time.
+class code_editor_parser
+{
+public:
+	code_editor_parser() : busy_(false), quit_(false)
+	{
+		thread_.reset(new threading::thread("code_editor_parse", boost::bind(&code_editor_parser::worker_loop, this)));
+	}
+
+	~code_editor_parser()
+	{
+		{
+			threading::lock l(mutex_);
+			quit_ = true;
+			work_cond_.notify_one();
+		}
+
+		thread_.reset();
+	}
+
+	void submit(const std::string& text, int generation)
+	{
+		parse_job_ptr job(new parse_job(text, generation));
+		threading::lock l(mutex_);
+		pending_ = job;
+		work_cond_.notify_one();
+	}
+
+	//waits until every submitted job is finished.
+	void wait()
+	{
+		threading::lock l(mutex_);
+		while(pending_ || busy_) {
+			done_cond_.wait(mutex_);
+		}
+	}
+
+	//the newest finished job, if it hasn't been taken already.
+	parse_job_ptr take_result()
+	{
+		parse_job_ptr result;
+		threading::lock l(mutex_);
+		result.swap(finished_);
+		return result;
+	}
+
+private:
+	void worker_loop()
+	{
+		for(;;) {
+			parse_job_ptr job;
+			{
+				threading::lock l(mutex_);
+				while(!quit_ && !pending_) {
+					work_cond_.wait(mutex_);
 				}
 
-				for(int n = 0; n != opening_brackets.size(); ++n) {
-					//any remaining brackets that weren't matched can be marked as errors.
-					colors_[opening_brackets[n].front().first][opening_brackets[n].front().second] = graphics::color(255, 0, 0);
+				if(quit_) {
+					return;
+				}
+
+				job.swap(pending_);
+				busy_ = true;
+			}
+
+			try {
+				job->doc = json::parse_plain(job->text, &job->plain);
+			} catch(json::parse_error& e) {
+				job->error.reset(new json::parse_error(e));
+			} catch(...) {
+				job->error.reset(new json::parse_error("Unknown error"));
+			}
+
+			threading::lock l(mutex_);
+			finished_.swap(job);
+			busy_ = false;
+			done_cond_.notify_all();
+		}
+	}
+
+	threading::mutex mutex_;
+	threading::condition work_cond_, done_cond_;
+	parse_job_ptr pending_, finished_;
+	bool busy_, quit_;
+
+	//declared last so it's joined before anything it uses is destroyed.
+	boost::scoped_ptr<threading::thread> thread_;
+};
+
+void code_editor_widget::on_change()
+{
+	generate_tokens();
+
+	const std::vector<std::string>& rows = get_data();
+	if(is_formula_) {
+		//the whole text is one formula, so it's lexed as one string.
+		std::vector<std::string> quoted = rows;
+		quoted.front() = "\"" + quoted.front();
+		quoted.back() += "\"";
+		colors_.clear();
+		bracket_match_.clear();
+		row_states_.clear();
+		relex(quoted, 0, quoted.size(), quoted.size());
+	} else if(lexed_rows_.empty()) {
+		lexed_rows_ = rows;
+		colors_.clear();
+		bracket_match_.clear();
+		row_states_.clear();
+		relex(rows, 0, rows.size(), rows.size());
+	} else {
+		//find the rows which changed. At least one row is left out of the
+		//unchanged prefix, since how the text ends may have changed.
+		const int old_size = lexed_rows_.size(), new_size = rows.size();
+		const int common = std::min(old_size, new_size);
+		int prefix = 0, suffix = 0;
+		while(prefix < common - 1 && lexed_rows_[prefix] == rows[prefix]) {
+			++prefix;
+		}
+
+		while(prefix + suffix < common && lexed_rows_[old_size - suffix - 1] == rows[new_size - suffix - 1]) {
+			++suffix;
+		}
+
+		//lexing starts again from the last row known to begin outside of
+		//any string. A quote with no closing quote may be closed now, so
+		//lexing starts from it if it comes first.
+		int begin = prefix;
+		for(int n = 0; n < begin; ++n) {
+			if(row_states_[n].unclosed_quote) {
+				begin = n;
+				break;
+			}
+		}
+
+		while(row_states_[begin].string_rows) {
+			begin -= row_states_[begin].string_rows;
+		}
+		relex(rows, begin, new_size - suffix, new_size - old_size);
+
+		lexed_rows_.erase(lexed_rows_.begin() + prefix, lexed_rows_.end() - suffix);
+		lexed_rows_.insert(lexed_rows_.begin() + prefix, rows.begin() + prefix, rows.end() - suffix);
+	}
+
+	text_editor_widget::on_change();
+}
+
+void code_editor_widget::relex(const std::vector<std::string>& rows, int first_row, int unchanged_begin, int delta)
+{
+	//rows from 'first_row' on are lexed until one among the unchanged rows
+	//at the end of the text begins outside of any string, both now and
+	//before the change, since from there on the text lexes the same way it
+	//did before. 'delta' is the number of rows added by the change.
+	std::vector<std::vector<graphics::color> > colors;
+	std::vector<row_state> states;
+	std::vector<bracket_row> brackets;
+
+	const auto new_row = [&](int string_rows) {
+		const row_state state = { string_rows, false };
+		colors.resize(colors.size()+1);
+		states.push_back(state);
+		brackets.resize(brackets.size()+1);
+	};
+
+	//the location of the next color to be added.
+	const auto current_loc = [&]() {
+		return std::pair<int,int>(first_row + colors.size() - 1, colors.back().size());
+	};
+
+	int row = first_row;
+	while(row < rows.size()) {
+		if(row >= unchanged_begin && row_states_[row - delta].string_rows == 0) {
+			break;
+		}
+
+		new_row(0);
+
+		int col = 0;
+		while(col < rows[row].size()) {
+			if(rows[row][col] != '"') {
+				colors.back().push_back(graphics::color(255, 255, 255));
+				++col;
+				continue;
+			}
+
+			if(!is_formula_) {
+				colors.back().push_back(graphics::color(196, 196, 196));
+			}
+
+			int end_row = row, end_col = col + 1;
+			if(!find_string_end(rows, &end_row, &end_col)) {
+				//a quote which is never closed is lexed as plain text.
+				states.back().unclosed_quote = true;
+				++col;
+				continue;
+			}
+
+			//formula tokens may span lines, so the string is lexed in one piece.
+			std::string s;
+			for(int n = row; n <= end_row; ++n) {
+				if(n != row) {
+					s += "\n";
 				}
 
-				while(i != end) {
-					//we might have bailed out of formula parsing early due to an error. Just treat
-					//remaining text until the closing quotes as plain.
-					if(*i == '\n') {
-						colors_.resize(colors_.size()+1);
-					} else {
-						colors_.back().push_back(graphics::color(196, 196, 196));
+				s.append(rows[n].begin() + (n == row ? col + 1 : 0), n == end_row ? rows[n].begin() + end_col : rows[n].end());
+			}
+
+			std::vector<std::vector<std::pair<int, int> > > opening_brackets, matched_brackets;
+
+			std::string::const_iterator i = s.begin();
+			while(i != s.end()) {
+				std::string::const_iterator begin = i;
+				try {
+					formula_tokenizer::token t = formula_tokenizer::get_token(i, s.end());
+
+					bool error_color = false;
+					switch(t.type) {
+					case formula_tokenizer::TOKEN_LPARENS:
+					case formula_tokenizer::TOKEN_LSQUARE:
+					case formula_tokenizer::TOKEN_LBRACKET:
+						opening_brackets.resize(opening_brackets.size()+1);
+						opening_brackets.back().push_back(current_loc());
+						break;
+					case formula_tokenizer::TOKEN_RPARENS:
+					case formula_tokenizer::TOKEN_RSQUARE:
+					case formula_tokenizer::TOKEN_RBRACKET:
+						if(opening_brackets.empty()) {
+							error_color = true;
+						} else {
+							opening_brackets.back().push_back(current_loc());
+							matched_brackets.push_back(opening_brackets.back());
+							opening_brackets.pop_back();
+						}
+						break;
+					case formula_tokenizer::TOKEN_COMMA:
+						if(opening_brackets.empty() == false) {
+							opening_brackets.back().push_back(current_loc());
+						}
+						break;
+					default:
+						break;
+					}
+
+					if(t.type == formula_tokenizer::TOKEN_OPERATOR && util::c_isalpha(*t.begin)) {
+						t.type = formula_tokenizer::TOKEN_KEYWORD;
 					}
-					++i;
+
+					while(begin != i) {
+						if(*begin == '\n') {
+							new_row(first_row + colors.size() - row);
+						} else {
+							graphics::color col(255, 255, 255);
+							if(t.type >= 0 && t.type < sizeof(TokenColors)/sizeof(TokenColors[0])) {
+								col = TokenColors[t.type];
+							}
+
+							if(error_color) {
+								col = graphics::color(255, 0, 0);
+							}
+
+							colors.back().push_back(col);
+						}
+						++begin;
+					}
+
+				} catch(formula_tokenizer::token_error&) {
+					i = begin;
+					break;
 				}
+			}
 
-				colors_.back().push_back(graphics::color(196, 196, 196));
-				i = end + 1;
+			for(int n = 0; n != opening_brackets.size(); ++n) {
+				//any remaining brackets that weren't matched can be marked as errors.
+				const std::pair<int,int>& loc = opening_brackets[n].front();
+				colors[loc.first - first_row][loc.second] = graphics::color(255, 0, 0);
 			}
 
+			while(i != s.end()) {
+				//we might have bailed out of formula parsing early due to an error. Just treat
+				//remaining text until the closing quotes as plain.
+				if(*i == '\n') {
+					new_row(first_row + colors.size() - row);
+				} else {
+					colors.back().push_back(graphics::color(196, 196, 196));
+				}
+				++i;
+			}
 
-		} else if(*i == '\n') {
-			colors_.resize(colors_.size()+1);
-			++i;
-		} else {
-			colors_.back().push_back(graphics::color(255, 255, 255));
-			++i;
+			colors.back().push_back(graphics::color(196, 196, 196));
+
+			for(int k = 0; k != matched_brackets.size(); ++k) {
+				const std::vector<std::pair<int, int> >& match = matched_brackets[k];
+				for(int n = 0; n != match.size(); ++n) {
+					std::vector<std::pair<int, int> >& entry = brackets[match[n].first - first_row][match[n].second];
+					for(int m = 0; m != match.size(); ++m) {
+						entry.push_back(std::pair<int,int>(match[m].first - match[n].first, match[m].second));
+					}
+				}
+			}
+
+			row = end_row;
+			col = end_col + 1;
 		}
+
+		++row;
 	}
 
-	text_editor_widget::on_change();
+	//replace the rows which were lexed again.
+	const int end = first_row + colors.size();
+	colors_.erase(colors_.begin() + first_row, colors_.begin() + end - delta);
+	colors_.insert(colors_.begin() + first_row, colors.begin(), colors.end());
+	row_states_.erase(row_states_.begin() + first_row, row_states_.begin() + end - delta);
+	row_states_.insert(row_states_.begin() + first_row, states.begin(), states.end());
+	bracket_match_.erase(bracket_match_.begin() + first_row, bracket_match_.begin() + end - delta);
+	bracket_match_.insert(bracket_match_.begin() + first_row, brackets.begin(), brackets.end());
 }
 
 graphics::color code_editor_widget::get_character_color(int row, int col) const
 {
-	std::map<std::pair<int, int>, std::vector<std::pair<int, int> > >::const_iterator itor = bracket_match_.find(std::pair<int,int>(row,col));
-	if(itor != bracket_match_.end()) {
+	ASSERT_LOG(row >= 0 && row < colors_.size(), "Invalid row: " << row << " /" << colors_.size());
+	ASSERT_LOG(col >= 0 && col < colors_[row].size(), "Invalid col: " << col << " /" << colors_[row].size());
+
+	bracket_row::const_iterator itor = bracket_match_[row].find(col);
+	if(itor != bracket_match_[row].end()) {
 		for(int n = 0; n != itor->second.size(); ++n) {
-			const int match_row = itor->second[n].first;
+			const int match_row = row + itor->second[n].first;
 			const int match_col = itor->second[n].second;
 			if(cursor_row() == match_row) {
 				if(cursor_col() == match_col+1 || colors_[match_row].size() == match_col+1 && cursor_col() > match_col+1) {
@@ -214,19 +471,18 @@ graphics::color code_editor_widget::get_character_color(int row, int col) const
 		}
 	}
 
-	ASSERT_LOG(row >= 0 && row < colors_.size(), "Invalid row: " << row << " /" << colors_.size());
-	ASSERT_LOG(col >= 0 && col < colors_[row].size(), "Invalid col: " << col << " /" << colors_[row].size());
 	return colors_[row][col];
 }
 
 void code_editor_widget::select_token(const std::string& row, int& begin_row, int& end_row, int& begin_col, int& end_col)
 {
-	std::pair<int,int> key(begin_row, begin_col);
-	if(bracket_match_.count(key)) {
-		begin_row = bracket_match_.find(key)->second.front().first;
-		begin_col = bracket_match_.find(key)->second.front().second;
-		end_row = bracket_match_.find(key)->second.back().first;
-		end_col = bracket_match_.find(key)->second.back().second+1;
+	if(begin_row >= 0 && begin_row < bracket_match_.size() && bracket_match_[begin_row].count(begin_col)) {
+		const std::vector<std::pair<int, int> >& match = bracket_match_[begin_row].find(begin_col)->second;
+		const int row = begin_row;
+		begin_row = row + match.front().first;
+		begin_col = match.front().second;
+		end_row = row + match.back().first;
+		end_col = match.back().second+1;
 		return;
 	}
 
@@ -368,15 +624,80 @@ bool code_editor_widget::handle_event(const SDL_Event& event, bool claimed)
 	return text_editor_widget::handle_event(event, claimed) || claimed;
 }
 
-void code_editor_widget::generate_tokens()
+void code_editor_widget::handle_process()
 {
-	current_text_ = text();
+	text_editor_widget::handle_process();
+	update_parse();
+}
 
-	try {
-		current_obj_ = json::parse(current_text_);
-	} catch(...) {
+void code_editor_widget::update_parse()
+{
+	if(!parser_) {
+		parser_.reset(new code_editor_parser);
+	}
+
+	apply_parse();
+
+	if(submitted_generation_ != text_generation_ && SDL_GetTicks() >= parse_due_) {
+		parser_->submit(current_text_, text_generation_);
+		submitted_generation_ = text_generation_;
+	}
+}
+
+void code_editor_widget::finish_parse()
+{
+	if(!parser_) {
+		parser_.reset(new code_editor_parser);
+	}
+
+	if(submitted_generation_ != text_generation_) {
+		parser_->submit(current_text_, text_generation_);
+		submitted_generation_ = text_generation_;
+	}
+
+	parser_->wait();
+	apply_parse();
+}
+
+void code_editor_widget::apply_parse()
+{
+	parse_job_ptr job = parser_->take_result();
+	if(!job) {
+		return;
 	}
 
+	//if the parse failed the last document which parsed is kept.
+	parse_error_ = job->error;
+	if(!parse_error_) {
+		if(job->plain) {
+			current_obj_ = job->doc;
+		} else {
+			try {
+				current_obj_ = json::parse(job->text);
+			} catch(json::parse_error& e) {
+				parse_error_.reset(new json::parse_error(e));
+			} catch(...) {
+				parse_error_.reset(new json::parse_error("Unknown error"));
+			}
+		}
+	}
+
+	parsed_generation_ = job->generation;
+}
+
+void code_editor_widget::check_parse() const
+{
+	if(parse_error_) {
+		throw *parse_error_;
+	}
+}
+
+void code_editor_widget::generate_tokens()
+{
+	current_text_ = text();
+	++text_generation_;
+	parse_due_ = SDL_GetTicks() + g_code_editor_parse_delay;
+
 	tokens_.clear();
 	const char* begin = current_text_.c_str();
 	const char* end = begin + current_text_.size();
@@ -504,6 +825,10 @@ void code_editor_widget::set_highlight_current_object(bool value)
 
 void code_editor_widget::modify_current_object(variant new_obj)
 {
+	//the object is found by its place in the parsed document, so the
+	//document can't be out of date.
+	finish_parse();
+
 	ObjectInfo info = get_current_object();
 	if(info.obj.is_null() || info.tokens.empty()) {
 		return;
@@ -20,12 +20,17 @@
 #include <map>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+
+#include "json_parser.hpp"
 #include "json_tokenizer.hpp"
 #include "slider.hpp"
 #include "text_editor_widget.hpp"
 
 namespace gui {
 
+class code_editor_parser;
+
 class code_editor_widget : public text_editor_widget
 {
 public:
@@ -48,20 +53,53 @@ public:
 
 	void set_formula(bool val=true) { is_formula_ = true; }
 
+	//applies a finished background parse of the document, and starts the
+	//next one once the text has been left alone for a moment. Called when
+	//the widget is processed; owners which don't process their children
+	//may call it directly.
+	void update_parse();
+
+	//whether the background parse has caught up with the text.
+	bool is_parse_current() const { return parsed_generation_ == text_generation_; }
+
+	//throws the error found by the last parse of the text, if it failed.
+	void check_parse() const;
+
 private:
 	ObjectInfo get_object_at(int row, int col) const;
 
 	virtual void handle_draw() const;
+	virtual void handle_process();
 	virtual bool handle_event(const SDL_Event& event, bool claimed);
 	void select_token(const std::string& row, int& begin_row, int& end_row, int& begin_col, int& end_col);
 	void on_change();
 	void on_move_cursor(bool auto_shift=false);
 	graphics::color get_character_color(int row, int col) const;
 
+	void relex(const std::vector<std::string>& rows, int first_row, int unchanged_begin, int delta);
+
 	std::vector<std::vector<graphics::color> > colors_;
 
-	//maps a location (a bracket or comma) to matching locations.
-	std::map<std::pair<int, int>, std::vector<std::pair<int, int> > > bracket_match_;
+	//for each row, maps the column of a bracket or comma to the locations
+	//matching it. Matching rows are relative to the row of the key, so
+	//rows keep their entries when lines are added or removed above them.
+	typedef std::map<int, std::vector<std::pair<int, int> > > bracket_row;
+	std::vector<bracket_row> bracket_match_;
+
+	//what the lexer knew at the start of each row.
+	struct row_state {
+		//rows back to the row with the opening quote of the string this row
+		//begins inside, or 0 if it begins outside of any string.
+		int string_rows;
+
+		//true if the row has a quote which is never closed. Changes anywhere
+		//after such a quote can change how it is lexed.
+		bool unclosed_quote;
+	};
+	std::vector<row_state> row_states_;
+
+	//the rows colors_ was lexed from.
+	std::vector<std::string> lexed_rows_;
 
 	mutable slider_ptr slider_;
 	int row_slider_, begin_col_slider_, end_col_slider_;
@@ -80,10 +118,19 @@ private:
 	std::vector<widget_ptr> slider_labels_;
 
 	void generate_tokens();
+	void finish_parse();
+	void apply_parse();
 	std::string current_text_;
 	variant current_obj_;
 	std::vector<json::Token> tokens_;
 
+	//current_obj_ is parsed on a worker thread after the text stops
+	//changing. The generations count changes to the text.
+	boost::shared_ptr<code_editor_parser> parser_;
+	boost::shared_ptr<json::parse_error> parse_error_;
+	int text_generation_, submitted_generation_, parsed_generation_;
+	Uint32 parse_due_;
+
 	bool is_formula_;
 };
 
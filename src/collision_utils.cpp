@@ -24,6 +24,41 @@
 namespace {
 std::map<std::string, int> solid_dimensions;
 std::vector<std::string> solid_dimension_ids;
+
+//the first one pixel step of 'a' in the direction (dx, dy) on which it
+//overlaps 'b', or INT_MAX if it never does.
+int first_overlap_step(const rect& a, const rect& b, int dx, int dy)
+{
+	if(a.w() == 0 || a.h() == 0 || b.w() == 0 || b.h() == 0) {
+		return INT_MAX;
+	}
+
+	const bool vertical = dy != 0;
+	if(vertical ? (a.x2() <= b.x() || b.x2() <= a.x()) : (a.y2() <= b.y() || b.y2() <= a.y())) {
+		return INT_MAX;
+	}
+
+	const int a1 = vertical ? a.y() : a.x(), a2 = vertical ? a.y2() : a.x2();
+	const int b1 = vertical ? b.y() : b.x(), b2 = vertical ? b.y2() : b.x2();
+
+	//the steps on which they overlap are those strictly between 'begin'
+	//and 'end'.
+	const int begin = dx + dy > 0 ? b1 - a2 : a1 - b2;
+	const int end = dx + dy > 0 ? b2 - a1 : a2 - b1;
+	const int first = std::max(1, begin + 1);
+	return first < end ? first : INT_MAX;
+}
+
+//the area 'r' covers while taking up to 'steps' one pixel steps in the
+//direction (dx, dy).
+rect swept_rect(const rect& r, int dx, int dy, int steps)
+{
+	if(r.w() == 0 || r.h() == 0) {
+		return r;
+	}
+
+	return rect_union(r, rect(r.x() + dx*steps, r.y() + dy*steps, r.w(), r.h()));
+}
 }
 
 void collision_info::read_surf_info()
@@ -74,11 +109,12 @@ bool point_standable(const level& lvl, const entity& e, int x, int y, collision_
 
 	const point pt(x, y);
 
-	const std::vector<entity_ptr>& chars = lvl.get_solid_chars();
+	std::vector<entity*> chars;
+	lvl.get_solid_chars_in_rect(rect(x, y, 1, 1), &chars);
 
-	for(std::vector<entity_ptr>::const_iterator i = chars.begin();
+	for(std::vector<entity*>::const_iterator i = chars.begin();
 	    i != chars.end(); ++i) {
-		const entity_ptr& obj = *i;
+		const entity_ptr obj(*i);
 		if(&e == obj.get()) {
 			continue;
 		}
@@ -136,11 +172,12 @@ bool entity_collides(level& lvl, const entity& e, MOVE_DIRECTION dir, collision_
 		return true;
 	}
 
-	const std::vector<entity_ptr>& solid_chars = lvl.get_solid_chars();
-	for(std::vector<entity_ptr>::const_iterator obj = solid_chars.begin(); obj != solid_chars.end(); ++obj) {
-		if(obj->get() != &e && entity_collides_with_entity(e, **obj, info)) {
+	std::vector<entity*> solid_chars;
+	lvl.get_solid_chars_in_rect(e.solid_rect(), &solid_chars);
+	for(std::vector<entity*>::const_iterator obj = solid_chars.begin(); obj != solid_chars.end(); ++obj) {
+		if(*obj != &e && entity_collides_with_entity(e, **obj, info)) {
 			if(info) {
-				info->collide_with = *obj;
+				info->collide_with = entity_ptr(*obj);
 			}
 			return true;
 		}
@@ -685,10 +722,11 @@ bool is_flightpath_clear(const level& lvl, const entity& e, const rect& area)
 		return false;
 	}
 
-	const std::vector<entity_ptr>& v = lvl.get_solid_chars();
-	for(std::vector<entity_ptr>::const_iterator obj = v.begin();
+	std::vector<entity*> v;
+	lvl.get_solid_chars_in_rect(area, &v);
+	for(std::vector<entity*>::const_iterator obj = v.begin();
 	    obj != v.end(); ++obj) {
-		if(obj->get() == &e) {
+		if(*obj == &e) {
 			continue;
 		}
 
@@ -699,3 +737,32 @@ bool is_flightpath_clear(const level& lvl, const entity& e, const rect& area)
 
 	return true;
 }
+
+int entity_clear_distance(const level& lvl, const entity& e, const rect& feet, int dx, int dy, int max_steps)
+{
+	int steps = lvl.clear_distance(e.solid_rect(), dx, dy, max_steps);
+	steps = lvl.clear_distance(feet, dx, dy, steps, true);
+
+	if(steps <= 0) {
+		return steps;
+	}
+
+	std::vector<entity*> chars;
+	lvl.get_solid_chars_in_rect(rect_union(swept_rect(e.solid_rect(), dx, dy, steps), swept_rect(feet, dx, dy, steps)), &chars);
+	for(std::vector<entity*>::const_iterator i = chars.begin(); i != chars.end() && steps > 0; ++i) {
+		const entity* obj = *i;
+		if(obj == &e) {
+			continue;
+		}
+
+		int first = std::min(first_overlap_step(e.solid_rect(), obj->solid_rect(), dx, dy),
+		                     first_overlap_step(feet, obj->solid_rect(), dx, dy));
+		if(obj->platform()) {
+			first = std::min(first, first_overlap_step(feet, obj->platform_bounds(), dx, dy));
+		}
+
+		steps = std::min(steps, first - 1);
+	}
+
+	return steps;
+}
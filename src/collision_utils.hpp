@@ -117,4 +117,11 @@ void detect_user_collisions(level& lvl);
 
 bool is_flightpath_clear(const level& lvl, const entity& e, const rect& area);
 
+//function which finds how many one pixel steps, up to max_steps, a solid
+//entity can take in the direction (dx, dy) before entity_collides() or a
+//check of whether it is standing with its feet in 'feet' could find
+//anything. Other objects are only considered by their rects, so the
+//answer may be short of the true distance but is never past it.
+int entity_clear_distance(const level& lvl, const entity& e, const rect& feet, int dx, int dy, int max_steps);
+
 #endif
@@ -87,6 +87,8 @@ namespace {
 
 const int widget_zorder_draw_later_threshold = 1000;
 
+type_check_counter g_type_checks("custom_object");
+
 const game_logic::formula_variable_storage_ptr& global_vars()
 {
 	static game_logic::formula_variable_storage_ptr obj(new game_logic::formula_variable_storage);
@@ -1262,8 +1264,13 @@ void custom_object::draw(int xx, int yy) const
 		draw_color_->to_color().set_as_current_color();
 	}
 
+#if defined(USE_BOX2D)
+	const int draw_x = x() + body_draw_offset_.x;
+	const int draw_y = y() + body_draw_offset_.y;
+#else
 	const int draw_x = x();
 	const int draw_y = y();
+#endif
 
 	if(type_->hidden_in_game() && !level::current().in_editor()) {
 		//pass
@@ -1517,30 +1524,21 @@ void custom_object::check_initialized()
 	validate_properties();
 }
 
+#if defined(USE_BOX2D)
+void custom_object::set_body_transform(float x, float y, float angle)
+{
+	rotate_z_ = decimal(double(angle) * 180.0 / M_PI);
+	set_x(int(x - (solid_rect().w() ? (solid_rect().w()/2) : current_frame().width()/2)));
+	set_y(int(y - (solid_rect().h() ? (solid_rect().h()/2) : current_frame().height()/2)));
+}
+#endif
+
 void custom_object::process(level& lvl)
 {
 	if(paused_) {
 		return;
 	}
 
-#if defined(USE_BOX2D)
-	box2d::world_ptr world = box2d::world::our_world_ptr();
-	if(body_) {
-		const b2Vec2 v = body_->get_body_ptr()->GetPosition();
-		const float a = body_->get_body_ptr()->GetAngle();
-		rotate_z_ = decimal(double(a) * 180.0 / M_PI);
-		set_x(int(v.x * world->scale() - (solid_rect().w() ? (solid_rect().w()/2) : current_frame().width()/2)));
-		set_y(int(v.y * world->scale() - (solid_rect().h() ? (solid_rect().h()/2) : current_frame().height()/2)));
-		//set_y(graphics::screen_height() - v.y * world->scale() - current_frame().height());
-		/*set_x((v.x + world->x1()) * graphics::screen_width() / (world->x2() - world->x1()));
-		if(world->y2() < 0) {
-			set_y(graphics::screen_height() - (v.y + world->y1()) * graphics::screen_height() / -(world->y2() + world->y1()));
-		} else {
-			set_y((v.y + world->y1()) * graphics::screen_height() / (world->y2() - world->y1()));
-		}*/
-	}
-#endif
-
 	if(type_->use_image_for_collisions()) {
 		//anything that uses their image for collisions is a static,
 		//un-moving object that will stay immobile.
@@ -1895,8 +1893,22 @@ void custom_object::process(level& lvl)
 	bool is_stuck = false;
 
 	collide = false;
-	int move_left;
-	for(move_left = std::abs(effective_velocity_y); move_left > 0 && !collide && !type_->ignore_collide(); move_left -= 100) {
+	int move_left = std::abs(effective_velocity_y);
+
+	//the steps on which nothing can be found are taken in one move. The
+	//rest are taken a pixel at a time, from where a collision might first
+	//be found, so the object stops and fires its events just as if it had
+	//stepped the whole way.
+	if(move_left >= 100) {
+		const int dir = effective_velocity_y > 0 ? 1 : -1;
+		const int steps = clear_move_steps(lvl, 0, dir, move_left/100);
+		if(steps > 0) {
+			move_centipixels(0, steps*100*dir);
+			move_left -= steps*100;
+		}
+	}
+
+	for(; move_left > 0 && !collide && !type_->ignore_collide(); move_left -= 100) {
 		const int dir = effective_velocity_y > 0 ? 1 : -1;
 		int damage = 0;
 
@@ -2050,7 +2062,20 @@ void custom_object::process(level& lvl)
 		const int backup_centi_y = centi_y();
 
 
-		for(move_left = std::abs(effective_velocity_x); move_left > 0 && !collide && !type_->ignore_collide(); move_left -= 100) {
+		move_left = std::abs(effective_velocity_x);
+
+		//as with vertical movement, but a step can also move an object
+		//which is standing, or was standing before it, up or down slopes.
+		if(move_left >= 100 && !standing_on_ && is_standing(lvl) == NOT_STANDING) {
+			const int dir = effective_velocity_x > 0 ? 1 : -1;
+			const int steps = clear_move_steps(lvl, dir, 0, move_left/100);
+			if(steps > 0) {
+				move_centipixels(steps*100*dir, 0);
+				move_left -= steps*100;
+			}
+		}
+
+		for(; move_left > 0 && !collide && !type_->ignore_collide(); move_left -= 100) {
 			if(type_->object_level_collisions() && non_solid_entity_collides_with_level(lvl, *this)) {
 				handle_event(OBJECT_EVENT_COLLIDE_LEVEL);
 			}
@@ -2547,6 +2572,27 @@ void custom_object::control(const level& lvl)
 {
 }
 
+namespace {
+PREF_BOOL(swept_movement, true, "Take the movement steps on which an object can't collide with anything in one move, rather than a pixel at a time");
+}
+
+int custom_object::clear_move_steps(const level& lvl, int dx, int dy, int max_steps) const
+{
+	//objects colliding with the level in non-solid space fire an event on
+	//every step, so they always step.
+	if(!g_swept_movement || !solid() || type_->ignore_collide() || type_->object_level_collisions()) {
+		return 0;
+	}
+
+	rect feet;
+	if(has_feet()) {
+		const int width = type_->feet_width();
+		feet = rect(feet_x() - width, feet_y(), width*2 + 1, 1);
+	}
+
+	return entity_clear_distance(lvl, *this, feet, dx, dy, max_steps);
+}
+
 custom_object::STANDING_STATUS custom_object::is_standing(const level& lvl, collision_info* info) const
 {
 	if(!has_feet()) {
@@ -3410,6 +3456,33 @@ public:
 };
 }
 
+namespace {
+//how a name resolved on a given object type, as remembered by a
+//game_logic::lookup_cache.
+enum LOOKUP_KIND {
+	LOOKUP_SLOT,      //index is a built in slot
+	LOOKUP_PROPERTY,  //index is an index into slot_properties()
+	LOOKUP_DYNAMIC,   //per-object storage; data is the type variable if any
+};
+
+bool property_has_value(const custom_object_type::property_entry& e)
+{
+	return e.getter || e.const_value || e.storage_slot >= 0;
+}
+}
+
+variant custom_object::get_property_value(const custom_object_type::property_entry& e) const
+{
+	if(e.getter) {
+		active_property_scope scope(*this, e.storage_slot);
+		return e.getter->execute(*this);
+	} else if(e.const_value) {
+		return *e.const_value;
+	} else {
+		return get_property_data(e.storage_slot);
+	}
+}
+
 variant custom_object::get_value(const std::string& key) const
 {
 	const int slot = type_->callable_definition()->get_slot(key);
@@ -3418,17 +3491,45 @@ variant custom_object::get_value(const std::string& key) const
 	}
 
 	std::map<std::string, custom_object_type::property_entry>::const_iterator property_itor = type_->properties().find(key);
-	if(property_itor != type_->properties().end()) {
-		if(property_itor->second.getter) {
-			active_property_scope scope(*this, property_itor->second.storage_slot);
-			return property_itor->second.getter->execute(*this);
-		} else if(property_itor->second.const_value) {
-			return *property_itor->second.const_value;
-		} else if(property_itor->second.storage_slot >= 0) {
-			return get_property_data(property_itor->second.storage_slot);
+	if(property_itor != type_->properties().end() && property_has_value(property_itor->second)) {
+		return get_property_value(property_itor->second);
+	}
+
+	std::map<std::string, variant>::const_iterator i = type_->variables().find(key);
+	return get_dynamic_value(key, i != type_->variables().end() ? &i->second : NULL);
+}
+
+variant custom_object::get_value_cached(const std::string& key, game_logic::lookup_cache& cache) const
+{
+	const unsigned int shape = type_->lookup_shape();
+	const game_logic::lookup_cache::entry* e = cache.find(shape);
+	if(e == NULL) {
+		const int slot = type_->callable_definition()->get_slot(key);
+		std::map<std::string, custom_object_type::property_entry>::const_iterator property_itor = type_->properties().find(key);
+		if(slot >= 0 && slot < NUM_CUSTOM_OBJECT_PROPERTIES) {
+			cache.insert(shape, LOOKUP_SLOT, slot);
+		} else if(property_itor != type_->properties().end() && property_has_value(property_itor->second)) {
+			cache.insert(shape, LOOKUP_PROPERTY, property_itor->second.slot);
+		} else {
+			std::map<std::string, variant>::const_iterator i = type_->variables().find(key);
+			cache.insert(shape, LOOKUP_DYNAMIC, -1, i != type_->variables().end() ? &i->second : NULL);
 		}
+
+		e = cache.find(shape);
 	}
 
+	switch(e->kind) {
+	case LOOKUP_SLOT:
+		return get_value_by_slot(e->index);
+	case LOOKUP_PROPERTY:
+		return get_property_value(type_->slot_properties()[e->index]);
+	default:
+		return get_dynamic_value(key, static_cast<const variant*>(e->data));
+	}
+}
+
+variant custom_object::get_dynamic_value(const std::string& key, const variant* type_variable) const
+{
 	if(!type_->is_strict()) {
 		variant var_result = tmp_vars_->query_value(key);
 		if(!var_result.is_null()) {
@@ -3441,9 +3542,8 @@ variant custom_object::get_value(const std::string& key) const
 		}
 	}
 
-	std::map<std::string, variant>::const_iterator i = type_->variables().find(key);
-	if(i != type_->variables().end()) {
-		return i->second;
+	if(type_variable) {
+		return *type_variable;
 	}
 
 	std::map<std::string, particle_system_ptr>::const_iterator particle_itor = particle_systems_.find(key);
@@ -4521,6 +4621,8 @@ void custom_object::set_value_by_slot(int slot, const variant& value)
 		for(int n = 0; n != value.num_elements(); ++n) {
 			platform_offsets_.push_back(value[n].as_int());
 		}
+
+		platform_bounds_changed();
 		break;
 	}
 
@@ -4733,7 +4835,7 @@ void custom_object::set_value_by_slot(int slot, const variant& value)
 			ASSERT_LOG(!e.const_value, "Attempt to set const property: " << debug_description() << "." << e.id);
 			if(e.setter) {
 
-				if(e.set_type) {
+				if(e.set_type && g_type_checks.need_check(write_type_proven(value, e.set_type))) {
 					ASSERT_LOG(e.set_type->match(value), "Setting " << debug_description() << "." << e.id << " to illegal value " << value.write_json() << " of type " << get_variant_type_from_value(value)->to_string() << " expected type " << e.set_type->to_string());
 				}
 
@@ -5009,6 +5111,11 @@ bool custom_object::always_active() const
 	return always_active_ || type_->always_active();
 }
 
+const processing_policy* custom_object::get_processing_policy() const
+{
+	return type_->processing().is_default() ? NULL : &type_->processing();
+}
+
 bool custom_object::body_harmful() const
 {
 	return type_->body_harmful();
@@ -5147,7 +5254,7 @@ bool custom_object::handle_event_internal(int event, const formula_callable* con
 		const game_logic::formula* handler = handlers[n];
 
 #ifndef DISABLE_FORMULA_PROFILER
-		formula_profiler::custom_object_event_frame event_frame = { type_.get(), event, false };
+		formula_profiler::custom_object_event_frame event_frame = { type_.get(), event, false, static_cast<int>(get_expression_call_stack().size()) };
 		event_call_stack.push_back(event_frame);
 #endif
 
@@ -5747,6 +5854,20 @@ rect custom_object::platform_rect_at(int xpos) const
 	return rect(area.x(), area.y() + offset, area.w(), area.h());
 }
 
+rect custom_object::platform_bounds() const
+{
+	const rect area = platform_rect();
+	if(platform_offsets_.empty() || area.w() == 0 || area.h() == 0) {
+		return area;
+	}
+
+	//offsets between two points are interpolated, so they stay within
+	//the range of the offsets given.
+	const int min_offset = std::min(0, *std::min_element(platform_offsets_.begin(), platform_offsets_.end()));
+	const int max_offset = std::max(0, *std::max_element(platform_offsets_.begin(), platform_offsets_.end()));
+	return rect(area.x(), area.y() + min_offset, area.w(), area.h() + max_offset - min_offset);
+}
+
 int custom_object::platform_slope_at(int xpos) const
 {
 	if(platform_offsets_.size() <= 1) {
@@ -5998,6 +6119,18 @@ BENCHMARK_ARG(custom_object_get_attr, const std::string& attr)
 BENCHMARK_ARG_CALL(custom_object_get_attr, easy_lookup, "x");
 BENCHMARK_ARG_CALL(custom_object_get_attr, hard_lookup, "xxxx");
 
+BENCHMARK_ARG(custom_object_get_attr_cached, const std::string& attr)
+{
+	static custom_object* obj = new custom_object("ant_black", 0, 0, false);
+	game_logic::lookup_cache cache;
+	BENCHMARK_LOOP {
+		obj->query_value_cached(attr, cache);
+	}
+}
+
+BENCHMARK_ARG_CALL(custom_object_get_attr_cached, cached_easy_lookup, "x");
+BENCHMARK_ARG_CALL(custom_object_get_attr_cached, cached_hard_lookup, "xxxx");
+
 BENCHMARK_ARG(custom_object_handle_event, const std::string& object_event)
 {
 	std::string::const_iterator i = std::find(object_event.begin(), object_event.end(), ':');
@@ -6017,3 +6150,96 @@ BENCHMARK_ARG(custom_object_handle_event, const std::string& object_event)
 BENCHMARK_ARG_CALL(custom_object_handle_event, ant_non_exist, "ant_black:blahblah");
 
 BENCHMARK_ARG_CALL_COMMAND_LINE(custom_object_handle_event);
+
+namespace {
+//records the collision events an object gets, so that two runs of the
+//same objects over the same level can be compared.
+class collision_log_object : public custom_object
+{
+public:
+	collision_log_object(int x, int y, int velocity_x, int velocity_y)
+	  : custom_object("swept_movement_test", x, y, velocity_x > 0)
+	{
+		mutate_value("velocity_x", variant(velocity_x));
+		mutate_value("velocity_y", variant(velocity_y));
+	}
+
+	using custom_object::handle_event;
+	bool handle_event(int event, const formula_callable* context=NULL)
+	{
+		if(event == OBJECT_EVENT_COLLIDE_LEVEL || event == OBJECT_EVENT_COLLIDE_HEAD ||
+		   event == OBJECT_EVENT_COLLIDE_FEET || event == OBJECT_EVENT_COLLIDE_SIDE) {
+			log.push_back(formatter() << get_object_event_str(event) << " " << x() << "," << y());
+		}
+
+		return custom_object::handle_event(event, context);
+	}
+
+	std::vector<std::string> log;
+};
+
+//throws objects at the floor, walls, ceiling and a block in the middle of a
+//level, and gives where each ended up followed by its collisions.
+std::vector<std::string> run_swept_movement_level(bool swept)
+{
+	const bool old_swept = g_swept_movement;
+	g_swept_movement = swept;
+
+	const variant node = json::parse(
+	  "{id: \"swept_movement_test.cfg\", dimensions: [0,0,1199,799],"
+	  " music: \"\", preloads: \"\", air_resistance: 20, water_resistance: 100,"
+	  " solid_rect: [{rect: [0,700,1199,799]}, {rect: [0,0,1199,40]},"
+	  "              {rect: [0,0,40,799]}, {rect: [1160,0,1199,799]},"
+	  "              {rect: [500,450,620,520]}]}");
+	boost::intrusive_ptr<level> lvl(new level("swept_movement_test.cfg", node));
+	lvl->finish_loading();
+
+	const bool had_level = level::current_ptr() != NULL;
+	std::vector<std::string> result;
+	{
+		const current_level_scope scope(lvl.get());
+
+		//x, y, velocity_x, velocity_y
+		const int starts[][4] = { {100, 600, 900, 0}, {1000, 300, -1500, -400},
+		                          {300, 100, 700, 2500}, {560, 200, 0, 1800},
+		                          {200, 500, 2000, -2600}, {900, 620, -3000, -100} };
+		std::vector<boost::intrusive_ptr<collision_log_object> > objects;
+		foreach(const int* s, starts) {
+			boost::intrusive_ptr<collision_log_object> obj(new collision_log_object(s[0], s[1], s[2], s[3]));
+			lvl->add_character(obj);
+			objects.push_back(obj);
+		}
+
+		for(int cycle = 0; cycle != 200; ++cycle) {
+			foreach(const boost::intrusive_ptr<collision_log_object>& obj, objects) {
+				obj->process(*lvl);
+			}
+		}
+
+		foreach(const boost::intrusive_ptr<collision_log_object>& obj, objects) {
+			result.push_back(formatter() << "at " << obj->x() << "," << obj->y());
+			result.insert(result.end(), obj->log.begin(), obj->log.end());
+		}
+	}
+
+	if(!had_level) {
+		level::clear_current_level();
+	}
+
+	g_swept_movement = old_swept;
+	return result;
+}
+}
+
+VIDEO_UNIT_TEST(custom_object_swept_movement)
+{
+	const std::vector<std::string> swept = run_swept_movement_level(true);
+	const std::vector<std::string> stepped = run_swept_movement_level(false);
+
+	//there are six objects, so any more lines than that are collisions.
+	CHECK_GT(stepped.size(), 6U);
+	CHECK_EQ(swept.size(), stepped.size());
+	for(size_t n = 0; n != swept.size(); ++n) {
+		CHECK_EQ(swept[n], stepped[n]);
+	}
+}
@@ -81,6 +81,15 @@ public:
 	virtual void draw_later(int x, int y) const;
 	virtual void draw_group() const;
 	virtual void process(level& lvl);
+#if defined(USE_BOX2D)
+	//called by the physics world to move the object to its body, given
+	//the body's center in pixels and its angle in radians.
+	void set_body_transform(float x, float y, float angle);
+
+	//how far from its position the object is drawn, to place it between
+	//its body's last two positions. Play never sees this offset.
+	void set_body_draw_offset(int x, int y) { body_draw_offset_ = point(x, y); }
+#endif
 	virtual void construct();
 	virtual bool create_object();
 	void set_level(level& lvl) { }
@@ -140,6 +149,7 @@ public:
 	virtual bool is_active(const rect& screen_area) const;
 	bool dies_on_inactive() const;
 	bool always_active() const;
+	const processing_policy* get_processing_policy() const;
 	bool move_to_standing(level& lvl, int max_displace=10000);
 
 	bool body_harmful() const;
@@ -293,6 +303,7 @@ protected:
 	virtual void control(const level& lvl);
 	variant get_value(const std::string& key) const;
 	variant get_value_by_slot(int slot) const;
+	variant get_value_cached(const std::string& key, game_logic::lookup_cache& cache) const;
 	void set_value(const std::string& key, const variant& value);
 	void set_value_by_slot(int slot, const variant& value);
 
@@ -312,6 +323,11 @@ protected:
 	enum STANDING_STATUS { NOT_STANDING, STANDING_BACK_FOOT, STANDING_FRONT_FOOT };
 	STANDING_STATUS is_standing(const level& lvl, collision_info* info=NULL) const;
 
+	//the number of whole pixel steps, up to max_steps, the object can move
+	//in the direction (dx, dy) in process() knowing that none of the checks
+	//made on each step could find anything.
+	int clear_move_steps(const level& lvl, int dx, int dy, int max_steps) const;
+
 	void set_parent(entity_ptr e, const std::string& pivot_point);
 
 	virtual int parent_depth(bool* has_human_parent=NULL, int cur_depth=0) const;
@@ -324,6 +340,7 @@ protected:
 	virtual void add_to_level();
 
 	virtual rect platform_rect_at(int xpos) const;
+	virtual rect platform_bounds() const;
 	virtual int platform_slope_at(int xpos) const;
 
 	virtual bool solid_platform() const;
@@ -418,6 +435,13 @@ private:
 
 	variant& get_property_data(int slot) { if(property_data_.size() <= slot) { property_data_.resize(slot+1); } return property_data_[slot]; }
 	variant get_property_data(int slot) const { if(property_data_.size() <= slot) { return variant(); } return property_data_[slot]; }
+
+	//the parts of get_value() after built in slots: a property known to
+	//have a value, and then the lookups that depend on this object's
+	//storage rather than its type. type_variable is the type's variable
+	//of the same name, if there is one.
+	variant get_property_value(const custom_object_type::property_entry& e) const;
+	variant get_dynamic_value(const std::string& key, const variant* type_variable) const;
 	std::vector<variant> property_data_;
 	mutable int active_property_;
 
@@ -481,6 +505,7 @@ private:
 
 #ifdef USE_BOX2D
 	box2d::body_ptr body_;
+	point body_draw_offset_;
 #endif
 
 	bool always_active_;
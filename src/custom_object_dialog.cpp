@@ -178,6 +178,15 @@ void do_nothing()
 {
 }
 
+void make_choice_row(const std::vector<std::string>& choices, int row, std::vector<gui::widget_ptr>* cells)
+{
+	if(cells->empty()) {
+		cells->push_back(gui::widget_ptr(new gui::label(choices[row], graphics::color_white())));
+	} else {
+		static_cast<gui::label*>(cells->front().get())->set_text(choices[row]);
+	}
+}
+
 }
 
 namespace editor_dialogs {
@@ -537,8 +546,20 @@ void custom_object_dialog::change_prototype()
 	grid->set_show_background(true);
 	grid->allow_selection();
 	grid->swallow_clicks();
-	foreach(const std::string& s, choices) {
-		grid->add_col(widget_ptr(new label(s, graphics::color_white())));
+
+	//only the prototypes in view get labels. The longest name gives the
+	//column width.
+	int longest = 0;
+	for(int n = 1; n < choices.size(); ++n) {
+		if(choices[n].size() > choices[longest].size()) {
+			longest = n;
+		}
+	}
+
+	if(!choices.empty()) {
+		const widget_ptr measure(new label(choices[longest], graphics::color_white()));
+		grid->set_col_width(0, measure->width() + 10);
+		grid->set_virtual_rows(choices.size(), boost::bind(make_choice_row, choices, _1, _2), measure->height());
 	}
 	grid->register_selection_callback(boost::bind(&custom_object_dialog::execute_change_prototype, this, choices, _1));
 
@@ -192,6 +192,36 @@ FUNCTION_DEF(performance, 0, 0, "performance(): returns an object with current p
 RETURN_TYPE("object")
 END_FUNCTION_DEF(performance)
 
+class sampling_profiler_command : public game_logic::command_callable
+{
+	std::string fname_;
+	int interval_us_;
+public:
+	sampling_profiler_command(const std::string& fname, int interval_us) : fname_(fname), interval_us_(interval_us)
+	{}
+
+	virtual void execute(game_logic::formula_callable& ob) const {
+		if(fname_.empty()) {
+			formula_profiler::stop_sampling();
+		} else {
+			formula_profiler::start_sampling(fname_, interval_us_);
+		}
+	}
+};
+
+FUNCTION_DEF(sampling_profiler, 1, 2, "sampling_profiler(string|null output_file, int interval_us=1000): starts the sampling profiler, writing folded stacks suitable for flamegraph.pl to output_file when stopped. Call with null to stop the profiler.")
+	const variant fname = args()[0]->evaluate(variables);
+	const int interval_us = args().size() > 1 ? args()[1]->evaluate(variables).as_int() : 1000;
+	ASSERT_LOG(interval_us > 0, "sampling_profiler() interval must be positive: " << interval_us);
+	sampling_profiler_command* cmd = new sampling_profiler_command(fname.is_null() ? "" : fname.as_string(), interval_us);
+	cmd->set_expression(this);
+	return variant(cmd);
+FUNCTION_ARGS_DEF
+	ARG_TYPE("string|null")
+	ARG_TYPE("int")
+RETURN_TYPE("commands")
+END_FUNCTION_DEF(sampling_profiler)
+
 FUNCTION_DEF(texture, 2, 3, "texture(objects, rect, bool half_size=false): render a texture")
 	variant objects = args()[0]->evaluate(variables);
 	variant area = args()[1]->evaluate(variables);
@@ -726,8 +756,8 @@ END_FUNCTION_DEF(music_onetime)
 class sound_command : public entity_command_callable
 {
 public:
-	explicit sound_command(const std::string& name, const bool loops, float volume, float fade_in_time, float stereo_left, float stereo_right)
-	  : names_(util::split(name)), loops_(loops), volume_(volume), fade_in_time_(fade_in_time), stereo_left_(stereo_left), stereo_right_(stereo_right)
+	explicit sound_command(const std::string& name, const bool loops, float volume, float fade_in_time, float stereo_left, float stereo_right, int priority)
+	  : names_(util::split(name)), loops_(loops), volume_(volume), fade_in_time_(fade_in_time), stereo_left_(stereo_left), stereo_right_(stereo_right), priority_(priority)
 	{}
 	virtual void execute(level& lvl, entity& ob) const {
 		sound::set_panning(stereo_left_, stereo_right_);
@@ -735,7 +765,7 @@ public:
 			if (names_.empty() == false){
 				int randomNum = rand()%names_.size();  //like a 1d-size die
 				if(names_[randomNum].empty() == false) {
-					sound::play_looped(names_[randomNum], &ob, volume_, fade_in_time_);
+					sound::play_looped(names_[randomNum], &ob, volume_, fade_in_time_, priority_);
 				}
 			}
 			
@@ -744,7 +774,7 @@ public:
 			if (names_.empty() == false){
 				int randomNum = rand()%names_.size();  //like a 1d-size die
 				if(names_[randomNum].empty() == false) {
-					sound::play(names_[randomNum], &ob, volume_, fade_in_time_);
+					sound::play(names_[randomNum], &ob, volume_, fade_in_time_, priority_);
 				}
 			}
 		}
@@ -757,9 +787,10 @@ private:
 	float volume_;
 	float fade_in_time_;
 	float stereo_left_, stereo_right_;
+	int priority_;
 };
 
-FUNCTION_DEF(sound, 1, 4, "sound(string id, decimal volume, decimal fade_in_time, [decimal,decimal] stereo): plays the sound file given by 'id', reaching full volume after fade_in_time seconds.")
+FUNCTION_DEF(sound, 1, 5, "sound(string id, decimal volume, decimal fade_in_time, [decimal,decimal] stereo, int priority=0): plays the sound file given by 'id', reaching full volume after fade_in_time seconds. If too many sounds are playing, lower priority sounds are cut off to make room.")
 	float stereo_left = 1.0, stereo_right = 1.0;
 	if(args().size() > 3) {
 		variant stereo_var = args()[3]->evaluate(variables);
@@ -772,7 +803,8 @@ FUNCTION_DEF(sound, 1, 4, "sound(string id, decimal volume, decimal fade_in_time
 									 false,
 									 args().size() > 1 ? args()[1]->evaluate(variables).as_decimal().as_float() : 1.0f,
 									 args().size() > 2 ? args()[2]->evaluate(variables).as_decimal().as_float() : 0.0f,
-									 stereo_left, stereo_right);
+									 stereo_left, stereo_right,
+									 args().size() > 4 ? args()[4]->evaluate(variables).as_int() : 0);
 	cmd->set_expression(this);
 	return variant(cmd);
 FUNCTION_ARGS_DEF
@@ -780,10 +812,11 @@ FUNCTION_ARGS_DEF
 	ARG_TYPE("decimal")
 	ARG_TYPE("decimal")
 	ARG_TYPE("[decimal,decimal]")
+	ARG_TYPE("int")
 RETURN_TYPE("commands")
 END_FUNCTION_DEF(sound)
 
-FUNCTION_DEF(sound_loop, 1, 4, "sound_loop(string id, decimal volume, decimal fade_in_time, [decimal,decimal] stereo): plays the sound file given by 'id' in a loop, if fade_in_time is given it will reach full volume after this time.")
+FUNCTION_DEF(sound_loop, 1, 5, "sound_loop(string id, decimal volume, decimal fade_in_time, [decimal,decimal] stereo, int priority=0): plays the sound file given by 'id' in a loop, if fade_in_time is given it will reach full volume after this time.")
 	float stereo_left = 1.0, stereo_right = 1.0;
 	if(args().size() > 3) {
 		variant stereo_var = args()[3]->evaluate(variables);
@@ -796,7 +829,8 @@ FUNCTION_DEF(sound_loop, 1, 4, "sound_loop(string id, decimal volume, decimal fa
 									 true,
 									 args().size() > 1 ? args()[1]->evaluate(variables).as_decimal().as_float() : 1.0f,
 									 args().size() > 2 ? args()[2]->evaluate(variables).as_decimal().as_float() : 0.0f,
-									 stereo_left, stereo_right);
+									 stereo_left, stereo_right,
+									 args().size() > 4 ? args()[4]->evaluate(variables).as_int() : 0);
 	cmd->set_expression(this);
 	return variant(cmd);
 FUNCTION_ARGS_DEF
@@ -804,6 +838,7 @@ FUNCTION_ARGS_DEF
 	ARG_TYPE("decimal")
 	ARG_TYPE("decimal")
 	ARG_TYPE("[decimal, decimal]")
+	ARG_TYPE("int")
 RETURN_TYPE("commands")
 END_FUNCTION_DEF(sound_loop)
 
@@ -1711,6 +1746,27 @@ FUNCTION_DEF(find_point_object_can_stand_on, 6, 7, "find_point_object_can_stand_
 	const int dy = args()[5]->evaluate(variables).as_int();
 	const int niterations = args().size() > 6 ? args()[6]->evaluate(variables).as_int() : 1000;
 
+	if(niterations > 0 && abs(dx) + abs(dy) == 1) {
+		//if no other object is along the way only the level's solidity
+		//matters, which can be searched a run of pixels at a time.
+		const rect path = rect_union(rect(x, y, 1, 1), rect(x + dx*(niterations-1), y + dy*(niterations-1), 1, 1));
+		std::vector<entity*> chars;
+		lvl->get_solid_chars_in_rect(path, &chars);
+		chars.erase(std::remove(chars.begin(), chars.end(), obj), chars.end());
+		if(chars.empty()) {
+			const int n = lvl->first_standable_step(x, y, dx, dy, niterations);
+			if(n == -1) {
+				return variant();
+			}
+
+			std::vector<variant> result;
+			result.reserve(2);
+			result.push_back(variant(x + dx*n));
+			result.push_back(variant(y + dy*n));
+			return variant(&result);
+		}
+	}
+
 	for(int n = 0; n < niterations; ++n) {
 		if(point_standable(*lvl, *obj, x, y)) {
 			std::vector<variant> result;
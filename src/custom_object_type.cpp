@@ -908,6 +908,50 @@ std::map<std::string,custom_object_type::EditorSummary> custom_object_type::get_
 	return m;
 }
 
+void custom_object_type::preload_all()
+{
+	if(object_file_paths().empty()) {
+		load_file_paths();
+	}
+
+	const int start = SDL_GetTicks();
+
+	//prototypes are parsed first, so they're queued first.
+	std::vector<std::string> object_ids, proto_paths, paths;
+	for(std::map<std::string, std::string>::const_iterator i = ::prototype_file_paths().begin(); i != ::prototype_file_paths().end(); ++i) {
+		if(i->first.size() > 4 && std::equal(i->first.end()-4, i->first.end(), ".cfg")) {
+			proto_paths.push_back(i->second);
+			paths.push_back(i->second);
+		}
+	}
+
+	for(std::map<std::string, std::string>::const_iterator i = object_file_paths().begin(); i != object_file_paths().end(); ++i) {
+		if(i->first.size() > 4 && std::equal(i->first.end()-4, i->first.end(), ".cfg")) {
+			object_ids.push_back(std::string(i->first.begin(), i->first.end()-4));
+			paths.push_back(i->second);
+		}
+	}
+
+	//the files are read, and those which don't use the preprocessor parsed,
+	//on the json worker threads while types are created here. Running FFL
+	//through the preprocessor, compiling FFL and loading textures all stay
+	//on the main thread.
+	const json::prefetch_scope prefetch(paths);
+
+	//parse every prototype once and keep it alive, which keeps it in the
+	//parse cache while each object that derives from it is merged.
+	std::vector<variant> prototypes;
+	foreach(const std::string& path, proto_paths) {
+		prototypes.push_back(json::parse_from_file(path));
+	}
+
+	foreach(const std::string& id, object_ids) {
+		get(id);
+	}
+
+	std::cerr << "PRELOADED " << object_ids.size() << " OBJECT TYPES IN " << (SDL_GetTicks() - start) << "ms\n";
+}
+
 std::vector<const_custom_object_type_ptr> custom_object_type::get_all()
 {
 	std::vector<const_custom_object_type_ptr> res;
@@ -1087,6 +1131,7 @@ void init_level_definition();
 
 custom_object_type::custom_object_type(const std::string& id, variant node, const custom_object_type* base_type, const custom_object_type* old_type)
   : id_(id),
+	lookup_shape_(game_logic::new_lookup_shape()),
 	hitpoints_(node["hitpoints"].as_int(1)),
 	timer_frequency_(node["timer_frequency"].as_int(-1)),
 	zorder_(node["zorder"].as_int()),
@@ -1130,6 +1175,7 @@ custom_object_type::custom_object_type(const std::string& id, variant node, cons
 	weak_solid_dimensions_(has_solid_ || platform_ || node["has_platform"].as_bool(false) ? 0xFFFFFFFF : 0),
 	weak_collide_dimensions_(0xFFFFFFFF),
 	activation_border_(node["activation_border"].as_int(100)),
+	processing_(node.has_key("processing") ? processing_policy(node["processing"]) : processing_policy()),
 	editor_force_standing_(node["editor_force_standing"].as_bool(false)),
 	hidden_in_game_(node["hidden_in_game"].as_bool(false)),
 	stateless_(node["stateless"].as_bool(false)),
@@ -1764,6 +1810,16 @@ BENCHMARK(custom_object_type_load)
 }
 
 
+BENCHMARK(custom_object_type_preload_all)
+{
+	BENCHMARK_LOOP {
+		custom_object_type::invalidate_all_objects();
+		custom_object_type::preload_all();
+		graphics::surface_cache::clear();
+		graphics::texture::clear_textures();
+	}
+}
+
 BENCHMARK(custom_object_type_frogatto_load)
 {
 	BENCHMARK_LOOP {
@@ -1790,5 +1846,5 @@ UTILITY(object_definition)
 
 UTILITY(test_all_objects)
 {
-	custom_object_type::get_all();
+	custom_object_type::preload_all();
 }
@@ -30,6 +30,7 @@
 #include "formula_function.hpp"
 #include "frame.hpp"
 #include "lua_iface.hpp"
+#include "object_scheduler.hpp"
 #include "particle_system.hpp"
 #include "raster.hpp"
 #include "solid_map_fwd.hpp"
@@ -66,6 +67,11 @@ public:
 	static void invalidate_object(const std::string& id);
 	static void invalidate_all_objects();
 	static std::vector<const_custom_object_type_ptr> get_all();
+
+	//loads every object type now rather than on first use. Object files are
+	//read on a pool of worker threads; parsing and compiling stay on the
+	//calling thread.
+	static void preload_all();
 	static std::vector<std::string> get_all_ids();
 
 	//a function which returns all objects that have an editor category
@@ -97,6 +103,7 @@ public:
 	const_custom_object_type_ptr get_sub_object(const std::string& id) const;
 
 	const_custom_object_callable_ptr callable_definition() const { return callable_definition_; }
+	unsigned int lookup_shape() const { return lookup_shape_; }
 
 	const std::string& id() const { return id_; }
 	int hitpoints() const { return hitpoints_; }
@@ -247,6 +254,7 @@ public:
 	variant node() const { return node_; }
 
 	int activation_border() const { return activation_border_; }
+	const processing_policy& processing() const { return processing_; }
 	const variant& available_frames() const { return available_frames_; }
 
 	bool editor_force_standing() const { return editor_force_standing_; }
@@ -284,6 +292,10 @@ private:
 	custom_object_callable_ptr callable_definition_;
 
 	std::string id_;
+
+	//identifies this type to formula inline caches; see lookup_cache.
+	unsigned int lookup_shape_;
+
 	int hitpoints_;
 
 	int timer_frequency_;
@@ -372,6 +384,7 @@ private:
 	unsigned int weak_solid_dimensions_, weak_collide_dimensions_;
 
 	int activation_border_;
+	processing_policy processing_;
 
 	std::map<std::string, game_logic::const_formula_ptr> variations_;
 	mutable std::map<std::vector<std::string>, const_custom_object_type_ptr> variations_cache_;
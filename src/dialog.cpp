@@ -41,6 +41,8 @@ namespace gui {
 
 namespace {
 
+PREF_BOOL(dialog_layer_cache, false, "Draw unchanged dialog widgets from offscreen copies rather than redrawing them every frame");
+
 module::module_file_map& get_dialog_path()
 {
 	static module::module_file_map dialog_file_map;
@@ -72,6 +74,7 @@ std::string get_dialog_file(const std::string& fname)
 dialog::dialog(int x, int y, int w, int h)
   : opened_(false), cancelled_(false), clear_bg_(196), padding_(10),
     add_x_(0), add_y_(0), bg_alpha_(1.0), last_draw_(-1), upscale_frame_(true),
+	cache_layers_(g_dialog_layer_cache),
 	current_tab_focus_(tab_widgets_.end()), control_lockout_(0)
 {
 	set_environment();
@@ -85,6 +88,7 @@ dialog::dialog(const variant& v, game_logic::formula_callable* e)
 	opened_(false), cancelled_(false), 
 	add_x_(0), add_y_(0), last_draw_(-1),
 	upscale_frame_(v["upscale_frame"].as_bool(true)),
+	cache_layers_(v["cache_layers"].as_bool(g_dialog_layer_cache)),
 	current_tab_focus_(tab_widgets_.end()), control_lockout_(0)
 {
 	forced_dimensions_ = rect(x(), y(), width(), height());
@@ -436,7 +440,11 @@ void dialog::handle_draw_children() const {
 	glPushMatrix();
 	glTranslatef(GLfloat(x()),GLfloat(y()),0.0);
 	foreach(const widget_ptr& w, widgets_) {
-		w->draw();
+		if(cache_layers_) {
+			w->draw_cached();
+		} else {
+			w->draw();
+		}
 	}
 	glPopMatrix();
 }
@@ -63,6 +63,10 @@ public:
 	void set_draw_background_fn(boost::function<void()> fn) { draw_background_fn_ = fn; }
 	void set_upscale_frame(bool upscale=true) { upscale_frame_ = upscale; }
 
+	//draws the widgets of the dialog which can be cached from offscreen
+	//copies, which are only redrawn when the widgets change.
+	void set_cache_layers(bool cache=true) { cache_layers_ = cache; }
+
 	virtual bool has_focus() const;
 	void set_process_hook(boost::function<void()> fn) { on_process_ = fn; }
 	static void draw_last_scene();
@@ -135,6 +139,7 @@ private:
 	boost::function<void()> draw_background_fn_;
 
 	bool upscale_frame_;
+	bool cache_layers_;
 };
 
 typedef boost::intrusive_ptr<dialog> dialog_ptr;
@@ -52,6 +52,7 @@
 #include "entity.hpp"
 #include "filesystem.hpp"
 #include "font.hpp"
+#include "glyph_atlas.hpp"
 #include "foreach.hpp"
 #include "formatter.hpp"
 #include "formula.hpp"
@@ -110,6 +111,7 @@ void toggle_draw_stats() {
 }
 
 PREF_BOOL_PERSISTENT(editor_grid, true, "Turns the editor grid on/off");
+PREF_INT(editor_autosave_delay, 3000, "Milliseconds the editor waits after a change before autosaving the level, so a burst of changes is saved once. 0 saves after every change");
 
 void toggle_draw_grid() {
 	g_editor_grid = !g_editor_grid;
@@ -548,6 +550,15 @@ void execute_functions(const std::vector<boost::function<void()> >& v) {
 	}
 }
 
+//shrinks tiles saved to restore a rect: a rect of one tile repeated is
+//restored from that tile alone.
+void compact_tile_rect(std::vector<std::string>* tiles)
+{
+	if(!tiles->empty() && std::count(tiles->begin(), tiles->end(), tiles->front()) == tiles->size()) {
+		tiles->resize(1);
+	}
+}
+
 bool g_started_dragging_object = false;
 
 //the current state of the rectangle we're dragging
@@ -822,7 +833,7 @@ editor::editor(const char* level_cfg)
 	cur_voxel_tileset_(0),
 #endif
 	drawing_rect_(false), dragging_(false), level_changed_(0),
-	selected_segment_(-1),
+	selected_segment_(-1), pencil_stroke_begin_(-1), autosave_due_(-1),
 	mouse_buttons_down_(0), prev_mousex_(-1), prev_mousey_(-1),
 	xres_(0), yres_(0), mouselook_mode_(false)
 {
@@ -1181,6 +1192,11 @@ bool editor::handle_event(const SDL_Event& event, bool swallowed)
 
 void editor::process()
 {
+	if(autosave_due_ != -1 && SDL_GetTicks() >= autosave_due_) {
+		autosave_due_ = -1;
+		autosave_level();
+	}
+
 	if(code_dialog_) {
 		code_dialog_->process();
 	}
@@ -1720,8 +1736,8 @@ void editor::handle_key_press(const SDL_KeyboardEvent& key)
 			}
 
 			if(!tile_selection_.tiles.empty()) {
-				undo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), std::vector<int>()));
-				redo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), std::vector<int>()));
+				undo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), min_x, min_y, max_x, max_y));
+				redo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), min_x, min_y, max_x, max_y));
 			}
 		}
 
@@ -2130,6 +2146,7 @@ void editor::handle_mouse_button_down(const SDL_MouseButtonEvent& event)
 	} else if(tool() == TOOL_PENCIL) {
 		drawing_rect_ = false;
 		dragging_ = true;
+		pencil_stroke_begin_ = undo_.size();
 		point p(anchorx_, anchory_);
 		if(buttons&SDL_BUTTON(SDL_BUTTON_LEFT)) {
 			add_tile_rect(p.x, p.y, p.x, p.y);
@@ -2367,6 +2384,12 @@ void editor::handle_mouse_button_up(const SDL_MouseButtonEvent& event)
 
 
 	if(editing_tiles()) {
+		if(pencil_stroke_begin_ != -1) {
+			//a pencil stroke is undone as one command.
+			group_commands(pencil_stroke_begin_);
+			pencil_stroke_begin_ = -1;
+		}
+
 		if(dragging_) {
 			const int selectx = xpos_ + mousex*zoom_;
 			const int selecty = ypos_ + mousey*zoom_;
@@ -2439,8 +2462,8 @@ void editor::handle_mouse_button_up(const SDL_MouseButtonEvent& event)
 				}
 
 				if(!tile_selection_.tiles.empty()) {
-					undo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), std::vector<int>()));
-					redo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), std::vector<int>()));
+					undo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), min_x, min_y, max_x, max_y));
+					redo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), min_x, min_y, max_x, max_y));
 				}
 			}
 
@@ -2669,13 +2692,13 @@ void editor::add_tile_rect(int zorder, const std::string& tile_id, int x1, int y
 			continue;
 		}
 
+		compact_tile_rect(&old_rect);
+
 		redo.push_back(boost::bind(&level::add_tile_rect, lvl.get(), zorder, x1, y1, x2, y2, tile_id));
 		undo.push_back(boost::bind(&level::add_tile_rect_vector, lvl.get(), zorder, x1, y1, x2, y2, old_rect));
 
-		std::vector<int> layers;
-		layers.push_back(zorder);
-		undo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), layers));
-		redo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), layers));
+		undo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), x1, y1, x2, y2));
+		redo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), x1, y1, x2, y2));
 	}
 
 	execute_command(
@@ -2722,13 +2745,14 @@ void editor::remove_tile_rect(int x1, int y1, int x2, int y2)
 
 		std::map<int, std::vector<std::string> > old_tiles;
 		lvl->get_all_tiles_rect(x1, y1, x2, y2, old_tiles);
-		for(std::map<int, std::vector<std::string> >::const_iterator i = old_tiles.begin(); i != old_tiles.end(); ++i) {
+		for(std::map<int, std::vector<std::string> >::iterator i = old_tiles.begin(); i != old_tiles.end(); ++i) {
+			compact_tile_rect(&i->second);
 			undo.push_back(boost::bind(&level::add_tile_rect_vector, lvl.get(), i->first, x1, y1, x2, y2, i->second));
 		}
 
 		redo.push_back(boost::bind(&level::clear_tile_rect, lvl.get(), x1, y1, x2, y2));
-		undo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), std::vector<int>()));
-		redo.push_back(boost::bind(&level::start_rebuild_tiles_in_background, lvl.get(), std::vector<int>()));
+		undo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), x1, y1, x2, y2));
+		redo.push_back(boost::bind(&level::refresh_tile_rect, lvl.get(), x1, y1, x2, y2));
 	}
 
 	execute_command(
@@ -3679,18 +3703,11 @@ void editor::draw_gui() const
 #endif
 
 	glColor4f(1.0, 1.0, 1.0, 1.0);
-	graphics::texture xtex = font::render_text(formatter() << (xpos_ + mousex*zoom_) << ",", graphics::color_white(), 14);
-	graphics::texture ytex = font::render_text(formatter() << (ypos_ + mousey*zoom_), graphics::color_white(), 14);
-	
-	graphics::blit_texture(xtex, 10, 80);
-	graphics::blit_texture(ytex, 10 + xtex.width(), 80);
+	font::draw_text(formatter() << (xpos_ + mousex*zoom_) << "," << (ypos_ + mousey*zoom_), graphics::color_white(), 14, 10, 80);
 	
 	if(tool() == TOOL_EDIT_HEXES) {
 		point p = hex::hex_map::get_tile_pos_from_pixel_pos(xpos_ + mousex*zoom_, ypos_ + mousey*zoom_);
-		graphics::texture xptex = font::render_text(formatter() << "(" << p.x << ",", graphics::color_white(), 14);
-		graphics::texture yptex = font::render_text(formatter() << p.y << ")", graphics::color_white(), 14);
-		graphics::blit_texture(xptex, 90, 80);
-		graphics::blit_texture(yptex, 90 + xptex.width(), 80);
+		font::draw_text(formatter() << "(" << p.x << "," << p.y << ")", graphics::color_white(), 14, 90, 80);
 		// XXX: generate the name / editor name of the tile under the mouse and display it.
 	}
 
@@ -3865,7 +3882,11 @@ void editor::execute_command(boost::function<void()> command, boost::function<vo
 	undo_.push_back(cmd);
 	redo_.clear();
 
-	autosave_level();
+	if(g_editor_autosave_delay <= 0) {
+		autosave_level();
+	} else if(autosave_due_ == -1) {
+		autosave_due_ = SDL_GetTicks() + g_editor_autosave_delay;
+	}
 }
 
 void editor::begin_command_group()
@@ -3884,6 +3905,11 @@ void editor::end_command_group()
 	const int index = undo_commands_groups_.top();
 	undo_commands_groups_.pop();
 
+	group_commands(index);
+}
+
+void editor::group_commands(int index)
+{
 	if(index >= undo_.size()) {
 		return;
 	}
@@ -3899,7 +3925,8 @@ void editor::end_command_group()
 	std::reverse(undo.begin(), undo.end());
 
 	//make it so undoing and redoing will freeze tile updates during the
-	//group command, and then do a full refresh of tiles once we're done.
+	//group command, and then refresh the tiles the commands touched once
+	//we're done.
 	undo.insert(undo.begin(), boost::bind(&level::editor_freeze_tile_updates, lvl_.get(), true));
 	undo.push_back(boost::bind(&level::editor_freeze_tile_updates, lvl_.get(), false));
 	redo.insert(redo.begin(), boost::bind(&level::editor_freeze_tile_updates, lvl_.get(), true));
@@ -3921,6 +3948,7 @@ void editor::undo_command()
 	}
 
 	--level_changed_;
+	pencil_stroke_begin_ = -1;
 
 	undo_.back().undo_command();
 	redo_.push_back(undo_.back());
@@ -3938,6 +3966,7 @@ void editor::redo_command()
 	}
 
 	++level_changed_;
+	pencil_stroke_begin_ = -1;
 
 	redo_.back().redo_command();
 	undo_.push_back(redo_.back());
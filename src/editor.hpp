@@ -228,6 +228,9 @@ public:
 	void begin_command_group();
 	void end_command_group();
 
+	//rolls up all commands from 'index' in undo_ into a single command.
+	void group_commands(int index);
+
 	void draw_gui() const;
 
 	//We are currently playing a level we are editing, and we want
@@ -386,6 +389,13 @@ private:
 	int level_changed_;
 	int selected_segment_;
 
+	//the index in undo_ of the first command of the pencil stroke being
+	//drawn, or -1.
+	int pencil_stroke_begin_;
+
+	//the time at which changes to the level should be autosaved, or -1.
+	int autosave_due_;
+
 	//track mouse buttons that went down that we handled the event for,
 	//and thus will handle the corresponding up event.
 	unsigned int mouse_buttons_down_;
@@ -207,6 +207,8 @@ void entity::calculate_solid_rect()
 	} else {
 		platform_rect_ = rect();
 	}
+
+	solid_char_grid_link_.update(*this);
 }
 
 rect entity::body_rect() const
@@ -31,6 +31,7 @@
 #include "frame.hpp"
 #include "geometry.hpp"
 #include "light.hpp"
+#include "solid_char_grid.hpp"
 #include "solid_map_fwd.hpp"
 #include "wml_formula_callable.hpp"
 #include "variant.hpp"
@@ -40,6 +41,7 @@ class frame;
 class level;
 class pc_character;
 class player_info;
+struct processing_policy;
 
 typedef boost::intrusive_ptr<character> character_ptr;
 
@@ -117,6 +119,9 @@ public:
 	const rect& frame_rect() const { return frame_rect_; }
 	rect platform_rect() const { return platform_rect_; }
 	virtual rect platform_rect_at(int xpos) const { return platform_rect(); }
+
+	//a rect containing platform_rect_at() for every x position.
+	virtual rect platform_bounds() const { return platform_rect(); }
 	virtual int platform_slope_at(int xpos) const { return 0; }
 	virtual bool solid_platform() const { return false; }
 	rect body_rect() const;
@@ -164,6 +169,9 @@ public:
 	virtual bool is_active(const rect& screen_area) const = 0;
 	virtual bool dies_on_inactive() const { return false; } 
 	virtual bool always_active() const { return false; } 
+
+	//how often the level processes the object, or NULL for every cycle.
+	virtual const processing_policy* get_processing_policy() const { return NULL; }
 	
 	virtual formula_callable* vars() { return NULL; }
 	virtual const formula_callable* vars() const { return NULL; }
@@ -320,6 +328,10 @@ protected:
 	virtual const_solid_info_ptr calculate_platform() const = 0;
 	void calculate_solid_rect();
 
+	//called when platform_bounds() changes other than through
+	//calculate_solid_rect().
+	void platform_bounds_changed() { solid_char_grid_link_.update(*this); }
+
 	bool control_status(controls::CONTROL_ITEM ctrl) const { return controls_[ctrl]; }
 	variant control_status_user() const { return controls_user_; }
 	void read_controls(int cycle);
@@ -389,6 +401,9 @@ private:
 	const_solid_info_ptr solid_;
 	const_solid_info_ptr platform_;
 
+	friend class solid_char_grid;
+	solid_char_grid_link solid_char_grid_link_;
+
 	int platform_motion_x_;
 
 	std::string spawned_by_;
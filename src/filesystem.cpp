@@ -457,6 +457,16 @@ namespace sys
 		}
 	}
 
+	bool file_modifications_pending()
+	{
+		if(file_mod_worker_thread == NULL) {
+			return false;
+		}
+
+		threading::lock lck(get_mod_queue_mutex());
+		return file_mod_notification_queue.empty() == false;
+	}
+
 	bool consecutive_periods(char a, char b) {
 		return a == '.' && b == '.';
 	}
@@ -89,6 +89,9 @@ struct filesystem_manager {
 void notify_on_file_modification(const std::string& path, boost::function<void()> handler);
 void pump_file_modifications();
 
+//true if pump_file_modifications() has handlers to call.
+bool file_modifications_pending();
+
 bool is_safe_write_path(const std::string& path, std::string* error=NULL);
 
 }
@@ -26,6 +26,7 @@
 #include "font.hpp"
 #include "foreach.hpp"
 #include "formatter.hpp"
+#include "glyph_atlas.hpp"
 #include "module.hpp"
 #include "string_utils.hpp"
 #include "surface.hpp"
@@ -66,7 +67,7 @@ const std::string& get_font_path(const std::string& name)
 TTF_Font* get_font(int size, const std::string& font_name="")
 {
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_HARMATTAN && !TARGET_OS_IPHONE
-	std::string fontn = get_font_path((font_name.empty() ? module::get_default_font() == "bitmap" ? "FreeMono" : module::get_default_font()  : font_name) + ".ttf");
+	std::string fontn = get_font_file(font_name);
 	TTF_Font* font = NULL;
 	font_map::const_iterator it = font_table.find(std::pair<std::string,int>(fontn,size));
 	if(it == font_table.end()) {
@@ -136,6 +137,8 @@ manager::manager()
 manager::~manager()
 {
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_HARMATTAN && !TARGET_OS_IPHONE
+	glyph_atlas::clear_all();
+
 	font_map::iterator it = font_table.begin();
 	while(it != font_table.end()) {
 		TTF_CloseFont(it->second);
@@ -211,6 +214,11 @@ graphics::texture render_text(const std::string& text,
 	return res;
 }
 
+std::string get_font_file(const std::string& font_name)
+{
+	return get_font_path((font_name.empty() ? module::get_default_font() == "bitmap" ? "FreeMono" : module::get_default_font()  : font_name) + ".ttf");
+}
+
 int char_width(int size, const std::string& fn)
 {
 	static std::map<std::string, std::map<int, int> > size_cache;
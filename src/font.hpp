@@ -40,6 +40,9 @@ graphics::texture render_text(const std::string& text,
 graphics::texture render_text_uncached(const std::string& text,
                                        const SDL_Color& color, int size, const std::string& font_name="");
 
+//the path of the font file used for the given font name.
+std::string get_font_file(const std::string& font_name="");
+
 int char_width(int size, const std::string& fn="");
 int char_height(int size, const std::string& fn="");
 
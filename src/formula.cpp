@@ -42,6 +42,8 @@
 #include "preferences.hpp"
 #include "random.hpp"
 #include "string_utils.hpp"
+#include "thread.hpp"
+#include "thread_local.hpp"
 #include "unit_test.hpp"
 #include "variant_type.hpp"
 #include "variant_utils.hpp"
@@ -50,8 +52,9 @@
 #define STRICT_ASSERT(cond, s) if(!(cond)) { STRICT_ERROR(s); }
 
 namespace {
-	//the last formula that was executed; used for outputting debugging info.
-	const game_logic::formula* last_executed_formula;
+	//the last formula that was executed on this thread; used for outputting
+	//debugging info.
+	THREAD_LOCAL const game_logic::formula* last_executed_formula;
 
 	bool _verbatim_string_expressions = false;
 
@@ -62,6 +65,12 @@ namespace {
 		static std::set<game_logic::formula*>* instance = new std::set<game_logic::formula*>;
 		return *instance;
 	}
+
+	//formulae may be created and destroyed by threads evaluating FFL.
+	threading::mutex& all_formulae_mutex() {
+		static threading::mutex* instance = new threading::mutex;
+		return *instance;
+	}
 }
 
 std::string output_formula_error_info() {
@@ -82,6 +91,12 @@ namespace game_logic
 		_verbatim_string_expressions = verbatim;
 	}
 	
+	unsigned int new_lookup_shape()
+	{
+		static unsigned int next_shape = 0;
+		return ++next_shape;
+	}
+
 	void formula_callable::set_value(const std::string& key, const variant& /*value*/)
 	{
 		std::cerr << "ERROR: cannot set key '" << key << "' on object\n";
@@ -830,7 +845,7 @@ private:
 	}
 	
 	variant execute(const formula_callable& variables) const {
-		variant result = variables.query_value(id_);
+		variant result = variables.query_value_cached(id_, cache_);
 		if(result.is_null() && function_) {
 			return function_->evaluate(variables);
 		}
@@ -872,6 +887,11 @@ private:
 
 	//If this symbol is a function, this is the value we can return for it.
 	expression_ptr function_;
+
+	//how id_ resolved on the callables this expression last ran against.
+	//This is also the cache for 'x.id' since the right side of a dot
+	//evaluates as an identifier on the left side's callable.
+	mutable lookup_cache cache_;
 };
 
 class instantiate_generic_expression : public formula_expression {
@@ -997,22 +1017,32 @@ private:
 
 namespace {
 PREF_INT(max_ffl_recursion, 1000, "Maximum depth of FFL recursion");
-int function_recursion_depth = 0;
+THREAD_LOCAL int function_recursion_depth = 0;
 
 #define DEBUG_FULL_EXPRESSION_STACKS
 #ifdef DEBUG_FULL_EXPRESSION_STACKS
-std::vector<expression_ptr> g_expr_stack;
+//each thread evaluating FFL has its own stack, created on first use.
+THREAD_LOCAL std::vector<expression_ptr>* g_expr_stack;
+
+std::vector<expression_ptr>& expr_stack() {
+	if(g_expr_stack == NULL) {
+		g_expr_stack = new std::vector<expression_ptr>;
+		threading::delete_at_thread_exit(&g_expr_stack);
+	}
+
+	return *g_expr_stack;
+}
 #endif // DEBUG_FULL_EXPRESSION_STACKS
 
 std::string get_expression_stack() {
 	std::ostringstream s;
 #ifdef DEBUG_FULL_EXPRESSION_STACKS
-	s << "NUMBER OF FRAMES: " << g_expr_stack.size() << "\n";
-	for(expression_ptr e : g_expr_stack) {
+	s << "NUMBER OF FRAMES: " << expr_stack().size() << "\n";
+	for(expression_ptr e : expr_stack()) {
 		s << "  " << e->str() << " " << e->debug_pinpoint_location() << "\n";
 	}
 
-	s << "OUTPUT FRAMES: " << g_expr_stack.size() << "\n";
+	s << "OUTPUT FRAMES: " << expr_stack().size() << "\n";
 #endif // DEBUG_FULL_EXPRESSION_STACKS
 	return s.str();
 }
@@ -1020,7 +1050,7 @@ std::string get_expression_stack() {
 struct InfiniteRecursionProtector {
 	explicit InfiniteRecursionProtector(const expression_ptr& expr) {
 #ifdef DEBUG_FULL_EXPRESSION_STACKS
-		g_expr_stack.push_back(expr);
+		expr_stack().push_back(expr);
 #endif
 		++function_recursion_depth;
 		
@@ -1028,7 +1058,7 @@ struct InfiniteRecursionProtector {
 	}
 	~InfiniteRecursionProtector() {
 #ifdef DEBUG_FULL_EXPRESSION_STACKS
-		g_expr_stack.pop_back();
+		expr_stack().pop_back();
 #endif
 		--function_recursion_depth;
 	}
@@ -2610,7 +2640,7 @@ expression_ptr parse_expression_internal(const variant& formula_str, const token
 namespace {
 	
 	//only allow one static_formula_callable to be active at a time.
-	bool static_formula_callable_active = false;
+	THREAD_LOCAL bool static_formula_callable_active = false;
 	
 	//a special callable which will throw an exception if it's actually called.
 	//we use this to determine if an expression is static -- i.e. doesn't
@@ -2645,7 +2675,7 @@ namespace {
 	};
 }
 
-int in_static_context = 0;
+THREAD_LOCAL int in_static_context = 0;
 struct static_context {
 	static_context() { ++in_static_context; }
 	~static_context() { --in_static_context; }
@@ -3498,6 +3528,7 @@ formula::formula(const variant& val, function_symbol_table* symbols, const_formu
 	str_.add_formula_using_this(this);
 
 #ifndef NO_EDITOR
+	const threading::lock lock(all_formulae_mutex());
 	all_formulae().insert(this);
 #endif
 }
@@ -3631,6 +3662,7 @@ formula::~formula() {
 
 	str_.remove_formula_using_this(this);
 #ifndef NO_EDITOR
+	const threading::lock lock(all_formulae_mutex());
 	all_formulae().erase(this);
 #endif
 }
@@ -3696,7 +3728,7 @@ variant formula::execute(const formula_callable& variables) const
 	//
 	//Naturally if we throw an exception we DON'T want to restore the
 	//last_executed_formula since we want to report the error.
-	static int execution_stack = 0;
+	static THREAD_LOCAL int execution_stack = 0;
 	const formula* prev_executed = execution_stack ? last_executed_formula : NULL;
 	last_executed_formula = this;
 	try {
@@ -39,6 +39,52 @@ struct formula_input {
 
 class formula_callable_visitor;
 
+//An inline cache for one place in a formula that looks a name up by
+//string. It remembers how the name resolved on the last few kinds of
+//callable seen there, so the next lookup on a callable of the same
+//'shape' can go straight to the right storage. What a shape is, and
+//what kind and index mean, is up to the callable; shape 0 is never used.
+struct lookup_cache {
+	enum { NumEntries = 4 };
+
+	struct entry {
+		unsigned int shape;
+		int kind, index;
+		const void* data;
+	};
+
+	lookup_cache() : next(0) {
+		for(int n = 0; n != NumEntries; ++n) {
+			entries[n].shape = 0;
+		}
+	}
+
+	const entry* find(unsigned int shape) const {
+		for(int n = 0; n != NumEntries; ++n) {
+			if(entries[n].shape == shape) {
+				return &entries[n];
+			}
+		}
+
+		return NULL;
+	}
+
+	void insert(unsigned int shape, int kind, int index, const void* data=NULL) {
+		entry& e = entries[next];
+		next = (next + 1)%NumEntries;
+		e.shape = shape;
+		e.kind = kind;
+		e.index = index;
+		e.data = data;
+	}
+
+	entry entries[NumEntries];
+	int next;
+};
+
+//allocates a new shape id for use with lookup_cache.
+unsigned int new_lookup_shape();
+
 //interface for objects that can have formulae run on them
 class formula_callable : public reference_counted_object {
 public:
@@ -54,6 +100,15 @@ public:
 		return get_value(key);
 	}
 
+	//as query_value(), but lets the callable use and update an inline
+	//cache belonging to the call site.
+	variant query_value_cached(const std::string& key, lookup_cache& cache) const {
+		if(has_self_ && key == "self") {
+			return variant(this);
+		}
+		return get_value_cached(key, cache);
+	}
+
 	variant query_value_by_slot(int slot) const {
 		return get_value_by_slot(slot);
 	}
@@ -121,6 +176,9 @@ protected:
 private:
 	virtual variant get_value(const std::string& key) const = 0;
 	virtual variant get_value_by_slot(int slot) const;
+	virtual variant get_value_cached(const std::string& key, lookup_cache& cache) const {
+		return get_value(key);
+	}
 
 	virtual std::string get_object_id() const { return "formula_callable"; }
 
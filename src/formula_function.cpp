@@ -62,6 +62,8 @@
 #include "md5.hpp"
 #include "rectangle_rotator.hpp"
 #include "string_utils.hpp"
+#include "thread.hpp"
+#include "thread_local.hpp"
 #include "unit_test.hpp"
 #include "variant_callable.hpp"
 #include "controls.hpp"
@@ -586,6 +588,8 @@ FUNCTION_DEF(singleton, 1, 1, "singleton(string typename): create a singleton ob
 	variant type = args()[0]->evaluate(variables);
 
 	static std::map<variant, boost::intrusive_ptr<formula_object> > cache;
+	static threading::mutex cache_mutex;
+	const threading::lock lock(cache_mutex);
 	if(cache.count(type)) {
 		return variant(cache[type].get());
 	}
@@ -702,8 +706,15 @@ FUNCTION_DEF(eval_no_recover, 1, 2, "eval_no_recover(str, [arg]): evaluate the g
 
 	variant s = args()[0]->evaluate(variables);
 
-	static std::map<std::string, const_formula_ptr> cache;
-	const_formula_ptr& f = cache[s.as_string()];
+	//compiled formulae keep state while they run, so each thread compiles
+	//its own.
+	static THREAD_LOCAL std::map<std::string, const_formula_ptr>* cache;
+	if(cache == NULL) {
+		cache = new std::map<std::string, const_formula_ptr>;
+		threading::delete_at_thread_exit(&cache);
+	}
+
+	const_formula_ptr& f = (*cache)[s.as_string()];
 	if(!f) {
 		f = const_formula_ptr(formula::create_optional_formula(s));
 	}
@@ -730,10 +741,17 @@ FUNCTION_DEF(eval, 1, 2, "eval(str, [arg]): evaluate the given string as FFL")
 
 	variant s = args()[0]->evaluate(variables);
 	try {
-		static std::map<std::string, const_formula_ptr> cache;
+		//compiled formulae keep state while they run, so each thread
+		//compiles its own.
+		static THREAD_LOCAL std::map<std::string, const_formula_ptr>* cache;
+		if(cache == NULL) {
+			cache = new std::map<std::string, const_formula_ptr>;
+			threading::delete_at_thread_exit(&cache);
+		}
+
 		const assert_recover_scope recovery_scope;
 
-		const_formula_ptr& f = cache[s.as_string()];
+		const_formula_ptr& f = (*cache)[s.as_string()];
 		if(!f) {
 			f = const_formula_ptr(formula::create_optional_formula(s));
 		}
@@ -3251,12 +3269,17 @@ END_FUNCTION_DEF(unencode)
 class set_command : public game_logic::command_callable
 {
 public:
-	set_command(variant target, const std::string& attr, const variant& variant_attr, variant val)
-	  : target_(target), attr_(attr), variant_attr_(variant_attr), val_(val)
+	set_command(variant target, const std::string& attr, const variant& variant_attr, variant val, const write_type_proof* proof=NULL)
+	  : target_(target), attr_(attr), variant_attr_(variant_attr), val_(val), proof_(proof)
 	{}
 	virtual void execute(game_logic::formula_callable& ob) const {
 		if(target_.is_callable()) {
 			ASSERT_LOG(!attr_.empty(), "ILLEGAL KEY IN SET OF CALLABLE: " << val_.write_json());
+			if(proof_) {
+				const write_type_proof_scope proof_scope(*proof_, val_);
+				target_.mutable_callable()->mutate_value(attr_, val_);
+				return;
+			}
 			target_.mutable_callable()->mutate_value(attr_, val_);
 		} else if(target_.is_map()) {
 			if(!attr_.empty()) {
@@ -3274,6 +3297,7 @@ private:
 	std::string attr_;
 	variant variant_attr_;
 	variant val_;
+	const write_type_proof* proof_;
 };
 
 class add_command : public game_logic::command_callable
@@ -3308,11 +3332,12 @@ private:
 class set_by_slot_command : public game_logic::command_callable
 {
 public:
-	set_by_slot_command(int slot, const variant& value)
-	  : slot_(slot), value_(value)
+	set_by_slot_command(int slot, const variant& value, const write_type_proof& proof)
+	  : slot_(slot), value_(value), proof_(proof)
 	{}
 
 	virtual void execute(game_logic::formula_callable& obj) const {
+		const write_type_proof_scope proof_scope(proof_, value_);
 		obj.mutate_value_by_slot(slot_, value_);
 	}
 
@@ -3321,18 +3346,20 @@ public:
 private:
 	int slot_;
 	variant value_;
+	const write_type_proof& proof_;
 };
 
 class set_target_by_slot_command : public game_logic::command_callable
 {
 public:
-	set_target_by_slot_command(variant target, int slot, const variant& value)
-	  : target_(target.mutable_callable()), slot_(slot), value_(value)
+	set_target_by_slot_command(variant target, int slot, const variant& value, const write_type_proof& proof)
+	  : target_(target.mutable_callable()), slot_(slot), value_(value), proof_(proof)
 	{
 		ASSERT_LOG(target_.get(), "target of set is not a callable");
 	}
 
 	virtual void execute(game_logic::formula_callable& obj) const {
+		const write_type_proof_scope proof_scope(proof_, value_);
 		target_->mutate_value_by_slot(slot_, value_);
 	}
 
@@ -3342,6 +3369,7 @@ private:
 	game_logic::formula_callable_ptr target_;
 	int slot_;
 	variant value_;
+	const write_type_proof& proof_;
 };
 
 class add_target_by_slot_command : public game_logic::command_callable
@@ -3386,7 +3414,8 @@ private:
 class set_function : public function_expression {
 public:
 	set_function(const args_list& args, const_formula_callable_definition_ptr callable_def)
-	  : function_expression("set", args, 2, 3), me_slot_(-1), slot_(-1) {
+	  : function_expression("set", args, 2, 3), me_slot_(-1), slot_(-1),
+	    proof_(args.back()->query_variant_type()) {
 		if(args.size() == 2) {
 			variant literal;
 			args[0]->is_literal(literal);
@@ -3403,7 +3432,7 @@ public:
 				} else {
 					slot_ = callable_def->get_slot(key_);
 					if(slot_ != -1) {
-						cmd_ = boost::intrusive_ptr<set_by_slot_command>(new set_by_slot_command(slot_, variant()));
+						cmd_ = boost::intrusive_ptr<set_by_slot_command>(new set_by_slot_command(slot_, variant(), proof_));
 					}
 				}
 			}
@@ -3415,9 +3444,13 @@ private:
 		if(me_slot_ != -1) {
 			variant target = variables.query_value_by_slot(me_slot_);
 			if(slot_ != -1) {
-				return variant(new set_target_by_slot_command(target, slot_, args()[1]->evaluate(variables)));
+				set_target_by_slot_command* cmd = new set_target_by_slot_command(target, slot_, args()[1]->evaluate(variables), proof_);
+				cmd->set_expression(this);
+				return variant(cmd);
 			} else if(!key_.empty()) {
-				return variant(new set_command(target, key_, variant(), args()[1]->evaluate(variables)));
+				set_command* cmd = new set_command(target, key_, variant(), args()[1]->evaluate(variables), &proof_);
+				cmd->set_expression(this);
+				return variant(cmd);
 			}
 		} else if(slot_ != -1) {
 			if(cmd_->refcount() == 1) {
@@ -3426,7 +3459,7 @@ private:
 				return variant(cmd_.get());
 			}
 
-			cmd_ = boost::intrusive_ptr<set_by_slot_command>(new set_by_slot_command(slot_, args()[1]->evaluate(variables)));
+			cmd_ = boost::intrusive_ptr<set_by_slot_command>(new set_by_slot_command(slot_, args()[1]->evaluate(variables), proof_));
 			cmd_->set_expression(this);
 			return variant(cmd_.get());
 		}
@@ -3434,7 +3467,7 @@ private:
 		if(!key_.empty()) {
 			static const std::string MeKey = "me";
 			variant target = variables.query_value(MeKey);
-			set_command* cmd = new set_command(target, key_, variant(), args()[1]->evaluate(variables));
+			set_command* cmd = new set_command(target, key_, variant(), args()[1]->evaluate(variables), &proof_);
 			cmd->set_expression(this);
 			return variant(cmd);
 		}
@@ -3444,7 +3477,7 @@ private:
 			variant variant_member;
 			variant target = args()[0]->evaluate_with_member(variables, member, &variant_member);
 			set_command* cmd = new set_command(
-			  target, member, variant_member, args()[1]->evaluate(variables));
+			  target, member, variant_member, args()[1]->evaluate(variables), &proof_);
 			cmd->set_expression(this);
 			return variant(cmd);
 		}
@@ -3457,7 +3490,7 @@ private:
 		set_command* cmd = new set_command(
 		    target,
 		    args()[begin_index]->evaluate(variables).as_string(), variant(),
-			args()[begin_index + 1]->evaluate(variables));
+			args()[begin_index + 1]->evaluate(variables), &proof_);
 		cmd->set_expression(this);
 		return variant(cmd);
 	}
@@ -3481,6 +3514,10 @@ private:
 	std::string key_;
 	int me_slot_, slot_;
 	mutable boost::intrusive_ptr<set_by_slot_command> cmd_;
+
+	//the static type of the value written, which lets the target skip
+	//its runtime type check when the two are compatible.
+	write_type_proof proof_;
 };
 
 class add_function : public function_expression {
@@ -3650,11 +3687,18 @@ std::map<std::string, variant>& get_doc_cache() {
 	return cache;
 }
 
+//documents may be read and written by games processed in parallel.
+threading::mutex& get_doc_cache_mutex() {
+	static threading::mutex instance;
+	return instance;
+}
+
 PREF_BOOL(write_backed_maps, false, "Write to backed maps such as used in Citadel's evolutionary system");
 
 class backed_map : public game_logic::formula_callable {
 public:
 	static void flush_all() {
+		const threading::lock lock(all_backed_maps_mutex);
 		foreach(backed_map* m, all_backed_maps) {
 			m->write_file();
 		}
@@ -3663,7 +3707,10 @@ public:
 	backed_map(const std::string& docname, variant generator, variant m)
 	  : docname_(docname), generator_(generator)
 	{
-		all_backed_maps.insert(this);
+		{
+			const threading::lock lock(all_backed_maps_mutex);
+			all_backed_maps.insert(this);
+		}
 
 		if(m.is_map()) {
 			foreach(const variant::map_pair& p, m.as_map()) {
@@ -3700,6 +3747,7 @@ public:
 
 	~backed_map() {
 		write_file();
+		const threading::lock lock(all_backed_maps_mutex);
 		all_backed_maps.erase(this);
 	}
 private:
@@ -3765,9 +3813,11 @@ private:
 	std::map<std::string, NodeInfo> map_;
 	variant generator_;
 	static std::set<backed_map*> all_backed_maps;
+	static threading::mutex all_backed_maps_mutex;
 };
 
 std::set<backed_map*> backed_map::all_backed_maps;
+threading::mutex backed_map::all_backed_maps_mutex;
 } //namespace {
 
 void flush_all_backed_maps()
@@ -3831,7 +3881,10 @@ FUNCTION_DEF(write_document, 2, 2, "write_document(string filename, doc): writes
 	}
 
 	return variant(new fn_command_callable_arg([=](formula_callable* callable) {
-		get_doc_cache()[docname] = doc;
+		{
+			const threading::lock lock(get_doc_cache_mutex());
+			get_doc_cache()[docname] = doc;
+		}
 
 		std::string real_docname = preferences::user_data_path() + docname;
 		sys::write_file(real_docname, game_logic::serialize_doc_with_objects(doc));
@@ -3868,9 +3921,12 @@ FUNCTION_DEF(get_document, 1, 2, "get_document(string filename, [enum {'null_on_
 		}
 	}
 
-	variant& v = get_doc_cache()[docname];
-	if(v.is_null() == false) {
-		return v;
+	{
+		const threading::lock lock(get_doc_cache_mutex());
+		std::map<std::string, variant>::const_iterator itor = get_doc_cache().find(docname);
+		if(itor != get_doc_cache().end() && itor->second.is_null() == false) {
+			return itor->second;
+		}
 	}
 
 	ASSERT_LOG(std::adjacent_find(docname.begin(), docname.end(), consecutive_periods) == docname.end(), "DOCUMENT NAME CONTAINS ADJACENT PERIODS " << docname);
@@ -3906,6 +3962,7 @@ END_FUNCTION_DEF(get_document)
 
 void remove_formula_function_cached_doc(const std::string& name)
 {
+	const threading::lock lock(get_doc_cache_mutex());
 	get_doc_cache().erase(name);
 }
 
@@ -45,6 +45,8 @@ void invalidate_class_definition(const std::string& class_name);
 
 namespace {
 
+type_check_counter g_type_checks("formula_object");
+
 variant flatten_list_of_maps(variant v) {
 	if(v.is_list() && v.num_elements() >= 1) {
 		variant result = flatten_list_of_maps(v[0]);
@@ -72,9 +74,9 @@ public:
 boost::intrusive_ptr<const formula_class> get_class(const std::string& type);
 
 struct property_entry {
-	property_entry() : variable_slot(-1) {
+	property_entry() : variable_slot(-1), getter_type_proven(false) {
 	}
-	property_entry(const std::string& class_name, const std::string& prop_name, variant node, int& state_slot) : variable_slot(-1) {
+	property_entry(const std::string& class_name, const std::string& prop_name, variant node, int& state_slot) : variable_slot(-1), getter_type_proven(false) {
 		name = prop_name;
 
 		formula_callable_definition_ptr class_def = get_class_definition(class_name);
@@ -141,6 +143,11 @@ struct property_entry {
 			if(valid_types.is_null() == false) {
 				set_type = parse_variant_type(valid_types);
 			}
+
+			if(getter && get_type) {
+				const variant_type_ptr getter_type = getter->query_variant_type();
+				getter_type_proven = !getter_type->is_any() && variant_types_compatible(get_type, getter_type);
+			}
 		} else {
 			variable_slot = state_slot++;
 			default_value = node;
@@ -154,6 +161,10 @@ struct property_entry {
 	variant_type_ptr get_type, set_type;
 	int variable_slot;
 
+	//the getter's static type shows it always returns a get_type, so the
+	//value doesn't need to be checked after a write.
+	bool getter_type_proven;
+
 	variant default_value;
 };
 
@@ -1220,7 +1231,7 @@ void formula_object::set_value_by_slot(int slot, const variant& value)
 
 	const property_entry& entry = class_->slots()[slot];
 
-	if(entry.set_type) {
+	if(entry.set_type && g_type_checks.need_check(write_type_proven(value, entry.set_type))) {
 		if(!entry.set_type->match(value)) {
 			ASSERT_LOG(false, "ILLEGAL WRITE PROPERTY ACCESS: SETTING VARIABLE " << entry.name << " OF TYPE " << entry.set_type->to_string() << " IN CLASS " << class_->name() << " TO INVALID TYPE " << variant::variant_type_to_string(value.type()) << ": " << value.write_json());
 		}
@@ -1237,26 +1248,28 @@ void formula_object::set_value_by_slot(int slot, const variant& value)
 	}
 
 	if(entry.get_type && (entry.getter || entry.setter)) {
-		//now that we've set the value, retrieve it and ensure it matches
-		//the type we expect.
-		variant var;
-
 		formula_ptr override;
 		if(slot < property_overrides_.size()) {
 			override = property_overrides_[slot];
 		}
-		if(override) {
-			private_data_scope scope(&private_data_, entry.variable_slot);
-			var = override->execute(*this);
-		} else if(entry.getter) {
-			private_data_scope scope(&private_data_, entry.variable_slot);
-			var = entry.getter->execute(*this);
-		} else {
-			ASSERT_NE(entry.variable_slot, -1);
-			var = variables_[entry.variable_slot];
-		}
 
-		ASSERT_LOG(entry.get_type->match(var), "AFTER WRITE TO " << entry.name << " IN CLASS " << class_->name() << " TYPE IS INVALID. EXPECTED " << entry.get_type->str() << " BUT FOUND " << var.write_json());
+		//now that we've set the value, retrieve it and ensure it matches
+		//the type we expect, unless the getter can only return that type.
+		if(g_type_checks.need_check(!override && entry.getter_type_proven)) {
+			variant var;
+			if(override) {
+				private_data_scope scope(&private_data_, entry.variable_slot);
+				var = override->execute(*this);
+			} else if(entry.getter) {
+				private_data_scope scope(&private_data_, entry.variable_slot);
+				var = entry.getter->execute(*this);
+			} else {
+				ASSERT_NE(entry.variable_slot, -1);
+				var = variables_[entry.variable_slot];
+			}
+
+			ASSERT_LOG(entry.get_type->match(var), "AFTER WRITE TO " << entry.name << " IN CLASS " << class_->name() << " TYPE IS INVALID. EXPECTED " << entry.get_type->str() << " BUT FOUND " << var.write_json());
+		}
 	}
 }
 
@@ -38,6 +38,7 @@
 #include "foreach.hpp"
 #include "formatter.hpp"
 #include "formula_profiler.hpp"
+#include "string_utils.hpp"
 #include "object_events.hpp"
 #include "variant.hpp"
 
@@ -122,10 +123,204 @@ const size_t max_samples = 10000;
 
 int nframes_profiled = 0;
 
+//State for the folded stack sampler. The signal handler copies the
+//current stacks into these preallocated buffers, and pump() folds them
+//into folded_samples outside of the handler.
+bool sampling_on = false;
+std::string sampling_fname;
+
+struct StackSample {
+	int expr_begin, expr_depth;
+	int event_begin, event_depth;
+};
+
+const size_t max_stack_samples = 1024;
+const size_t max_stack_sample_frames = 65536;
+
+std::vector<StackSample> stack_samples;
+std::vector<const game_logic::formula_expression*> stack_sample_exprs;
+std::vector<custom_object_event_frame> stack_sample_events;
+size_t num_stack_samples = 0, num_stack_sample_exprs = 0, num_stack_sample_events = 0;
+int dropped_stack_samples = 0;
+
+struct FoldedFrame {
+	const game_logic::formula_expression* expression;
+	const custom_object_type* type;
+	int event_id;
+
+	bool operator<(const FoldedFrame& f) const {
+		return expression < f.expression || expression == f.expression && type < f.type ||
+		       expression == f.expression && type == f.type && event_id < f.event_id;
+	}
+};
+
+//each key holds one reference to each of its expressions.
+std::map<std::vector<FoldedFrame>, int> folded_samples;
+
+void record_stack_sample()
+{
+	//Called from the signal handler, so must not allocate memory.
+	const std::vector<CallStackEntry>& expr_stack = get_expression_call_stack();
+	if(num_stack_samples == max_stack_samples ||
+	   num_stack_sample_exprs + expr_stack.size() > max_stack_sample_frames ||
+	   num_stack_sample_events + event_call_stack.size() > max_stack_sample_frames) {
+		++dropped_stack_samples;
+		return;
+	}
+
+	for(int n = 0; n != expr_stack.size(); ++n) {
+		if(expr_stack[n].expression == NULL) {
+			return;
+		}
+	}
+
+	StackSample& sample = stack_samples[num_stack_samples++];
+	sample.expr_begin = num_stack_sample_exprs;
+	sample.expr_depth = expr_stack.size();
+	sample.event_begin = num_stack_sample_events;
+	sample.event_depth = event_call_stack.size();
+
+	for(int n = 0; n != expr_stack.size(); ++n) {
+		intrusive_ptr_add_ref(expr_stack[n].expression);
+		stack_sample_exprs[num_stack_sample_exprs++] = expr_stack[n].expression;
+	}
+
+	for(int n = 0; n != event_call_stack.size(); ++n) {
+		stack_sample_events[num_stack_sample_events++] = event_call_stack[n];
+	}
+}
+
+void fold_stack_samples()
+{
+	handler_disabled = true;
+
+	std::vector<FoldedFrame> key;
+	for(int n = 0; n != num_stack_samples; ++n) {
+		const StackSample& sample = stack_samples[n];
+		const game_logic::formula_expression* const* exprs = &stack_sample_exprs[sample.expr_begin];
+		const custom_object_event_frame* events = &stack_sample_events[sample.event_begin];
+
+		key.clear();
+		int nevent = 0;
+		for(int i = 0; i <= sample.expr_depth; ++i) {
+			while(nevent != sample.event_depth && events[nevent].expression_depth <= i) {
+				const FoldedFrame frame = { NULL, events[nevent].type, events[nevent].event_id };
+				key.push_back(frame);
+				++nevent;
+			}
+
+			if(i != sample.expr_depth) {
+				const FoldedFrame frame = { exprs[i], NULL, -1 };
+				key.push_back(frame);
+			}
+		}
+
+		int& count = folded_samples[key];
+		if(count++ > 0) {
+			//the key already holds references to these expressions.
+			for(int i = 0; i != sample.expr_depth; ++i) {
+				intrusive_ptr_release(exprs[i]);
+			}
+		}
+	}
+
+	num_stack_samples = num_stack_sample_exprs = num_stack_sample_events = 0;
+
+	handler_disabled = false;
+}
+
+std::string sanitize_frame_name(std::string s)
+{
+	for(std::string::iterator i = s.begin(); i != s.end(); ++i) {
+		if(*i == ';' || util::c_isspace(*i)) {
+			*i = '_';
+		}
+	}
+
+	return s;
+}
+
+std::string get_expression_frame_name(const game_logic::formula_expression* expr)
+{
+	const char* name = expr->name() ? expr->name() : "expr";
+	const variant parent = expr->parent_formula();
+	const variant::debug_info* info = parent.get_debug_info();
+	const std::pair<int,int> loc = expr->debug_loc_in_file();
+	if(info == NULL || info->filename == NULL || loc.first < 0 || !parent.is_string()) {
+		return sanitize_frame_name(formatter() << name << "@(unknown)");
+	}
+
+	const std::string& src = parent.as_string();
+	int line = info->line, column = info->column;
+	for(int n = 0; n < loc.first && n < src.size(); ++n) {
+		if(src[n] == '\n') {
+			++line;
+			column = 1;
+		} else {
+			++column;
+		}
+	}
+
+	return sanitize_frame_name(formatter() << name << "@" << *info->filename << ":" << line << ":" << column);
+}
+
+void write_folded_samples()
+{
+	fold_stack_samples();
+
+	std::map<const game_logic::formula_expression*, std::string> expr_names;
+
+	std::ostringstream s;
+	for(std::map<std::vector<FoldedFrame>, int>::const_iterator i = folded_samples.begin(); i != folded_samples.end(); ++i) {
+		if(i->first.empty()) {
+			s << "CORE_ENGINE";
+		}
+
+		for(int n = 0; n != i->first.size(); ++n) {
+			const FoldedFrame& frame = i->first[n];
+			if(n) {
+				s << ";";
+			}
+
+			if(frame.expression) {
+				std::string& name = expr_names[frame.expression];
+				if(name.empty()) {
+					name = get_expression_frame_name(frame.expression);
+				}
+
+				s << name;
+			} else {
+				s << sanitize_frame_name(frame.type->id() + ":" + get_object_event_str(frame.event_id));
+			}
+		}
+
+		s << " " << i->second << "\n";
+
+		foreach(const FoldedFrame& frame, i->first) {
+			if(frame.expression) {
+				intrusive_ptr_release(frame.expression);
+			}
+		}
+	}
+
+	folded_samples.clear();
+
+	if(dropped_stack_samples) {
+		std::cerr << "SAMPLING PROFILER DROPPED " << dropped_stack_samples << " SAMPLES\n";
+		dropped_stack_samples = 0;
+	}
+
+	sys::write_file(sampling_fname, s.str());
+	std::cerr << "WROTE FOLDED STACK PROFILE TO " << sampling_fname << "\n";
+}
+
 #if defined(_WINDOWS) || TARGET_OS_IPHONE
 SDL_TimerID sdl_profile_timer;
 #endif
 
+//number of profilers (the manager and the sampler) using the timer.
+int timer_users = 0;
+
 #if defined(_WINDOWS) || TARGET_OS_IPHONE
 Uint32 sdl_timer_callback(Uint32 interval, void *param)
 #else
@@ -144,6 +339,18 @@ void sigprof_handler(int sig)
 	}
 #endif
 
+	if(sampling_on) {
+		record_stack_sample();
+	}
+
+	if(!profiler_on) {
+#if defined(_WINDOWS) || TARGET_OS_IPHONE
+		return interval;
+#else
+		return;
+#endif
+	}
+
 	if(current_expression_call_stack.empty() && current_expression_call_stack.capacity() >= get_expression_call_stack().size()) {
 		bool valid = true;
 
@@ -184,6 +391,44 @@ void sigprof_handler(int sig)
 #endif
 }
 
+void start_timer(int interval_us)
+{
+	if(timer_users++ > 0) {
+		return;
+	}
+
+#if defined(_WINDOWS) || TARGET_OS_IPHONE
+	// Crappy windows approximation.
+	sdl_profile_timer = SDL_AddTimer(std::max(1, interval_us/1000), sdl_timer_callback, 0);
+	if(sdl_profile_timer == NULL) {
+		std::cerr << "Couldn't create a profiling timer!" << std::endl;
+	}
+#else
+	signal(SIGPROF, sigprof_handler);
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = interval_us/1000000;
+	timer.it_interval.tv_usec = interval_us%1000000;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, 0);
+#endif
+}
+
+void stop_timer()
+{
+	if(--timer_users > 0) {
+		return;
+	}
+
+#if defined(_WINDOWS) || TARGET_OS_IPHONE
+	SDL_RemoveTimer(sdl_profile_timer);
+#else
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, 0);
+#endif
+}
+
 }
 
 manager::manager(const char* output_file)
@@ -200,21 +445,7 @@ manager::manager(const char* output_file)
 
 		init_call_stack(65536);
 
-#if defined(_WINDOWS) || TARGET_OS_IPHONE
-		// Crappy windows approximation.
-		sdl_profile_timer = SDL_AddTimer(10, sdl_timer_callback, 0);
-		if(sdl_profile_timer == NULL) {
-			std::cerr << "Couldn't create a profiling timer!" << std::endl;
-		}
-#else
-		signal(SIGPROF, sigprof_handler);
-
-		struct itimerval timer;
-		timer.it_interval.tv_sec = 0;
-		timer.it_interval.tv_usec = 10000;
-		timer.it_value = timer.it_interval;
-		setitimer(ITIMER_PROF, &timer, 0);
-#endif
+		start_timer(10000);
 	}
 }
 
@@ -227,13 +458,7 @@ void end_profiling()
 {
 	fprintf(stderr, "END PROFILING: %d\n", (int)profiler_on);
 	if(profiler_on){
-#if defined(_WINDOWS) || TARGET_OS_IPHONE
-		SDL_RemoveTimer(sdl_profile_timer);
-#else
-		struct itimerval timer;
-		memset(&timer, 0, sizeof(timer));
-		setitimer(ITIMER_PROF, &timer, 0);
-#endif
+		stop_timer();
 
 		std::map<std::string, int> samples_map;
 
@@ -339,9 +564,49 @@ void pump()
 		current_expression_call_stack.clear();
 	}
 
+	if(num_stack_samples) {
+		fold_stack_samples();
+	}
+
 	++nframes_profiled;
 }
 
+void start_sampling(const std::string& output_file, int interval_us)
+{
+	if(sampling_on) {
+		stop_sampling();
+	}
+
+	stack_samples.resize(max_stack_samples);
+	stack_sample_exprs.resize(max_stack_sample_frames);
+	stack_sample_events.resize(max_stack_sample_frames);
+
+	main_thread = SDL_ThreadID();
+	init_call_stack(65536);
+	event_call_stack.reserve(1024);
+
+	sampling_fname = output_file;
+	sampling_on = true;
+	start_timer(interval_us);
+	std::cerr << "STARTED SAMPLING PROFILER: " << output_file << "\n";
+}
+
+void stop_sampling()
+{
+	if(!sampling_on) {
+		return;
+	}
+
+	stop_timer();
+	sampling_on = false;
+	write_folded_samples();
+}
+
+bool sampling_active()
+{
+	return sampling_on;
+}
+
 bool custom_object_event_frame::operator<(const custom_object_event_frame& f) const
 {
 	return type < f.type || type == f.type && event_id < f.event_id ||
@@ -49,6 +49,10 @@ class suspend_scope
 
 inline std::string get_profile_summary() { return ""; }
 
+inline void start_sampling(const std::string& output_file, int interval_us=1000) {}
+inline void stop_sampling() {}
+inline bool sampling_active() { return false; }
+
 }
 
 #else
@@ -87,6 +91,10 @@ struct custom_object_event_frame {
 	int event_id;
 	bool executing_commands;
 
+	//size of the FFL expression call stack when the event was fired. Used
+	//to interleave event frames with expression frames in stack samples.
+	int expression_depth;
+
 	bool operator<(const custom_object_event_frame& f) const;
 };
 
@@ -113,6 +121,16 @@ private:
 
 std::string get_profile_summary();
 
+//Sampling profiler which periodically snapshots the FFL expression call
+//stack along with the event call stack. When stopped it writes the samples
+//to output_file in the 'folded stacks' format, one stack per line with
+//frames separated by ';' followed by a sample count, which can be fed
+//directly to flamegraph.pl. May be started and stopped at any time, e.g.
+//from the debug console.
+void start_sampling(const std::string& output_file, int interval_us=1000);
+void stop_sampling();
+bool sampling_active();
+
 }
 
 #endif
@@ -20,6 +20,7 @@
 #include <iostream>
 
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/in_place_factory.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "asserts.hpp"
@@ -43,6 +44,7 @@
 #include "variant_utils.hpp"
 
 PREF_FLOAT(global_frame_scale, 2.0, "Sets the global frame scales for all frames in all animations");
+PREF_BOOL(palette_shader, false, "Apply color palettes to sprites in a shader rather than making a copy of the sprite sheet for each palette");
 
 namespace {
 
@@ -507,13 +509,77 @@ void frame::set_palettes(unsigned int palettes)
 	if(palettes == 0) {
 		if(current_palette_ != -1) {
 			texture_ = graphics::texture::get(image_);
+			palette_map_ = graphics::texture();
 			current_palette_ = -1;
 		}
 		return;
 	}
 
-	texture_ = graphics::texture::get_palette_mapped(image_, npalette);
 	current_palette_ = npalette;
+	palette_map_ = graphics::texture();
+
+	if(g_palette_shader) {
+		graphics::texture indexed = graphics::texture::get_palette_indexed(image_, &palette_map_);
+		if(indexed.valid() && palette_map_.valid()) {
+			texture_ = indexed;
+			const GLfloat ncolors = palette_map_.width();
+			const GLfloat nrows = palette_map_.height();
+			palette_index_[0] = palette_map_.translate_coord_x(1.0f/ncolors);
+			palette_index_[1] = palette_map_.translate_coord_y((npalette + 1.5f)/nrows);
+			return;
+		}
+
+		palette_map_ = graphics::texture();
+	}
+
+	texture_ = graphics::texture::get_palette_mapped(image_, npalette);
+}
+
+void frame::resolve_palette_texture() const
+{
+	if(palette_map_.valid()) {
+		texture_ = graphics::texture::get_palette_mapped(image_, current_palette_);
+		palette_map_ = graphics::texture();
+	}
+}
+
+namespace {
+//the palette uniforms of the palette shader's program, looked up once
+//rather than on every draw.
+struct palette_uniforms {
+	gles2::program_ptr program;
+	gles2::actives_map_iterator palette_map, palette_index;
+};
+
+palette_uniforms g_palette_uniforms;
+}
+
+void frame::begin_palette_draw(boost::optional<gles2::manager>& shader) const
+{
+	if(!palette_map_.valid()) {
+		return;
+	}
+
+	//objects with shaders of their own get a palette mapped copy.
+	if(gles2::active_shader() != gles2::get_tex_shader() || !gles2::get_palette_shader()) {
+		resolve_palette_texture();
+		return;
+	}
+
+	shader = boost::in_place(gles2::get_palette_shader());
+	gles2::program_ptr prog = gles2::active_shader()->shader();
+	if(g_palette_uniforms.program != prog) {
+		g_palette_uniforms.palette_map = prog->get_uniform_reference("u_anura_palette_map");
+		g_palette_uniforms.palette_index = prog->get_uniform_reference("u_anura_palette_index");
+		g_palette_uniforms.program = prog;
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, palette_map_.get_id());
+	glActiveTexture(GL_TEXTURE0);
+
+	prog->set_uniform(g_palette_uniforms.palette_map, variant(1));
+	prog->set_uniform(g_palette_uniforms.palette_index, 1, palette_index_);
 }
 
 void frame::set_color_palette(unsigned int palettes)
@@ -729,6 +795,7 @@ std::vector<bool>::const_iterator frame::get_alpha_itor(int x, int y, int time,
 
 void frame::draw_into_blit_queue(graphics::blit_queue& blit, int x, int y, bool face_right, bool upside_down, int time) const
 {
+	resolve_palette_texture();
 	const frame_info* info = NULL;
 	GLfloat rect[4];
 	get_rect_in_texture(time, &rect[0], info);
@@ -754,6 +821,9 @@ void frame::draw_into_blit_queue(graphics::blit_queue& blit, int x, int y, bool
 
 void frame::draw(int x, int y, bool face_right, bool upside_down, int time, GLfloat rotate) const
 {
+	boost::optional<gles2::manager> palette_shader;
+	begin_palette_draw(palette_shader);
+
 	const frame_info* info = NULL;
 	GLfloat rect[4];
 	get_rect_in_texture(time, &rect[0], info);
@@ -778,6 +848,9 @@ void frame::draw(int x, int y, bool face_right, bool upside_down, int time, GLfl
 
 void frame::draw(int x, int y, bool face_right, bool upside_down, int time, GLfloat rotate, GLfloat scale) const
 {
+	boost::optional<gles2::manager> palette_shader;
+	begin_palette_draw(palette_shader);
+
 	const frame_info* info = NULL;
 	GLfloat rect[4];
 	get_rect_in_texture(time, &rect[0], info);
@@ -808,6 +881,9 @@ void frame::draw(int x, int y, bool face_right, bool upside_down, int time, GLfl
 
 void frame::draw(int x, int y, const rect& area, bool face_right, bool upside_down, int time, GLfloat rotate) const
 {
+	boost::optional<gles2::manager> palette_shader;
+	begin_palette_draw(palette_shader);
+
 	const frame_info* info = NULL;
 	GLfloat rect[4];
 	get_rect_in_texture(time, &rect[0], info);
@@ -898,6 +974,7 @@ void frame::draw3(int time, GLint va, GLint tc) const
 
 void frame::draw_custom(int x, int y, const std::vector<CustomPoint>& points, const rect* area, bool face_right, bool upside_down, int time, GLfloat rotate) const
 {
+	resolve_palette_texture();
 	texture_.set_as_current_texture();
 
 	const frame_info* info = NULL;
@@ -1023,6 +1100,7 @@ PREF_BOOL(debug_custom_draw, false, "Show debug visualization of custom drawing"
 
 void frame::draw_custom(int x, int y, const GLfloat* xy, const GLfloat* uv, int nelements, bool face_right, bool upside_down, int time, GLfloat rotate, int cycle) const
 {
+	resolve_palette_texture();
 	texture_.set_as_current_texture();
 
 	const frame_info* info = NULL;
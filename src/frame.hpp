@@ -18,6 +18,7 @@
 #define FRAME_HPP_INCLUDED
 
 #include <boost/array.hpp>
+#include <boost/optional.hpp>
 
 #include <string>
 #include <vector>
@@ -34,6 +35,10 @@ namespace graphics {
 class blit_queue;
 }
 
+namespace gles2 {
+struct manager;
+}
+
 class frame : public game_logic::formula_callable
 {
 public:
@@ -110,7 +115,7 @@ public:
 	int height() const { return img_rect_.h()*scale_; }
 	int duration() const;
 	bool hit(int time_in_frame) const;
-	const graphics::texture& img() const { return texture_; }
+	const graphics::texture& img() const { resolve_palette_texture(); return texture_; }
 	const rect& area() const { return img_rect_; }
 	int num_frames() const { return nframes_; }
 	int num_frames_per_row() const { return nframes_per_row_ > 0 && nframes_per_row_ < nframes_ ? nframes_per_row_ : nframes_; }
@@ -155,7 +160,7 @@ private:
 
 	//ID's used to signal events that occur on this animation.
 	int enter_event_id_, end_event_id_, leave_event_id_, process_event_id_;
-	graphics::texture texture_;
+	mutable graphics::texture texture_;
 	const_solid_info_ptr solid_;
 	rect collide_rect_;
 	rect hit_rect_;
@@ -198,6 +203,19 @@ private:
 	std::vector<int> palettes_recognized_;
 	int current_palette_;
 
+	//set when the current palette is applied by a shader. texture_ then
+	//holds palette indexes and palette_map_ the colors they stand for.
+	mutable graphics::texture palette_map_;
+	GLfloat palette_index_[2];
+
+	//makes texture_ hold the colors of the current palette, for drawing
+	//which can't use the palette shader.
+	void resolve_palette_texture() const;
+
+	//switches to the palette shader, by constructing 'shader', if the
+	//palette can be applied by it, otherwise resolves the texture.
+	void begin_palette_draw(boost::optional<gles2::manager>& shader) const;
+
 	struct pivot_schedule {
 		std::string name;
 		std::vector<point> points;
@@ -74,6 +74,14 @@ namespace KRE
 			return it->second;
 		}
 
+		FT_Face open_font_face(const std::string& path, int index)
+		{
+			FT_Face face;
+			FT_Error error = FT_New_Face(get_freetype_library(), path.c_str(), index, &face);
+			ASSERT_LOG(error == 0, "Could not load font face: " << path << " error: " << error);
+			return face;
+		}
+
 		std::vector<unsigned> get_glyphs_from_string(FT_Face face, const std::string& utf8)
 		{
 			std::vector<unsigned> res;
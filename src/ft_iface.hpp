@@ -35,6 +35,9 @@ namespace KRE
 	{
 		// Get a font face from a file.
 		FT_Face get_font_face(const std::string& font_file, int index=0);
+		// Open a new, uncached face from a font file path. The caller owns the
+		// face and must release it with FT_Done_Face.
+		FT_Face open_font_face(const std::string& path, int index=0);
 		// convert a utf8 encoding strings into a series of glyph indicies in the font face.
 		std::vector<unsigned> get_glyphs_from_string(FT_Face face, const std::string& utf8);
 	}
@@ -352,7 +352,32 @@ namespace {
         "    },\n"
 		"}\n";
 
+	//draws an image stored as palette indexes. The index in the red (low
+	//byte) and green (high byte) channels picks a column of the palette
+	//map; u_anura_palette_index holds the width of a column and the row of
+	//the palette in texture coordinates.
+	const std::string fs_palette = 
+		"uniform sampler2D u_tex_map;\n"
+		"uniform sampler2D u_anura_palette_map;\n"
+		"uniform vec2 u_anura_palette_index;\n"
+		"uniform vec4 u_color;\n"
+		"uniform bool u_anura_discard;\n"
+		"varying vec2 v_texcoord;\n"
+		"void main()\n"
+		"{\n"
+		"	vec4 texel = texture2D(u_tex_map, v_texcoord);\n"
+		"	float index = floor(texel.r*255.0 + 0.5) + floor(texel.g*255.0 + 0.5)*256.0;\n"
+		"	gl_FragColor = texture2D(u_anura_palette_map, vec2((index + 0.5)*u_anura_palette_index.x, u_anura_palette_index.y)) * u_color;\n"
+		"	if(u_anura_discard && gl_FragColor[3] == 0.0) { discard; }\n"
+		"}\n";
+	const std::string palette_shader_info = 
+		"{\"shader\": {\n"
+        "    \"program\": \"palette_shader\",\n"
+		"    \"create\": \"[set(uniforms.u_tex_map, 0), set(uniforms.u_anura_palette_map, 1)]\",\n"
+		"}}\n";
+
 	static gles2::shader_program_ptr tex_shader_program;
+	static gles2::shader_program_ptr palette_shader_program;
 	static gles2::shader_program_ptr texcol_shader_program;
 	static gles2::shader_program_ptr simple_shader_program;
 	static gles2::shader_program_ptr simple_col_shader_program;
@@ -453,6 +478,11 @@ namespace gles2 {
 		return tex_shader_program;
 	}
 
+	shader_program_ptr get_palette_shader()
+	{
+		return palette_shader_program;
+	}
+
 	shader_program_ptr get_texcol_shader()
 	{
 		return texcol_shader_program;
@@ -557,6 +587,13 @@ namespace gles2 {
 		tex_shader_program->configure(json::parse(tex_shader_info)["shader"]);
 		tex_shader_program->init(0);
 
+		gles2::shader v_palette(GL_VERTEX_SHADER, "palette_vertex_shader", variant(vs_tex));
+		gles2::shader f_palette(GL_FRAGMENT_SHADER, "palette_fragment_shader", variant(fs_palette));
+		fixed_program::add_shader("palette_shader", v_palette, f_palette, ts["attributes"], ts["uniforms"]);
+		palette_shader_program.reset(new shader_program());
+		palette_shader_program->configure(json::parse(palette_shader_info)["shader"]);
+		palette_shader_program->init(0);
+
 		gles2::shader v_texcol(GL_VERTEX_SHADER, "texcol_vertex_shader", variant(vs_texcol));
 		gles2::shader f_texcol(GL_FRAGMENT_SHADER, "texcol_fragment_shader", variant(fs_texcol));
 		variant tcs = json::parse(texcol_attribute_info);
@@ -117,6 +117,8 @@ namespace gles2 {
 	typedef boost::intrusive_ptr<const fixed_program> const_fixed_program_ptr;
 
 	shader_program_ptr get_tex_shader();
+	//like the tex shader, but for images stored as palette indexes.
+	shader_program_ptr get_palette_shader();
 	shader_program_ptr get_texcol_shader();
 	shader_program_ptr get_simple_shader();
 	shader_program_ptr get_simple_col_shader();
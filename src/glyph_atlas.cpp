@@ -0,0 +1,331 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <iostream>
+
+#include "asserts.hpp"
+#include "font.hpp"
+#include "glyph_atlas.hpp"
+#include "raster.hpp"
+#include "texture.hpp"
+#include "unit_test.hpp"
+#include "utf8_to_codepoint.hpp"
+
+namespace font {
+
+namespace {
+typedef std::map<std::pair<std::string, int>, glyph_atlas*> atlas_map;
+atlas_map& atlases()
+{
+	static atlas_map* instance = new atlas_map;
+	return *instance;
+}
+
+//the fewest glyphs an atlas should be able to hold at once.
+const int MinAtlasCells = 256;
+const int MaxAtlasSize = 2048;
+
+void add_quad(graphics::blit_queue* queue, int x, int y, int w, int h, GLfloat u1, GLfloat v1, GLfloat u2, GLfloat v2)
+{
+	//quads share one triangle strip, joined by degenerate triangles.
+	if(!queue->empty()) {
+		queue->repeat_last();
+		queue->add(x, y, u1, v1);
+	}
+
+	queue->add(x, y, u1, v1);
+	queue->add(x + w, y, u2, v1);
+	queue->add(x, y + h, u1, v2);
+	queue->add(x + w, y + h, u2, v2);
+}
+}
+
+glyph_atlas& glyph_atlas::get(int size, const std::string& font_name)
+{
+	const std::pair<std::string, int> key(get_font_file(font_name), size);
+	glyph_atlas*& atlas = atlases()[key];
+	if(atlas == NULL) {
+		atlas = new glyph_atlas(key.first, size);
+	}
+
+	return *atlas;
+}
+
+void glyph_atlas::clear_all()
+{
+	for(atlas_map::iterator i = atlases().begin(); i != atlases().end(); ++i) {
+		delete i->second;
+	}
+
+	atlases().clear();
+}
+
+glyph_atlas::glyph_atlas(const std::string& font_file, int size)
+  : face_(KRE::FT::open_font_face(font_file)), texture_id_(0),
+    generation_(0), epoch_(0)
+{
+	FT_Set_Pixel_Sizes(face_, 0, size);
+	const FT_Size_Metrics& metrics = face_->size->metrics;
+	ascender_ = (metrics.ascender + 63) >> 6;
+	line_height_ = (metrics.ascender - metrics.descender + 63) >> 6;
+
+	//a pixel of padding around each cell keeps glyphs from bleeding into
+	//their neighbors. Glyphs wider than the cells are clipped.
+	cell_width_ = std::min<int>(metrics.max_advance >> 6, size*2) + 2;
+	cell_height_ = line_height_ + 2;
+
+	texture_size_ = 256;
+	while(texture_size_ < MaxAtlasSize && (texture_size_/cell_width_)*(texture_size_/cell_height_) < MinAtlasCells) {
+		texture_size_ *= 2;
+	}
+
+	cells_per_row_ = texture_size_/cell_width_;
+	ncells_ = cells_per_row_*(texture_size_/cell_height_);
+	ASSERT_LOG(ncells_ > 0, "FONT " << font_file << " AT SIZE " << size << " IS TOO LARGE FOR A GLYPH ATLAS");
+
+	for(int n = ncells_ - 1; n >= 0; --n) {
+		free_cells_.push_back(n);
+	}
+
+	pixels_.resize(texture_size_*texture_size_*4);
+	for(int n = 0; n < pixels_.size(); n += 4) {
+		pixels_[n] = pixels_[n+1] = pixels_[n+2] = 0xFF;
+		pixels_[n+3] = 0;
+	}
+
+	dirty_begin_ = texture_size_;
+	dirty_end_ = 0;
+}
+
+glyph_atlas::~glyph_atlas()
+{
+	if(texture_id_) {
+		glDeleteTextures(1, &texture_id_);
+	}
+
+	FT_Done_Face(face_);
+}
+
+bool glyph_atlas::allocate_cell(int* cell)
+{
+	if(!free_cells_.empty()) {
+		*cell = free_cells_.back();
+		free_cells_.pop_back();
+		return true;
+	}
+
+	//take the cell of the glyph which has gone longest without being
+	//drawn. Glyphs laid out since the last draw may still be waiting in
+	//a queue, so they can't be taken.
+	std::map<char32_t, glyph>::iterator lru = glyphs_.end();
+	for(std::map<char32_t, glyph>::iterator i = glyphs_.begin(); i != glyphs_.end(); ++i) {
+		if(i->second.cell >= 0 && i->second.last_used < generation_ &&
+		   (lru == glyphs_.end() || i->second.last_used < lru->second.last_used)) {
+			lru = i;
+		}
+	}
+
+	if(lru == glyphs_.end()) {
+		return false;
+	}
+
+	*cell = lru->second.cell;
+	glyphs_.erase(lru);
+	++epoch_;
+	return true;
+}
+
+const glyph_atlas::glyph* glyph_atlas::get_glyph(char32_t codepoint)
+{
+	std::map<char32_t, glyph>::iterator itor = glyphs_.find(codepoint);
+	if(itor != glyphs_.end()) {
+		itor->second.last_used = generation_;
+		return &itor->second;
+	}
+
+	glyph g;
+	g.index = FT_Get_Char_Index(face_, codepoint);
+	g.cell = -1;
+	g.left = g.top = g.width = g.height = g.advance = 0;
+	g.last_used = generation_;
+
+	if(FT_Load_Glyph(face_, g.index, FT_LOAD_RENDER) != 0) {
+		std::cerr << "COULD NOT RENDER GLYPH " << int(codepoint) << "\n";
+		return &(glyphs_[codepoint] = g);
+	}
+
+	const FT_GlyphSlot slot = face_->glyph;
+	const FT_Bitmap& bitmap = slot->bitmap;
+	g.advance = (slot->advance.x + 32) >> 6;
+	g.left = slot->bitmap_left;
+	g.top = slot->bitmap_top;
+	g.width = std::min<int>(bitmap.width, cell_width_ - 2);
+	g.height = std::min<int>(bitmap.rows, cell_height_ - 2);
+
+	if(g.width > 0 && g.height > 0) {
+		if(!allocate_cell(&g.cell)) {
+			return NULL;
+		}
+
+		const int cell_x = (g.cell%cells_per_row_)*cell_width_;
+		const int cell_y = (g.cell/cells_per_row_)*cell_height_;
+
+		//clear the whole cell, since it may have held a larger glyph.
+		for(int y = 0; y != cell_height_; ++y) {
+			unsigned char* dst = &pixels_[((cell_y + y)*texture_size_ + cell_x)*4];
+			for(int x = 0; x != cell_width_; ++x) {
+				dst[x*4 + 3] = 0;
+			}
+		}
+
+		for(int y = 0; y != g.height; ++y) {
+			const unsigned char* src = bitmap.buffer + y*bitmap.pitch;
+			unsigned char* dst = &pixels_[((cell_y + 1 + y)*texture_size_ + cell_x + 1)*4];
+			for(int x = 0; x != g.width; ++x) {
+				if(bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+					dst[x*4 + 3] = (src[x >> 3] & (0x80 >> (x&7))) ? 0xFF : 0;
+				} else {
+					dst[x*4 + 3] = src[x];
+				}
+			}
+		}
+
+		dirty_begin_ = std::min(dirty_begin_, cell_y);
+		dirty_end_ = std::max(dirty_end_, cell_y + cell_height_);
+	}
+
+	return &(glyphs_[codepoint] = g);
+}
+
+bool glyph_atlas::layout(const std::string& text, int x, int y, graphics::blit_queue* queue, rect* area)
+{
+	const bool use_kerning = FT_HAS_KERNING(face_) != 0;
+	const GLfloat texel = 1.0f/texture_size_;
+
+	int pen_x = 0, pen_y = 0, width = 0;
+	unsigned int prev_index = 0;
+	for(char32_t codepoint : utils::utf8_to_codepoint(text)) {
+		if(codepoint == '\n') {
+			pen_x = 0;
+			pen_y += line_height_;
+			prev_index = 0;
+			continue;
+		}
+
+		const glyph* g = get_glyph(codepoint);
+		if(g == NULL) {
+			return false;
+		}
+
+		if(use_kerning && prev_index && g->index) {
+			FT_Vector delta;
+			FT_Get_Kerning(face_, prev_index, g->index, FT_KERNING_DEFAULT, &delta);
+			pen_x += delta.x >> 6;
+		}
+
+		if(queue && g->cell >= 0) {
+			const int u = (g->cell%cells_per_row_)*cell_width_ + 1;
+			const int v = (g->cell/cells_per_row_)*cell_height_ + 1;
+			add_quad(queue, x + pen_x + g->left, y + pen_y + ascender_ - g->top, g->width, g->height,
+			         u*texel, v*texel, (u + g->width)*texel, (v + g->height)*texel);
+		}
+
+		pen_x += g->advance;
+		width = std::max(width, pen_x);
+		prev_index = g->index;
+	}
+
+	if(area) {
+		*area = rect(x, y, width, pen_y + line_height_);
+	}
+
+	return true;
+}
+
+void glyph_atlas::prepare_draw()
+{
+	if(texture_id_ == 0) {
+		glGenTextures(1, &texture_id_);
+		graphics::texture::set_current_texture(texture_id_);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_size_, texture_size_, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels_[0]);
+	} else if(dirty_begin_ < dirty_end_) {
+		//only the rows holding new glyphs are sent.
+		graphics::texture::set_current_texture(texture_id_);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty_begin_, texture_size_, dirty_end_ - dirty_begin_,
+		                GL_RGBA, GL_UNSIGNED_BYTE, &pixels_[dirty_begin_*texture_size_*4]);
+	}
+
+	dirty_begin_ = texture_size_;
+	dirty_end_ = 0;
+	++generation_;
+}
+
+rect draw_text(const std::string& text, const SDL_Color& color, int size, int x, int y, const std::string& font_name)
+{
+	glyph_atlas& atlas = glyph_atlas::get(size, font_name);
+
+	graphics::blit_queue queue;
+	rect area;
+	if(!atlas.layout(text, x, y, &queue, &area)) {
+		graphics::texture t = render_text(text, color, size, font_name);
+		graphics::blit_texture(t, x, y);
+		return rect(x, y, t.width(), t.height());
+	}
+
+	atlas.prepare_draw();
+	queue.set_texture(atlas.texture_id());
+
+	glColor4ub(color.r, color.g, color.b, 255);
+	queue.do_blit();
+	glColor4ub(255, 255, 255, 255);
+	return area;
+}
+
+UNIT_TEST(glyph_atlas_layout)
+{
+	glyph_atlas& atlas = glyph_atlas::get(14);
+
+	rect line, lines;
+	CHECK(atlas.layout("AVAV", 10, 20, NULL, &line), "could not lay out text");
+	CHECK_EQ(line.x(), 10);
+	CHECK_EQ(line.y(), 20);
+	CHECK_EQ(line.h(), atlas.line_height());
+	CHECK(line.w() > 0, "text has no width");
+
+	CHECK(atlas.layout("AVAV\nAV", 0, 0, NULL, &lines), "could not lay out text");
+	CHECK_EQ(lines.w(), line.w());
+	CHECK_EQ(lines.h(), atlas.line_height()*2);
+
+	//a two byte utf-8 sequence is one glyph, so it lays out in one quad.
+	graphics::blit_queue queue;
+	CHECK(atlas.layout("\xc3\xa9", 0, 0, &queue, NULL), "could not lay out text");
+	CHECK_EQ(queue.size(), 8);
+}
+
+BENCHMARK(glyph_atlas_layout)
+{
+	glyph_atlas& atlas = glyph_atlas::get(14);
+	graphics::blit_queue queue;
+	BENCHMARK_LOOP {
+		queue.clear();
+		atlas.layout("Score: 1234567890", 0, 0, &queue, NULL);
+	}
+}
+
+}
@@ -0,0 +1,112 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GLYPH_ATLAS_HPP_INCLUDED
+#define GLYPH_ATLAS_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ft_iface.hpp"
+#include "geometry.hpp"
+#include "graphics.hpp"
+
+namespace graphics {
+class blit_queue;
+}
+
+namespace font {
+
+//A texture holding the glyphs of one font at one size. Glyphs are
+//rendered with FreeType the first time they are needed, into a grid of
+//equally sized cells, and when the grid is full the glyph which has gone
+//longest without being drawn gives up its cell. Text is drawn as a batch
+//of quads from the atlas, so changing text only costs building vertices
+//rather than rendering and uploading a new texture.
+class glyph_atlas
+{
+public:
+	static glyph_atlas& get(int size, const std::string& font_name="");
+
+	//destroys all atlases. Called when fonts are shut down.
+	static void clear_all();
+
+	~glyph_atlas();
+
+	//lays utf-8 text out with its top left corner at (x,y), adding a quad
+	//per glyph to 'queue' if it is given. The queue must be drawn with
+	//texture_id() as its texture, set after prepare_draw(). Lines are split
+	//on '\n'. The area covered is stored in 'area' if it is given. Returns
+	//false if the text needs more distinct glyphs than the atlas can hold
+	//at once.
+	bool layout(const std::string& text, int x, int y, graphics::blit_queue* queue, rect* area=NULL);
+
+	//uploads newly rendered glyphs. Must be called before drawing quads
+	//from the atlas. Glyphs laid out since the previous call can't be
+	//evicted until this is called.
+	void prepare_draw();
+
+	//incremented whenever a glyph is evicted, so quads laid out earlier
+	//may refer to a cell which now holds a different glyph.
+	int epoch() const { return epoch_; }
+
+	int line_height() const { return line_height_; }
+	GLuint texture_id() const { return texture_id_; }
+
+	//the number of glyphs which can be held at once.
+	int capacity() const { return ncells_; }
+
+private:
+	glyph_atlas(const std::string& font_file, int size);
+	glyph_atlas(const glyph_atlas&);
+	void operator=(const glyph_atlas&);
+
+	struct glyph {
+		unsigned int index;
+		int cell;
+		int left, top, width, height;
+		int advance;
+		int last_used;
+	};
+
+	const glyph* get_glyph(char32_t codepoint);
+	bool allocate_cell(int* cell);
+
+	FT_Face face_;
+	int ascender_, line_height_;
+
+	int cell_width_, cell_height_, cells_per_row_, ncells_;
+	int texture_size_;
+	GLuint texture_id_;
+
+	//the texture's pixels: white, with the glyph coverage as alpha.
+	std::vector<unsigned char> pixels_;
+	int dirty_begin_, dirty_end_;
+
+	std::map<char32_t, glyph> glyphs_;
+	std::vector<int> free_cells_;
+
+	int generation_, epoch_;
+};
+
+//draws text from the atlas of the given font and size, falling back to
+//render_text() if it doesn't fit. Returns the area drawn.
+rect draw_text(const std::string& text, const SDL_Color& color, int size, int x, int y, const std::string& font_name="");
+
+}
+
+#endif
@@ -36,7 +36,8 @@ grid::grid(int ncols)
 	selected_row_(-1), allow_selection_(false), must_select_(false),
     swallow_clicks_(false), hpad_(0), vpad_(0), show_background_(false),
 	max_height_(-1), allow_highlight_(true), set_h_(0), set_w_(0),
-	default_selection_(-1), draw_selection_highlight_(false)
+	default_selection_(-1), draw_selection_highlight_(false),
+	first_row_(0), virtual_rows_(0), overscan_(0)
 {
 	set_environment();
 	set_dim(0,0);
@@ -48,7 +49,8 @@ grid::grid(const variant& v, game_logic::formula_callable* e)
     swallow_clicks_(false), hpad_(0), vpad_(0), show_background_(false),
 	max_height_(-1), allow_highlight_(true), set_h_(0), set_w_(0),
 	default_selection_(v["default_select"].as_int(-1)), 
-	draw_selection_highlight_(v["draw_selection_highlighted"].as_bool(false))
+	draw_selection_highlight_(v["draw_selection_highlighted"].as_bool(false)),
+	first_row_(0), virtual_rows_(0), overscan_(0)
 {
 	ASSERT_LOG(get_environment() != 0, "You must specify a callable environment");
 	if(v.has_key("on_select")) {
@@ -220,6 +222,7 @@ void grid::handle_process()
 void grid::add_row(const std::vector<widget_ptr>& widgets)
 {
 	assert(widgets.size() == ncols_);
+	ASSERT_LOG(!row_provider_, "Rows can't be added to a virtual grid");
 	int index = 0;
 	foreach(const widget_ptr& widget, widgets) {
 		cells_.push_back(widget);
@@ -238,6 +241,18 @@ void grid::add_row(const std::vector<widget_ptr>& widgets)
 	recalculate_dimensions();
 }
 
+void grid::set_virtual_rows(int nrows, row_provider provider, int row_height, int overscan)
+{
+	ASSERT_LOG(row_height > 0, "A virtual grid needs a row height");
+	cells_.clear();
+	first_row_ = 0;
+	row_provider_ = provider;
+	virtual_rows_ = nrows;
+	row_height_ = row_height;
+	overscan_ = overscan;
+	recalculate_dimensions();
+}
+
 grid& grid::add_col(const std::string& str) {
 	return add_col(widget_ptr(new label(str, graphics::color_white())));
 }
@@ -285,6 +300,8 @@ grid& grid::set_hpad(int pad)
 void grid::reset_contents(const variant& v)
 {
 	cells_.clear();
+	first_row_ = 0;
+	row_provider_ = row_provider();
 	if(v.is_null()) {
 		return;
 	}
@@ -335,13 +352,9 @@ int grid::row_at(int xpos, int ypos) const
 
 void grid::recalculate_dimensions()
 {
+	invalidate();
 	visible_cells_.clear();
 
-	int w = 0;
-	foreach(int width, col_widths_) {
-		w += width;
-	}
-
 	int desired_height = row_height_*nrows();
 	set_virtual_height(desired_height);
 	set_scroll_step(1);
@@ -354,14 +367,24 @@ void grid::recalculate_dimensions()
 	//	}
 	}
 
+	if(row_provider_) {
+		update_virtual_rows(set_h_ ? set_h_ : desired_height);
+	}
+
+	int w = 0;
+	foreach(int width, col_widths_) {
+		w += width;
+	}
+
 	if(set_h_ != 0 || set_w_ != 0) {
 		widget::set_dim(set_w_ ? set_w_ : w, set_h_ ? set_h_ : desired_height);
 	} else {
 		widget::set_dim(w, desired_height);
 	}
 
-	int y = 0;
-	for(int n = 0; n != nrows(); ++n) {
+	const int rows = cells_.size()/ncols_;
+	int y = first_row_*row_height_;
+	for(int n = 0; n != rows; ++n) {
 		int x = 0;
 		for(int m = 0; m != ncols_; ++m) {
 			int align = 0;
@@ -384,7 +407,6 @@ void grid::recalculate_dimensions()
 					visible_cells_.push_back(widget);
 					widget->set_clip_area(rect(0, 0, width(), height()));
 				}
-				std::sort(visible_cells_.begin(), visible_cells_.end(), widget_sort_zorder());
 			}
 
 			x += col_widths_[m];
@@ -393,9 +415,61 @@ void grid::recalculate_dimensions()
 		y += row_height_;
 	}
 
+	std::sort(visible_cells_.begin(), visible_cells_.end(), widget_sort_zorder());
+
 	update_scrollbar();
 }
 
+void grid::update_virtual_rows(int visible_height)
+{
+	const int begin = std::max(0, std::min(virtual_rows_, yscroll()/row_height_ - overscan_));
+	const int end = std::max(begin, std::min(virtual_rows_, (yscroll() + visible_height)/row_height_ + 1 + overscan_));
+	const int old_begin = first_row_, old_end = first_row_ + cells_.size()/ncols_;
+	if(begin == old_begin && end == old_end) {
+		return;
+	}
+
+	//rows which have gone out of range give their widgets to the rows
+	//coming into range.
+	std::vector<int> spare_rows;
+	for(int row = old_begin; row < old_end; ++row) {
+		if(row < begin || row >= end) {
+			spare_rows.push_back(row);
+		}
+	}
+
+	std::vector<widget_ptr> cells, row_cells;
+	cells.reserve((end - begin)*ncols_);
+	for(int row = begin; row < end; ++row) {
+		if(row >= old_begin && row < old_end) {
+			const std::vector<widget_ptr>::const_iterator i = cells_.begin() + (row - old_begin)*ncols_;
+			cells.insert(cells.end(), i, i + ncols_);
+			continue;
+		}
+
+		row_cells.clear();
+		if(!spare_rows.empty()) {
+			const std::vector<widget_ptr>::const_iterator i = cells_.begin() + (spare_rows.back() - old_begin)*ncols_;
+			row_cells.assign(i, i + ncols_);
+			spare_rows.pop_back();
+		}
+
+		row_provider_(row, &row_cells);
+		ASSERT_LOG(row_cells.size() == ncols_, "Grid row provider gave " << row_cells.size() << " cells for a row of " << ncols_);
+
+		for(int m = 0; m != ncols_; ++m) {
+			if(row_cells[m] && row_cells[m]->width()+hpad_ > col_widths_[m]) {
+				col_widths_[m] = row_cells[m]->width()+hpad_;
+			}
+		}
+
+		cells.insert(cells.end(), row_cells.begin(), row_cells.end());
+	}
+
+	cells_.swap(cells);
+	first_row_ = begin;
+}
+
 void grid::visit_values(game_logic::formula_callable_visitor& visitor)
 {
 	foreach(widget_ptr& cell, cells_) {
@@ -460,6 +534,16 @@ void grid::handle_draw() const
 	scrollable_widget::handle_draw();
 }
 
+unsigned int grid::render_state() const
+{
+	unsigned int state = scrollable_widget::render_state();
+	state = state*31 + (allow_highlight_ ? selected_row_ + 1 : 0);
+	state = state*31 + (draw_selection_highlight_ ? default_selection_ + 1 : 0);
+	state = state*31 + show_background_;
+	state = state*31 + header_rows_.size();
+	return state;
+}
+
 bool grid::handle_event(const SDL_Event& event, bool claimed)
 {
 	claimed = scrollable_widget::handle_event(event, claimed);
@@ -45,6 +45,18 @@ public:
 	virtual void set_dim(int w, int h);
 	void add_row(const std::vector<widget_ptr>& widgets);
 
+	//fills 'cells' with the widgets of a row of a virtual grid. If a row has
+	//scrolled out of view 'cells' holds its widgets, which may be reused;
+	//otherwise it is empty.
+	typedef boost::function<void (int row, std::vector<widget_ptr>* cells)> row_provider;
+
+	//makes the grid hold 'nrows' rows of 'row_height', whose widgets are
+	//only created by 'provider' while the row is in view or within
+	//'overscan' rows of it. Columns don't know the width of rows which
+	//haven't been created, so their widths should be set up front; they
+	//still grow to fit the rows which are created.
+	void set_virtual_rows(int nrows, row_provider provider, int row_height, int overscan=4);
+
 	grid& add_col(const std::string& str);
 	grid& add_col(const widget_ptr& widget=widget_ptr());
 
@@ -84,17 +96,28 @@ protected:
 	virtual void handle_draw() const;
 	virtual void handle_process();
 
+	virtual bool is_render_cacheable() const { return true; }
+	virtual unsigned int render_state() const;
+
 private:
 	DECLARE_CALLABLE(grid);
 
 	int row_at(int x, int y) const;
 	void recalculate_dimensions();
+	void update_virtual_rows(int visible_height);
 
 	void visit_values(game_logic::formula_callable_visitor& visitor);
 
-	int nrows() const { return cells_.size()/ncols_; }
+	int nrows() const { return row_provider_ ? virtual_rows_ : cells_.size()/ncols_; }
 	int ncols_;
+
+	//the cells of the rows which exist, starting at first_row_. Only a
+	//virtual grid has rows which don't exist.
 	std::vector<widget_ptr> cells_;
+	int first_row_;
+	row_provider row_provider_;
+	int virtual_rows_, overscan_;
+
 	std::vector<widget_ptr> visible_cells_;
 	std::vector<int> col_widths_;
 	std::vector<COLUMN_ALIGN> col_aligns_;
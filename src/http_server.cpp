@@ -18,10 +18,16 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/bind.hpp>
 #include <deque>
+#include <exception>
 #include <iostream>
+#include <string.h>
 
 #if !defined(_WINDOWS)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 #endif
 
 #include "asserts.hpp"
@@ -31,6 +37,7 @@
 #include "json_parser.hpp"
 #include "http_server.hpp"
 #include "string_utils.hpp"
+#include "thread.hpp"
 #include "utils.hpp"
 #include "unit_test.hpp"
 #include "variant.hpp"
@@ -39,8 +46,185 @@ using boost::asio::ip::tcp;
 
 namespace http {
 
-web_server::web_server(boost::asio::io_service& io_service, int port)
-  : acceptor_(io_service, tcp::endpoint(tcp::v4(), port))
+namespace {
+
+class string_chunk : public response_chunk
+{
+public:
+	explicit string_chunk(std::string& str) { str_.swap(str); }
+	const char* data() const { return str_.c_str(); }
+	size_t size() const { return str_.size(); }
+private:
+	std::string str_;
+};
+
+class static_string_chunk : public response_chunk
+{
+public:
+	explicit static_string_chunk(const char* str) : str_(str), size_(strlen(str)) {}
+	const char* data() const { return str_; }
+	size_t size() const { return size_; }
+private:
+	const char* str_;
+	size_t size_;
+};
+
+#if !defined(_WINDOWS)
+class mapped_file_chunk : public response_chunk
+{
+public:
+	mapped_file_chunk(int fd, size_t size) : data_(NULL), size_(size)
+	{
+		if(size_ > 0) {
+			void* p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(p != MAP_FAILED) {
+				data_ = p;
+			}
+		}
+	}
+
+	~mapped_file_chunk()
+	{
+		if(data_) {
+			munmap(data_, size_);
+		}
+	}
+
+	bool valid() const { return data_ != NULL || size_ == 0; }
+
+	const char* data() const { return reinterpret_cast<const char*>(data_); }
+	size_t size() const { return size_; }
+private:
+	void* data_;
+	size_t size_;
+};
+#endif
+
+struct cached_file {
+	cached_file() : inode(0), mod_time(0), size(0) {}
+	response_chunk_ptr chunk;
+	int64_t inode, mod_time, size;
+};
+
+std::map<std::string, cached_file> file_cache;
+
+//servers on different strands may serve files at the same time.
+threading::mutex file_cache_mutex;
+
+}
+
+response_chunk_ptr make_response_chunk(std::string& str)
+{
+	return response_chunk_ptr(new string_chunk(str));
+}
+
+response_chunk_ptr make_response_chunk(const char* str)
+{
+	return response_chunk_ptr(new static_string_chunk(str));
+}
+
+response_chunk_ptr get_cached_file(const std::string& fname)
+{
+	const threading::lock lock(file_cache_mutex);
+
+#if !defined(_WINDOWS)
+	const int fd = open(fname.c_str(), O_RDONLY);
+	if(fd < 0) {
+		file_cache.erase(fname);
+		return response_chunk_ptr();
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		return response_chunk_ptr();
+	}
+
+	//the file has been replaced if it's a different inode or it has been
+	//touched since we mapped it.
+	cached_file& entry = file_cache[fname];
+	if(entry.chunk && entry.inode == st.st_ino && entry.mod_time == st.st_mtime && entry.size == st.st_size) {
+		close(fd);
+		return entry.chunk;
+	}
+
+	boost::shared_ptr<mapped_file_chunk> chunk(new mapped_file_chunk(fd, st.st_size));
+	close(fd);
+
+	if(!chunk->valid()) {
+		file_cache.erase(fname);
+		return response_chunk_ptr();
+	}
+
+	entry.chunk = chunk;
+	entry.inode = st.st_ino;
+	entry.mod_time = st.st_mtime;
+	entry.size = st.st_size;
+	return entry.chunk;
+#else
+	if(!sys::file_exists(fname)) {
+		file_cache.erase(fname);
+		return response_chunk_ptr();
+	}
+
+	const int64_t mod_time = sys::file_mod_time(fname);
+	cached_file& entry = file_cache[fname];
+	if(entry.chunk && entry.mod_time == mod_time) {
+		return entry.chunk;
+	}
+
+	std::string contents = sys::read_file(fname);
+	entry.chunk = make_response_chunk(contents);
+	entry.mod_time = mod_time;
+	entry.size = entry.chunk->size();
+	return entry.chunk;
+#endif
+}
+
+void invalidate_cached_file(const std::string& fname)
+{
+	const threading::lock lock(file_cache_mutex);
+	file_cache.erase(fname);
+}
+
+void run_io_service(boost::asio::io_service& io_service, int nthreads)
+{
+	std::exception_ptr error;
+	threading::mutex error_mutex;
+
+	const auto run = [&io_service, &error, &error_mutex]() {
+		try {
+			io_service.run();
+		} catch(...) {
+			{
+				threading::lock l(error_mutex);
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
+			io_service.stop();
+		}
+	};
+
+	std::vector<boost::shared_ptr<threading::thread> > threads;
+	for(int n = 1; n < nthreads; ++n) {
+		threads.push_back(boost::shared_ptr<threading::thread>(new threading::thread("io_service", run)));
+	}
+
+	run();
+
+	threads.clear();
+
+	if(error) {
+		io_service.reset();
+		std::rethrow_exception(error);
+	}
+}
+
+web_server::web_server(boost::asio::io_service& io_service, int port, boost::asio::io_service::strand* strand)
+  : acceptor_(io_service, tcp::endpoint(tcp::v4(), port)),
+    owned_strand_(strand ? NULL : new boost::asio::io_service::strand(io_service)),
+    strand_(strand ? strand : owned_strand_.get())
 {
 	start_accept();
 }
@@ -53,11 +237,18 @@ web_server::~web_server()
 void web_server::start_accept()
 {
 	socket_ptr socket(new tcp::socket(acceptor_.get_io_service()));
-	acceptor_.async_accept(*socket, boost::bind(&web_server::handle_accept, this, socket, boost::asio::placeholders::error));
+	acceptor_.async_accept(*socket, strand_->wrap(boost::bind(&web_server::handle_accept, this, socket, boost::asio::placeholders::error)));
 }
 
 namespace {
 int nconnections = 0;
+
+//the most data we buffer for a request before its headers are complete.
+const size_t max_header_size = 64*1024;
+
+//how long a connection may go without sending a request or being sent a
+//response before it is closed.
+const int idle_timeout_seconds = 30;
 }
 
 void web_server::handle_accept(socket_ptr socket, const boost::system::error_code& error)
@@ -67,16 +258,51 @@ void web_server::handle_accept(socket_ptr socket, const boost::system::error_cod
 		return;
 	}
 
-	start_receive(socket);
+	++nconnections;
+
+	receive_buf_ptr recv_buf(new receive_buf(acceptor_.get_io_service()));
+	connections_[socket] = recv_buf;
+
+	start_idle_timer(socket, recv_buf);
+	start_receive(socket, recv_buf);
 	start_accept();
 }
 
-void web_server::start_receive(socket_ptr socket, receive_buf_ptr recv_buf)
+void web_server::start_idle_timer(socket_ptr socket, receive_buf_ptr recv_buf)
 {
-	if(!recv_buf) {
-		recv_buf.reset(new receive_buf);
+	recv_buf->nactivity_checked = recv_buf->nactivity;
+	recv_buf->idle_timer.expires_from_now(boost::posix_time::seconds(idle_timeout_seconds));
+	recv_buf->idle_timer.async_wait(strand_->wrap(boost::bind(&web_server::handle_idle_timeout, this, socket, recv_buf, boost::asio::placeholders::error)));
+}
+
+void web_server::handle_idle_timeout(socket_ptr socket, receive_buf_ptr recv_buf, const boost::system::error_code& error)
+{
+	if(error == boost::asio::error::operation_aborted) {
+		return;
+	}
+
+	std::map<socket_ptr, receive_buf_ptr>::iterator itor = connections_.find(socket);
+	if(itor == connections_.end() || itor->second != recv_buf) {
+		return;
 	}
 
+	if(socket->is_open() == false) {
+		//closed by other code holding the socket.
+		connections_.erase(itor);
+		return;
+	}
+
+	//a request being handled, such as a long poll, isn't idle.
+	if(recv_buf->responding || recv_buf->nactivity != recv_buf->nactivity_checked) {
+		start_idle_timer(socket, recv_buf);
+		return;
+	}
+
+	disconnect(socket);
+}
+
+void web_server::start_receive(socket_ptr socket, receive_buf_ptr recv_buf)
+{
 	buffer_ptr buf(new boost::array<char, 64*1024>);
 	socket->async_read_some(boost::asio::buffer(*buf), boost::bind(&web_server::handle_receive, this, socket, buf, _1, _2, recv_buf));
 }
@@ -87,32 +313,26 @@ void web_server::handle_receive(socket_ptr socket, buffer_ptr buf,
 	receive_buf_ptr recv_buf)
 {
 	if(e) {
-		//TODO: handle error
-		std::cerr << "SOCKET ERROR: " << e.message() << "\n";
-		disconnect(socket);
+		if(e != boost::asio::error::eof) {
+			std::cerr << "SOCKET ERROR: " << e.message() << "\n";
+		}
+		strand_->dispatch(boost::bind(&web_server::handle_receive_error, this, socket));
 		return;
 	}
 
+	++recv_buf->nactivity;
 	handle_incoming_data(socket, &(*buf)[0], &(*buf)[0] + nbytes, recv_buf);
 }
 
-void web_server::handle_incoming_data(socket_ptr socket, const char* i1, const char* i2, receive_buf_ptr recv_buf)
+void web_server::handle_receive_error(socket_ptr socket)
 {
-	recv_buf->msg += std::string(i1, i2);
-	fprintf(stderr, "HANDLE INCOMING: %d / %d\n", (int)recv_buf->msg.size(), (int)recv_buf->wanted);
-
-	if(recv_buf->wanted > 0 && recv_buf->msg.size() < recv_buf->wanted) {
-		start_receive(socket, recv_buf);
-		return;
-	}
-
-	timeval before, after;
-	gettimeofday(&before, NULL);
-	handle_message(socket, recv_buf);
-	gettimeofday(&after, NULL);
+	disconnect(socket);
+}
 
-	const int ms = (after.tv_sec - before.tv_sec)*1000 + (after.tv_usec - before.tv_usec)/1000;
-	std::cerr << "handle_incoming_data time: " << ms << "ms\n";
+void web_server::handle_incoming_data(socket_ptr socket, const char* i1, const char* i2, receive_buf_ptr recv_buf)
+{
+	recv_buf->msg.append(i1, i2);
+	process_requests(socket, recv_buf);
 }
 
 namespace {
@@ -150,7 +370,7 @@ std::map<std::string, std::string> parse_env(const std::string& str)
 	std::map<std::string, std::string> env;
 	std::vector<std::string> lines = util::split(str, '\n');
 	foreach(const std::string& line, lines) {
-		if(line.empty()) {
+		if(line.empty() || line == "\r") {
 			break;
 		}
 
@@ -169,62 +389,98 @@ std::map<std::string, std::string> parse_env(const std::string& str)
 	return env;
 }
 
+//finds the end of the headers of the request at the start of msg,
+//returning the offset of the body or std::string::npos if the headers
+//are incomplete.
+size_t find_header_end(const std::string& msg)
+{
+	const size_t crlf = msg.find("\r\n\r\n");
+	const size_t lf = msg.find("\n\n");
+	if(crlf != std::string::npos && (lf == std::string::npos || crlf < lf)) {
+		return crlf + 4;
+	} else if(lf != std::string::npos) {
+		return lf + 2;
+	}
+
+	return std::string::npos;
 }
 
-void web_server::handle_message(socket_ptr socket, receive_buf_ptr recv_buf)
+//whether the connection should persist after responding to the request.
+//HTTP/1.1 connections persist unless the client sends Connection: close
+//while HTTP/1.0 clients must ask for keep-alive.
+bool request_keep_alive(const std::string& msg, environment& env)
 {
-	const std::string& msg = recv_buf->msg;
-	if(msg.size() < 16) {
-		std::cerr << "CLOSESOCKB\n";
-		disconnect(socket);
-		return;
+	const std::string::const_iterator end_line = std::find(msg.begin(), msg.end(), '\n');
+	const bool http11 = std::search(msg.begin(), end_line, "HTTP/1.1", "HTTP/1.1" + 8) != end_line;
+
+	std::string connection = env["connection"];
+	std::transform(connection.begin(), connection.end(), connection.begin(), tolower);
+	if(http11) {
+		return connection.find("close") == std::string::npos;
+	} else {
+		return connection.find("keep-alive") != std::string::npos;
 	}
+}
 
-	if(std::equal(msg.begin(), msg.begin()+5, "POST ")) {
+}
 
-		environment env = parse_env(msg);
-		const int content_length = atoi(env["content-length"].c_str());
-		fprintf(stderr, "PARSE content-length: %d\n", content_length);
+void web_server::process_requests(socket_ptr socket, receive_buf_ptr recv_buf)
+{
+	if(recv_buf->responding) {
+		//a pipelined request: wait until the current response is sent.
+		return;
+	}
 
-		const char* payload = NULL;
-		const char* payload1 = strstr(msg.c_str(), "\n\n");
-		const char* payload2 = strstr(msg.c_str(), "\r\n\r\n");
-		if(payload1) {
-			payload1 += 2;
-			payload = payload1;
+	std::string& msg = recv_buf->msg;
+	const size_t header_len = find_header_end(msg);
+	if(header_len == std::string::npos) {
+		if(msg.size() > max_header_size) {
+			std::cerr << "CLOSESOCKB\n";
+			strand_->dispatch(boost::bind(&web_server::disconnect, this, socket));
+			return;
 		}
 
-		if(payload2 && (!payload1 || payload2 < payload1)) {
-			payload2 += 4;
-			payload = payload2;
-		}
+		start_receive(socket, recv_buf);
+		return;
+	}
 
-		const int payload_len = payload ? (msg.c_str() + msg.size() - payload) : 0;
+	environment env = parse_env(msg.substr(0, header_len));
+	const int content_length = std::max(0, atoi(env["content-length"].c_str()));
+	if(msg.size() < header_len + content_length) {
+		start_receive(socket, recv_buf);
+		return;
+	}
 
-		fprintf(stderr, "PAYLOAD LEN: %d < %d\n", payload_len, content_length);
-		if(!payload || payload_len < content_length) {
-			if(payload_len) {
-				recv_buf->wanted = msg.size() + (content_length - payload_len);
-			}
-			start_receive(socket, recv_buf);
-			return;
-		}
+	const std::string request(msg, 0, header_len + content_length);
+	msg.erase(0, header_len + content_length);
 
-		variant doc;
+	recv_buf->keep_alive = request_keep_alive(request, env);
+	recv_buf->responding = true;
 
-		try {
-			doc = parse_message(std::string(payload, payload + payload_len));
-		} catch(json::parse_error& e) {
-			std::cerr << "ERROR PARSING JSON: " << e.error_message() << "\n";
-			sys::write_file("./error_payload2.txt", std::string(payload));
-		} catch(...) {
-			std::cerr << "UNKNOWN ERROR PARSING JSON\n";
-		}
+	timeval before, after;
+	gettimeofday(&before, NULL);
+	handle_message(socket, request, header_len);
+	gettimeofday(&after, NULL);
 
-		if(!doc.is_null()) {
-			handle_post(socket, doc, env);
-			return;
-		}
+	const int ms = (after.tv_sec - before.tv_sec)*1000 + (after.tv_usec - before.tv_usec)/1000;
+	std::cerr << "handle_incoming_data time: " << ms << "ms\n";
+}
+
+void web_server::handle_message(socket_ptr socket, const std::string& msg, size_t header_len)
+{
+	if(msg.size() < 16) {
+		std::cerr << "CLOSESOCKB\n";
+		strand_->dispatch(boost::bind(&web_server::disconnect, this, socket));
+		return;
+	}
+
+	if(std::equal(msg.begin(), msg.begin()+5, "POST ")) {
+
+		//the body is parsed on the strand since variants may only be
+		//used by one thread at a time.
+		const environment env = parse_env(msg.substr(0, header_len));
+		strand_->dispatch(boost::bind(&web_server::handle_post_body, this, socket, msg.substr(header_len), env));
+		return;
 	} else if(std::equal(msg.begin(), msg.begin()+4, "GET ")) {
 		std::string::const_iterator begin_url = msg.begin() + 4;
 		std::string::const_iterator end_url = std::find(begin_url, msg.end(), ' ');
@@ -253,19 +509,52 @@ void web_server::handle_message(socket_ptr socket, receive_buf_ptr recv_buf)
 			}
 		}
 
-		handle_get(socket, url_base, args);
+		strand_->dispatch(boost::bind(&web_server::handle_get, this, socket, url_base, args));
 
 		return;
 	}
 
-	disconnect(socket);
+	strand_->dispatch(boost::bind(&web_server::disconnect, this, socket));
 }
 
-void web_server::handle_send(socket_ptr socket, const boost::system::error_code& e, size_t nbytes, size_t max_bytes, boost::shared_ptr<std::string> buf)
+void web_server::handle_post_body(socket_ptr socket, const std::string& body, const environment& env)
 {
-	if(nbytes == max_bytes || e) {
+	variant doc;
+
+	try {
+		doc = parse_message(body);
+	} catch(json::parse_error& e) {
+		std::cerr << "ERROR PARSING JSON: " << e.error_message() << "\n";
+		sys::write_file("./error_payload2.txt", body);
+	} catch(...) {
+		std::cerr << "UNKNOWN ERROR PARSING JSON\n";
+	}
+
+	if(doc.is_null()) {
 		disconnect(socket);
+		return;
+	}
+
+	handle_post(socket, doc, env);
+}
+
+void web_server::handle_send(socket_ptr socket, const boost::system::error_code& e, size_t nbytes, size_t max_bytes, boost::shared_ptr<std::string> header, std::vector<response_chunk_ptr> body, bool keep_alive)
+{
+	if(e || nbytes != max_bytes || !keep_alive) {
+		disconnect(socket);
+		return;
+	}
+
+	std::map<socket_ptr, receive_buf_ptr>::iterator itor = connections_.find(socket);
+	if(itor == connections_.end()) {
+		return;
 	}
+
+	//the response is complete so move on to any pipelined request.
+	receive_buf_ptr recv_buf = itor->second;
+	++recv_buf->nactivity;
+	recv_buf->responding = false;
+	process_requests(socket, recv_buf);
 }
 
 void web_server::disconnect_socket(socket_ptr socket)
@@ -276,30 +565,69 @@ void web_server::disconnect_socket(socket_ptr socket)
 
 void web_server::disconnect(socket_ptr socket)
 {
-	disconnect_socket(socket);
+	std::map<socket_ptr, receive_buf_ptr>::iterator itor = connections_.find(socket);
+	if(itor == connections_.end()) {
+		socket->close();
+		return;
+	}
+
+	itor->second->idle_timer.cancel();
+	connections_.erase(itor);
+
+	//the socket may already have been closed, and counted, by other code
+	//holding it.
+	if(socket->is_open()) {
+		disconnect_socket(socket);
+	}
+}
+
+bool web_server::keep_alive(socket_ptr socket) const
+{
+	std::map<socket_ptr, receive_buf_ptr>::const_iterator itor = connections_.find(socket);
+	return itor != connections_.end() && itor->second->keep_alive;
 }
 
 void web_server::send_msg(socket_ptr socket, const std::string& type, const std::string& msg, const std::string& header_parms)
 {
-    std::stringstream buf;
+	std::string body(msg);
+	send_msg(socket, type, std::vector<response_chunk_ptr>(1, make_response_chunk(body)), header_parms);
+}
+
+void web_server::send_msg(socket_ptr socket, const std::string& type, const std::vector<response_chunk_ptr>& body, const std::string& header_parms)
+{
+	const bool persist = keep_alive(socket);
+
+	size_t content_length = 0;
+	foreach(const response_chunk_ptr& chunk, body) {
+		content_length += chunk->size();
+	}
+
+	std::stringstream buf;
 	buf <<
 		"HTTP/1.1 200 OK\r\n"
 		"Date: " << get_http_datetime() << "\r\n"
-		"Connection: close\r\n"
+		"Connection: " << (persist ? "keep-alive" : "close") << "\r\n"
 		"Server: Wizard/1.0\r\n"
 		"Accept-Ranges: bytes\r\n"
 		"Access-Control-Allow-Origin: *\r\n"
 		"Content-Type: " << type << "\r\n"
-		"Content-Length: " << std::dec << (int)msg.size() << "\r\n"
+		"Content-Length: " << std::dec << content_length << "\r\n"
 		"Last-Modified: " << get_http_datetime() << "\r\n" <<
         (header_parms.empty() ? "" : header_parms + "\r\n")
         << "\r\n";
 
-	boost::shared_ptr<std::string> str(new std::string(buf.str()));
-	*str += msg;
+	boost::shared_ptr<std::string> header(new std::string(buf.str()));
 
-	boost::asio::async_write(*socket, boost::asio::buffer(*str),
-	                         boost::bind(&web_server::handle_send, this, socket, _1, _2, str->size(), str));
+	//write the header and body as a scatter-gather list.
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.reserve(body.size() + 1);
+	buffers.push_back(boost::asio::buffer(*header));
+	foreach(const response_chunk_ptr& chunk, body) {
+		buffers.push_back(boost::asio::buffer(chunk->data(), chunk->size()));
+	}
+
+	boost::asio::async_write(*socket, buffers,
+	                         strand_->wrap(boost::bind(&web_server::handle_send, this, socket, _1, _2, header->size() + content_length, header, body, persist)));
 }
 
 void web_server::send_404(socket_ptr socket)
@@ -314,7 +642,7 @@ void web_server::send_404(socket_ptr socket)
 		"\r\n";
 	boost::shared_ptr<std::string> str(new std::string(buf.str()));
 	boost::asio::async_write(*socket, boost::asio::buffer(*str),
-                boost::bind(&web_server::handle_send, this, socket, _1, _2, str->size(), str));
+                strand_->wrap(boost::bind(&web_server::handle_send, this, socket, _1, _2, str->size(), str, std::vector<response_chunk_ptr>(), false)));
 }
 
 variant web_server::parse_message(const std::string& msg) const
@@ -322,4 +650,168 @@ variant web_server::parse_message(const std::string& msg) const
 	return json::parse(msg, json::JSON_NO_PREPROCESSOR);
 }
 
+namespace {
+
+//A connection used by the http_load_test utility. It keeps up to
+//'pipeline' requests in flight on the connection, timing each one.
+struct load_test_connection {
+	load_test_connection(boost::asio::io_service& service, const std::string& req, int pipeline_depth, int nrequests, std::vector<int>* latencies_out)
+	  : socket(service), request(req), pipeline(pipeline_depth), remaining(nrequests), latencies(latencies_out)
+	{}
+
+	tcp::socket socket;
+	std::string request;
+	int pipeline, remaining;
+	std::deque<timeval> sent;
+	std::string response;
+	boost::array<char, 64*1024> read_buf;
+	std::vector<int>* latencies;
+};
+
+typedef boost::shared_ptr<load_test_connection> load_test_connection_ptr;
+
+void load_test_receive(load_test_connection_ptr conn);
+
+void load_test_send(load_test_connection_ptr conn)
+{
+	boost::shared_ptr<std::string> buf(new std::string);
+	while(conn->remaining > 0 && conn->sent.size() < conn->pipeline) {
+		timeval tv;
+		gettimeofday(&tv, NULL);
+		conn->sent.push_back(tv);
+		*buf += conn->request;
+		--conn->remaining;
+	}
+
+	if(buf->empty() == false) {
+		boost::asio::async_write(conn->socket, boost::asio::buffer(*buf), [conn, buf](const boost::system::error_code& e, size_t nbytes) {
+			ASSERT_LOG(!e, "Error sending request: " << e.message());
+		});
+	}
+}
+
+void load_test_handle_receive(load_test_connection_ptr conn, const boost::system::error_code& e, size_t nbytes)
+{
+	ASSERT_LOG(!e, "Error receiving response: " << e.message());
+	conn->response.append(&conn->read_buf[0], &conn->read_buf[0] + nbytes);
+
+	for(;;) {
+		const size_t header_len = find_header_end(conn->response);
+		if(header_len == std::string::npos) {
+			break;
+		}
+
+		environment env = parse_env(conn->response.substr(0, header_len));
+		const size_t content_length = atoi(env["content-length"].c_str());
+		if(conn->response.size() < header_len + content_length) {
+			break;
+		}
+
+		conn->response.erase(0, header_len + content_length);
+
+		ASSERT_LOG(conn->sent.empty() == false, "Received unexpected response");
+		timeval tv;
+		gettimeofday(&tv, NULL);
+		conn->latencies->push_back((tv.tv_sec - conn->sent.front().tv_sec)*1000000 + (tv.tv_usec - conn->sent.front().tv_usec));
+		conn->sent.pop_front();
+	}
+
+	if(conn->remaining == 0 && conn->sent.empty()) {
+		conn->socket.close();
+		return;
+	}
+
+	load_test_send(conn);
+	load_test_receive(conn);
+}
+
+void load_test_receive(load_test_connection_ptr conn)
+{
+	conn->socket.async_read_some(boost::asio::buffer(conn->read_buf), boost::bind(load_test_handle_receive, conn, _1, _2));
+}
+
+}
+
+//Measures the throughput and latency of a web server by sending it
+//requests from many connections, each of which pipelines requests.
+COMMAND_LINE_UTILITY(http_load_test)
+{
+	std::string host = "localhost", port = "23456", path = "/", post_body;
+	int nconnections = 16, nrequests = 1000, pipeline = 1;
+
+	std::deque<std::string> arguments(args.begin(), args.end());
+	while(!arguments.empty()) {
+		const std::string arg = arguments.front();
+		arguments.pop_front();
+		ASSERT_LOG(arguments.empty() == false, "NEED ARGUMENT AFTER " << arg);
+		const std::string value = arguments.front();
+		arguments.pop_front();
+
+		if(arg == "--host") {
+			host = value;
+		} else if(arg == "-p" || arg == "--port") {
+			port = value;
+		} else if(arg == "--path") {
+			path = value;
+		} else if(arg == "--post") {
+			post_body = sys::read_file(value);
+		} else if(arg == "--connections") {
+			nconnections = atoi(value.c_str());
+		} else if(arg == "--requests") {
+			nrequests = atoi(value.c_str());
+		} else if(arg == "--pipeline") {
+			pipeline = atoi(value.c_str());
+		} else {
+			ASSERT_LOG(false, "UNRECOGNIZED ARGUMENT: " << arg);
+		}
+	}
+
+	ASSERT_LOG(nconnections > 0 && nrequests > 0 && pipeline > 0, "Connections, requests and pipeline depth must be positive");
+
+	std::ostringstream request;
+	if(post_body.empty()) {
+		request << "GET " << path << " HTTP/1.1\r\nHost: " << host << "\r\n\r\n";
+	} else {
+		request << "POST " << path << " HTTP/1.1\r\nHost: " << host << "\r\nContent-Length: " << post_body.size() << "\r\n\r\n" << post_body;
+	}
+
+	boost::asio::io_service io_service;
+	tcp::resolver resolver(io_service);
+	tcp::resolver::iterator endpoint = resolver.resolve(tcp::resolver::query(host, port));
+
+	std::vector<int> latencies;
+	latencies.reserve(nrequests);
+
+	timeval start_time;
+	gettimeofday(&start_time, NULL);
+
+	for(int n = 0; n != nconnections; ++n) {
+		const int requests_for_connection = nrequests/nconnections + (n < nrequests%nconnections ? 1 : 0);
+		if(requests_for_connection == 0) {
+			continue;
+		}
+
+		load_test_connection_ptr conn(new load_test_connection(io_service, request.str(), pipeline, requests_for_connection, &latencies));
+		boost::asio::connect(conn->socket, endpoint);
+		load_test_send(conn);
+		load_test_receive(conn);
+	}
+
+	io_service.run();
+
+	timeval end_time;
+	gettimeofday(&end_time, NULL);
+	const double elapsed = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_usec - start_time.tv_usec)/1000000.0;
+
+	std::sort(latencies.begin(), latencies.end());
+	ASSERT_LOG(latencies.empty() == false, "No responses received");
+
+	printf("%d requests over %d connections (pipeline depth %d) in %.3fs\n", (int)latencies.size(), nconnections, pipeline, elapsed);
+	printf("requests/s: %.1f\n", latencies.size()/elapsed);
+	printf("latency p50: %.3fms p99: %.3fms max: %.3fms\n",
+	       latencies[latencies.size()/2]/1000.0,
+	       latencies[std::min(latencies.size()-1, (latencies.size()*99)/100)]/1000.0,
+	       latencies.back()/1000.0);
+}
+
 }
@@ -19,19 +19,59 @@
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <atomic>
 #include <map>
+#include <string>
+#include <vector>
 
 namespace http {
 
 typedef std::map<std::string, std::string> environment;
 
+//A piece of a response which is kept alive until it has been written to
+//the socket, allowing responses to be sent as a list of buffers without
+//concatenating them.
+class response_chunk
+{
+public:
+	virtual ~response_chunk() {}
+	virtual const char* data() const = 0;
+	virtual size_t size() const = 0;
+};
+
+typedef boost::shared_ptr<const response_chunk> response_chunk_ptr;
+
+//creates a chunk holding the given string. The string is swapped into the
+//chunk rather than copied and will be left empty.
+response_chunk_ptr make_response_chunk(std::string& str);
+response_chunk_ptr make_response_chunk(const char* str);
+
+//Returns the contents of the given file as a chunk. Files are memory mapped
+//where supported and cached so repeated requests for them are served without
+//reading or copying the file. Files must be replaced atomically (written to
+//a temporary and renamed) rather than modified in place. Returns NULL if the
+//file can't be read.
+response_chunk_ptr get_cached_file(const std::string& fname);
+void invalidate_cached_file(const std::string& fname);
+
+//Runs the io_service on nthreads threads, including the calling thread.
+//Returns when the io_service runs out of work. If a handler throws, the
+//io_service is stopped and the exception rethrown in the calling thread.
+void run_io_service(boost::asio::io_service& io_service, int nthreads);
+
 class web_server
 {
 public:
 	typedef boost::shared_ptr<boost::asio::ip::tcp::socket> socket_ptr;
 	typedef boost::shared_ptr<boost::array<char, 64*1024> > buffer_ptr;
 
-	explicit web_server(boost::asio::io_service& io_service, int port=23456);
+	//Socket I/O and request framing may happen on any thread running the
+	//io_service. Request bodies are parsed, and handle_post(), handle_get()
+	//and disconnect() called, through a strand, so derived classes see
+	//them serialized. If strand is NULL the server uses its own strand;
+	//pass one in to serialize with other objects, such as a game server.
+	explicit web_server(boost::asio::io_service& io_service, int port=23456, boost::asio::io_service::strand* strand=NULL);
 	virtual ~web_server();
 
 	static void disconnect_socket(socket_ptr socket);
@@ -41,32 +81,66 @@ protected:
 	void handle_accept(socket_ptr socket, const boost::system::error_code& error);
 
 	void send_msg(socket_ptr socket, const std::string& mime_type, const std::string& msg, const std::string& header_parms);
+	void send_msg(socket_ptr socket, const std::string& mime_type, const std::vector<response_chunk_ptr>& body, const std::string& header_parms);
 	void send_404(socket_ptr socket);
 
-	void handle_send(socket_ptr socket, const boost::system::error_code& e, size_t nbytes, size_t max_bytes, boost::shared_ptr<std::string> buf);
+	void handle_send(socket_ptr socket, const boost::system::error_code& e, size_t nbytes, size_t max_bytes, boost::shared_ptr<std::string> header, std::vector<response_chunk_ptr> body, bool keep_alive);
 
 	virtual void disconnect(socket_ptr socket);
 
+	//the strand handlers are called through. Derived classes should wrap
+	//their own asynchronous handlers, such as timers, with it.
+	boost::asio::io_service::strand& handler_strand() { return *strand_; }
+
 	virtual void handle_post(socket_ptr socket, variant doc, const environment& env) = 0;
 	virtual void handle_get(socket_ptr socket, const std::string& url, const std::map<std::string, std::string>& args) = 0;
 
 private:
+	//State kept for each connection. Connections are HTTP/1.1 persistent
+	//unless the client asks otherwise. Requests may be pipelined: they are
+	//buffered in msg and handled one at a time, each after the response to
+	//the previous one has been written. Connections that are idle for too
+	//long are closed by idle_timer, which is only used from the strand.
 	struct receive_buf {
-		receive_buf() : wanted(0) {}
+		explicit receive_buf(boost::asio::io_service& io_service) : keep_alive(false), responding(false), nactivity(0), nactivity_checked(0), idle_timer(io_service) {}
 		std::string msg;
-		size_t wanted;
+		bool keep_alive;
+		std::atomic<bool> responding;
+
+		//counts reads and writes, so the timer can tell if there were any
+		//since it last checked.
+		std::atomic<int> nactivity;
+		int nactivity_checked;
+		boost::asio::deadline_timer idle_timer;
 	};
 	typedef boost::shared_ptr<receive_buf> receive_buf_ptr;
 
-	void start_receive(socket_ptr socket, receive_buf_ptr buf=receive_buf_ptr());
+	void start_idle_timer(socket_ptr socket, receive_buf_ptr recv_buf);
+	void handle_idle_timeout(socket_ptr socket, receive_buf_ptr recv_buf, const boost::system::error_code& error);
+
+	void start_receive(socket_ptr socket, receive_buf_ptr buf);
 	void handle_receive(socket_ptr socket, buffer_ptr buf, const boost::system::error_code& e, size_t nbytes, receive_buf_ptr recv_buf);
 	void handle_incoming_data(socket_ptr socket, const char* i1, const char* i2, receive_buf_ptr recv_buf);
 
-	void handle_message(socket_ptr socket, receive_buf_ptr recv_buf);
+	//handles the next complete request buffered for the socket, or starts
+	//receiving more data if there isn't one.
+	void process_requests(socket_ptr socket, receive_buf_ptr recv_buf);
+
+	void handle_message(socket_ptr socket, const std::string& msg, size_t header_len);
+	void handle_post_body(socket_ptr socket, const std::string& body, const environment& env);
+	void handle_receive_error(socket_ptr socket);
+
+	bool keep_alive(socket_ptr socket) const;
 
 	virtual variant parse_message(const std::string& msg) const;
 
 	boost::asio::ip::tcp::acceptor acceptor_;
+
+	boost::scoped_ptr<boost::asio::io_service::strand> owned_strand_;
+	boost::asio::io_service::strand* strand_;
+
+	//only accessed from strand_.
+	std::map<socket_ptr, receive_buf_ptr> connections_;
 };
 
 }
@@ -113,6 +113,7 @@ void image_widget::set_value(const std::string& key, const variant& v)
 		ASSERT_LOG(v.is_list() && v.num_elements() == 2, "parameter to 'image_wv' must be two-element list. Found: " << v.to_debug_string());
 		init(v[0].as_int(), v[1].as_int());
 	}
+	invalidate();
 	return widget::set_value(key, v);
 }
 
@@ -163,6 +164,7 @@ gui_section_widget::gui_section_widget(const variant& v, game_logic::formula_cal
 void gui_section_widget::set_gui_section(const std::string& id)
 {
 	section_ = gui_section::get(id);
+	invalidate();
 }
 
 void gui_section_widget::handle_draw() const
@@ -39,12 +39,16 @@ public:
 	const rect& area() const { return area_; }
 	const graphics::texture& tex() const { return texture_; }
 
-	void set_rotation(GLfloat rotate) { rotate_ = rotate; }
-	void set_area(const rect& area) { area_ = area; }
+	void set_rotation(GLfloat rotate) { rotate_ = rotate; invalidate(); }
+	void set_area(const rect& area) { area_ = area; invalidate(); }
 
 	void set_value(const std::string& key, const variant& v);
 	variant get_value(const std::string& key) const;
 
+protected:
+	//a rotated image may draw outside the widget.
+	virtual bool is_render_cacheable() const { return rotate_ == 0.0f; }
+
 private:
 	void handle_draw() const;
 
@@ -68,6 +72,8 @@ public:
 protected:
 	void set_value(const std::string& key, const variant& v);
 	variant get_value(const std::string& key) const;
+
+	virtual bool is_render_cacheable() const { return true; }
 private:
 	const_gui_section_ptr section_;
 	int scale_;
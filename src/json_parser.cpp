@@ -15,6 +15,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <algorithm>
+#include <deque>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "asserts.hpp"
 #include "code_editor_dialog.hpp"
@@ -33,6 +38,7 @@
 #include "preferences.hpp"
 #include "preprocessor.hpp"
 #include "string_utils.hpp"
+#include "thread.hpp"
 #include "unit_test.hpp"
 #include "variant_utils.hpp"
 #include "wml_formula_callable.hpp"
@@ -45,12 +51,209 @@ namespace json {
 
 namespace {
 std::map<std::string, std::string> pseudo_file_contents;
+
+struct streamed_file {
+	streamed_file(const std::string& fname, const std::string& path)
+	  : fname(fname), path(path), plain(false), state(QUEUED)
+	{}
+
+	std::string fname, path;
+	std::string contents, md5;
+
+	//the document parsed without the preprocessor, or null if that failed.
+	variant doc;
+
+	//true if running the preprocessor wouldn't have changed doc.
+	bool plain;
+
+	//guarded by the pool's mutex. Until the file is DONE its other members
+	//belong to the thread reading it.
+	enum STATE { QUEUED, READING, DONE };
+	STATE state;
+};
+
+typedef std::map<std::string, boost::shared_ptr<streamed_file> > streamed_file_map;
+
+//streamed files are handed over the first time they're parsed, while
+//prefetched files are kept until clear_prefetched_files().
+streamed_file_map streamed_files, prefetched_files;
+
+void stream_worker(streamed_file* file);
+
+PREF_INT(json_stream_threads, 2, "Number of threads used to read and parse files in the background. With 0 files are read when they're needed");
+
+//the threads which read streamed files. There are only a few of them
+//however many files are asked for, and files wait in a queue, in the
+//order they were asked for, until a thread is free. With no threads
+//every file is read by finish().
+class stream_pool
+{
+public:
+	stream_pool() : quit_(false)
+	{
+		for(int n = 0; n < g_json_stream_threads; ++n) {
+			threads_.push_back(boost::shared_ptr<threading::thread>(new threading::thread("json_stream", boost::bind(&stream_pool::worker_loop, this))));
+		}
+	}
+
+	~stream_pool()
+	{
+		{
+			threading::lock l(mutex_);
+			quit_ = true;
+			work_cond_.notify_all();
+		}
+
+		//joins the workers.
+		threads_.clear();
+	}
+
+	void add(streamed_file* file)
+	{
+		threading::lock l(mutex_);
+		queue_.push_back(file);
+		work_cond_.notify_one();
+	}
+
+	//returns once the file is read, after which it belongs to the caller.
+	//A file no worker has started on is taken off the queue and read on
+	//this thread instead, or if 'read' is false, left unread.
+	void finish(streamed_file* file, bool read=true)
+	{
+		{
+			threading::lock l(mutex_);
+			if(file->state != streamed_file::QUEUED) {
+				while(file->state != streamed_file::DONE) {
+					done_cond_.wait(mutex_);
+				}
+
+				return;
+			}
+
+			std::deque<streamed_file*>::iterator i = std::find(queue_.begin(), queue_.end(), file);
+			if(i != queue_.end()) {
+				queue_.erase(i);
+			}
+
+			if(!read) {
+				return;
+			}
+
+			file->state = streamed_file::READING;
+		}
+
+		stream_worker(file);
+
+		threading::lock l(mutex_);
+		file->state = streamed_file::DONE;
+	}
+
+private:
+	void worker_loop()
+	{
+		for(;;) {
+			streamed_file* file;
+			{
+				threading::lock l(mutex_);
+				while(!quit_ && queue_.empty()) {
+					work_cond_.wait(mutex_);
+				}
+
+				if(quit_) {
+					return;
+				}
+
+				file = queue_.front();
+				queue_.pop_front();
+				file->state = streamed_file::READING;
+			}
+
+			stream_worker(file);
+
+			threading::lock l(mutex_);
+			file->state = streamed_file::DONE;
+			done_cond_.notify_all();
+		}
+	}
+
+	threading::mutex mutex_;
+	threading::condition work_cond_, done_cond_;
+	std::deque<streamed_file*> queue_;
+	bool quit_;
+	std::vector<boost::shared_ptr<threading::thread> > threads_;
+};
+
+//declared after the files so that at exit the workers are joined before
+//the files they might be reading are destroyed.
+boost::scoped_ptr<stream_pool> g_stream_pool;
+
+stream_pool& get_stream_pool()
+{
+	if(!g_stream_pool) {
+		g_stream_pool.reset(new stream_pool);
+	}
+
+	return *g_stream_pool;
+}
+
+void erase_streamed_file(streamed_file_map& files, const std::string& fname)
+{
+	streamed_file_map::iterator i = files.find(fname);
+	if(i != files.end()) {
+		get_stream_pool().finish(i->second.get(), false);
+		files.erase(i);
+	}
+}
+
+void clear_streamed_files(streamed_file_map& files)
+{
+	for(streamed_file_map::iterator i = files.begin(); i != files.end(); ++i) {
+		get_stream_pool().finish(i->second.get(), false);
+	}
+
+	files.clear();
+}
+
+}
+
+void prefetch_files(const std::vector<std::string>& paths)
+{
+	foreach(const std::string& path, paths) {
+		if(pseudo_file_contents.count(path) == 0 && prefetched_files.count(path) == 0) {
+			boost::shared_ptr<streamed_file> file(new streamed_file(path, module::map_file(path)));
+			prefetched_files[path] = file;
+			get_stream_pool().add(file.get());
+		}
+	}
+}
+
+void clear_prefetched_files()
+{
+	clear_streamed_files(prefetched_files);
+}
+
+void stream_file(const std::string& fname)
+{
+	if(streamed_files.count(fname) || pseudo_file_contents.count(fname)) {
+		return;
+	}
+
+	boost::shared_ptr<streamed_file> file(new streamed_file(fname, module::map_file(fname)));
+	streamed_files[fname] = file;
+	get_stream_pool().add(file.get());
+}
+
+void clear_streamed_files()
+{
+	clear_streamed_files(streamed_files);
 }
 
 void set_file_contents(const std::string& path, const std::string& contents)
 {
 	game_logic::remove_formula_function_cached_doc(contents);
 	pseudo_file_contents[path] = contents;
+	erase_streamed_file(prefetched_files, path);
+	erase_streamed_file(streamed_files, path);
 }
 
 std::string get_file_contents(const std::string& path)
@@ -227,10 +430,19 @@ struct JsonObject {
 
 std::set<std::string> filename_registry;
 
+threading::mutex& filename_registry_mutex()
+{
+	static threading::mutex instance;
+	return instance;
+}
+
+//Without the preprocessor this touches no global state other than the
+//filename registry, so it may be run off the main thread.
 variant parse_internal(const std::string& doc, const std::string& fname,
                        JSON_PARSE_OPTIONS options,
 					   std::map<std::string, json_macro_ptr>* macros,
-					   const game_logic::formula_callable* callable)
+					   const game_logic::formula_callable* callable,
+					   bool* saw_constant_name=NULL)
 {
 	std::map<std::string, json_macro_ptr> macros_buf;
 	if(!macros) {
@@ -239,13 +451,14 @@ variant parse_internal(const std::string& doc, const std::string& fname,
 
 	bool use_preprocessor = options&JSON_USE_PREPROCESSOR;
 
-	std::set<std::string>::const_iterator filename_itor = filename_registry.insert(fname).first;
-
-
-	const std::string* filename = &*filename_itor;
+	const std::string* filename;
+	{
+		threading::lock lck(filename_registry_mutex());
+		filename = &*filename_registry.insert(fname).first;
+	}
 
 	variant::debug_info debug_info;
-	debug_info.filename = &*filename_itor;
+	debug_info.filename = filename;
 	debug_info.line = 1;
 	debug_info.column = 1;
 
@@ -371,6 +584,11 @@ variant parse_internal(const std::string& doc, const std::string& fname,
 
 			case Token::TYPE_IDENTIFIER:
 				CHECK_PARSE(stack.back().type == VAL_OBJ, "Unexpected identifier: " + std::string(t.begin, t.end), t.begin - doc.c_str());
+				//only names with no lower case letters can be constants, so
+				//ordinary unquoted keys parse the same either way.
+				if(saw_constant_name && std::find_if(t.begin, t.end, util::c_islower) == t.end) {
+					*saw_constant_name = true;
+				}
 			case Token::TYPE_STRING: {
 				std::string s(t.begin, t.end);
 				variant::debug_info str_debug_info = debug_info;
@@ -541,6 +759,29 @@ variant json_macro::call(variant arg) const
 	return parse_internal(code_, "", JSON_USE_PREPROCESSOR, &m, callable);
 }
 
+//runs on one of the pool's threads, or on the main thread if it wants the
+//file before a worker has started on it. Any document with an '@' in it,
+//or with identifiers that might name constants, needs the preprocessor and
+//so is left for the main thread to parse.
+void stream_worker(streamed_file* file)
+{
+	try {
+		file->contents = sys::read_file(file->path);
+		file->md5 = md5::sum(file->contents);
+		if(file->contents.empty()) {
+			return;
+		}
+
+		bool saw_constant_name = false;
+		file->doc = parse_internal(file->contents, file->fname, JSON_NO_PREPROCESSOR, NULL, NULL, &saw_constant_name);
+		file->plain = !saw_constant_name && file->contents.find('@') == std::string::npos;
+	} catch(...) {
+		//the main thread will parse it again and report the error.
+		file->doc = variant();
+		file->plain = false;
+	}
+}
+
 }
 
 variant parse(const std::string& doc, JSON_PARSE_OPTIONS options)
@@ -548,15 +789,46 @@ variant parse(const std::string& doc, JSON_PARSE_OPTIONS options)
 	return parse_internal(doc, "", options, NULL, NULL);
 }
 
+variant parse_plain(const std::string& doc, bool* plain)
+{
+	bool saw_constant_name = false;
+	variant result = parse_internal(doc, "", JSON_NO_PREPROCESSOR, NULL, NULL, &saw_constant_name);
+	*plain = !saw_constant_name && doc.find('@') == std::string::npos;
+	return result;
+}
+
 variant parse_from_file(const std::string& fname, JSON_PARSE_OPTIONS options)
 {
 	try {
-		std::string data = get_file_contents(fname);
+		std::string data, data_md5;
+		variant streamed_doc;
+		streamed_file_map::iterator streamed = streamed_files.find(fname);
+		streamed_file_map::const_iterator prefetched = prefetched_files.find(fname);
+		if(streamed != streamed_files.end()) {
+			//once finished the file is ours alone.
+			get_stream_pool().finish(streamed->second.get());
+			data.swap(streamed->second->contents);
+			data_md5.swap(streamed->second->md5);
+			if(streamed->second->plain || options == JSON_NO_PREPROCESSOR) {
+				streamed_doc = streamed->second->doc;
+			}
+			streamed_files.erase(streamed);
+		} else if(prefetched != prefetched_files.end()) {
+			get_stream_pool().finish(prefetched->second.get());
+			data = prefetched->second->contents;
+			data_md5 = prefetched->second->md5;
+			if(prefetched->second->plain || options == JSON_NO_PREPROCESSOR) {
+				streamed_doc = prefetched->second->doc;
+			}
+		} else {
+			data = get_file_contents(fname);
+			data_md5 = md5::sum(data);
+		}
 
 		typedef std::pair<std::string, JSON_PARSE_OPTIONS> CacheKey;
 		static std::map<CacheKey, variant> cache;
 
-		CacheKey key(md5::sum(data), options);
+		CacheKey key(data_md5, options);
 		std::map<CacheKey, variant>::iterator cache_itor = cache.find(key);
 		if(cache_itor != cache.end()) {
 			return cache_itor->second;
@@ -571,7 +843,11 @@ variant parse_from_file(const std::string& fname, JSON_PARSE_OPTIONS options)
 		variant result;
 		
 		try {
-			result = parse_internal(data, fname, options, NULL, NULL);
+			if(streamed_doc.is_null() == false) {
+				result = streamed_doc;
+			} else {
+				result = parse_internal(data, fname, options, NULL, NULL);
+			}
 		} catch(parse_error& e) {
 			if(!preferences::edit_and_continue()) {
 				throw e;
@@ -615,6 +891,26 @@ bool file_exists_and_is_valid(const std::string& fname)
 	}
 }
 
+UNIT_TEST(json_parse_plain)
+{
+	const std::string doc = sys::read_file(module::map_file("data/objects/hud-elements/dummy_gui_object.cfg"));
+	CHECK(doc.empty() == false, "could not read object file");
+
+	bool plain = false;
+	variant v = parse_plain(doc, &plain);
+	CHECK(plain, "object file with unquoted keys is not plain");
+	CHECK_EQ(v, parse(doc));
+
+	parse_plain("{a: 1, b: {c: [2, 3]}}", &plain);
+	CHECK_EQ(plain, true);
+
+	parse_plain("{SCREEN_WIDTH: 1}", &plain);
+	CHECK_EQ(plain, false);
+
+	parse_plain("{a: \"@eval 4\"}", &plain);
+	CHECK_EQ(plain, false);
+}
+
 UNIT_TEST(json_base)
 {
 	std::string doc = "[{\"@base\": true, x: 5, y: 4}, {}, {a: 9, y: 2}, \"@eval {}\"]";
@@ -18,6 +18,7 @@
 #define JSON_PARSER_HPP_INCLUDED
 
 #include <string>
+#include <vector>
 
 #include "variant.hpp"
 
@@ -25,9 +26,43 @@ namespace json {
 void set_file_contents(const std::string& path, const std::string& contents);
 std::string get_file_contents(const std::string& path);
 
+//queues the given files to be read and hashed, and where they don't use
+//the preprocessor parsed, by the worker threads stream_file() uses, so that
+//parse_from_file() can take them from memory. Files stay in memory until
+//clear_prefetched_files() is called; use it for bulk loads, not as a
+//long lived cache.
+void prefetch_files(const std::vector<std::string>& paths);
+void clear_prefetched_files();
+
+//prefetches files for as long as it's in scope.
+class prefetch_scope
+{
+public:
+	explicit prefetch_scope(const std::vector<std::string>& paths) { prefetch_files(paths); }
+	~prefetch_scope() { clear_prefetched_files(); }
+private:
+	prefetch_scope(const prefetch_scope&);
+	void operator=(const prefetch_scope&);
+};
+
+//queues the given file to be read by one of a few shared worker threads,
+//and returns without waiting. If the document doesn't use the preprocessor
+//it's also parsed there, so a later parse_from_file() of it only has to
+//wait for the worker, if at all. The parsed tree is only ever touched by
+//one thread at a time: the worker until it finishes, then the main thread
+//once parse_from_file() has waited for it.
+void stream_file(const std::string& fname);
+void clear_streamed_files();
+
 enum JSON_PARSE_OPTIONS { JSON_NO_PREPROCESSOR = 0, JSON_USE_PREPROCESSOR };
 variant parse(const std::string& doc, JSON_PARSE_OPTIONS options=JSON_USE_PREPROCESSOR);
 variant parse_from_file(const std::string& fname, JSON_PARSE_OPTIONS options=JSON_USE_PREPROCESSOR);
+
+//parses a document without the preprocessor. Unlike parse(), this may be
+//called off the main thread. *plain is set to whether parse() with the
+//preprocessor would give the same result.
+variant parse_plain(const std::string& doc, bool* plain);
+
 bool file_exists_and_is_valid(const std::string& fname);
 
 struct parse_error {
@@ -172,6 +172,8 @@ void label::recalculate_texture()
 	if(border_color_.get()) {
 		border_texture_ = font::render_text(current_text(), *border_color_, size_, font_);
 	}
+
+	invalidate();
 }
 
 void label::handle_draw() const
@@ -192,6 +194,26 @@ void label::handle_draw() const
 
 void label::set_texture(graphics::texture t) {
 	texture_ = t;
+	invalidate();
+}
+
+rect label::render_bounds() const
+{
+	const rect area = widget::render_bounds();
+	if(!border_texture_.valid()) {
+		return area;
+	}
+
+	return rect(area.x() - border_size_, area.y() - border_size_, area.w() + border_size_*2, area.h() + border_size_*2);
+}
+
+unsigned int label::render_state() const
+{
+	if(!draw_highlight_) {
+		return 0;
+	}
+
+	return 1 + (highlight_color_.r << 24 | highlight_color_.g << 16 | highlight_color_.b << 8 | highlight_color_.a);
 }
 
 bool label::in_label(int xloc, int yloc) const
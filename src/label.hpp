@@ -65,6 +65,7 @@ public:
 	void set_click_handler(boost::function<void()> click) { on_click_ = click; }
 	void set_highlight_color(const SDL_Color &col) {highlight_color_ = col;}
 	void allow_highlight_on_mouseover(bool val=true) { highlight_on_mouseover_ = val; }
+	virtual rect render_bounds() const;
 protected:
 	label(const label&);
 	void operator=(const label&);
@@ -77,6 +78,9 @@ protected:
 	virtual variant handle_write();
 	virtual widget_settings_dialog* settings_dialog(int x, int y, int w, int h);
 
+	virtual bool is_render_cacheable() const { return true; }
+	virtual unsigned int render_state() const;
+
 protected:
 	DECLARE_CALLABLE(label);
 private:
@@ -17,8 +17,10 @@
 #include <boost/bind.hpp>
 
 #include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <math.h>
+#include <sstream>
 
 #include "IMG_savepng.h"
 #include "asserts.hpp"
@@ -206,7 +208,7 @@ level::level(const std::string& level_cfg, variant node)
 	  num_compiled_tiles_(0),
 	  entered_portal_active_(false), save_point_x_(-1), save_point_y_(-1),
 	  editor_(false), show_foreground_(true), show_background_(true), dark_(false), dark_color_(graphics::color_transform(0, 0, 0, 255)), air_resistance_(0), water_resistance_(7), end_game_(false),
-      editor_tile_updates_frozen_(0), editor_dragging_objects_(false),
+      editor_tile_updates_frozen_(0), editor_dirty_all_tiles_(false), editor_dragging_objects_(false),
 	  zoom_level_(decimal::from_int(1)),
 	  palettes_used_(0),
 	  background_palette_(-1),
@@ -331,6 +333,7 @@ level::level(const std::string& level_cfg, variant node)
 	auto_move_camera_ = point(node["auto_move_camera"]);
 	air_resistance_ = node["air_resistance"].as_int(20);
 	water_resistance_ = node["water_resistance"].as_int(100);
+	scheduler_.set_budget(node["object_processing_budget"].as_int(object_scheduler::DefaultBudget));
 
 	camera_rotation_ = game_logic::formula::create_optional_formula(node["camera_rotation"]);
 
@@ -902,6 +905,10 @@ struct level_tile_rebuild_info {
 	//a locked flag which is polled to see if tile rebuilding has been completed.
 	bool tile_rebuild_complete;
 
+	//the union of the rects refresh_tile_rect() was asked to rebuild while
+	//background rebuilds were frozen.
+	rect frozen_refresh_rect;
+
 	threading::mutex tile_rebuild_complete_mutex;
 
 	//the tiles where the thread will store the new tiles.
@@ -991,7 +998,21 @@ void level::unfreeze_rebuild_tiles_in_background()
 	}
 
 	info.tile_rebuild_in_progress = false;
-	start_rebuild_tiles_in_background(info.rebuild_tile_layers_buffer);
+
+	const rect refresh = info.frozen_refresh_rect;
+	info.frozen_refresh_rect = rect();
+	if(info.tile_rebuild_queued) {
+		info.tile_rebuild_queued = false;
+
+		//a rebuild of all layers covers the rect anyway.
+		if(refresh.w() > 0 && !info.rebuild_tile_layers_buffer.empty()) {
+			rebuild_tiles_rect(refresh);
+		}
+
+		start_rebuild_tiles_in_background(info.rebuild_tile_layers_buffer);
+	} else if(refresh.w() > 0) {
+		rebuild_tiles_rect(refresh);
+	}
 }
 
 namespace {
@@ -1076,6 +1097,7 @@ void level::complete_rebuild_tiles_in_background()
 void level::rebuild_tiles()
 {
 	if(editor_tile_updates_frozen_) {
+		editor_dirty_all_tiles_ = true;
 		return;
 	}
 
@@ -1155,6 +1177,7 @@ struct TileInRect {
 void level::rebuild_tiles_rect(const rect& r)
 {
 	if(editor_tile_updates_frozen_) {
+		editor_dirty_tiles_ = editor_dirty_tiles_.w() > 0 ? rect_union(editor_dirty_tiles_, r) : r;
 		return;
 	}
 
@@ -1182,7 +1205,7 @@ void level::rebuild_tiles_rect(const rect& r)
 	if(std::adjacent_find(tiles_.rbegin(), tiles_.rend(), level_tile_zorder_pos_comparer()) != tiles_.rend()) {
 		std::sort(tiles_.begin(), tiles_.end(), level_tile_zorder_pos_comparer());
 	}
-	prepare_tiles_for_drawing();
+	prepare_tiles_for_drawing(&r);
 }
 
 std::string level::package() const
@@ -1245,6 +1268,10 @@ variant level::write() const
 	res.add("air_resistance", air_resistance_);
 	res.add("water_resistance", water_resistance_);
 
+	if(scheduler_.budget() != object_scheduler::DefaultBudget) {
+		res.add("object_processing_budget", scheduler_.budget());
+	}
+
 	res.add("touch_controls", allow_touch_controls_);
 
 	res.add("preloads", util::join(preloads_));
@@ -1628,6 +1655,34 @@ void level::set_next_level(const std::string& name)
 namespace {
 //counter incremented every time the level is drawn.
 int draw_count = 0;
+
+//tile layers are split into square chunks this many tiles across.
+const int TileChunkTiles = 16;
+
+int tile_chunk_size()
+{
+	return TileSize*TileChunkTiles;
+}
+
+int tile_chunk_of(int v)
+{
+	const int size = tile_chunk_size();
+	return v >= 0 ? v/size : -((-v - 1)/size) - 1;
+}
+
+int tile_draw_call_count = 0, tile_chunks_built = 0, tile_chunks_uploaded = 0;
+}
+
+int level::tile_draw_calls()
+{
+	return tile_draw_call_count;
+}
+
+std::string level::tile_draw_report()
+{
+	std::ostringstream s;
+	s << "tiles: " << tile_draw_call_count << " draw calls, " << tile_chunks_built << " chunks built, " << tile_chunks_uploaded << " chunks uploaded\n";
+	return s.str();
 }
 
 void level::draw_layer(int layer, int x, int y, int w, int h) const
@@ -1691,100 +1746,36 @@ void level::draw_layer(int layer, int x, int y, int w, int h) const
 		return;
 	}
 
-	const level_tile* t = &*tile_itor;
-	const level_tile* end_tiles = &*tiles_.begin() + tiles_.size();
-
 	layer_blit_info& blit_info = layer_itor->second;
 
-	const rect tile_positions(x/TileSize - (x < 0 ? 1 : 0), y/TileSize - (y < 0 ? 1 : 0),
-	                          (x + w)/TileSize - (x + w < 0 ? 1 : 0),
-							  (y + h)/TileSize - (y + h < 0 ? 1 : 0));
-
-	std::vector<layer_blit_info::IndexType>& opaque_indexes = blit_info.opaque_indexes;
-	std::vector<layer_blit_info::IndexType>& translucent_indexes = blit_info.translucent_indexes;
-
-	if(blit_info.tile_positions != tile_positions || editor_) {
-		blit_info.tile_positions = tile_positions;
-
-		opaque_indexes.clear();
-		translucent_indexes.clear();
-
-		int ystart = std::max<int>(0, (y - blit_info.ybase)/TileSize);
-		int yend = std::min<int>(blit_info.indexes.size(), (y + h - blit_info.ybase)/TileSize + 1);
-
-		for(; ystart < yend; ++ystart) {
-			const std::vector<layer_blit_info::IndexType>& indexes = blit_info.indexes[ystart];
-			int xstart = std::max<int>(0, (x - blit_info.xbase)/TileSize);
-			int xend = std::min<int>(indexes.size(), (x + w - blit_info.xbase)/TileSize + 1);
-			for(; xstart < xend; ++xstart) {
-				if(indexes[xstart] != TILE_INDEX_TYPE_MAX) {
-					if(indexes[xstart] > 0) {
-						GLint index = indexes[xstart];
-						opaque_indexes.push_back(index);
-						opaque_indexes.push_back(index+1);
-						opaque_indexes.push_back(index+2);
-						opaque_indexes.push_back(index+1);
-						opaque_indexes.push_back(index+2);
-						opaque_indexes.push_back(index+3);
-						ASSERT_INDEX_INTO_VECTOR(index, blit_info.blit_vertexes);
-						ASSERT_INDEX_INTO_VECTOR(index+3, blit_info.blit_vertexes);
-					} else {
-						GLint index = -indexes[xstart];
-						translucent_indexes.push_back(index);
-						translucent_indexes.push_back(index+1);
-						translucent_indexes.push_back(index+2);
-						translucent_indexes.push_back(index+1);
-						translucent_indexes.push_back(index+2);
-						translucent_indexes.push_back(index+3);
-						ASSERT_INDEX_INTO_VECTOR(index, blit_info.blit_vertexes);
-						ASSERT_INDEX_INTO_VECTOR(index+3, blit_info.blit_vertexes);
-					}
-				}
-			}
+	//pick out the chunks in view a row at a time.
+	static std::vector<layer_blit_info::tile_chunk*> visible_chunks;
+	visible_chunks.clear();
+
+	const int xchunk1 = tile_chunk_of(x), xchunk2 = tile_chunk_of(x + w);
+	const int ychunk1 = tile_chunk_of(y), ychunk2 = tile_chunk_of(y + h);
+	for(int ychunk = ychunk1; ychunk <= ychunk2; ++ychunk) {
+		layer_blit_info::chunk_map::iterator i = blit_info.chunks.lower_bound(std::pair<int, int>(ychunk, xchunk1));
+		for(; i != blit_info.chunks.end() && i->first.first == ychunk && i->first.second <= xchunk2; ++i) {
+			visible_chunks.push_back(&i->second);
 		}
 	}
 
 	glDisable(GL_BLEND);
 	draw_layer_solid(layer, x, y, w, h);
-	if(blit_info.texture_id != GLuint(-1)) {
-		graphics::texture::set_current_texture(blit_info.texture_id);
-	}
 
 #if defined(USE_SHADERS)
 	gles2::active_shader()->prepare_draw();
 #endif
 
-	if(!opaque_indexes.empty()) {
-#if defined(USE_SHADERS)
-		gles2::active_shader()->shader()->vertex_array(2, GL_SHORT, GL_FALSE, sizeof(tile_corner), &blit_info.blit_vertexes[0].vertex[0]);
-		gles2::active_shader()->shader()->texture_array(2, GL_FLOAT, GL_FALSE, sizeof(tile_corner), &blit_info.blit_vertexes[0].uv[0]);
-#else
-		glVertexPointer(2, GL_SHORT, sizeof(tile_corner), &blit_info.blit_vertexes[0].vertex[0]);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(tile_corner), &blit_info.blit_vertexes[0].uv[0]);
-#endif
-		glDrawElements(GL_TRIANGLES, opaque_indexes.size(), TILE_INDEX_TYPE, &opaque_indexes[0]);
+	for(int n = 0; n != visible_chunks.size(); ++n) {
+		draw_tile_chunk(*visible_chunks[n], false);
 	}
+
 	glEnable(GL_BLEND);
 
-	if(!translucent_indexes.empty()) {
-#if defined(USE_SHADERS)
-		gles2::active_shader()->shader()->vertex_array(2, GL_SHORT, GL_FALSE, sizeof(tile_corner), &blit_info.blit_vertexes[0].vertex[0]);
-		gles2::active_shader()->shader()->texture_array(2, GL_FLOAT, GL_FALSE, sizeof(tile_corner), &blit_info.blit_vertexes[0].uv[0]);
-#else
-		glVertexPointer(2, GL_SHORT, sizeof(tile_corner), &blit_info.blit_vertexes[0].vertex[0]);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(tile_corner), &blit_info.blit_vertexes[0].uv[0]);
-#endif
-		if(blit_info.texture_id == GLuint(-1)) {
-			//we have multiple different texture ID's in this layer. This means
-			//we will draw each tile seperately.
-			for(int n = 0; n < translucent_indexes.size(); n += 6) {
-				graphics::texture::set_current_texture(blit_info.vertex_texture_ids[translucent_indexes[n]/4]);
-				glDrawElements(GL_TRIANGLES, 6, TILE_INDEX_TYPE, &translucent_indexes[n]);
-			}
-		} else {
-			//we have just one texture ID and so can draw all tiles in one call.
-			glDrawElements(GL_TRIANGLES, translucent_indexes.size(), TILE_INDEX_TYPE, &translucent_indexes[0]);
-		}
+	for(int n = 0; n != visible_chunks.size(); ++n) {
+		draw_tile_chunk(*visible_chunks[n], true);
 	}
 
 	glPopMatrix();
@@ -1792,6 +1783,53 @@ void level::draw_layer(int layer, int x, int y, int w, int h) const
 	glColor4f(1.0, 1.0, 1.0, 1.0);
 }
 
+void level::draw_tile_chunk(layer_blit_info::tile_chunk& chunk, bool translucent)
+{
+	const std::vector<layer_blit_info::batch>& batches = translucent ? chunk.translucent_batches : chunk.opaque_batches;
+	if(batches.empty()) {
+		return;
+	}
+
+#if defined(USE_SHADERS)
+	if(!chunk.uploaded) {
+		chunk.vbo = graphics::vbo_array(new GLuint[2], graphics::vbo_deleter(2));
+		glGenBuffers(2, &chunk.vbo[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, chunk.vertexes.size()*sizeof(tile_corner), &chunk.vertexes[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.vbo[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, chunk.indexes.size()*sizeof(GLushort), &chunk.indexes[0], GL_STATIC_DRAW);
+
+		//from now on the chunk is only drawn from the buffers.
+		std::vector<tile_corner>().swap(chunk.vertexes);
+		std::vector<GLushort>().swap(chunk.indexes);
+		chunk.uploaded = true;
+		++tile_chunks_uploaded;
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.vbo[1]);
+	}
+
+	gles2::active_shader()->shader()->vertex_array(2, GL_SHORT, GL_FALSE, sizeof(tile_corner), reinterpret_cast<const GLvoid*>(offsetof(tile_corner, vertex)));
+	gles2::active_shader()->shader()->texture_array(2, GL_FLOAT, GL_FALSE, sizeof(tile_corner), reinterpret_cast<const GLvoid*>(offsetof(tile_corner, uv)));
+	const GLushort* indexes = NULL;
+#else
+	glVertexPointer(2, GL_SHORT, sizeof(tile_corner), &chunk.vertexes[0].vertex[0]);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(tile_corner), &chunk.vertexes[0].uv[0]);
+	const GLushort* indexes = &chunk.indexes[0];
+#endif
+
+	foreach(const layer_blit_info::batch& b, batches) {
+		graphics::texture::set_current_texture(b.texture_id);
+		glDrawElements(GL_TRIANGLES, b.count, GL_UNSIGNED_SHORT, indexes + b.offset);
+		++tile_draw_call_count;
+	}
+
+#if defined(USE_SHADERS)
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+#endif
+}
+
 void level::draw_layer_solid(int layer, int x, int y, int w, int h) const
 {
 	solid_color_rect arg;
@@ -1839,39 +1877,47 @@ void level::draw_layer_solid(int layer, int x, int y, int w, int h) const
 	}
 }
 
-void level::prepare_tiles_for_drawing()
+namespace {
+bool tile_in_chunks(const level_tile& t, int x1, int y1, int x2, int y2)
 {
-	level_object::set_current_palette(palettes_used_);
+	const int xchunk = tile_chunk_of(t.x), ychunk = tile_chunk_of(t.y);
+	return xchunk >= x1 && xchunk <= x2 && ychunk >= y1 && ychunk <= y2;
+}
+}
 
-	solid_color_rects_.clear();
-	blit_cache_.clear();
+void level::prepare_tiles_for_drawing(const rect* area)
+{
+	level_object::set_current_palette(palettes_used_);
 
-	for(int n = 0; n != tiles_.size(); ++n) {
-		if(!is_arcade_level() && tiles_[n].object->solid_color()) {
-			continue;
+	//the range of chunks to rebuild, inclusive.
+	int xchunk1 = INT_MIN, ychunk1 = INT_MIN, xchunk2 = INT_MAX, ychunk2 = INT_MAX;
+	if(area) {
+		if(area->w() <= 0 || area->h() <= 0) {
+			return;
 		}
 
-		//in the editor we want to draw the whole level, so don't exclude
-		//things outside the level bounds.
-		if(!editor_ && (tiles_[n].x <= boundaries().x() - TileSize || tiles_[n].y <= boundaries().y() - TileSize || tiles_[n].x >= boundaries().x2() || tiles_[n].y >= boundaries().y2())) {
-			continue;
-		}
+		xchunk1 = tile_chunk_of(area->x());
+		ychunk1 = tile_chunk_of(area->y());
+		xchunk2 = tile_chunk_of(area->x2() - 1);
+		ychunk2 = tile_chunk_of(area->y2() - 1);
 
-		layer_blit_info& blit_info = blit_cache_[tiles_[n].zorder];
-		if(blit_info.xbase == -1) {
-			blit_info.texture_id = tiles_[n].object->texture().get_id();
-			blit_info.xbase = tiles_[n].x;
-			blit_info.ybase = tiles_[n].y;
+		for(std::map<int, layer_blit_info>::iterator i = blit_cache_.begin(); i != blit_cache_.end(); ++i) {
+			layer_blit_info::chunk_map& chunks = i->second.chunks;
+			for(int ychunk = ychunk1; ychunk <= ychunk2; ++ychunk) {
+				chunks.erase(chunks.lower_bound(std::pair<int, int>(ychunk, xchunk1)),
+				             chunks.upper_bound(std::pair<int, int>(ychunk, xchunk2)));
+			}
 		}
+	} else {
+		blit_cache_.clear();
+	}
 
-		if(tiles_[n].x < blit_info.xbase) {
-			blit_info.xbase = tiles_[n].x;
-		}
+	solid_color_rects_.clear();
 
-		if(tiles_[n].y < blit_info.ybase) {
-			blit_info.ybase = tiles_[n].y;
-		}
-	}
+	//the tiles for each chunk being rebuilt, keyed by layer and then by
+	//the chunk's row and column.
+	typedef std::map<std::pair<int, std::pair<int, int> >, std::vector<const level_tile*> > chunk_tiles_map;
+	chunk_tiles_map chunk_tiles;
 
 	for(int n = 0; n != tiles_.size(); ++n) {
 		if(!editor_ && (tiles_[n].x <= boundaries().x() - TileSize || tiles_[n].y <= boundaries().y() - TileSize || tiles_[n].x >= boundaries().x2() || tiles_[n].y >= boundaries().y2())) {
@@ -1896,34 +1942,20 @@ void level::prepare_tiles_for_drawing()
 			continue;
 		}
 
-		layer_blit_info& blit_info = blit_cache_[tiles_[n].zorder];
+		if(!tile_in_chunks(tiles_[n], xchunk1, ychunk1, xchunk2, ychunk2)) {
+			continue;
+		}
 
 		tiles_[n].draw_disabled = false;
 
-		blit_info.blit_vertexes.resize(blit_info.blit_vertexes.size() + 4);
-		const int npoints = level_object::calculate_tile_corners(&blit_info.blit_vertexes[blit_info.blit_vertexes.size() - 4], tiles_[n]);
-		if(npoints == 0) {
-			blit_info.blit_vertexes.resize(blit_info.blit_vertexes.size() - 4);
-		} else {
-			blit_info.vertex_texture_ids.push_back(tiles_[n].object->texture().get_id());
-			if(blit_info.vertex_texture_ids.back() != blit_info.texture_id) {
-				blit_info.texture_id = GLuint(-1);
-			}
-
-			const int xtile = (tiles_[n].x - blit_info.xbase)/TileSize;
-			const int ytile = (tiles_[n].y - blit_info.ybase)/TileSize;
-			ASSERT_GE(xtile, 0);
-			ASSERT_GE(ytile, 0);
-			if(blit_info.indexes.size() <= ytile) {
-				blit_info.indexes.resize(ytile+1);
-			}
-
-			if(blit_info.indexes[ytile].size() <= xtile) {
-				blit_info.indexes[ytile].resize(xtile+1, TILE_INDEX_TYPE_MAX);
-			}
+		const std::pair<int, int> chunk(tile_chunk_of(tiles_[n].y), tile_chunk_of(tiles_[n].x));
+		chunk_tiles[std::make_pair(tiles_[n].zorder, chunk)].push_back(&tiles_[n]);
+	}
 
-			blit_info.indexes[ytile][xtile] = (blit_info.blit_vertexes.size() - 4) * (tiles_[n].object->is_opaque() ? 1 : -1);
-		}
+	for(chunk_tiles_map::const_iterator i = chunk_tiles.begin(); i != chunk_tiles.end(); ++i) {
+		const std::pair<int, int>& chunk = i->first.second;
+		layer_blit_info& blit_info = blit_cache_[i->first.first];
+		build_tile_chunk(&blit_info.chunks[chunk], chunk.second*tile_chunk_size(), chunk.first*tile_chunk_size(), i->second);
 	}
 
 	for(int n = 1; n < solid_color_rects_.size(); ++n) {
@@ -1950,6 +1982,10 @@ void level::prepare_tiles_for_drawing()
 			continue;
 		}
 
+		if(!tile_in_chunks(t, xchunk1, ychunk1, xchunk2, ychunk2)) {
+			continue;
+		}
+
 		if(!t.draw_disabled && opaque.count(std::pair<int,int>(t.x, t.y))) {
 			t.draw_disabled = true;
 			continue;
@@ -1962,6 +1998,59 @@ void level::prepare_tiles_for_drawing()
 
 }
 
+void level::build_tile_chunk(layer_blit_info::tile_chunk* chunk, int xbase, int ybase, const std::vector<const level_tile*>& tiles)
+{
+	//only the last tile in each cell is drawn.
+	const level_tile* cells[TileChunkTiles*TileChunkTiles];
+	std::fill(cells, cells + TileChunkTiles*TileChunkTiles, static_cast<const level_tile*>(NULL));
+	foreach(const level_tile* t, tiles) {
+		const int xcell = (t->x - xbase)/TileSize;
+		const int ycell = (t->y - ybase)/TileSize;
+		ASSERT_LOG(xcell >= 0 && xcell < TileChunkTiles && ycell >= 0 && ycell < TileChunkTiles, "TILE AT " << t->x << "," << t->y << " OUTSIDE OF ITS CHUNK");
+		cells[ycell*TileChunkTiles + xcell] = t;
+	}
+
+	//the quads in the chunk, keyed by whether they are translucent and by
+	//their texture, so each batch is a contiguous run of indexes.
+	std::vector<std::pair<std::pair<int, GLuint>, int> > quads;
+	for(int n = 0; n != TileChunkTiles*TileChunkTiles; ++n) {
+		if(cells[n] == NULL) {
+			continue;
+		}
+
+		const int base = chunk->vertexes.size();
+		chunk->vertexes.resize(base + 4);
+		if(level_object::calculate_tile_corners(&chunk->vertexes[base], *cells[n]) == 0) {
+			chunk->vertexes.resize(base);
+			continue;
+		}
+
+		quads.push_back(std::make_pair(std::make_pair(cells[n]->object->is_opaque() ? 0 : 1, cells[n]->object->texture().get_id()), base));
+	}
+
+	std::sort(quads.begin(), quads.end());
+
+	static const GLushort QuadIndexes[] = {0, 1, 2, 1, 2, 3};
+	for(int n = 0; n != quads.size(); ++n) {
+		std::vector<layer_blit_info::batch>& batches = quads[n].first.first ? chunk->translucent_batches : chunk->opaque_batches;
+		if(n == 0 || quads[n].first != quads[n-1].first) {
+			layer_blit_info::batch b;
+			b.texture_id = quads[n].first.second;
+			b.offset = chunk->indexes.size();
+			b.count = 0;
+			batches.push_back(b);
+		}
+
+		for(int i = 0; i != 6; ++i) {
+			chunk->indexes.push_back(GLushort(quads[n].second + QuadIndexes[i]));
+		}
+
+		batches.back().count += 6;
+	}
+
+	++tile_chunks_built;
+}
+
 void level::draw_status() const
 {
 	if(!gui_algorithm_.empty()) {
@@ -2706,10 +2795,14 @@ void level::do_processing()
 		active_chars = chars_immune_from_time_freeze_;
 	}
 
+	const point focus(last_draw_position().x/100 + graphics::screen_width()/2,
+	                  last_draw_position().y/100 + graphics::screen_height()/2);
+	scheduler_.schedule(cycle_, focus, active_chars);
+
 	while(!active_chars.empty()) {
 		new_chars_.clear();
 		foreach(const entity_ptr& c, active_chars) {
-			if(!c->destroyed() && (chars_by_label_.count(c->label()) || c->is_human())) {
+			if(!c->destroyed() && (chars_by_label_.count(c->label()) || c->is_human()) && !scheduler_.is_deferred(*c)) {
 				c->process(*this);
 			}
 	
@@ -2722,6 +2815,9 @@ void level::do_processing()
 			}
 		}
 
+		//objects created this cycle are always processed.
+		scheduler_.clear();
+
 		active_chars = new_chars_;
 		active_chars_.insert(active_chars_.end(), new_chars_.begin(), new_chars_.end());
 	}
@@ -2860,16 +2956,18 @@ bool level::is_solid(const level_solid_map& map, int x, int y, const surface_inf
 
 bool level::standable(const rect& r, const surface_info** info) const
 {
-	const int ybegin = r.y();
-	const int yend = r.y2();
-	const int xbegin = r.x();
-	const int xend = r.x2();
-
-	for(int y = ybegin; y != yend; ++y) {
-		for(int x = xbegin; x != xend; ++x) {
-			if(standable(x, y, info)) {
-				return true;
+	//each row is searched for its leftmost solid and standable pixels, so
+	//that the pixel found is the one a search pixel by pixel would find.
+	for(int y = r.y(); y < r.y2(); ++y) {
+		int solid_x = r.x2(), standable_x;
+		const tile_solid_info* solid_tile = solid_.first_solid_in_row(y, r.x(), r.x2(), &solid_x);
+		const tile_solid_info* standable_tile = standable_.first_solid_in_row(y, r.x(), solid_x, &standable_x);
+		if(standable_tile || solid_tile) {
+			if(info) {
+				*info = standable_tile ? &standable_tile->info : &solid_tile->info;
 			}
+
+			return true;
 		}
 	}
 
@@ -2907,37 +3005,25 @@ bool level::solid(const entity& e, const std::vector<point>& points, const surfa
 
 bool level::solid(int xbegin, int ybegin, int w, int h, const surface_info** info) const
 {
-	const int xend = xbegin + w;
-	const int yend = ybegin + h;
+	//rows with no tiles in them at all are skipped a tile's height at a
+	//time.
+	const int line = solid_.first_solid_line(xbegin, ybegin, w, h, 0, 1);
+	if(line == -1) {
+		return false;
+	}
 
-	for(int y = ybegin; y != yend; ++y) {
-		for(int x = xbegin; x != xend; ++x) {
-			if(solid(x, y, info)) {
-				return true;
-			}
-		}
+	int xpos;
+	const tile_solid_info* tile = solid_.first_solid_in_row(ybegin + line, xbegin, xbegin + w, &xpos);
+	if(info) {
+		*info = &tile->info;
 	}
 
-	return false;
+	return true;
 }
 
 bool level::solid(const rect& r, const surface_info** info) const
 {
-	//TODO: consider optimizing this function.
-	const int ybegin = r.y();
-	const int yend = r.y2();
-	const int xbegin = r.x();
-	const int xend = r.x2();
-
-	for(int y = ybegin; y != yend; ++y) {
-		for(int x = xbegin; x != xend; ++x) {
-			if(solid(x, y, info)) {
-				return true;
-			}
-		}
-	}
-
-	return false;
+	return solid(r.x(), r.y(), r.w(), r.h(), info);
 }
 
 bool level::may_be_solid_in_rect(const rect& r) const
@@ -2962,7 +3048,8 @@ bool level::may_be_solid_in_rect(const rect& r) const
 
 	for(int ypos = 0; ypos < y2; ++ypos) {
 		for(int xpos = 0; xpos < x2; ++xpos) {
-			if(solid_.find(tile_pos(pos.first + xpos, pos.second + ypos))) {
+			const tile_solid_info* info = solid_.find(tile_pos(pos.first + xpos, pos.second + ypos));
+			if(info && !info->empty()) {
 				return true;
 			}
 		}
@@ -2971,6 +3058,71 @@ bool level::may_be_solid_in_rect(const rect& r) const
 	return false;
 }
 
+int level::clear_distance(const rect& area, int dx, int dy, int max_steps, bool standable) const
+{
+	if(area.w() == 0 || area.h() == 0 || max_steps <= 0) {
+		return std::max(max_steps, 0);
+	}
+
+	//the area covered by the steps, less the line the area starts out
+	//covering at its back.
+	rect sweep;
+	if(dy > 0) {
+		sweep = rect(area.x(), area.y() + 1, area.w(), area.h() - 1 + max_steps);
+	} else if(dy < 0) {
+		sweep = rect(area.x(), area.y() - max_steps, area.w(), area.h() - 1 + max_steps);
+	} else if(dx > 0) {
+		sweep = rect(area.x() + 1, area.y(), area.w() - 1 + max_steps, area.h());
+	} else {
+		sweep = rect(area.x() - max_steps, area.y(), area.w() - 1 + max_steps, area.h());
+	}
+
+	int line = solid_.first_solid_line(sweep.x(), sweep.y(), sweep.w(), sweep.h(), dx, dy);
+	if(standable) {
+		const int standable_line = standable_.first_solid_line(sweep.x(), sweep.y(), sweep.w(), sweep.h(), dx, dy);
+		if(standable_line != -1 && (line == -1 || standable_line < line)) {
+			line = standable_line;
+		}
+	}
+
+	if(line == -1) {
+		return max_steps;
+	}
+
+	//the area's leading edge reaches the line on the step after it has
+	//crossed its own length.
+	const int length = dy ? area.h() : area.w();
+	return std::max(1, line - length + 2) - 1;
+}
+
+int level::first_standable_step(int x, int y, int dx, int dy, int nsteps) const
+{
+	if(nsteps <= 0) {
+		return -1;
+	}
+
+	//the steps make up a line one pixel wide, so scanning the lines
+	//across it in the direction of the steps finds the first one.
+	rect line;
+	if(dy > 0) {
+		line = rect(x, y, 1, nsteps);
+	} else if(dy < 0) {
+		line = rect(x, y - nsteps + 1, 1, nsteps);
+	} else if(dx > 0) {
+		line = rect(x, y, nsteps, 1);
+	} else {
+		line = rect(x - nsteps + 1, y, nsteps, 1);
+	}
+
+	const int solid_step = solid_.first_solid_line(line.x(), line.y(), line.w(), line.h(), dx, dy);
+	const int standable_step = standable_.first_solid_line(line.x(), line.y(), line.w(), line.h(), dx, dy);
+	if(solid_step == -1 || standable_step != -1 && standable_step < solid_step) {
+		return standable_step;
+	}
+
+	return solid_step;
+}
+
 void level::set_solid_area(const rect& r, bool solid)
 {
 	std::string empty_info;
@@ -3000,7 +3152,9 @@ void level::add_tile(const level_tile& t)
 	tiles_.insert(itor, t);
 	add_tile_solid(t);
 	layers_.insert(t.zorder);
-	prepare_tiles_for_drawing();
+
+	const rect area(t.x, t.y, 1, 1);
+	prepare_tiles_for_drawing(&area);
 }
 
 bool level::add_tile_rect(int zorder, int x1, int y1, int x2, int y2, const std::string& str)
@@ -3044,11 +3198,6 @@ void level::set_tile_layer_speed(int zorder, int x_speed, int y_speed)
 	m.set_speed(x_speed, y_speed);
 }
 
-void level::refresh_tile_rect(int x1, int y1, int x2, int y2)
-{
-	rebuild_tiles_rect(rect(x1-128, y1-128, (x2 - x1) + 256, (y2 - y1) + 256));
-}
-
 namespace {
 int round_tile_size(int n)
 {
@@ -3060,6 +3209,44 @@ int round_tile_size(int n)
 	}
 }
 
+//how far a tile's pattern may look for its neighbors.
+const int TilePatternReach = TileSize*4;
+
+}
+
+void level::refresh_tile_rect(int x1, int y1, int x2, int y2)
+{
+	if(x1 > x2) {
+		std::swap(x1, x2);
+	}
+
+	if(y1 > y2) {
+		std::swap(y1, y2);
+	}
+
+	//a rebuild in flight works from a copy of the tile maps taken when it
+	//began, and will replace these tiles when it completes, so it has to
+	//run again instead.
+	level_tile_rebuild_info& info = tile_rebuild_map[this];
+	if(info.rebuild_tile_thread != NULL) {
+		start_rebuild_tiles_in_background(std::vector<int>());
+		return;
+	}
+
+	x1 = round_tile_size(x1) - TilePatternReach;
+	y1 = round_tile_size(y1) - TilePatternReach;
+	x2 = round_tile_size(x2 + TileSize) + TilePatternReach;
+	y2 = round_tile_size(y2 + TileSize) + TilePatternReach;
+	const rect r(x1, y1, x2 - x1, y2 - y1);
+
+	//background rebuilds are frozen, so wait until they are thawed and
+	//rebuild everything asked for then, once.
+	if(info.tile_rebuild_in_progress) {
+		info.frozen_refresh_rect = info.frozen_refresh_rect.w() > 0 ? rect_union(info.frozen_refresh_rect, r) : r;
+		return;
+	}
+
+	rebuild_tiles_rect(r);
 }
 
 bool level::add_tile_rect_vector_internal(int zorder, int x1, int y1, int x2, int y2, const std::vector<std::string>& tiles)
@@ -3396,6 +3583,7 @@ void level::remove_character(entity_ptr e)
 	}
 	chars_.erase(std::remove(chars_.begin(), chars_.end(), e), chars_.end());
 	solid_chars_.erase(std::remove(solid_chars_.begin(), solid_chars_.end(), e), solid_chars_.end());
+	solid_char_grid_.remove(*e);
 	active_chars_.erase(std::remove(active_chars_.begin(), active_chars_.end(), e), active_chars_.end());
 }
 
@@ -3491,7 +3679,7 @@ void level::add_solid_rect(int x1, int y1, int x2, int y2, int friction, int tra
 		for(int x = x1; x < x2; x += TileSize) {
 			tile_pos pos(x/TileSize, y/TileSize);
 			tile_solid_info& s = solid_.insert_or_find(pos);
-			s.all_solid = true;
+			s.set_all_solid();
 			s.info.friction = friction;
 			s.info.traction = traction;
 
@@ -3544,16 +3732,10 @@ void level::set_solid(level_solid_map& map, int x, int y, int friction, int trac
 	if(solid) {
 		info.info.friction = friction;
 		info.info.traction = traction;
-		info.bitmap.set(index);
-	} else {
-		if(info.all_solid) {
-			info.all_solid = false;
-			info.bitmap.set();
-		}
-
-		info.bitmap.reset(index);
 	}
 
+	info.set_pixel(index, solid);
+
 	if(info_str.empty() == false) {
 		info.info.info = surface_info::get_info_str(info_str);
 	}
@@ -3624,6 +3806,7 @@ void level::add_character(entity_ptr p)
 {
 	if(solid_chars_.empty() == false && p->solid()) {
 		solid_chars_.push_back(p);
+		solid_char_grid_.add(*p);
 	}
 
 	ASSERT_LOG(p->label().empty() == false, "Entity has no label");
@@ -4191,11 +4374,24 @@ const std::vector<entity_ptr>& level::get_solid_chars() const
 				solid_chars_.push_back(e);
 			}
 		}
+
+		solid_char_grid_.assign(solid_chars_);
 	}
 
 	return solid_chars_;
 }
 
+void level::get_solid_chars_in_rect(const rect& area, std::vector<entity*>* result) const
+{
+	const std::vector<entity_ptr>& chars = get_solid_chars();
+	if(solid_char_grid_.size() != chars.size()) {
+		//a copy of a level starts with an empty grid.
+		solid_char_grid_.assign(chars);
+	}
+
+	solid_char_grid_.query(area, result);
+}
+
 void level::begin_movement_script(const std::string& key, entity& e)
 {
 	std::map<std::string, movement_script>::const_iterator itor = movement_scripts_.find(key);
@@ -4494,7 +4690,14 @@ void level::editor_freeze_tile_updates(bool value)
 	} else {
 		--editor_tile_updates_frozen_;
 		if(editor_tile_updates_frozen_ == 0) {
-			rebuild_tiles();
+			const rect dirty = editor_dirty_tiles_;
+			editor_dirty_tiles_ = rect();
+			if(editor_dirty_all_tiles_) {
+				editor_dirty_all_tiles_ = false;
+				rebuild_tiles();
+			} else if(dirty.w() > 0) {
+				rebuild_tiles_rect(dirty);
+			}
 		}
 	}
 }
@@ -4930,6 +5133,43 @@ BENCHMARK(level_solid)
 	}
 }
 
+BENCHMARK(level_solid_rect)
+{
+	//solid and standable checks of object sized areas, which are answered
+	//a run of pixels at a time.
+	static level* lvl = new level("stairway-to-heaven.cfg");
+	BENCHMARK_LOOP {
+		const rect area(rng::generate()%1000, rng::generate()%1000, 32, 64);
+		lvl->solid(area);
+		lvl->standable(area);
+	}
+}
+
+BENCHMARK(level_solid_column)
+{
+	//searching down a column for somewhere to stand.
+	static level* lvl = new level("stairway-to-heaven.cfg");
+	BENCHMARK_LOOP {
+		lvl->first_standable_step(rng::generate()%1000, rng::generate()%1000, 0, 1, 1000);
+	}
+}
+
+BENCHMARK(level_draw_tiles)
+{
+	//draws screens from around a level, as scrolling through it would.
+	static level* lvl = NULL;
+	if(!lvl) {
+		lvl = new level("stairway-to-heaven.cfg");
+		static variant holder(lvl);
+		lvl->finish_loading();
+		lvl->set_as_current_level();
+	}
+
+	BENCHMARK_LOOP {
+		lvl->draw(rng::generate()%1000, rng::generate()%1000, graphics::screen_width(), graphics::screen_height());
+	}
+}
+
 BENCHMARK(load_nene)
 {
 	BENCHMARK_LOOP {
@@ -48,6 +48,7 @@
 #include "level_object.hpp"
 #include "level_solid_map.hpp"
 #include "movement_script.hpp"
+#include "object_scheduler.hpp"
 #include "raster.hpp"
 #include "speech_dialog.hpp"
 #include "tile_map.hpp"
@@ -82,6 +83,11 @@ public:
 
 	static int tile_rebuild_state_id();
 
+	//the number of draw calls made for tile layers so far, and a summary
+	//of them along with how many tile chunks were built and uploaded.
+	static int tile_draw_calls();
+	static std::string tile_draw_report();
+
 	static void set_player_variant_type(variant type);
 
 	explicit level(const std::string& level_cfg, variant node=variant());
@@ -125,6 +131,16 @@ public:
 	bool solid(const rect& r, const surface_info** info=NULL) const;
 	bool solid(int xbegin, int ybegin, int w, int h, const surface_info** info=NULL) const;
 	bool may_be_solid_in_rect(const rect& r) const;
+
+	//the number of one pixel steps, up to max_steps, that 'area' can take
+	//in the direction (dx, dy) without overlapping a solid pixel, or with
+	//'standable' a standable one. Objects aren't considered.
+	int clear_distance(const rect& area, int dx, int dy, int max_steps, bool standable=false) const;
+
+	//takes up to nsteps one pixel steps from (x, y) in the direction
+	//(dx, dy), returning the number of steps taken before landing on a
+	//standable pixel -- 0 if (x, y) is standable -- or -1 if none is.
+	int first_standable_step(int x, int y, int dx, int dy, int nsteps) const;
 	void set_solid_area(const rect& r, bool solid);
 	entity_ptr board(int x, int y) const;
 	const rect& boundaries() const { return boundaries_; }
@@ -133,6 +149,9 @@ public:
 	bool add_tile_rect(int zorder, int x1, int y1, int x2, int y2, const std::string& tile);
 	bool add_tile_rect_vector(int zorder, int x1, int y1, int x2, int y2, const std::vector<std::string>& tiles);
 	void set_tile_layer_speed(int zorder, int x_speed, int y_speed);
+
+	//rebuilds the tiles and solidity around a rect whose tiles changed,
+	//taking in the neighbors whose patterns the change may affect.
 	void refresh_tile_rect(int x1, int y1, int x2, int y2);
 	void get_tile_rect(int zorder, int x1, int y1, int x2, int y2, std::vector<std::string>& tiles) const;
 	void get_all_tiles_rect(int x1, int y1, int x2, int y2, std::map<int, std::vector<std::string> >& tiles) const;
@@ -255,7 +274,8 @@ public:
 	void complete_rebuild_tiles_in_background();
 
 	//stop calls to start_rebuild_tiles_in_background from proceeding
-	//until unfreeze_rebuild_tiles_in_background() is called.
+	//until unfreeze_rebuild_tiles_in_background() is called. Calls to
+	//refresh_tile_rect() meanwhile are rebuilt together on unfreezing.
 	void freeze_rebuild_tiles_in_background();
 
 	void unfreeze_rebuild_tiles_in_background();
@@ -311,6 +331,10 @@ public:
 	const std::vector<entity_ptr>& get_active_chars() const { return active_chars_; }
 	const std::vector<entity_ptr>& get_chars() const { return chars_; }
 	const std::vector<entity_ptr>& get_solid_chars() const;
+
+	//appends the objects of get_solid_chars() whose solid or platform
+	//area may intersect 'area' to 'result', in the same order.
+	void get_solid_chars_in_rect(const rect& area, std::vector<entity*>* result) const;
 	void swap_chars(std::vector<entity_ptr>& v) { chars_.swap(v); solid_chars_.clear(); }
 	int num_active_chars() const { return active_chars_.size(); }
 
@@ -349,6 +373,8 @@ public:
 
 	const point* lock_screen() const { return lock_screen_.get(); }
 
+	//while frozen, tile rebuilds are put off and only the area they would
+	//have covered is recorded. It is rebuilt once they are thawed.
 	void editor_freeze_tile_updates(bool value);
 
 	decimal zoom_level() const;
@@ -424,7 +450,9 @@ private:
 	void read_compiled_tiles(variant node, std::vector<level_tile>::iterator& out);
 
 	void complete_tiles_refresh();
-	void prepare_tiles_for_drawing();
+	//builds the chunks tiles are drawn from. Only the chunks overlapping
+	//'area' are rebuilt if it is given.
+	void prepare_tiles_for_drawing(const rect* area=NULL);
 
 	void do_processing();
 
@@ -493,39 +521,41 @@ private:
 	int highlight_layer_;
 
 	struct layer_blit_info {
-		layer_blit_info() : texture_id(0), xbase(-1), ybase(-1)
-		{}
-
-		GLuint texture_id;
-
-		std::vector<tile_corner> blit_vertexes;
-
-		//texture ID's for each set of corners, used if texture_id == -1
-		//(i.e. if there are 
-		std::vector<GLuint> vertex_texture_ids;
-
-		int xbase, ybase;
-
-		typedef GLint IndexType;
-#define TILE_INDEX_TYPE GL_UNSIGNED_INT
-#define TILE_INDEX_TYPE_MAX INT_MAX
-
-		//a two dimensional array of indexes into vertex_texture_ids,
-		//representing the tiles in a layer.
-		std::vector<std::vector<IndexType> > indexes;
-
-		//we have two blit queues for a layer. One to draw tiles which have
-		//some alpha (GL_BLEND enabled) and others which are completely opaque
-		//and can be drawn more efficiently without alpha blending.
-		std::vector<IndexType> opaque_indexes, translucent_indexes;
-
-		rect tile_positions;
-
-		//graphics::vbo_array vbo;
+		//tiles drawn in the same call: 'count' indexes from 'offset' in
+		//the chunk's indexes, all using one texture.
+		struct batch {
+			GLuint texture_id;
+			int offset, count;
+		};
+
+		//a square block of the layer's tiles. Its vertexes and indexes are
+		//uploaded to buffers of its own the first time it is drawn, and stay
+		//there until tiles inside it change.
+		struct tile_chunk {
+			tile_chunk() : uploaded(false)
+			{}
+
+			std::vector<tile_corner> vertexes;
+			std::vector<GLushort> indexes;
+
+			//completely opaque tiles are drawn with GL_BLEND disabled, before
+			//those with some alpha. There is one batch for each texture.
+			std::vector<batch> opaque_batches, translucent_batches;
+
+			bool uploaded;
+			graphics::vbo_array vbo;
+		};
+
+		//chunks keyed by their row and then their column.
+		typedef std::map<std::pair<int, int>, tile_chunk> chunk_map;
+		chunk_map chunks;
 	};
 
 	mutable std::map<int, layer_blit_info> blit_cache_;
 
+	static void build_tile_chunk(layer_blit_info::tile_chunk* chunk, int xbase, int ybase, const std::vector<const level_tile*>& tiles);
+	static void draw_tile_chunk(layer_blit_info::tile_chunk& chunk, bool translucent);
+
 	struct solid_color_rect {
 		graphics::color color;
 		rect area;
@@ -550,7 +580,11 @@ private:
 	std::vector<entity_ptr> chars_;
 	mutable std::vector<entity_ptr> active_chars_;
 	std::vector<entity_ptr> new_chars_;
+
+	//holds back objects whose processing policies skip a cycle.
+	object_scheduler scheduler_;
 	mutable std::vector<entity_ptr> solid_chars_;
+	mutable solid_char_grid solid_char_grid_;
 
 	std::vector<entity_ptr> chars_immune_from_time_freeze_;
 
@@ -652,6 +686,8 @@ private:
 	std::deque<backup_snapshot_ptr> backups_;
 
 	int editor_tile_updates_frozen_;
+	rect editor_dirty_tiles_;
+	bool editor_dirty_all_tiles_;
 	bool editor_dragging_objects_;
 
 	std::vector<std::string> gui_algo_str_;
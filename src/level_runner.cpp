@@ -742,6 +742,7 @@ level_runner::level_runner(boost::intrusive_ptr<level>& lvl, std::string& level_
 	done = false;
 	start_time_ = SDL_GetTicks();
 	pause_time_ = -global_pause_time;
+	last_physics_ticks_ = 0;
 	mouse_clicking_ = false;
 	mouse_drag_count_ = 0;
 }
@@ -873,7 +874,10 @@ bool level_runner::play_cycle()
 #if defined(USE_BOX2D)
 	box2d::world_ptr world = box2d::world::our_world_ptr();
 	if(world && !paused) {
-		world->step(1.0f/50.0f);
+		//physics always advances by one cycle's worth of steps, so play
+		//doesn't depend on how long frames take.
+		world->advance();
+		last_physics_ticks_ = SDL_GetTicks();
 	}
 #endif
 
@@ -1615,6 +1619,14 @@ bool level_runner::play_cycle()
 
 		lvl_->process_draw();
 
+#if defined(USE_BOX2D)
+		//only drawing depends on the time since physics last advanced.
+		box2d::world_ptr draw_world = box2d::world::our_world_ptr();
+		if(draw_world && last_physics_ticks_) {
+			draw_world->set_draw_interpolation(float(SDL_GetTicks() - last_physics_ticks_)/preferences::frame_time_millis());
+		}
+#endif
+
 		if(should_draw) {
 #ifndef NO_EDITOR
 			const Uint8 *key = SDL_GetKeyboardState(NULL);
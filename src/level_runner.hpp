@@ -94,6 +94,9 @@ private:
 	int start_time_;
 	int pause_time_;
 
+	//when physics was last advanced, or 0 if it hasn't been.
+	int last_physics_ticks_;
+
 	point last_stats_point_;
 	std::string last_stats_point_level_;
 	bool handle_mouse_events(const SDL_Event &event);
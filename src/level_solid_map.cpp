@@ -14,14 +14,27 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <iostream>
 #include <set>
 
 #include "foreach.hpp"
 #include "level_solid_map.hpp"
 #include "preferences.hpp"
+#include "unit_test.hpp"
 
 namespace {
+//splits a pixel coordinate into the tile it's in and its offset in it.
+void split_coordinate(int v, int* tile, int* offset)
+{
+	*tile = v/TileSize;
+	*offset = v%TileSize;
+	if(*offset < 0) {
+		--*tile;
+		*offset += TileSize;
+	}
+}
+
 void merge_surface_info(surface_info& a, const surface_info& b)
 {
 	a.friction = std::max<int>(a.friction, b.friction);
@@ -39,6 +52,134 @@ const std::string* surface_info::get_info_str(const std::string& key)
 	return &*info_set.insert(key).first;
 }
 
+tile_solid_info::tile_solid_info()
+  : bitmap(TileSize*TileSize), all_solid(false),
+    spans_valid_(false), empty_(true), full_(false)
+{
+}
+
+void tile_solid_info::set_pixel(int index, bool solid)
+{
+	if(solid) {
+		bitmap.set(index);
+	} else {
+		if(all_solid) {
+			all_solid = false;
+			bitmap.set();
+		}
+
+		bitmap.reset(index);
+	}
+
+	spans_valid_ = false;
+}
+
+void tile_solid_info::set_all_solid()
+{
+	all_solid = true;
+	spans_valid_ = false;
+}
+
+void tile_solid_info::merge(const tile_solid_info& o)
+{
+	all_solid = all_solid || o.all_solid;
+	if(!all_solid) {
+		bitmap |= o.bitmap;
+	}
+
+	spans_valid_ = false;
+}
+
+bool tile_solid_info::empty() const
+{
+	update_spans();
+	return empty_;
+}
+
+bool tile_solid_info::full() const
+{
+	update_spans();
+	return full_;
+}
+
+int tile_solid_info::first_solid_in_row(int y, int begin, int end) const
+{
+	return first_solid_in_line(y, begin, end);
+}
+
+int tile_solid_info::first_solid_in_column(int x, int begin, int end) const
+{
+	return first_solid_in_line(TileSize + x, begin, end);
+}
+
+int tile_solid_info::first_solid_in_line(int line, int begin, int end) const
+{
+	update_spans();
+	if(full_) {
+		return begin < end ? begin : -1;
+	}
+
+	if(empty_) {
+		return -1;
+	}
+
+	for(int n = lines_[line]; n != lines_[line+1]; ++n) {
+		const span& s = spans_[n];
+		if(s.end > begin) {
+			const int result = std::max<int>(s.begin, begin);
+			return result < end ? result : -1;
+		}
+	}
+
+	return -1;
+}
+
+void tile_solid_info::update_spans() const
+{
+	if(spans_valid_) {
+		return;
+	}
+
+	spans_valid_ = true;
+	spans_.clear();
+	lines_.clear();
+
+	full_ = all_solid || bitmap.all();
+	empty_ = !full_ && bitmap.none();
+	if(full_ || empty_) {
+		return;
+	}
+
+	for(int line = 0; line != TileSize*2; ++line) {
+		lines_.push_back(spans_.size());
+
+		//rows step through the bitmap one pixel at a time, and columns
+		//one row at a time.
+		const bool row = line < TileSize;
+		const int first = row ? line*TileSize : line - TileSize;
+		const int stride = row ? 1 : TileSize;
+
+		int n = 0;
+		while(n != TileSize) {
+			if(!bitmap.test(first + n*stride)) {
+				++n;
+				continue;
+			}
+
+			span s;
+			s.begin = n;
+			while(n != TileSize && bitmap.test(first + n*stride)) {
+				++n;
+			}
+
+			s.end = n;
+			spans_.push_back(s);
+		}
+	}
+
+	lines_.push_back(spans_.size());
+}
+
 level_solid_map::level_solid_map()
 {
 }
@@ -179,11 +320,8 @@ void level_solid_map::merge(const level_solid_map& map, int xoffset, int yoffset
 				continue;
 			}
 
-			dst.all_solid = dst.all_solid || src->all_solid;
+			dst.merge(*src);
 			merge_surface_info(dst.info, src->info);
-			if(!dst.all_solid) {
-				dst.bitmap = dst.bitmap | src->bitmap;
-			}
 		}
 
 		for(int m = 0; m != map.negative_rows_[n].positive_cells.size(); ++m) {
@@ -194,11 +332,8 @@ void level_solid_map::merge(const level_solid_map& map, int xoffset, int yoffset
 				continue;
 			}
 
-			dst.all_solid = dst.all_solid || src->all_solid;
+			dst.merge(*src);
 			merge_surface_info(dst.info, src->info);
-			if(!dst.all_solid) {
-				dst.bitmap = dst.bitmap | src->bitmap;
-			}
 		}
 	}
 
@@ -211,11 +346,8 @@ void level_solid_map::merge(const level_solid_map& map, int xoffset, int yoffset
 				continue;
 			}
 
-			dst.all_solid = dst.all_solid || src->all_solid;
+			dst.merge(*src);
 			merge_surface_info(dst.info, src->info);
-			if(!dst.all_solid) {
-				dst.bitmap = dst.bitmap | src->bitmap;
-			}
 		}
 
 		for(int m = 0; m != map.positive_rows_[n].positive_cells.size(); ++m) {
@@ -227,11 +359,188 @@ void level_solid_map::merge(const level_solid_map& map, int xoffset, int yoffset
 
 			tile_solid_info& dst = insert_or_find(pos);
 
-			dst.all_solid = dst.all_solid || src->all_solid;
+			dst.merge(*src);
 			merge_surface_info(dst.info, src->info);
-			if(!dst.all_solid) {
-				dst.bitmap = dst.bitmap | src->bitmap;
+		}
+	}
+}
+
+bool level_solid_map::any_tiles_in_line(int pos, int begin, int end, bool vertical) const
+{
+	int line_tile, line_offset;
+	split_coordinate(pos, &line_tile, &line_offset);
+
+	int tile, offset;
+	split_coordinate(begin, &tile, &offset);
+	for(int v = begin - offset; v < end; v += TileSize, ++tile) {
+		const tile_solid_info* info = find(vertical ? tile_pos(tile, line_tile) : tile_pos(line_tile, tile));
+		if(info && !info->empty()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool level_solid_map::solid_in_line(int pos, int begin, int end, bool vertical) const
+{
+	int line_tile, line_offset;
+	split_coordinate(pos, &line_tile, &line_offset);
+
+	int v = begin;
+	while(v < end) {
+		int tile, offset;
+		split_coordinate(v, &tile, &offset);
+		const int count = std::min(end - v, TileSize - offset);
+
+		const tile_solid_info* info = find(vertical ? tile_pos(tile, line_tile) : tile_pos(line_tile, tile));
+		if(info) {
+			const int first = vertical ? info->first_solid_in_row(line_offset, offset, offset + count)
+			                           : info->first_solid_in_column(line_offset, offset, offset + count);
+			if(first != -1) {
+				return true;
+			}
+		}
+
+		v += count;
+	}
+
+	return false;
+}
+
+int level_solid_map::first_solid_line(int x, int y, int w, int h, int dx, int dy) const
+{
+	const bool vertical = dy != 0;
+	const bool forward = dx + dy > 0;
+	const int nlines = vertical ? h : w;
+	const int begin = vertical ? x : y;
+	const int end = begin + (vertical ? w : h);
+	const int first = forward ? (vertical ? y : x) : (vertical ? y + h : x + w) - 1;
+
+	int n = 0;
+	while(n < nlines) {
+		const int pos = forward ? first + n : first - n;
+		int tile, offset;
+		split_coordinate(pos, &tile, &offset);
+
+		//the lines left in this row or column of tiles.
+		const int band_end = n + std::min(nlines - n, forward ? TileSize - offset : offset + 1);
+		if(!any_tiles_in_line(pos, begin, end, vertical)) {
+			n = band_end;
+			continue;
+		}
+
+		for(; n != band_end; ++n) {
+			if(solid_in_line(forward ? first + n : first - n, begin, end, vertical)) {
+				return n;
 			}
 		}
 	}
+
+	return -1;
+}
+
+const tile_solid_info* level_solid_map::first_solid_in_row(int y, int begin, int end, int* xpos) const
+{
+	int tile_y, offset_y;
+	split_coordinate(y, &tile_y, &offset_y);
+
+	int v = begin;
+	while(v < end) {
+		int tile, offset;
+		split_coordinate(v, &tile, &offset);
+		const int count = std::min(end - v, TileSize - offset);
+
+		const tile_solid_info* info = find(tile_pos(tile, tile_y));
+		if(info) {
+			const int first = info->first_solid_in_row(offset_y, offset, offset + count);
+			if(first != -1) {
+				*xpos = v - offset + first;
+				return info;
+			}
+		}
+
+		v += count;
+	}
+
+	return NULL;
+}
+
+UNIT_TEST(tile_solid_info_spans)
+{
+	tile_solid_info info;
+	CHECK(info.empty(), "new tile is not empty");
+
+	for(int n = 0; n != TileSize*TileSize/3; ++n) {
+		info.set_pixel((n*7919)%(TileSize*TileSize), true);
+	}
+
+	info.set_pixel(5, false);
+	CHECK(!info.empty() && !info.full(), "tile should be partly solid");
+
+	//every part of every row and column must agree with the bitmap.
+	for(int line = 0; line != TileSize; ++line) {
+		for(int begin = 0; begin <= TileSize; begin += 3) {
+			for(int end = begin; end <= TileSize; end += 5) {
+				int row = -1, column = -1;
+				for(int n = end - 1; n >= begin; --n) {
+					if(info.bitmap.test(line*TileSize + n)) {
+						row = n;
+					}
+
+					if(info.bitmap.test(n*TileSize + line)) {
+						column = n;
+					}
+				}
+
+				CHECK_EQ(info.first_solid_in_row(line, begin, end), row);
+				CHECK_EQ(info.first_solid_in_column(line, begin, end), column);
+			}
+		}
+	}
+
+	info.set_all_solid();
+	CHECK(info.full(), "all solid tile is not full");
+	CHECK_EQ(info.first_solid_in_column(3, 2, 4), 2);
+
+	info.set_pixel(0, false);
+	CHECK(!info.full(), "tile should no longer be full");
+	CHECK_EQ(info.first_solid_in_row(0, 0, TileSize), 1);
+}
+
+UNIT_TEST(level_solid_map_first_solid_line)
+{
+	level_solid_map m;
+	const int points[][2] = { {5, 7}, {-3, 40}, {TileSize*2 + 1, -TileSize - 2}, {-TileSize*3, 3} };
+	foreach(const int* p, points) {
+		int tile_x, x, tile_y, y;
+		split_coordinate(p[0], &tile_x, &x);
+		split_coordinate(p[1], &tile_y, &y);
+		m.insert_or_find(tile_pos(tile_x, tile_y)).set_pixel(y*TileSize + x, true);
+	}
+
+	//every line of every direction over some areas around the points
+	//must give the same answer as checking pixel by pixel.
+	const int dirs[][2] = { {0, 1}, {0, -1}, {1, 0}, {-1, 0} };
+	for(int area = 0; area != 6; ++area) {
+		const int x = -TileSize*3 - 5 + area*17, y = -TileSize - 9 + area*13;
+		const int w = TileSize*5 + area*3, h = TileSize*2 + 50 - area*7;
+		foreach(const int* d, dirs) {
+			const bool vertical = d[1] != 0;
+			const int nlines = vertical ? h : w;
+			int expected = -1;
+			for(int n = 0; n != nlines && expected == -1; ++n) {
+				const int line = (d[0] + d[1] > 0) ? n : nlines - 1 - n;
+				foreach(const int* p, points) {
+					const int along = vertical ? p[1] - y : p[0] - x;
+					const int across = vertical ? p[0] - x : p[1] - y;
+					if(along == line && across >= 0 && across < (vertical ? w : h)) {
+						expected = n;
+					}
+				}
+			}
+
+			CHECK_EQ(m.first_solid_line(x, y, w, h, d[0], d[1]), expected);
+		}
+	}
 }
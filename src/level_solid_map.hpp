@@ -41,12 +41,49 @@ struct surface_info {
 	static const std::string* get_info_str(const std::string& key);
 };
 
+//The solidity of one tile. Besides the bitmap, each row and each column
+//of the tile is kept as a list of solid runs, so that questions like
+//'where is the first solid pixel in this part of a row' are answered a run
+//at a time rather than a pixel at a time. The runs are rebuilt from the
+//bitmap the first time they're needed after it changes, so changes must
+//be made through set_pixel(), set_all_solid() and merge().
 struct tile_solid_info {
-	tile_solid_info() : bitmap(TileSize*TileSize), all_solid(false)
-	{}
+	tile_solid_info();
 	tile_bitmap bitmap;
 	surface_info info;
 	bool all_solid;
+
+	//sets or clears the pixel at index y*TileSize + x.
+	void set_pixel(int index, bool solid);
+	void set_all_solid();
+
+	//makes every pixel solid in 'o' solid in this tile too.
+	void merge(const tile_solid_info& o);
+
+	//true if no pixel, or every pixel, of the tile is solid.
+	bool empty() const;
+	bool full() const;
+
+	//the leftmost solid pixel of row y from x = begin to end, or the
+	//topmost solid pixel of column x from y = begin to end. -1 if there
+	//is none.
+	int first_solid_in_row(int y, int begin, int end) const;
+	int first_solid_in_column(int x, int begin, int end) const;
+
+private:
+	struct span {
+		short begin, end;
+	};
+
+	void update_spans() const;
+	int first_solid_in_line(int line, int begin, int end) const;
+
+	mutable bool spans_valid_, empty_, full_;
+
+	//the runs of line n are spans_[lines_[n]] up to spans_[lines_[n+1]].
+	//Lines 0 to TileSize-1 are the rows, and the columns follow them.
+	mutable std::vector<span> spans_;
+	mutable std::vector<int> lines_;
 };
 
 class level_solid_map {
@@ -61,10 +98,27 @@ public:
 	void clear();
 
 	void merge(const level_solid_map& m, int xoffset, int yoffset);
+
+	//scans the lines of the given area one at a time in the direction
+	//(dx, dy) -- rows from the top for (0, 1), columns from the right for
+	//(-1, 0) and so on -- and returns the index of the first line with a
+	//solid pixel in it, or -1 if there is none. Rows or columns of tiles
+	//with nothing in them are skipped whole.
+	int first_solid_line(int x, int y, int w, int h, int dx, int dy) const;
+
+	//finds the leftmost solid pixel of row y from x = begin to end.
+	//Returns the tile it's in and stores its x position in 'xpos', or
+	//returns NULL if there is none.
+	const tile_solid_info* first_solid_in_row(int y, int begin, int end, int* xpos) const;
 private:
 
 	tile_solid_info** insert_raw(const tile_pos& pos);
 
+	//'vertical' means the lines are rows: the line is row 'pos', from
+	//x = begin to end. Otherwise it is column 'pos', from y = begin to end.
+	bool any_tiles_in_line(int pos, int begin, int end, bool vertical) const;
+	bool solid_in_line(int pos, int begin, int end, bool vertical) const;
+
 	struct row {
 		std::vector<tile_solid_info*> positive_cells, negative_cells;
 	};
@@ -25,6 +25,7 @@
 #include "preferences.hpp"
 #include "preprocessor.hpp"
 #include "string_utils.hpp"
+#include "unit_test.hpp"
 #include "variant.hpp"
 
 namespace {
@@ -57,12 +58,35 @@ const std::string& get_level_path(const std::string& name)
 	return itor->second;
 }
 
+namespace {
+bool is_save_file(const std::string& lvl)
+{
+	return lvl == "autosave.cfg" || (lvl.size() >= 7 && lvl.substr(0,4) == "save" && lvl.substr(lvl.size()-4) == ".cfg");
+}
+}
+
 void clear_level_wml()
 {
+	json::clear_streamed_files();
 }
 
+//Levels aren't constructed off the main thread, since that runs object
+//code, but their files are read and, where they don't use the
+//preprocessor, parsed on a worker thread. See json::stream_file().
 void preload_level_wml(const std::string& lvl)
 {
+	if(lvl.empty() || is_save_file(lvl)) {
+		return;
+	}
+
+	if(get_level_paths().empty()) {
+		load_level_paths();
+	}
+
+	std::map<std::string, std::string>::const_iterator itor = module::find(get_level_paths(), lvl);
+	if(itor != get_level_paths().end()) {
+		json::stream_file(itor->second);
+	}
 }
 
 variant load_level_wml(const std::string& lvl)
@@ -74,7 +98,7 @@ variant load_level_wml_nowait(const std::string& lvl)
 {
 	if(lvl == "autosave.cfg") {
 		return json::parse_from_file(preferences::auto_save_file_path());
-	} else if(lvl.size() >= 7 && lvl.substr(0,4) == "save" && lvl.substr(lvl.size()-4) == ".cfg") {
+	} else if(is_save_file(lvl)) {
 		preferences::set_save_slot(lvl);
 		return json::parse_from_file(preferences::save_file_path());
 	}
@@ -87,10 +111,12 @@ load_level_manager::load_level_manager()
 
 load_level_manager::~load_level_manager()
 {
+	clear_level_wml();
 }
 
 void preload_level(const std::string& lvl)
 {
+	preload_level_wml(lvl);
 }
 
 boost::intrusive_ptr<level> load_level(const std::string& lvl)
@@ -131,3 +157,19 @@ std::vector<std::string> get_known_levels()
 	std::sort(files.begin(), files.end());
 	return files;
 }
+
+UNIT_TEST(stream_all_levels)
+{
+	const std::vector<std::string> levels = get_known_levels();
+
+	//start every level at once, then check each against a plain parse.
+	foreach(const std::string& lvl, levels) {
+		preload_level_wml(lvl);
+	}
+
+	foreach(const std::string& lvl, levels) {
+		const variant streamed = load_level_wml(lvl);
+		const variant direct = json::parse(json::get_file_contents(get_level_path(lvl)));
+		CHECK_EQ(streamed, direct);
+	}
+}
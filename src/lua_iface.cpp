@@ -26,6 +26,7 @@
 #include <cmath>
 #include <iostream>
 #include <functional>
+#include <new>
 #include <boost/bind.hpp>
 #ifdef _MSC_VER
 #include <boost/math/special_functions/round.hpp>
@@ -36,6 +37,7 @@
 #include "filesystem.hpp"
 #include "formula_function_registry.hpp"
 #include "formula_object.hpp"
+#include "json_parser.hpp"
 #include "lua_iface.hpp"
 #include "level.hpp"
 #include "module.hpp"
@@ -52,6 +54,7 @@ namespace lua
 		const char* const function_str = "anura.function";
 		const char* const callable_str = "anura.callable";
 		const char* const lib_functions_str = "anura.lib";
+		const char* const variant_proxy_str = "anura.variant";
 	}
 
 	lua_context& get_global_lua_instance()
@@ -114,6 +117,287 @@ namespace lua
 			variant value;
 		};
 
+		static int variant_to_lua_value(lua_State* L, const variant& value);
+		static variant lua_value_to_variant(lua_State* L, int ndx);
+
+		// FFL lists and maps are passed to Lua as proxies holding the variant,
+		// rather than being copied into tables. Elements are converted when
+		// they're read. Lists and maps read out of a proxy are proxies too, and
+		// are kept in the proxy's uservalue table, keyed as Lua indexed them, so
+		// that writes to them stay visible through the parent. The first write
+		// to a proxy whose variant is still shared copies it, one level deep.
+		// Lists keep the 0-based indexes the old table conversion used.
+		struct variant_proxy
+		{
+			variant value;
+		};
+
+		static void push_variant_proxy(lua_State* L, const variant& value)
+		{
+			void* mem = lua_newuserdata(L, sizeof(variant_proxy));	// (-0,+1,e)
+			variant_proxy* proxy = new (mem) variant_proxy;
+			proxy->value = value;
+
+			luaL_getmetatable(L, variant_proxy_str);	// (-0,+1,e)
+			lua_setmetatable(L, -2);					// (-1,+0,e)
+
+			lua_newtable(L);							// (-0,+1,e)
+			lua_setuservalue(L, -2);					// (-1,+0,-)
+		}
+
+		static int proxy_list_index(lua_State* L, const variant_proxy& proxy, int key)
+		{
+			if(lua_type(L, key) != LUA_TNUMBER) {
+				return -1;
+			}
+
+			const lua_Number d = lua_tonumber(L, key);
+			const int index = int(d);
+			if(index != d || index < 0 || index >= int(proxy.value.num_elements())) {
+				return -1;
+			}
+
+			return index;
+		}
+
+		// pushes an element read out of the proxy at index 'ud', which Lua
+		// knows by the key at index 'key'.
+		static void push_proxy_element(lua_State* L, int ud, int key, const variant& element)
+		{
+			if(!element.is_list() && !element.is_map()) {
+				variant_to_lua_value(L, element);		// (-0,+1,e)
+				return;
+			}
+
+			lua_getuservalue(L, ud);					// (-0,+1,-)
+			lua_pushvalue(L, key);						// (-0,+1,-)
+			lua_rawget(L, -2);							// (-1,+1,-)
+			if(lua_isnil(L, -1)) {
+				lua_pop(L, 1);							// (-1,+0,-)
+				push_variant_proxy(L, element);			// (-0,+1,e)
+				lua_pushvalue(L, key);					// (-0,+1,-)
+				lua_pushvalue(L, -2);					// (-0,+1,-)
+				lua_rawset(L, -4);						// (-2,+0,e)
+			}
+			lua_remove(L, -2);							// (-1,+0,-)
+		}
+
+		static void forget_proxy_element(lua_State* L, int ud, int key)
+		{
+			lua_getuservalue(L, ud);					// (-0,+1,-)
+			lua_pushvalue(L, key);						// (-0,+1,-)
+			lua_pushnil(L);								// (-0,+1,-)
+			lua_rawset(L, -3);							// (-2,+0,e)
+			lua_pop(L, 1);								// (-1,+0,-)
+		}
+
+		static void make_proxy_unique(variant_proxy& proxy)
+		{
+			if(proxy.value.refcount() == 1) {
+				return;
+			}
+
+			if(proxy.value.is_list()) {
+				std::vector<variant> v = proxy.value.as_list();
+				proxy.value = variant(&v);
+			} else {
+				std::map<variant,variant> m = proxy.value.as_map();
+				proxy.value = variant(&m);
+			}
+		}
+
+		// the proxy's variant, with writes made through its cached children
+		// folded back in. No copying is done unless Lua changed something.
+		static variant proxy_to_variant(lua_State* L, int ud)
+		{
+			ud = lua_absindex(L, ud);
+			variant_proxy* proxy = static_cast<variant_proxy*>(lua_touserdata(L, ud));
+
+			lua_getuservalue(L, ud);					// (-0,+1,-)
+			lua_pushnil(L);								// (-0,+1,-)
+			while(lua_next(L, -2)) {					// (-1,+(2|0),e)
+				const variant child = proxy_to_variant(L, -1);
+				if(proxy->value.is_list()) {
+					const int index = proxy_list_index(L, *proxy, -2);
+					if(index >= 0 && proxy->value[index].get_addr() != child.get_addr()) {
+						make_proxy_unique(*proxy);
+						*proxy->value.get_index_mutable(index) = child;
+					}
+				} else {
+					const variant key = lua_value_to_variant(L, -2);
+					const std::map<variant,variant>& m = proxy->value.as_map();
+					std::map<variant,variant>::const_iterator i = m.find(key);
+					if(i == m.end() || i->second.get_addr() != child.get_addr()) {
+						make_proxy_unique(*proxy);
+						proxy->value.add_attr_mutation(key, child);
+					}
+				}
+				lua_pop(L, 1);							// (-1,+0,-)
+			}
+			lua_pop(L, 1);								// (-1,+0,-)
+
+			return proxy->value;
+		}
+
+		static int proxy_index(lua_State* L)
+		{
+			// stack -- proxy, key
+			variant_proxy* proxy = static_cast<variant_proxy*>(luaL_checkudata(L, 1, variant_proxy_str));	// (-0,+0,-)
+			if(proxy->value.is_list()) {
+				const int index = proxy_list_index(L, *proxy, 2);
+				if(index < 0) {
+					lua_pushnil(L);
+				} else {
+					push_proxy_element(L, 1, 2, proxy->value[index]);
+				}
+				return 1;
+			}
+
+			const std::map<variant,variant>& m = proxy->value.as_map();
+			std::map<variant,variant>::const_iterator i = m.find(lua_value_to_variant(L, 2));
+			if(i == m.end()) {
+				lua_pushnil(L);
+			} else {
+				push_proxy_element(L, 1, 2, i->second);
+			}
+			return 1;
+		}
+
+		static int proxy_newindex(lua_State* L)
+		{
+			// stack -- proxy, key, value
+			variant_proxy* proxy = static_cast<variant_proxy*>(luaL_checkudata(L, 1, variant_proxy_str));	// (-0,+0,-)
+			const variant value = lua_value_to_variant(L, 3);
+			forget_proxy_element(L, 1, 2);
+
+			if(proxy->value.is_list()) {
+				const int size = proxy->value.num_elements();
+				if(lua_type(L, 2) == LUA_TNUMBER && lua_tonumber(L, 2) == size) {
+					std::vector<variant> v = proxy->value.as_list();
+					v.push_back(value);
+					proxy->value = variant(&v);
+					return 0;
+				}
+
+				const int index = proxy_list_index(L, *proxy, 2);
+				luaL_argcheck(L, index >= 0, 2, "list index out of range");
+				make_proxy_unique(*proxy);
+				*proxy->value.get_index_mutable(index) = value;
+				return 0;
+			}
+
+			make_proxy_unique(*proxy);
+			if(value.is_null()) {
+				proxy->value.remove_attr_mutation(lua_value_to_variant(L, 2));
+			} else {
+				proxy->value.add_attr_mutation(lua_value_to_variant(L, 2), value);
+			}
+			return 0;
+		}
+
+		static int proxy_len(lua_State* L)
+		{
+			variant_proxy* proxy = static_cast<variant_proxy*>(luaL_checkudata(L, 1, variant_proxy_str));	// (-0,+0,-)
+			lua_pushinteger(L, proxy->value.num_elements());	// (-0,+1,-)
+			return 1;
+		}
+
+		static int proxy_next(lua_State* L)
+		{
+			// stack -- proxy, key
+			variant_proxy* proxy = static_cast<variant_proxy*>(luaL_checkudata(L, 1, variant_proxy_str));	// (-0,+0,-)
+			lua_settop(L, 2);
+			if(proxy->value.is_list()) {
+				int index = 0;
+				if(!lua_isnil(L, 2)) {
+					index = proxy_list_index(L, *proxy, 2);
+					luaL_argcheck(L, index >= 0, 2, "invalid key to 'next'");
+					++index;
+				}
+
+				if(index >= int(proxy->value.num_elements())) {
+					lua_pushnil(L);
+					return 1;
+				}
+
+				lua_pushinteger(L, index);				// (-0,+1,-)
+				push_proxy_element(L, 1, 3, proxy->value[index]);
+				return 2;
+			}
+
+			const std::map<variant,variant>& m = proxy->value.as_map();
+			std::map<variant,variant>::const_iterator i = m.begin();
+			if(!lua_isnil(L, 2)) {
+				i = m.upper_bound(lua_value_to_variant(L, 2));
+			}
+
+			if(i == m.end()) {
+				lua_pushnil(L);
+				return 1;
+			}
+
+			variant_to_lua_value(L, i->first);			// (-0,+1,e)
+			push_proxy_element(L, 1, 3, i->second);
+			return 2;
+		}
+
+		static int proxy_pairs(lua_State* L)
+		{
+			luaL_checkudata(L, 1, variant_proxy_str);	// (-0,+0,-)
+			lua_pushcfunction(L, proxy_next);			// (-0,+1,-)
+			lua_pushvalue(L, 1);						// (-0,+1,-)
+			lua_pushnil(L);								// (-0,+1,-)
+			return 3;
+		}
+
+		static int proxy_tostring(lua_State* L)
+		{
+			luaL_checkudata(L, 1, variant_proxy_str);	// (-0,+0,-)
+			const std::string s = proxy_to_variant(L, 1).write_json();
+			lua_pushlstring(L, s.c_str(), s.size());	// (-0,+1,-)
+			return 1;
+		}
+
+		static int proxy_gc(lua_State* L)
+		{
+			variant_proxy* proxy = static_cast<variant_proxy*>(luaL_checkudata(L, 1, variant_proxy_str));	// (-0,+0,-)
+			proxy->~variant_proxy();
+			return 0;
+		}
+
+		const luaL_Reg gVariantProxyFunctions[] = {
+			{"__index", proxy_index},
+			{"__newindex", proxy_newindex},
+			{"__len", proxy_len},
+			{"__pairs", proxy_pairs},
+			{"__tostring", proxy_tostring},
+			{"__gc", proxy_gc},
+			{NULL, NULL},
+		};
+
+		// copies a list or map into fresh Lua tables, recursively. This is
+		// what every list and map passed to Lua used to cost.
+		static void push_table_copy(lua_State* L, const variant& value)
+		{
+			if(value.is_list()) {
+				lua_newtable(L);								// (-0,+1,-)
+				for(int n = 0; n != value.num_elements(); ++n) {
+					lua_pushnumber(L, n);						// (-0,+1,-)
+					push_table_copy(L, value[n]);				// (-0,+1,e)
+					lua_settable(L,-3);							// (-2,+0,e)
+				}
+			} else if(value.is_map()) {
+				lua_newtable(L);								// (-0,+1,-)
+				for(auto it : value.as_map()) {
+					push_table_copy(L, it.first);				// (-0,+1,e)
+					push_table_copy(L, it.second);				// (-0,+1,e)
+					lua_settable(L,-3);							// (-2,+0,e)
+				}
+			} else {
+				variant_to_lua_value(L, value);					// (-0,+1,e)
+			}
+		}
+
 		static int variant_to_lua_value(lua_State* L, const variant& value)
 		{
 			switch(value.type()) {
@@ -129,30 +413,17 @@ namespace lua
 				case variant::VARIANT_TYPE_DECIMAL:
 					lua_pushnumber(L, value.as_decimal().as_float());
 					break;
-				case variant::VARIANT_TYPE_LIST: {
-					lua_newtable(L);								// (-0,+1,-)
-					for(int n = 0; n != value.num_elements(); ++n) {
-						lua_pushnumber(L, n);						// (-0,+1,-)
-						variant_to_lua_value(L, value[n]);			// (-0,+1,e)
-						lua_settable(L,-3);							// (-2,+0,e)
-					}
+				case variant::VARIANT_TYPE_LIST:
+					push_variant_proxy(L, value);					// (-0,+1,e)
 					break;
-				}
 				case variant::VARIANT_TYPE_STRING: {
 					const std::string& s = value.as_string();
 					lua_pushlstring(L, s.c_str(), s.size());
 					break;
 				}
-				case variant::VARIANT_TYPE_MAP: {
-					lua_newtable(L);								// (-0,+1,-)
-					auto m = value.as_map();
-					for(auto it : m) {
-						variant_to_lua_value(L, it.first);			// (-0,+1,e)
-						variant_to_lua_value(L, it.second);			// (-0,+1,e)
-						lua_settable(L,-3);							// (-2,+0,e)
-					}
+				case variant::VARIANT_TYPE_MAP:
+					push_variant_proxy(L, value);					// (-0,+1,e)
 					break;
-				}
 				case variant::VARIANT_TYPE_CALLABLE: {
 					using namespace game_logic;
 					formula_callable** a = static_cast<formula_callable**>(lua_newuserdata(L, sizeof(formula_callable*))); //(-0,+1,e)
@@ -216,6 +487,11 @@ namespace lua
 				case LUA_TTABLE:
 					break;
 				case LUA_TUSERDATA:
+					if(luaL_testudata(L, ndx, variant_proxy_str)) {
+						return proxy_to_variant(L, ndx);
+					}
+					luaL_error(L, "Unsupported type to convert on stack: %d", t);
+					break;
 				case LUA_TTHREAD:
 				case LUA_TLIGHTUSERDATA:
 				default:
@@ -456,6 +732,18 @@ namespace lua
 			return 1;
 		}
 
+		// Anura.table(v) returns a plain Lua table copy of a list or map proxy,
+		// for code which needs a real table. Anything else is returned as is.
+		static int to_table(lua_State* L)
+		{
+			if(luaL_testudata(L, 1, variant_proxy_str)) {
+				push_table_copy(L, proxy_to_variant(L, 1));	// (-0,+1,e)
+			} else {
+				lua_settop(L, 1);
+			}
+			return 1;
+		}
+
 		static int anura_table_index(lua_State* L) 
 		{
 			const char *name = lua_tostring(L, 2);						// (-0,+0,e)
@@ -471,6 +759,7 @@ namespace lua
 		static const struct luaL_Reg anura_functions [] = {
 			{"level", get_level},
 			{"lib", get_lib},
+			{"table", to_table},
 			{NULL, NULL},
 		};
 
@@ -548,6 +837,9 @@ namespace lua
 		luaL_newmetatable(context_ptr(), lib_functions_str);
 		luaL_setfuncs(context_ptr(), gLibMetaFunctions, 0);
 
+		luaL_newmetatable(context_ptr(), variant_proxy_str);
+		luaL_setfuncs(context_ptr(), gVariantProxyFunctions, 0);
+
 		push_anura_table(context_ptr());
 
 		/*dostring(
@@ -698,4 +990,55 @@ UNIT_TEST(lua_test)
 	lua::lua_context ctx;
 }
 
+UNIT_TEST(lua_variant_proxy)
+{
+	const variant original = json::parse("{\"a\": 1, \"b\": [1, 2, 3]}", json::JSON_NO_PREPROCESSOR);
+
+	lua::lua_context ctx;
+	lua_State* L = ctx.context_ptr();
+	CHECK_EQ(ctx.dostring("", "function f(t) t.b[1] = 'x'; t.c = #t.b; return t end"), false);
+
+	lua_getglobal(L, "f");
+	lua::variant_to_lua_value(L, original);
+	CHECK_EQ(lua_pcall(L, 1, 1, 0), LUA_OK);
+	const variant result = lua::lua_value_to_variant(L, -1);
+	lua_pop(L, 1);
+
+	CHECK_EQ(result, json::parse("{\"a\": 1, \"b\": [1, \"x\", 3], \"c\": 3}", json::JSON_NO_PREPROCESSOR));
+
+	//Lua's writes went to its own copy.
+	CHECK_EQ(original["b"][1], variant(2));
+}
+
+BENCHMARK_ARG(lua_pass_list, bool use_proxy)
+{
+	std::vector<variant> items;
+	for(int n = 0; n != 10000; ++n) {
+		std::map<variant,variant> m;
+		m[variant("x")] = variant(n);
+		m[variant("y")] = variant(n*2);
+		items.push_back(variant(&m));
+	}
+
+	const variant list(&items);
+
+	lua::lua_context ctx;
+	lua_State* L = ctx.context_ptr();
+	ctx.dostring("", "function f(t) return t[5000].x end");
+
+	BENCHMARK_LOOP {
+		lua_getglobal(L, "f");
+		if(use_proxy) {
+			lua::variant_to_lua_value(L, list);
+		} else {
+			lua::push_table_copy(L, list);
+		}
+		lua_pcall(L, 1, 1, 0);
+		lua_pop(L, 1);
+	}
+}
+
+BENCHMARK_ARG_CALL(lua_pass_list, proxy, true);
+BENCHMARK_ARG_CALL(lua_pass_list, table_copy, false);
+
 #endif
@@ -70,10 +70,12 @@
 #include "message_dialog.hpp"
 #include "module.hpp"
 #include "multiplayer.hpp"
+#include "object_scheduler.hpp"
 #include "player_info.hpp"
 #include "preferences.hpp"
 #include "preprocessor.hpp"
 #include "raster.hpp"
+#include "shaders.hpp"
 #include "sound.hpp"
 #include "stats.hpp"
 #include "string_utils.hpp"
@@ -83,7 +85,9 @@
 #include "texture_frame_buffer.hpp"
 #include "tile_map.hpp"
 #include "unit_test.hpp"
+#include "variant_type.hpp"
 #include "variant_utils.hpp"
+#include "widget_render_cache.hpp"
 #include "wm.hpp"
 
 #if defined(__APPLE__)
@@ -114,6 +118,12 @@ namespace {
 	PREF_BOOL(auto_update_module, false, "Auto updates the module from the module server on startup (number of milliseconds to spend attempting to update the module)");
 	PREF_STRING(auto_update_anura, "", "Auto update Anura's binaries from the module server using the given name as the module ID (e.g. anura-windows might be the id for the windows binary)");
 	PREF_INT(auto_update_timeout, 5000, "Timeout to use on auto updates (given in milliseconds)");
+	PREF_BOOL(preload_all_objects, false, "Load every object type at startup instead of when it is first used");
+	PREF_BOOL(report_type_checks, false, "On exit, report how many property write type checks in each module were proven unnecessary by the formula compiler");
+	PREF_BOOL(report_uniform_calls, false, "On exit, report how many glUniform calls shader programs issued and how many they skipped because the program already held the value");
+	PREF_BOOL(report_object_scheduling, false, "On exit, report how many object updates were held back by the processing policies in object definitions");
+	PREF_BOOL(report_tile_draws, false, "On exit, report how many draw calls tile layers made and how many tile chunks were built and uploaded");
+	PREF_BOOL(report_widget_cache, false, "On exit, report how many dialog widgets were drawn from cached copies, redrawn into them, or drawn directly");
 
 #if defined(_WINDOWS)
 	const std::string anura_exe_name = "anura.exe";
@@ -936,7 +946,7 @@ extern "C" int main(int argcount, char* argvec[])
 		graphical_font::init_for_locale(i18n::get_locale());
 		preloads = json::parse_from_file("data/preload.cfg");
 		int preload_items = preloads["preload"].num_elements();
-		loader.set_number_of_items(preload_items+7); // 7 is the number of items that will be loaded below
+		loader.set_number_of_items(preload_items+7+(g_preload_all_objects ? 1 : 0)); // 7 is the number of items that will be loaded below
 		custom_object::init();
 		loader.draw_and_increment(_("Initializing custom object functions"));
 		loader.draw_and_increment(_("Initializing textures"));
@@ -947,6 +957,11 @@ extern "C" int main(int argcount, char* argvec[])
 
 		game_logic::formula_object::load_all_classes();
 
+		if(g_preload_all_objects) {
+			loader.draw_and_increment(_("Loading objects"));
+			custom_object_type::preload_all();
+		}
+
 	} catch(const json::parse_error& e) {
 		std::cerr << "ERROR PARSING: " << e.error_message() << "\n";
 		return 0;
@@ -982,6 +997,10 @@ extern "C" int main(int argcount, char* argvec[])
 	texture_frame_buffer::init();
 #endif
 
+	if(!skip_tests && !test::run_video_tests()) {
+		return -1;
+	}
+
 	if(run_benchmarks) {
 		if(benchmarks_list.empty() == false) {
 			test::run_benchmarks(&benchmarks_list);
@@ -1050,6 +1069,28 @@ extern "C" int main(int argcount, char* argvec[])
 
 	level::clear_current_level();
 
+	if(g_report_type_checks) {
+		std::cerr << type_check_report();
+	}
+
+	if(g_report_tile_draws) {
+		std::cerr << level::tile_draw_report();
+	}
+
+	if(g_report_object_scheduling) {
+		std::cerr << object_scheduler::report();
+	}
+
+#ifdef USE_SHADERS
+	if(g_report_uniform_calls) {
+		std::cerr << gles2::program::uniform_call_report();
+	}
+
+	if(g_report_widget_cache) {
+		std::cerr << gui::widget_render_cache::report() << "\n";
+	}
+#endif
+
 	} //end manager scope, make managers destruct before calling SDL_Quit
 //	controls::debug_dump_controls();
 #if defined(TARGET_PANDORA) || defined(TARGET_TEGRA)
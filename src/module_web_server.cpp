@@ -61,7 +61,7 @@ module_web_server::module_web_server(const std::string& data_path, boost::asio::
 void module_web_server::heartbeat()
 {
 	timer_.expires_from_now(boost::posix_time::seconds(1));
-	timer_.async_wait(boost::bind(&module_web_server::heartbeat, this));
+	timer_.async_wait(handler_strand().wrap(boost::bind(&module_web_server::heartbeat, this)));
 }
 
 void module_web_server::handle_post(socket_ptr socket, variant doc, const http::environment& env)
@@ -82,55 +82,63 @@ void module_web_server::handle_post(socket_ptr socket, variant doc, const http::
 
 			const std::string module_path = data_path_ + module_id + ".cfg";
 			if(sys::file_exists(module_path)) {
-				std::string response = "{\nstatus: \"ok\",\nmodule: ";
-				{
+				fprintf(stderr, "MANIFEST: %d\n", (int)doc.has_key("manifest"));
+				if(!doc.has_key("manifest")) {
+					//the whole module is wanted so send the file as-is
+					//from the cache without copying it.
+					http::response_chunk_ptr contents = http::get_cached_file(module_path);
+					ASSERT_LOG(contents, "Could not read module: " << module_path);
+
+					std::vector<http::response_chunk_ptr> body;
+					body.push_back(http::make_response_chunk("{\nstatus: \"ok\",\nmodule: "));
+					body.push_back(contents);
+					body.push_back(http::make_response_chunk("\n}"));
+					send_msg(socket, "text/json", body, "");
+				} else {
+					std::string response = "{\nstatus: \"ok\",\nmodule: ";
 					std::string contents = sys::read_file(module_path);
-					fprintf(stderr, "MANIFEST: %d\n", (int)doc.has_key("manifest"));
-					if(doc.has_key("manifest")) {
-						variant their_manifest = doc["manifest"];
-						variant module = json::parse(contents);
-						variant our_manifest = module["manifest"];
-
-						std::vector<variant> deletions;
-						for(auto p : their_manifest.as_map()) {
-							if(!our_manifest.has_key(p.first)) {
-								deletions.push_back(p.first);
-							}
+					variant their_manifest = doc["manifest"];
+					variant module = json::parse(contents);
+					variant our_manifest = module["manifest"];
+
+					std::vector<variant> deletions;
+					for(auto p : their_manifest.as_map()) {
+						if(!our_manifest.has_key(p.first)) {
+							deletions.push_back(p.first);
 						}
+					}
 
-						if(!deletions.empty()) {
-							module.add_attr_mutation(variant("delete"), variant(&deletions));
-						}
-
-						std::vector<variant> matches;
-
-						for(auto p : our_manifest.as_map()) {
-							if(!their_manifest.has_key(p.first)) {
-								fprintf(stderr, "their manifest does not have key: %s\n", p.first.write_json().c_str());
-								continue;
-							}
+					if(!deletions.empty()) {
+						module.add_attr_mutation(variant("delete"), variant(&deletions));
+					}
 
-							if(p.second["md5"] != their_manifest[p.first]["md5"]) {
-								fprintf(stderr, "their manifest mismatch key: %s\n", p.first.write_json().c_str());
-								continue;
-							}
+					std::vector<variant> matches;
 
-							matches.push_back(p.first);
+					for(auto p : our_manifest.as_map()) {
+						if(!their_manifest.has_key(p.first)) {
+							fprintf(stderr, "their manifest does not have key: %s\n", p.first.write_json().c_str());
+							continue;
 						}
 
-						for(variant match : matches) {
-							our_manifest.remove_attr_mutation(match);
+						if(p.second["md5"] != their_manifest[p.first]["md5"]) {
+							fprintf(stderr, "their manifest mismatch key: %s\n", p.first.write_json().c_str());
+							continue;
 						}
 
-						contents = module.write_json();
+						matches.push_back(p.first);
 					}
 
+					for(variant match : matches) {
+						our_manifest.remove_attr_mutation(match);
+					}
+
+					contents = module.write_json();
+
 					response += contents;
+					response += "\n}";
+					send_msg(socket, "text/json", response, "");
 				}
 
-				response += "\n}";
-				send_msg(socket, "text/json", response, "");
-
 				variant summary = data_[module_id];
 				if(summary.is_map()) {
 					summary.add_attr_mutation(variant("num_downloads"), variant(summary["num_downloads"].as_int() + 1));
@@ -203,6 +211,7 @@ void module_web_server::handle_post(socket_ptr socket, variant doc, const http::
 			sys::write_file(module_path_tmp, contents);
 			const int rename_result = rename(module_path_tmp.c_str(), module_path.c_str());
 			ASSERT_LOG(rename_result == 0, "FAILED TO RENAME FILE: " << errno);
+			http::invalidate_cached_file(module_path);
 
 			response[variant("status")] = variant("ok");
 
@@ -268,6 +277,7 @@ void module_web_server::handle_post(socket_ptr socket, variant doc, const http::
 			sys::write_file(module_path_tmp, contents);
 			const int rename_result = rename(module_path_tmp.c_str(), dst_path.c_str());
 			ASSERT_LOG(rename_result == 0, "FAILED TO RENAME FILE: " << errno);
+			http::invalidate_cached_file(dst_path);
 
 			response[variant("status")] = variant("ok");
 
@@ -12,16 +12,24 @@
 #include <deque>
 #include <numeric>
 #include <map>
+#include <set>
 #include <vector>
 
 #include "SDL.h"
+#include <SDL_image.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "IMG_savepng.h"
 #include "asserts.hpp"
 #include "border_widget.hpp"
 #include "button.hpp"
 #include "checkbox.hpp"
 #include "color_picker.hpp"
 #include "filesystem.hpp"
+#include "foreach.hpp"
 #include "formatter.hpp"
 #include "gles2.hpp"
 #include "grid_widget.hpp"
@@ -33,11 +41,13 @@
 #include "level_runner.hpp"
 #include "lighting.hpp"
 #include "module.hpp"
+#include "normal_map.hpp"
 #include "preferences.hpp"
 #include "slider.hpp"
 #include "surface.hpp"
 #include "surface_cache.hpp"
 #include "texture.hpp"
+#include "thread.hpp"
 #include "unit_test.hpp"
 
 namespace graphics 
@@ -45,6 +55,8 @@ namespace graphics
 	extern void set_alpha_for_transparent_colors_in_rgba_surface(SDL_Surface* s, int options);
 }
 
+PREF_INT(normal_map_threads, 4, "Number of threads used to bake normal maps");
+
 namespace
 {
 	struct rgb
@@ -242,6 +254,43 @@ namespace
 		return res;
 	}
 
+#if defined(__SSE2__)
+	// rounds each lane to float precision, as adding into a float does.
+	__m128d round_to_float(__m128d v)
+	{
+		return _mm_cvtps_pd(_mm_cvtpd_ps(v));
+	}
+
+	// convolution_filter() for a pixel whose whole window is inside the
+	// image, working on all four channels at once. The sums are rounded
+	// the same way as the scalar code rounds them, so the results match.
+	void convolve_pixel_sse2(const uint8_t* top_left, int pitch, const double* weights, int mx, int my, double bias, double divisor, bool preserve_alpha, uint8_t* out)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128d sum_rg = _mm_set1_pd(float(bias));
+		__m128d sum_ba = sum_rg;
+		for(int j = 0; j != my; ++j) {
+			const uint8_t* row = top_left + j*pitch;
+			for(int i = 0; i != mx; ++i) {
+				const __m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(row + i*4)), zero), zero);
+				const __m128d w = _mm_set1_pd(*weights++);
+				sum_rg = round_to_float(_mm_add_pd(sum_rg, _mm_mul_pd(_mm_cvtepi32_pd(pixel), w)));
+				sum_ba = round_to_float(_mm_add_pd(sum_ba, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(pixel, 8)), w)));
+			}
+		}
+
+		double sums[4];
+		_mm_storeu_pd(sums, sum_rg);
+		_mm_storeu_pd(sums + 2, sum_ba);
+		out[0] = clamp_u8(sums[0] / divisor);
+		out[1] = clamp_u8(sums[1] / divisor);
+		out[2] = clamp_u8(sums[2] / divisor);
+		if(!preserve_alpha) {
+			out[3] = clamp_u8(sums[3] / divisor);
+		}
+	}
+#endif
+
 	// Generic convolution filter
 	// bias is added to all pixels in the output.
 	// divisor is the factor to divide the computing pixel value by.
@@ -249,6 +298,7 @@ namespace
 	//     if clamp == false: use default_color 
     //	   else: use closest pixel value
 	// if preserve_alpha: don't saturate the alpha value.
+	// if allow_simd: pixels away from the edges use SSE2 where available.
 	graphics::surface convolution_filter(const graphics::surface& surf, 
 		const std::vector<std::vector<double>>& matrix, 
 		int mx, 
@@ -257,14 +307,28 @@ namespace
 		double bias, 
 		bool preserve_alpha, 
 		const graphics::color& default_color, 
-		bool clamp)
+		bool clamp,
+		bool allow_simd=true)
 	{
 		graphics::surface res = surf.clone();
 		const uint8_t* pixels = reinterpret_cast<const uint8_t*>(surf.get()->pixels);
 		uint8_t* res_pixels = reinterpret_cast<uint8_t*>(res.get()->pixels);
+
+		std::vector<double> weights;
+		for(int j = 0; j != my; ++j) {
+			weights.insert(weights.end(), matrix[j].begin(), matrix[j].begin() + mx);
+		}
+
 		for(int m = 0; m != res->h; ++m) {
 			for(int n = 0; n != res->w; ++n) {
 				const int ndx = (n + m * res->w) * 4;
+#if defined(__SSE2__)
+				if(allow_simd && n >= mx/2 && n + mx - mx/2 <= res->w && m >= my/2 && m + my - my/2 <= res->h) {
+					const uint8_t* top_left = pixels + ndx - (mx/2 + (my/2)*res->w)*4;
+					convolve_pixel_sse2(top_left, res->w*4, &weights[0], mx, my, bias, divisor, preserve_alpha, res_pixels + ndx);
+					continue;
+				}
+#endif
 				float sum_r = bias;
 				float sum_g = bias;
 				float sum_b = bias;
@@ -692,14 +756,7 @@ namespace
 		calculate_normal(s_sobel.get(), gs_param);
 		texture s_tex = texture::get_no_cache(s_sobel);
 
-		graphics::set_alpha_for_transparent_colors_in_rgba_surface(s, 0);
-		surface s_aux = drop_shadow_filter(s, graphics::color(0,0,0), 3, 3, 0.0, 3, 1.0, true, false, 3);
-		//graphics::surface s_aux = extract_alpha_mask(s, graphics::color(0,0,0), graphics::color(255,255,255));
-		//surface s_emb_h = emboss(s_aux, 0);
-		s_aux = make_grayscale(s_aux, NULL);
-		surface s_norm = calculate_normal2(emboss(s_aux, 0), emboss(s_aux, 90));
-		s_norm = alpha_clip(s_norm, s);
-		//surface s_emb = s_aux;
+		surface s_norm = bake_normal_map(s);
 		aux_.reset(new gui::image_widget(texture::get_no_cache(s_norm), widget_width, widget_height));
 		add_widget(aux_, 0, widget_height + between_padding);
 
@@ -712,6 +769,293 @@ namespace
 
 }
 
+namespace graphics
+{
+
+surface bake_normal_map(surface s)
+{
+	set_alpha_for_transparent_colors_in_rgba_surface(s.get(), 0);
+	surface s_aux = drop_shadow_filter(s, graphics::color(0,0,0), 3, 3, 0.0, 3, 1.0, true, false, 3);
+	s_aux = make_grayscale(s_aux, NULL);
+	surface s_norm = calculate_normal2(emboss(s_aux, 0), emboss(s_aux, 90));
+	return alpha_clip(s_norm, s);
+}
+
+namespace
+{
+	const std::string NormalMapSuffix = "-normal.png";
+
+	// loads an image as 32-bit RGBA. Safe to call from any thread.
+	surface load_rgba_image(const std::string& path)
+	{
+		surface img(IMG_Load(path.c_str()));
+		if(img.get() == NULL) {
+			return surface();
+		}
+
+		surface result(SDL_CreateRGBSurface(0, img->w, img->h, 32, SURFACE_MASK));
+		SDL_SetSurfaceBlendMode(img.get(), SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(img.get(), NULL, result.get(), NULL);
+		return result;
+	}
+
+	struct bake_job
+	{
+		const std::vector<std::string>* paths;
+		int next, baked;
+		threading::mutex mutex;
+	};
+
+	void bake_normal_maps_worker(bake_job* job)
+	{
+		for(;;) {
+			std::string path;
+			{
+				threading::lock lck(job->mutex);
+				if(job->next == job->paths->size()) {
+					return;
+				}
+
+				path = (*job->paths)[job->next++];
+			}
+
+			surface img = load_rgba_image(path);
+			const bool baked = img.get() && IMG_SavePNG(normal_map_path(path).c_str(), bake_normal_map(img).get()) == 0;
+
+			threading::lock lck(job->mutex);
+			if(baked) {
+				std::cerr << "BAKED NORMAL MAP FOR " << path << "\n";
+				++job->baked;
+			} else {
+				std::cerr << "COULD NOT BAKE NORMAL MAP FOR " << path << "\n";
+			}
+		}
+	}
+
+	// Normal maps generated at runtime for images with no baked map. The
+	// background thread hands finished surfaces over under the lock, and
+	// the main thread turns them into textures.
+	struct runtime_normal_maps
+	{
+		runtime_normal_maps() : worker_running(false)
+		{}
+
+		std::map<std::string, texture> textures;
+
+		threading::mutex mutex;
+		std::deque<std::string> queue;
+		std::set<std::string> pending;
+		std::map<std::string, surface> finished;
+		bool worker_running;
+		boost::shared_ptr<threading::thread> worker;
+	};
+
+	runtime_normal_maps& runtime_maps()
+	{
+		static runtime_normal_maps* instance = new runtime_normal_maps;
+		return *instance;
+	}
+
+	void runtime_normal_map_worker()
+	{
+		runtime_normal_maps& maps = runtime_maps();
+		for(;;) {
+			std::string path;
+			{
+				threading::lock lck(maps.mutex);
+				if(maps.queue.empty()) {
+					maps.worker_running = false;
+					return;
+				}
+
+				path = maps.queue.front();
+				maps.queue.pop_front();
+			}
+
+			surface img = load_rgba_image(path);
+			surface result;
+			if(img.get()) {
+				result = bake_normal_map(img);
+				img = surface();
+			} else {
+				std::cerr << "COULD NOT LOAD IMAGE TO GENERATE NORMAL MAP: " << path << "\n";
+			}
+
+			//surfaces aren't safe to share between threads, so the last
+			//reference this thread holds is dropped under the lock.
+			threading::lock lck(maps.mutex);
+			maps.finished[path] = result;
+			result = surface();
+		}
+	}
+}
+
+std::string normal_map_path(const std::string& image_path)
+{
+	std::string::size_type dot = image_path.rfind('.');
+	if(dot == std::string::npos || image_path.find('/', dot) != std::string::npos) {
+		dot = image_path.size();
+	}
+
+	return std::string(image_path.begin(), image_path.begin() + dot) + NormalMapSuffix;
+}
+
+bool is_normal_map_path(const std::string& path)
+{
+	return path.size() >= NormalMapSuffix.size() && std::equal(NormalMapSuffix.begin(), NormalMapSuffix.end(), path.end() - NormalMapSuffix.size());
+}
+
+bool normal_map_up_to_date(const std::string& image_path)
+{
+	const std::string baked = normal_map_path(image_path);
+	return sys::file_exists(baked) && sys::file_mod_time(baked) >= sys::file_mod_time(image_path);
+}
+
+int bake_normal_maps(const std::vector<std::string>& image_paths, int nthreads)
+{
+	bake_job job;
+	job.paths = &image_paths;
+	job.next = job.baked = 0;
+
+	nthreads = std::max(1, std::min<int>(nthreads, image_paths.size()));
+
+	std::vector<boost::shared_ptr<threading::thread> > threads;
+	for(int n = 1; n < nthreads; ++n) {
+		threads.push_back(boost::shared_ptr<threading::thread>(new threading::thread("bake_normal_maps", boost::bind(bake_normal_maps_worker, &job))));
+	}
+
+	bake_normal_maps_worker(&job);
+
+	//joins the threads.
+	threads.clear();
+	return job.baked;
+}
+
+texture get_normal_map(const std::string& image_path)
+{
+	runtime_normal_maps& maps = runtime_maps();
+	std::map<std::string, texture>::const_iterator itor = maps.textures.find(image_path);
+	if(itor != maps.textures.end()) {
+		return itor->second;
+	}
+
+	if(normal_map_up_to_date(image_path)) {
+		return maps.textures[image_path] = texture::get(normal_map_path(image_path));
+	}
+
+	threading::lock lck(maps.mutex);
+	std::map<std::string, surface>::iterator finished = maps.finished.find(image_path);
+	if(finished != maps.finished.end()) {
+		texture result;
+		if(finished->second.get()) {
+			result = texture::get_no_cache(finished->second);
+		}
+
+		maps.finished.erase(finished);
+		maps.pending.erase(image_path);
+		return maps.textures[image_path] = result;
+	}
+
+	if(maps.pending.insert(image_path).second) {
+		maps.queue.push_back(image_path);
+		if(!maps.worker_running) {
+			//the previous worker has finished, so this doesn't block.
+			maps.worker.reset();
+			maps.worker_running = true;
+			maps.worker.reset(new threading::thread("normal_maps", runtime_normal_map_worker));
+		}
+	}
+
+	return texture();
+}
+
+}
+
+UNIT_TEST(normal_map_convolution_simd)
+{
+	graphics::surface s(SDL_CreateRGBSurface(0, 13, 9, 32, SURFACE_MASK));
+	uint8_t* pixels = reinterpret_cast<uint8_t*>(s->pixels);
+	for(int n = 0; n != 13*9*4; ++n) {
+		pixels[n] = uint8_t(n*37 + (n/7)*11);
+	}
+
+	for(int angle = 0; angle != 4; ++angle) {
+		std::vector<std::vector<double>> matrix(3, std::vector<double>(3));
+		for(int n = 0; n != 9; ++n) {
+			matrix[n/3][n%3] = cos(angle + n*M_PI/4.0);
+		}
+
+		graphics::surface simd = convolution_filter(s, matrix, 3, 3, 1.0, 128.0, angle%2 == 0, graphics::color(255,255,255), angle < 2);
+		graphics::surface scalar = convolution_filter(s, matrix, 3, 3, 1.0, 128.0, angle%2 == 0, graphics::color(255,255,255), angle < 2, false);
+		CHECK_EQ(memcmp(simd->pixels, scalar->pixels, 13*9*4), 0);
+	}
+}
+
+UNIT_TEST(normal_map_path)
+{
+	CHECK_EQ(graphics::normal_map_path("images/frog.png"), "images/frog-normal.png");
+	CHECK_EQ(graphics::normal_map_path("images/v1.2/frog"), "images/v1.2/frog-normal.png");
+	CHECK_EQ(graphics::is_normal_map_path("images/frog-normal.png"), true);
+	CHECK_EQ(graphics::is_normal_map_path("images/frog.png"), false);
+}
+
+BENCHMARK(bake_normal_map)
+{
+	graphics::surface s = graphics::surface_cache::get_no_cache("characters/frogatto-spritesheet1.png");
+	graphics::surface rgba(SDL_CreateRGBSurface(0, s->w, s->h, 32, SURFACE_MASK));
+	SDL_SetSurfaceBlendMode(s.get(), SDL_BLENDMODE_NONE);
+	SDL_BlitSurface(s.get(), NULL, rgba.get(), NULL);
+	BENCHMARK_LOOP {
+		graphics::bake_normal_map(rgba);
+	}
+}
+
+// Bakes normal maps for the images given, or for every image in the
+// module's images/ directory. Only images changed since their normal map
+// was baked are done, unless --force is given.
+UTILITY(bake_normal_maps)
+{
+#ifndef IMPLEMENT_SAVE_PNG
+	std::cerr
+		<< "This build wasn't done with IMPLEMENT_SAVE_PNG defined. "
+		<< "Consquently image files will not be written, aborting requested operation."
+		<< std::endl;
+	return;
+#endif
+
+	bool force = false;
+	std::vector<std::string> images;
+	foreach(const std::string& arg, args) {
+		if(arg == "--force") {
+			force = true;
+		} else {
+			images.push_back(module::map_file(arg));
+		}
+	}
+
+	if(images.empty()) {
+		std::map<std::string, std::string> files;
+		module::get_unique_filenames_under_dir("images/", &files);
+		for(std::map<std::string, std::string>::const_iterator i = files.begin(); i != files.end(); ++i) {
+			const std::string& path = i->second;
+			if(path.size() > 4 && std::equal(path.end() - 4, path.end(), ".png") && !graphics::is_normal_map_path(path)) {
+				images.push_back(path);
+			}
+		}
+	}
+
+	std::vector<std::string> stale;
+	foreach(const std::string& path, images) {
+		if(force || !graphics::normal_map_up_to_date(path)) {
+			stale.push_back(path);
+		}
+	}
+
+	std::cerr << "BAKING " << stale.size() << " OF " << images.size() << " NORMAL MAPS\n";
+	const int baked = graphics::bake_normal_maps(stale, g_normal_map_threads);
+	std::cerr << "BAKED " << baked << " NORMAL MAPS\n";
+}
+
 UTILITY(calculate_normal_map)
 {
 	std::deque<std::string> arguments(args.begin(), args.end());
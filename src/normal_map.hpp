@@ -0,0 +1,53 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef NORMAL_MAP_HPP_INCLUDED
+#define NORMAL_MAP_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "surface.hpp"
+#include "texture.hpp"
+
+namespace graphics
+{
+
+//builds a normal map for a sprite sheet for use with lit shaders. The
+//surface must be 32-bit RGBA; its transparent color is made transparent
+//in place.
+surface bake_normal_map(surface s);
+
+//the file a baked normal map for an image is kept in, next to the image:
+//images/foo.png has its normal map in images/foo-normal.png.
+std::string normal_map_path(const std::string& image_path);
+bool is_normal_map_path(const std::string& path);
+
+//true if the image has a baked normal map at least as new as it is.
+bool normal_map_up_to_date(const std::string& image_path);
+
+//bakes the normal maps of the given images, writing them to
+//normal_map_path(), on up to nthreads threads. Returns the number baked.
+int bake_normal_maps(const std::vector<std::string>& image_paths, int nthreads);
+
+//returns the normal map for an image, loading the baked one if it is up
+//to date. Otherwise one is generated on a background thread, and an
+//invalid texture is returned until it is ready. Main thread only.
+texture get_normal_map(const std::string& image_path);
+
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "asserts.hpp"
+#include "entity.hpp"
+#include "foreach.hpp"
+#include "json_parser.hpp"
+#include "object_scheduler.hpp"
+#include "unit_test.hpp"
+
+namespace {
+int cycles_scheduled = 0, updates_scheduled = 0;
+int deferred_by_interval = 0, deferred_by_distance = 0, deferred_by_budget = 0;
+int largest_backlog = 0;
+
+//spreads objects processed every few cycles over those cycles. Labels
+//are the same from one run to the next, unlike addresses.
+unsigned int label_phase(const std::string& label)
+{
+	unsigned int result = 0;
+	foreach(char c, label) {
+		result = result*31 + static_cast<unsigned char>(c);
+	}
+
+	return result;
+}
+}
+
+processing_policy::processing_policy() : every(1), within(-1), budgeted(false)
+{
+}
+
+processing_policy::processing_policy(variant node)
+  : every(node["every"].as_int(1)),
+    within(node["within"].as_int(-1)),
+    budgeted(node["budgeted"].as_bool(false))
+{
+	ASSERT_LOG(every >= 1, "processing: every MUST BE AT LEAST 1: " << node.debug_location());
+}
+
+bool processing_policy::is_default() const
+{
+	return every == 1 && within < 0 && !budgeted;
+}
+
+object_scheduler::object_scheduler() : budget_(DefaultBudget)
+{
+}
+
+void object_scheduler::schedule(int cycle, const point& focus, const std::vector<entity_ptr>& chars)
+{
+	objects_.clear();
+	foreach(const entity_ptr& e, chars) {
+		const processing_policy* policy = e->get_processing_policy();
+		if(policy == NULL || e->is_human()) {
+			continue;
+		}
+
+		object obj;
+		obj.id = e.get();
+		obj.policy = policy;
+		obj.label = &e->label();
+		obj.midpoint = policy->within >= 0 ? e->midpoint() : point();
+		objects_.push_back(obj);
+	}
+
+	schedule(cycle, focus, objects_);
+}
+
+void object_scheduler::schedule(int cycle, const point& focus, const std::vector<object>& objects)
+{
+	deferred_.clear();
+	budgeted_.clear();
+
+	++cycles_scheduled;
+
+	foreach(const object& obj, objects) {
+		const processing_policy* policy = obj.policy;
+		++updates_scheduled;
+
+		if(policy->every > 1 && (cycle + label_phase(*obj.label))%policy->every != 0) {
+			deferred_.push_back(obj.id);
+			++deferred_by_interval;
+			continue;
+		}
+
+		if(policy->within >= 0) {
+			const int dx = obj.midpoint.x - focus.x, dy = obj.midpoint.y - focus.y;
+			if(abs(dx) > policy->within || abs(dy) > policy->within || dx*dx + dy*dy > policy->within*policy->within) {
+				deferred_.push_back(obj.id);
+				++deferred_by_distance;
+				continue;
+			}
+		}
+
+		if(policy->budgeted) {
+			budgeted_.push_back(obj.id);
+		}
+	}
+
+	//the objects processed within the budget are a window which moves
+	//along the list by the size of the budget each cycle.
+	const int nbudgeted = budgeted_.size();
+	if(budget_ > 0 && nbudgeted > budget_) {
+		const int start = int((static_cast<unsigned int>(cycle)*budget_)%nbudgeted);
+		for(int n = budget_; n != nbudgeted; ++n) {
+			deferred_.push_back(budgeted_[(start + n)%nbudgeted]);
+		}
+
+		deferred_by_budget += nbudgeted - budget_;
+		largest_backlog = std::max(largest_backlog, nbudgeted - budget_);
+	}
+
+	std::sort(deferred_.begin(), deferred_.end());
+}
+
+bool object_scheduler::is_deferred(const void* id) const
+{
+	return std::binary_search(deferred_.begin(), deferred_.end(), id);
+}
+
+std::string object_scheduler::report()
+{
+	std::ostringstream s;
+	s << "object scheduling: " << updates_scheduled << " updates of objects with processing policies over " << cycles_scheduled << " cycles; "
+	  << deferred_by_interval << " held back by interval, " << deferred_by_distance << " by distance, "
+	  << deferred_by_budget << " by budget (largest backlog " << largest_backlog << ")\n";
+	return s.str();
+}
+
+UNIT_TEST(processing_policy)
+{
+	CHECK(processing_policy().is_default(), "default processing policy holds objects back");
+
+	const processing_policy policy(json::parse("{\"every\": 4, \"within\": 800, \"budgeted\": true}"));
+	CHECK_EQ(policy.every, 4);
+	CHECK_EQ(policy.within, 800);
+	CHECK(policy.budgeted, "policy not budgeted");
+	CHECK(!policy.is_default(), "policy treated as default");
+}
+
+namespace {
+//the objects held back on each of 'ncycles' cycles, one character per
+//object: 'i' for interval, 'd' for distance, 'b' for budget, '.' if it
+//was processed.
+std::string schedule_cycles(object_scheduler& scheduler, const std::vector<object_scheduler::object>& objects, int ncycles)
+{
+	std::string result;
+	for(int cycle = 0; cycle != ncycles; ++cycle) {
+		scheduler.schedule(cycle, point(0, 0), objects);
+		foreach(const object_scheduler::object& obj, objects) {
+			if(!scheduler.is_deferred(obj.id)) {
+				result += '.';
+			} else if(obj.policy->every > 1) {
+				result += 'i';
+			} else if(obj.policy->within >= 0) {
+				result += 'd';
+			} else {
+				result += 'b';
+			}
+		}
+		result += '\n';
+	}
+
+	return result;
+}
+}
+
+UNIT_TEST(object_scheduler_schedule)
+{
+	const processing_policy every_three(json::parse("{\"every\": 3}"));
+	const processing_policy nearby(json::parse("{\"within\": 100}"));
+	const processing_policy budgeted(json::parse("{\"budgeted\": true}"));
+
+	//objects 0-1 run every third cycle, 2 is near the focus and 3 far
+	//from it, and 4-7 share a budget of two a cycle.
+	const int NumObjects = 8;
+	const std::string labels[NumObjects] = { "bat", "crow", "near", "far", "ant1", "ant2", "ant3", "ant4" };
+	const processing_policy* policies[NumObjects] = { &every_three, &every_three, &nearby, &nearby, &budgeted, &budgeted, &budgeted, &budgeted };
+	const point midpoints[NumObjects] = { point(), point(), point(50, 50), point(500, 0), point(), point(), point(), point() };
+	int ids[NumObjects];
+
+	std::vector<object_scheduler::object> objects;
+	for(int n = 0; n != NumObjects; ++n) {
+		object_scheduler::object obj;
+		obj.id = &ids[n];
+		obj.policy = policies[n];
+		obj.label = &labels[n];
+		obj.midpoint = midpoints[n];
+		objects.push_back(obj);
+	}
+
+	const int NumCycles = 12;
+	object_scheduler scheduler;
+	scheduler.set_budget(2);
+
+	int nprocessed[NumObjects] = {};
+	for(int cycle = 0; cycle != NumCycles; ++cycle) {
+		scheduler.schedule(cycle, point(0, 0), objects);
+
+		int nbudgeted = 0;
+		for(int n = 0; n != NumObjects; ++n) {
+			if(scheduler.is_deferred(&ids[n]) == false) {
+				++nprocessed[n];
+				if(policies[n]->budgeted) {
+					++nbudgeted;
+				}
+			}
+		}
+
+		for(int n = 0; n != 2; ++n) {
+			const bool on_interval = (cycle + label_phase(labels[n]))%3 == 0;
+			CHECK(scheduler.is_deferred(&ids[n]) != on_interval, "object " << labels[n] << " not held back by its interval on cycle " << cycle);
+		}
+
+		CHECK(!scheduler.is_deferred(&ids[2]), "object near the focus held back on cycle " << cycle);
+		CHECK(scheduler.is_deferred(&ids[3]), "object far from the focus processed on cycle " << cycle);
+		CHECK_EQ(nbudgeted, 2);
+	}
+
+	//every third cycle for interval objects, and the budget window goes
+	//round the four budgeted objects every two cycles.
+	CHECK_EQ(nprocessed[0], NumCycles/3);
+	CHECK_EQ(nprocessed[1], NumCycles/3);
+	for(int n = 4; n != NumObjects; ++n) {
+		CHECK_EQ(nprocessed[n], NumCycles/2);
+	}
+
+	//schedules depend on nothing but their inputs.
+	object_scheduler first, second;
+	first.set_budget(2);
+	second.set_budget(2);
+	CHECK_EQ(schedule_cycles(first, objects, NumCycles), schedule_cycles(second, objects, NumCycles));
+}
@@ -0,0 +1,102 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef OBJECT_SCHEDULER_HPP_INCLUDED
+#define OBJECT_SCHEDULER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "entity_fwd.hpp"
+#include "geometry.hpp"
+#include "variant.hpp"
+
+//How often an object type is processed, from the 'processing' attribute
+//of its definition, e.g. processing: { every: 4, within: 800, budgeted: true }
+//Objects which don't matter to play, such as ambient critters, can be
+//processed less often than every cycle. They simply stand still on the
+//cycles they are held back.
+struct processing_policy
+{
+	processing_policy();
+	explicit processing_policy(variant node);
+
+	//true if the object is processed every cycle.
+	bool is_default() const;
+
+	//processed only once in this many cycles.
+	int every;
+
+	//held back while its midpoint is further than this many pixels from
+	//the middle of the screen. -1 for any distance.
+	int within;
+
+	//processed only when the level's budget for the cycle allows.
+	bool budgeted;
+};
+
+//Decides which active objects are held back on a cycle by their policies.
+//Schedules depend only on the cycle, the objects' labels and their
+//positions, never on how long processing takes, so replays and games
+//played over the network stay in sync.
+class object_scheduler
+{
+public:
+	static const int DefaultBudget = 32;
+
+	object_scheduler();
+
+	//the number of budgeted objects which may be processed each cycle,
+	//or 0 for no limit.
+	int budget() const { return budget_; }
+	void set_budget(int budget) { budget_ = budget; }
+
+	//an object as the scheduler sees it. 'id' tells objects apart and is
+	//never dereferenced. 'midpoint' is only used if the policy has 'within'.
+	struct object {
+		const void* id;
+		const processing_policy* policy;
+		const std::string* label;
+		point midpoint;
+	};
+
+	//finds the objects in 'chars' which are held back on 'cycle', given the
+	//middle of the screen. Humans are never held back.
+	void schedule(int cycle, const point& focus, const std::vector<entity_ptr>& chars);
+
+	//as above, for objects which all have policies.
+	void schedule(int cycle, const point& focus, const std::vector<object>& objects);
+
+	bool is_deferred(const entity& e) const { return is_deferred(static_cast<const void*>(&e)); }
+	bool is_deferred(const void* id) const;
+	void clear() { deferred_.clear(); }
+
+	//counts the updates held back by each kind of policy.
+	static std::string report();
+
+private:
+	int budget_;
+
+	//sorted so it can be searched.
+	std::vector<const void*> deferred_;
+
+	std::vector<const void*> budgeted_;
+
+	//reused by each call to schedule() with entities.
+	std::vector<object> objects_;
+};
+
+#endif
@@ -61,6 +61,10 @@ private:
 	variant get_value(const std::string& key) const;	
 	void set_value(const std::string& key, const variant& value);
 
+	//player keys are matched by name in get_value(), which the inline caches
+	//in custom_object would skip, so don't use them.
+	variant get_value_cached(const std::string& key, game_logic::lookup_cache& cache) const { return get_value(key); }
+
 	variant get_player_value_by_slot(int slot) const;
 	void set_player_value_by_slot(int slot, const variant& value);
 
@@ -19,11 +19,15 @@
 #include <time.h>
 
 #include "random.hpp"
+#include "thread_local.hpp"
 
 namespace rng {
 
-static unsigned int UninitSeed = 11483;
-static unsigned int next = UninitSeed;
+static const unsigned int UninitSeed = 11483;
+
+//each thread has its own generator so that games processed in parallel
+//each get the sequence given by their own seed.
+static THREAD_LOCAL unsigned int next = UninitSeed;
 
 int generate() {
 	if(next == UninitSeed) {
@@ -881,6 +881,11 @@ bool blit_queue::merge(const blit_queue& q, short begin, short end)
 		glPopMatrix();
 	}
 	
+	bool clip_scope::active()
+	{
+		return current_clip_scope != NULL;
+	}
+
 	clip_scope::~clip_scope() {
 		stencil_.reset();
 		if(parent_) {
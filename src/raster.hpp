@@ -206,6 +206,9 @@ struct clip_scope {
 	void apply(const SDL_Rect& r);
 	void reapply();
 
+	//true if drawing is currently clipped by a clip_scope.
+	static bool active();
+
 	clip_scope* parent_;
 	SDL_Rect area_;
 	GLfloat matrix_[16];
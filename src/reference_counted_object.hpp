@@ -19,8 +19,46 @@
 
 #include <assert.h>
 
+#include <atomic>
+
 #include "boost/intrusive_ptr.hpp"
 
+namespace threading
+{
+//whether reference counts may be changed by several threads at once, as
+//when a server processes games in parallel. Counts are then updated with
+//atomic operations, which are slower. Must be set before the threads start.
+extern bool g_atomic_refcounts;
+inline void enable_atomic_refcounts() { g_atomic_refcounts = true; }
+}
+
+//a reference count which is updated atomically once
+//threading::enable_atomic_refcounts() has been called.
+class refcount_int
+{
+public:
+	refcount_int(int n=0) : n_(n) {}
+	refcount_int(const refcount_int& o) : n_(int(o)) {}
+	refcount_int& operator=(int n) { n_.store(n, std::memory_order_relaxed); return *this; }
+	refcount_int& operator=(const refcount_int& o) { return *this = int(o); }
+
+	operator int() const { return n_.load(std::memory_order_relaxed); }
+
+	int operator++() { return threading::g_atomic_refcounts ? ++n_ : add(1); }
+	int operator--() { return threading::g_atomic_refcounts ? --n_ : add(-1); }
+	int operator++(int) { return operator++() - 1; }
+	int operator--(int) { return operator--() + 1; }
+
+private:
+	int add(int delta) {
+		const int n = n_.load(std::memory_order_relaxed) + delta;
+		n_.store(n, std::memory_order_relaxed);
+		return n;
+	}
+
+	std::atomic<int> n_;
+};
+
 class reference_counted_object
 {
 public:
@@ -40,7 +78,7 @@ public:
 protected:
 	void turn_reference_counting_off() { count_ = 1000000; }
 private:
-	mutable int count_;
+	mutable refcount_int count_;
 };
 
 struct reference_counted_object_pin_norelease
@@ -59,6 +59,28 @@ void scrollable_widget::set_dim(int w, int h)
 void scrollable_widget::on_set_yscroll(int old_yscroll, int new_yscroll)
 {}
 
+rect scrollable_widget::render_bounds() const
+{
+	if(!scrollbar_) {
+		return widget::render_bounds();
+	}
+
+	return rect_union(widget::render_bounds(), scrollbar_->render_bounds());
+}
+
+unsigned int scrollable_widget::render_state() const
+{
+	unsigned int state = yscroll_*31 + virtual_height_;
+	if(scrollbar_) {
+		state = state*31 + scrollbar_->window_pos() + 1;
+		state = state*31 + scrollbar_->x();
+		state = state*31 + scrollbar_->y();
+		state = state*31 + scrollbar_->height();
+	}
+
+	return state;
+}
+
 void scrollable_widget::set_virtual_height(int height)
 {
 	virtual_height_ = height;
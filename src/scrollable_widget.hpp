@@ -36,6 +36,9 @@ public:
 	virtual bool handle_event(const SDL_Event& event, bool claimed);
 
 	virtual void set_loc(int x, int y);
+
+	//includes the scrollbar, which is drawn to the right of the widget.
+	virtual rect render_bounds() const;
 protected:
 	~scrollable_widget();
 	void set_virtual_height(int height);
@@ -48,6 +51,8 @@ protected:
 
 	virtual void set_value(const std::string& key, const variant& v);
 	virtual variant get_value(const std::string& key) const;
+
+	virtual unsigned int render_state() const;
 private:
 	virtual void on_set_yscroll(int old_yscroll, int new_yscroll);
 
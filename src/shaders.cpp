@@ -28,6 +28,7 @@
 #include "json_parser.hpp"
 #include "level.hpp"
 #include "module.hpp"
+#include "normal_map.hpp"
 #include "shaders.hpp"
 #include "variant_utils.hpp"
 #include "profile_timer.hpp"
@@ -124,18 +125,60 @@ bool shader::compile(const std::string& code)
 namespace {
 	std::map<std::string, gles2::program_ptr> shader_programs;
 	std::map<std::string, gles2::shader_program_ptr> g_global_shaders;
+
+	int uniform_calls_issued = 0, uniform_calls_skipped = 0;
+
+	//the number of floats or ints making up one element of a uniform of the
+	//given type, or 0 if the type isn't handled.
+	int uniform_components(GLenum type, bool* is_int)
+	{
+		*is_int = false;
+		switch(type) {
+		case GL_FLOAT:		return 1;
+		case GL_FLOAT_VEC2:	return 2;
+		case GL_FLOAT_VEC3:	return 3;
+		case GL_FLOAT_VEC4:	return 4;
+		case GL_FLOAT_MAT2:	return 4;
+		case GL_FLOAT_MAT3:	return 9;
+		case GL_FLOAT_MAT4:	return 16;
+		}
+
+		*is_int = true;
+		switch(type) {
+		case GL_INT:
+		case GL_BOOL:
+		case GL_SAMPLER_2D:	return 1;
+		case GL_INT_VEC2:
+		case GL_BOOL_VEC2:	return 2;
+		case GL_INT_VEC3:
+		case GL_BOOL_VEC3:	return 3;
+		case GL_INT_VEC4:
+		case GL_BOOL_VEC4:	return 4;
+		}
+
+		return 0;
+	}
+
+	void append_floats(const variant& value, std::vector<GLfloat>* out)
+	{
+		for(size_t n = 0; n < value.num_elements(); ++n) {
+			out->push_back(GLfloat(value[n].as_decimal().as_float()));
+		}
+	}
 }
 
 program::program() 
-	: object_(0), vertex_location_(-1), texcoord_location_(-1), color_attr_location_(-1), u_tex_map_(-1), u_mvp_matrix_(-1), u_sprite_area_(-1), u_draw_area_(-1), u_cycle_(-1), u_color_(-1), u_point_size_(-1)
+	: object_(0), vertex_location_(-1), texcoord_location_(-1), color_attr_location_(-1), u_tex_map_(-1), u_mvp_matrix_(-1), u_sprite_area_(-1), u_draw_area_(-1), u_cycle_(-1), u_color_(-1), u_point_size_(-1), u_discard_(-1)
 {
+	std::fill(known_uniforms_, known_uniforms_ + NUM_KNOWN_UNIFORMS, static_cast<actives*>(NULL));
 	environ_ = this;
 }
 
 
 program::program(const std::string& name, const shader& vs, const shader& fs)
-	: object_(0), vertex_location_(-1), texcoord_location_(-1), color_attr_location_(-1), u_tex_map_(-1), u_mvp_matrix_(-1), u_sprite_area_(-1), u_draw_area_(-1), u_cycle_(-1), u_color_(-1), u_point_size_(-1)
+	: object_(0), vertex_location_(-1), texcoord_location_(-1), color_attr_location_(-1), u_tex_map_(-1), u_mvp_matrix_(-1), u_sprite_area_(-1), u_draw_area_(-1), u_cycle_(-1), u_color_(-1), u_point_size_(-1), u_discard_(-1)
 {
+	std::fill(known_uniforms_, known_uniforms_ + NUM_KNOWN_UNIFORMS, static_cast<actives*>(NULL));
 	environ_ = this;
 	init(name, vs, fs);
 }
@@ -197,9 +240,27 @@ GLint program::get_uniform(const std::string& attr) const
 	if(it == uniforms_.end()) {
 		return -1;
 	}
+	it->second.external = true;
+	return it->second.location;
+}
+
+GLint program::uniform_location(const std::string& attr) const
+{
+	std::map<std::string, actives>::const_iterator it = uniforms_.find(attr);
+	if(it == uniforms_.end()) {
+		return -1;
+	}
 	return it->second.location;
 }
 
+GLint program::mvp_matrix_uniform() const
+{
+	if(known_uniforms_[KNOWN_MVP_MATRIX] != NULL) {
+		known_uniforms_[KNOWN_MVP_MATRIX]->external = true;
+	}
+	return u_mvp_matrix_;
+}
+
 bool program::queryAttributes()
 {
 	GLint active_attribs;
@@ -258,150 +319,143 @@ variant program::get_uniform_value(const std::string& key) const
 
 void program::set_uniform(const actives_map_iterator& it, const GLsizei count, const GLfloat* fv)
 {
-	const actives& u = it->second;
-	switch(u.type) {
-	case GL_FLOAT: {
-		glUniform1fv(u.location, count, fv);
-		break;
-	}
-	case GL_FLOAT_VEC2: {
-		glUniform2fv(u.location, count, fv);
-		break;
-	}
-	case GL_FLOAT_VEC3: {
-		glUniform3fv(u.location, count, fv);
-		break;
-	}
-	case GL_FLOAT_VEC4: {
-		glUniform4fv(u.location, count, fv);
-		break;
-	}
-	case GL_FLOAT_MAT2:	{
-		glUniformMatrix2fv(u.location, count, GL_FALSE, fv);
-		break;
-	}
-	case GL_FLOAT_MAT3: {
-		glUniformMatrix3fv(u.location, count, GL_FALSE, fv);
-		break;
-	}
-	case GL_FLOAT_MAT4: {
-		glUniformMatrix4fv(u.location, count, GL_FALSE, fv);
-		break;
-	}
+	bool is_int = false;
+	const int components = uniform_components(it->second.type, &is_int);
+	WRITE_LOG(components > 0 && !is_int, "Unhandled uniform type: " << it->second.type);
 
-	default:
-		WRITE_LOG(false, "Unhandled uniform type: " << it->second.type);
-	}
+	scratch_uniform_.ints.clear();
+	scratch_uniform_.floats.assign(fv, fv + count*components);
+	set_uniform_data(it->second, scratch_uniform_);
 }
 
 void program::set_uniform(const actives_map_iterator& it, const variant& value)
 {
-	const actives& u = it->second;
+	convert_uniform(it->second, value, &scratch_uniform_);
+	set_uniform_data(it->second, scratch_uniform_);
+}
+
+void program::convert_uniform(const actives& u, const variant& value, uniform_data* data)
+{
+	data->floats.clear();
+	data->ints.clear();
+
 	switch(u.type) {
 	case GL_FLOAT: {
 		if(u.num_elements == 1) {
-			glUniform1f(u.location, GLfloat(value.as_decimal().as_float()));
+			data->floats.push_back(GLfloat(value.as_decimal().as_float()));
 		} else {
 			ASSERT_LOG(u.num_elements == value.num_elements(), "Incorrect number of elements for uniform array: " << u.num_elements << " vs " << value.num_elements());
-			std::vector<GLfloat> v(u.num_elements);
-			for(size_t n = 0; n < value.num_elements(); ++n) {
-				v[n] = GLfloat(value[n].as_decimal().as_float());
-			}
-
-			glUniform1fv(u.location, u.num_elements, &v[0]);
+			append_floats(value, &data->floats);
 		}
-
 		break;
 	}
-	case GL_FLOAT_VEC2: {
+	case GL_FLOAT_VEC2:
 		WRITE_LOG(value.num_elements() == 2, "Must be four(2) elements in vector.");
-		GLfloat v[2];
-		for(size_t n = 0; n < value.num_elements(); ++n) {
-			v[n] = GLfloat(value[n].as_decimal().as_float());
-		}
-		glUniform2fv(u.location, u.num_elements, &v[0]);
+		append_floats(value, &data->floats);
 		break;
-	}
-	case GL_FLOAT_VEC3: {
+	case GL_FLOAT_VEC3:
 		WRITE_LOG(value.num_elements() == 3, "Must be three(3) elements in vector.");
-		GLfloat v[3];
-		for(size_t n = 0; n < value.num_elements(); ++n) {
-			v[n] = GLfloat(value[n].as_decimal().as_float());
-		}
-		glUniform3fv(u.location, u.num_elements, &v[0]);
+		append_floats(value, &data->floats);
 		break;
-	}
-	case GL_FLOAT_VEC4: {
+	case GL_FLOAT_VEC4:
 		ASSERT_LOG(value.num_elements() % 4 == 0 && value.num_elements()/4 <= u.num_elements, "Elements in vector must be divisible by 4 and fit in the array");
-		std::vector<GLfloat> v(value.num_elements());
-		for(size_t n = 0; n < value.num_elements(); ++n) {
-			v[n] = GLfloat(value[n].as_decimal().as_float());
-		}
-		glUniform4fv(u.location, v.size()/4, &v[0]);
-		break;
-	}
-	case GL_INT:		glUniform1i(u.location, value.as_int()); break;
-	case GL_INT_VEC2:	
-		WRITE_LOG(value.num_elements() == 2, "Must be two(2) elements in vec.");
-		glUniform2i(u.location, value[0].as_int(), value[1].as_int()); 
-		break;
-	case GL_INT_VEC3:	
-		WRITE_LOG(value.num_elements() == 3, "Must be three(3) elements in vec.");
-		glUniform3iv(u.location, u.num_elements, &value.as_list_int()[0]); 
-		break;
-	case GL_INT_VEC4: 	
-		WRITE_LOG(value.num_elements() == 4, "Must be four(4) elements in vec.");
-		glUniform4iv(u.location, u.num_elements, &value.as_list_int()[0]); 
+		append_floats(value, &data->floats);
 		break;
-	case GL_BOOL:		glUniform1i(u.location, value.as_bool()); break;
-	case GL_BOOL_VEC2:	
-		WRITE_LOG(value.num_elements() == 2, "Must be two(2) elements in vec.");
-		glUniform2i(u.location, value[0].as_bool(), value[1].as_bool()); 
+	case GL_INT:
+	case GL_SAMPLER_2D:
+		data->ints.push_back(value.as_int());
 		break;
-	case GL_BOOL_VEC3:	
-		WRITE_LOG(value.num_elements() == 3, "Must be three(3) elements in vec.");
-		glUniform3i(u.location, value[0].as_bool(), value[1].as_bool(), value[2].as_bool()); 
+	case GL_INT_VEC2:
+	case GL_INT_VEC3:
+	case GL_INT_VEC4: {
+		const int size = u.type == GL_INT_VEC2 ? 2 : (u.type == GL_INT_VEC3 ? 3 : 4);
+		WRITE_LOG(value.num_elements() == size, "Must be " << size << " elements in vec.");
+		for(int n = 0; n != size; ++n) {
+			data->ints.push_back(value[n].as_int());
+		}
 		break;
-	case GL_BOOL_VEC4:
-		WRITE_LOG(value.num_elements() == 4, "Must be four(4) elements in vec.");
-		glUniform4i(u.location, value[0].as_bool(), value[1].as_bool(), value[2].as_bool(), value[3].as_bool()); 
+	}
+	case GL_BOOL:
+		data->ints.push_back(value.as_bool());
 		break;
-	case GL_FLOAT_MAT2:	{
-		WRITE_LOG(value.num_elements() == 4, "Must be four(4) elements in matrix.");
-		GLfloat v[4];
-		for(size_t n = 0; n < value.num_elements(); ++n) {
-			v[n] = GLfloat(value[n].as_decimal().as_float());
+	case GL_BOOL_VEC2:
+	case GL_BOOL_VEC3:
+	case GL_BOOL_VEC4: {
+		const int size = u.type == GL_BOOL_VEC2 ? 2 : (u.type == GL_BOOL_VEC3 ? 3 : 4);
+		WRITE_LOG(value.num_elements() == size, "Must be " << size << " elements in vec.");
+		for(int n = 0; n != size; ++n) {
+			data->ints.push_back(value[n].as_bool());
 		}
-		glUniformMatrix2fv(u.location, u.num_elements, GL_FALSE, &v[0]);
 		break;
 	}
-	case GL_FLOAT_MAT3: {
+	case GL_FLOAT_MAT2:
+		WRITE_LOG(value.num_elements() == 4, "Must be four(4) elements in matrix.");
+		append_floats(value, &data->floats);
+		break;
+	case GL_FLOAT_MAT3:
 		WRITE_LOG(value.num_elements() == 9, "Must be nine(9) elements in matrix.");
-		GLfloat v[9];
-		for(size_t n = 0; n < value.num_elements(); ++n) {
-			v[n] = GLfloat(value[n].as_decimal().as_float());
-		}
-		glUniformMatrix3fv(u.location, u.num_elements, GL_FALSE, &v[0]);
+		append_floats(value, &data->floats);
 		break;
-	}
-	case GL_FLOAT_MAT4: {
+	case GL_FLOAT_MAT4:
 		WRITE_LOG(value.num_elements() == 16, "Must be 16 elements in matrix.");
-		GLfloat v[16];
-		for(size_t n = 0; n < value.num_elements(); ++n) {
-			v[n] = GLfloat(value[n].as_decimal().as_float());
-		}
-		glUniformMatrix4fv(u.location, u.num_elements, GL_FALSE, &v[0]);
+		append_floats(value, &data->floats);
 		break;
-	}
-
-	case GL_SAMPLER_2D:		glUniform1i(u.location, value.as_int()); break;
 
 	case GL_SAMPLER_CUBE:
 	default:
-		WRITE_LOG(false, "Unhandled uniform type: " << it->second.type);
+		WRITE_LOG(false, "Unhandled uniform type: " << u.type);
 	}
 }
 
+void program::set_uniform_data(actives& u, const uniform_data& data)
+{
+	bool is_int = false;
+	const int components = uniform_components(u.type, &is_int);
+	const GLsizei count = components ? GLsizei((is_int ? data.ints.size() : data.floats.size())/components) : 0;
+	if(count == 0) {
+		//the value didn't suit the uniform, which was reported when it
+		//was converted.
+		return;
+	}
+
+	if(!u.external && u.shadow == data) {
+		++uniform_calls_skipped;
+		return;
+	}
+
+	const GLfloat* fv = is_int ? NULL : &data.floats[0];
+	const GLint* iv = is_int ? &data.ints[0] : NULL;
+	switch(u.type) {
+	case GL_FLOAT:		glUniform1fv(u.location, count, fv); break;
+	case GL_FLOAT_VEC2:	glUniform2fv(u.location, count, fv); break;
+	case GL_FLOAT_VEC3:	glUniform3fv(u.location, count, fv); break;
+	case GL_FLOAT_VEC4:	glUniform4fv(u.location, count, fv); break;
+	case GL_FLOAT_MAT2:	glUniformMatrix2fv(u.location, count, GL_FALSE, fv); break;
+	case GL_FLOAT_MAT3:	glUniformMatrix3fv(u.location, count, GL_FALSE, fv); break;
+	case GL_FLOAT_MAT4:	glUniformMatrix4fv(u.location, count, GL_FALSE, fv); break;
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_2D:	glUniform1iv(u.location, count, iv); break;
+	case GL_INT_VEC2:
+	case GL_BOOL_VEC2:	glUniform2iv(u.location, count, iv); break;
+	case GL_INT_VEC3:
+	case GL_BOOL_VEC3:	glUniform3iv(u.location, count, iv); break;
+	case GL_INT_VEC4:
+	case GL_BOOL_VEC4:	glUniform4iv(u.location, count, iv); break;
+	}
+
+	++uniform_calls_issued;
+	u.shadow = data;
+}
+
+std::string program::uniform_call_report()
+{
+	std::ostringstream s;
+	const int total = uniform_calls_issued + uniform_calls_skipped;
+	s << "uniforms: " << uniform_calls_issued << " glUniform calls issued, " << uniform_calls_skipped << " of " << total << " skipped as redundant\n";
+	return s.str();
+}
+
 actives_map_iterator program::get_uniform_reference(const std::string& key)
 {
 	if(stored_uniforms_.has_key(key)) {
@@ -438,6 +492,19 @@ void program::set_uniform_or_defer(actives_map_iterator& it, const variant& valu
 	set_uniform(it, value);
 }
 
+void program::set_uniform_or_defer(actives_map_iterator& it, const variant& value, const uniform_data& data)
+{
+	it->second.last_value = value;
+
+	GLint cur_prog;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &cur_prog);
+	if(cur_prog != get()) {
+		uniforms_to_update_.push_back(it);
+		return;
+	}
+	set_uniform_data(it->second, data);
+}
+
 namespace {
 	class uniforms_callable : public game_logic::formula_callable 
 	{
@@ -723,6 +790,28 @@ namespace {
 		}
 	};
 
+	// the normal map baked for an image, for lit shaders. If the image has
+	// no up to date baked map one is generated in the background, and null
+	// is returned until it is ready.
+	class load_normal_map_function : public game_logic::function_expression 
+	{
+	public:
+		explicit load_normal_map_function(const args_list& args)
+		 : function_expression("load_normal_map", args, 1, 1)
+		{}
+	private:
+		variant execute(const game_logic::formula_callable& variables) const 
+		{
+			game_logic::formula::fail_if_static_context();
+			const std::string filename = module::map_file(args()[0]->evaluate(variables).as_string());
+			const graphics::texture tex = graphics::get_normal_map(filename);
+			if(!tex.valid()) {
+				return variant();
+			}
+			return variant(new texture_object(tex));
+		}
+	};
+
 	class blend_mode_command : public game_logic::command_callable
 	{
 	public:
@@ -775,6 +864,8 @@ namespace {
 				return game_logic::expression_ptr(new bind_texture_function(args));
 			} else if(fn == "load_texture") {
 				return game_logic::expression_ptr(new load_texture_function(args));
+			} else if(fn == "load_normal_map") {
+				return game_logic::expression_ptr(new load_normal_map_function(args));
 			} else if(fn == "blend_mode") {
 				return game_logic::expression_ptr(new blend_mode_function(args));
 			}
@@ -1005,49 +1096,50 @@ void program::set_fixed_attributes()
 
 void program::set_fixed_uniforms(const variant& node)
 {
-	u_discard_ = get_uniform("u_anura_discard");
+	u_discard_ = uniform_location("u_anura_discard");
 
 	if(node.has_key("mvp_matrix")) {
-		u_mvp_matrix_ = GLint(get_uniform(node["mvp_matrix"].as_string()));
+		u_mvp_matrix_ = GLint(uniform_location(node["mvp_matrix"].as_string()));
 		ASSERT_LOG(u_mvp_matrix_ != -1, "mvp_matrix uniform given but nothing in corresponding shader.");
 	} else {
 		u_mvp_matrix_ = -1;
 	}
 
 	if(node.has_key("sprite_area")) {
-		u_sprite_area_ = GLint(get_uniform(node["sprite_area"].as_string()));
+		u_sprite_area_ = GLint(uniform_location(node["sprite_area"].as_string()));
 		ASSERT_LOG(u_sprite_area_ != -1, "sprite_area uniform given but nothing in corresponding shader.");
 	} else {
 		u_sprite_area_ = -1;
 	}
 
 	if(node.has_key("draw_area")) {
-		u_draw_area_ = GLint(get_uniform(node["draw_area"].as_string()));
+		u_draw_area_ = GLint(uniform_location(node["draw_area"].as_string()));
 		ASSERT_LOG(u_mvp_matrix_ != -1, "draw_area uniform given but nothing in corresponding shader.");
 	} else {
 		u_draw_area_ = -1;
 	}
 
 	if(node.has_key("cycle")) {
-		u_cycle_ = GLint(get_uniform(node["cycle"].as_string()));
+		u_cycle_ = GLint(uniform_location(node["cycle"].as_string()));
 		ASSERT_LOG(u_mvp_matrix_ != -1, "cycle uniform given but nothing in corresponding shader.");
 	} else {
 		u_cycle_ = -1;
 	}
 
 	if(node.has_key("color")) {
-		u_color_ = GLint(get_uniform(node["color"].as_string()));
+		u_color_ = GLint(uniform_location(node["color"].as_string()));
 		ASSERT_LOG(u_color_ != -1, "color uniform given but nothing in corresponding shader.");
 	} else {
 		u_color_ = -1;
 	}
 	if(node.has_key("point_size")) {
-		u_point_size_ = GLint(get_uniform(node["point_size"].as_string()));
+		u_point_size_ = GLint(uniform_location(node["point_size"].as_string()));
 		ASSERT_LOG(u_point_size_ != -1, "point size uniform given but nothing in corresponding shader.");
 	} else {
 		u_point_size_ = -1;
 	}
 	stored_uniforms_ = node;
+	resolve_known_uniforms();
 }
 
 void program::set_fixed_uniforms()
@@ -1090,6 +1182,44 @@ void program::set_fixed_uniforms()
 		//the tex map defaults to a binding of 0.
 		glUniform1i(u_tex_map_, 0);
 	}
+
+	resolve_known_uniforms();
+}
+
+void program::resolve_known_uniforms()
+{
+	const GLint locations[NUM_KNOWN_UNIFORMS] = {
+		u_discard_, u_mvp_matrix_, u_color_, u_point_size_,
+		u_sprite_area_, u_draw_area_, u_cycle_,
+	};
+
+	for(int n = 0; n != NUM_KNOWN_UNIFORMS; ++n) {
+		known_uniforms_[n] = NULL;
+		for(actives_map_iterator i = uniforms_.begin(); i != uniforms_.end() && locations[n] != -1; ++i) {
+			if(i->second.location == locations[n]) {
+				known_uniforms_[n] = &i->second;
+				break;
+			}
+		}
+	}
+}
+
+void program::set_known_uniform(KNOWN_UNIFORM n, const GLfloat* fv, int nfloats)
+{
+	if(known_uniforms_[n] != NULL) {
+		scratch_uniform_.ints.clear();
+		scratch_uniform_.floats.assign(fv, fv + nfloats);
+		set_uniform_data(*known_uniforms_[n], scratch_uniform_);
+	}
+}
+
+void program::set_known_uniform(KNOWN_UNIFORM n, GLint value)
+{
+	if(known_uniforms_[n] != NULL) {
+		scratch_uniform_.floats.clear();
+		scratch_uniform_.ints.assign(1, value);
+		set_uniform_data(*known_uniforms_[n], scratch_uniform_);
+	}
 }
 
 void program::load_shaders(const std::string& shader_data)
@@ -1218,51 +1348,32 @@ void program::set_deferred_uniforms()
 
 void program::set_known_uniforms()
 {
-#if defined(USE_SHADERS)
-	if(u_discard_ >= 0) {
-		int value = gles2::get_alpha_test() ? 1 : 0;
-		glUniform1i(u_discard_, value);
-	}
-
-	if(u_mvp_matrix_ != -1) {
-		glUniformMatrix4fv(u_mvp_matrix_, 1, GL_FALSE, glm::value_ptr(gles2::get_mvp_matrix()));
-	}
-	if(u_color_ != -1) {
-		glUniform4fv(u_color_, 1, gles2::get_color());
-	}
-	if(u_point_size_ != -1) {
+	//these go through the shadow values, so a program drawing many objects
+	//in a row only sends the ones which changed.
+	set_known_uniform(KNOWN_DISCARD, gles2::get_alpha_test() ? 1 : 0);
+	set_known_uniform(KNOWN_MVP_MATRIX, glm::value_ptr(gles2::get_mvp_matrix()), 16);
+	set_known_uniform(KNOWN_COLOR, gles2::get_color(), 4);
+	if(known_uniforms_[KNOWN_POINT_SIZE] != NULL) {
 		GLfloat pt_size;
 		glGetFloatv(GL_POINT_SIZE, &pt_size);
-		glUniform1f(u_point_size_, pt_size);
+		set_known_uniform(KNOWN_POINT_SIZE, &pt_size, 1);
 	}
-#endif
 }
 
 void program::set_sprite_area(const GLfloat* fl)
 {
-#if defined(USE_SHADERS)
-	if(u_sprite_area_ != -1) {
-		glUniform4fv(u_sprite_area_, 1, fl);
-	}
-#endif
+	set_known_uniform(KNOWN_SPRITE_AREA, fl, 4);
 }
 
 void program::set_draw_area(const GLfloat* fl)
 {
-#if defined(USE_SHADERS)
-	if(u_draw_area_ != -1) {
-		glUniform4fv(u_draw_area_, 1, fl);
-	}
-#endif
+	set_known_uniform(KNOWN_DRAW_AREA, fl, 4);
 }
 
 void program::set_cycle(int cycle)
 {
-#if defined(USE_SHADERS)
-	if(u_cycle_ != -1) {
-		glUniform1f(u_cycle_, static_cast<GLfloat>(cycle));
-	}
-#endif
+	const GLfloat value = static_cast<GLfloat>(cycle);
+	set_known_uniform(KNOWN_CYCLE, &value, 1);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -1545,9 +1656,10 @@ void shader_program::uniform_commands_callable::execute_on_draw()
 	foreach(DrawCommand& cmd, uniform_commands_) {
 		if(cmd.increment) {
 			cmd.value = cmd.value + variant(1);
+			program_->set_uniform_or_defer(cmd.target, cmd.value);
+		} else {
+			program_->set_uniform_or_defer(cmd.target, cmd.value, cmd.data);
 		}
-
-		program_->set_uniform_or_defer(cmd.target, cmd.value);
 	}
 }
 
@@ -1581,6 +1693,10 @@ void shader_program::uniform_commands_callable::set_value(const std::string& key
 		target->value = value;
 		target->increment = false;
 	}
+
+	if(!target->increment) {
+		program::convert_uniform(target->target->second, target->value, &target->data);
+	}
 }
 
 void shader_program::attribute_commands_callable::execute_on_draw()
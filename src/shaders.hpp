@@ -52,8 +52,20 @@ private:
 	std::string code_;
 };
 
+// A uniform value as it is passed to glUniform*(), either as floats or,
+// for int, bool and sampler uniforms, as ints.
+struct uniform_data
+{
+	std::vector<GLfloat> floats;
+	std::vector<GLint> ints;
+
+	bool operator==(const uniform_data& o) const { return floats == o.floats && ints == o.ints; }
+};
+
 struct actives
 {
+	actives() : type(0), num_elements(0), location(-1), external(false)
+	{}
 	// Name of variable.
 	std::string name;
 	// type of the uniform/attribute variable
@@ -65,6 +77,11 @@ struct actives
 	GLint location;
 	// Last value
 	variant last_value;
+	// The value last sent for a uniform. A value equal to it isn't sent again.
+	uniform_data shadow;
+	// Set once the location of a uniform has been handed out, since it may
+	// then be written with glUniform*() directly, behind the shadow's back.
+	mutable bool external;
 };
 
 class program;
@@ -94,13 +111,15 @@ public:
 	void set_uniform(const actives_map_iterator& it, const GLsizei count, const GLfloat* fv);
 	void set_uniform_or_defer(actives_map_iterator& it, const variant& value);
 	void set_uniform_or_defer(const std::string& key, const variant& value);
+	//as above, with 'value' already converted to 'data' by convert_uniform().
+	void set_uniform_or_defer(actives_map_iterator& it, const variant& value, const uniform_data& data);
 	variant get_uniform_value(const std::string& key) const;
 	void set_attributes(const std::string& key, const variant& value);
 	void set_attributes(const actives_map_iterator& it, const variant& value);
 	variant get_attributes_value(const std::string& key) const;
 	game_logic::formula_callable* get_environment() { return environ_; }
 	void set_deferred_uniforms();
-	GLint mvp_matrix_uniform() const { return u_mvp_matrix_; }
+	GLint mvp_matrix_uniform() const;
 	GLint vertex_attribute() const { return vertex_location_; }
 	GLint texcoord_attribute() const { return texcoord_location_; }
 	GLuint get_fixed_attribute(const std::string& name) const;
@@ -134,6 +153,14 @@ public:
 	void set_draw_area(const GLfloat* fl);
 	void set_cycle(int cycle);
 
+	//converts a value for the uniform to what is passed to glUniform*().
+	//Leaves 'data' empty if the value doesn't suit the uniform.
+	static void convert_uniform(const actives& u, const variant& value, uniform_data* data);
+
+	//how many glUniform*() calls went through programs, and how many were
+	//skipped because the program already held the value.
+	static std::string uniform_call_report();
+
 	const shader& vertex_shader() const { return vs_; }
 	const shader& fragment_shader() const { return fs_; }
 private:
@@ -141,6 +168,15 @@ private:
 	bool queryUniforms();
 	bool queryAttributes();
 
+	GLint uniform_location(const std::string& name) const;
+	void set_uniform_data(actives& u, const uniform_data& data);
+
+	enum KNOWN_UNIFORM { KNOWN_DISCARD, KNOWN_MVP_MATRIX, KNOWN_COLOR, KNOWN_POINT_SIZE,
+	                     KNOWN_SPRITE_AREA, KNOWN_DRAW_AREA, KNOWN_CYCLE, NUM_KNOWN_UNIFORMS };
+	void resolve_known_uniforms();
+	void set_known_uniform(KNOWN_UNIFORM n, const GLfloat* fv, int nfloats);
+	void set_known_uniform(KNOWN_UNIFORM n, GLint value);
+
 	std::vector<GLint> active_attributes_;
 	variant stored_attributes_;
 	variant stored_uniforms_;
@@ -173,6 +209,12 @@ private:
 	GLint u_point_size_;
 	GLint u_discard_;
 
+	//the uniforms at the u_*_ locations above, or NULL.
+	actives* known_uniforms_[NUM_KNOWN_UNIFORMS];
+
+	//reused when converting values, to save allocating per call.
+	uniform_data scratch_uniform_;
+
 	friend class shader_program;
 };
 
@@ -213,6 +255,10 @@ protected:
 		std::map<std::string, actives>::iterator target;
 		variant value;
 		bool increment;
+
+		//the value converted for the target uniform when it was set, so
+		//setting it on each draw needn't convert it again.
+		uniform_data data;
 	};
 
 	class attribute_commands_callable : public game_logic::formula_callable
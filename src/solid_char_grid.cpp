@@ -0,0 +1,307 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+
+#include "asserts.hpp"
+#include "collision_utils.hpp"
+#include "custom_object.hpp"
+#include "entity.hpp"
+#include "foreach.hpp"
+#include "level.hpp"
+#include "random.hpp"
+#include "solid_char_grid.hpp"
+#include "unit_test.hpp"
+
+namespace {
+const int CellSize = 128;
+
+//objects covering more cells than this, such as long platforms, are
+//returned by every query rather than filed under each cell.
+const int MaxEntryCells = 64;
+
+int cell_of(int v)
+{
+	return v >= 0 ? v/CellSize : -((-v - 1)/CellSize) - 1;
+}
+
+rect entity_bounds(const entity& e)
+{
+	return rect_union(e.solid_rect(), e.platform_bounds());
+}
+}
+
+solid_char_grid_link::~solid_char_grid_link()
+{
+	while(!grids_.empty()) {
+		grids_.back().first->remove_entry(grids_.back().second);
+	}
+}
+
+void solid_char_grid_link::update(const entity& e)
+{
+	for(int n = 0; n != grids_.size(); ++n) {
+		grids_[n].first->update_entry(grids_[n].second, e);
+	}
+}
+
+solid_char_grid::solid_char_grid() : next_order_(0), query_id_(0)
+{
+}
+
+solid_char_grid::solid_char_grid(const solid_char_grid&) : next_order_(0), query_id_(0)
+{
+}
+
+solid_char_grid::~solid_char_grid()
+{
+	while(!entries_.empty()) {
+		remove_entry(entries_.size() - 1);
+	}
+}
+
+void solid_char_grid::assign(const std::vector<entity_ptr>& chars)
+{
+	//entries which aren't in 'chars' are left with a negative order.
+	foreach(entry& en, entries_) {
+		en.order = -1;
+	}
+
+	next_order_ = 0;
+	foreach(const entity_ptr& e, chars) {
+		int index = -1;
+		foreach(const solid_char_grid_link::grid_index& link, e->solid_char_grid_link_.grids_) {
+			if(link.first == this) {
+				index = link.second;
+			}
+		}
+
+		if(index == -1) {
+			add(*e);
+		} else if(entries_[index].order == -1) {
+			entries_[index].order = next_order_++;
+		}
+	}
+
+	for(int n = entries_.size() - 1; n >= 0; --n) {
+		if(entries_[n].order == -1) {
+			remove_entry(n);
+		}
+	}
+}
+
+void solid_char_grid::add(entity& e)
+{
+	foreach(const solid_char_grid_link::grid_index& link, e.solid_char_grid_link_.grids_) {
+		if(link.first == this) {
+			return;
+		}
+	}
+
+	entry en;
+	en.e = &e;
+	en.order = next_order_++;
+	en.x1 = en.y1 = 0;
+	en.x2 = en.y2 = -1;
+	en.large = false;
+	entries_.push_back(en);
+
+	const int index = entries_.size() - 1;
+	e.solid_char_grid_link_.grids_.push_back(solid_char_grid_link::grid_index(this, index));
+	update_entry(index, e);
+}
+
+void solid_char_grid::remove(const entity& e)
+{
+	foreach(const solid_char_grid_link::grid_index& link, e.solid_char_grid_link_.grids_) {
+		if(link.first == this) {
+			remove_entry(link.second);
+			return;
+		}
+	}
+}
+
+void solid_char_grid::query(const rect& area, std::vector<entity*>* result) const
+{
+	if(area.w() <= 0 || area.h() <= 0) {
+		return;
+	}
+
+	if(seen_.size() < entries_.size()) {
+		seen_.resize(entries_.size(), query_id_);
+	}
+
+	if(++query_id_ == 0) {
+		std::fill(seen_.begin(), seen_.end(), 0);
+		query_id_ = 1;
+	}
+
+	found_.clear();
+	foreach(int index, large_) {
+		seen_[index] = query_id_;
+		found_.push_back(std::pair<int, int>(entries_[index].order, index));
+	}
+
+	const int x1 = cell_of(area.x()), x2 = cell_of(area.x2() - 1);
+	const int y1 = cell_of(area.y()), y2 = cell_of(area.y2() - 1);
+	for(int y = y1; y <= y2; ++y) {
+		for(int x = x1; x <= x2; ++x) {
+			cell_map::const_iterator cell = cells_.find(std::pair<int, int>(x, y));
+			if(cell == cells_.end()) {
+				continue;
+			}
+
+			foreach(int index, cell->second) {
+				if(seen_[index] != query_id_) {
+					seen_[index] = query_id_;
+					found_.push_back(std::pair<int, int>(entries_[index].order, index));
+				}
+			}
+		}
+	}
+
+	std::sort(found_.begin(), found_.end());
+	for(int n = 0; n != found_.size(); ++n) {
+		result->push_back(entries_[found_[n].second].e);
+	}
+}
+
+void solid_char_grid::update_entry(int index, const entity& e)
+{
+	entry& en = entries_[index];
+
+	const rect bounds = entity_bounds(e);
+	int x1 = 0, y1 = 0, x2 = -1, y2 = -1;
+	if(bounds.w() > 0 && bounds.h() > 0) {
+		x1 = cell_of(bounds.x());
+		y1 = cell_of(bounds.y());
+		x2 = cell_of(bounds.x2() - 1);
+		y2 = cell_of(bounds.y2() - 1);
+	}
+
+	const bool large = x2 - x1 >= MaxEntryCells || y2 - y1 >= MaxEntryCells ||
+	                   (x2 - x1 + 1)*(y2 - y1 + 1) > MaxEntryCells;
+	if(large && en.large || !large && !en.large && x1 == en.x1 && y1 == en.y1 && x2 == en.x2 && y2 == en.y2) {
+		return;
+	}
+
+	unfile_entry(index);
+	en.x1 = x1;
+	en.y1 = y1;
+	en.x2 = x2;
+	en.y2 = y2;
+	en.large = large;
+	file_entry(index);
+}
+
+void solid_char_grid::remove_entry(int index)
+{
+	unfile_entry(index);
+
+	std::vector<solid_char_grid_link::grid_index>& links = entries_[index].e->solid_char_grid_link_.grids_;
+	for(int n = 0; n != links.size(); ++n) {
+		if(links[n].first == this) {
+			links.erase(links.begin() + n);
+			break;
+		}
+	}
+
+	const int last = entries_.size() - 1;
+	if(index != last) {
+		rename_entry(last, index);
+	}
+
+	entries_.pop_back();
+}
+
+void solid_char_grid::file_entry(int index)
+{
+	const entry& en = entries_[index];
+	if(en.large) {
+		large_.push_back(index);
+		return;
+	}
+
+	for(int y = en.y1; y <= en.y2; ++y) {
+		for(int x = en.x1; x <= en.x2; ++x) {
+			cells_[std::pair<int, int>(x, y)].push_back(index);
+		}
+	}
+}
+
+void solid_char_grid::unfile_entry(int index)
+{
+	const entry& en = entries_[index];
+	if(en.large) {
+		large_.erase(std::find(large_.begin(), large_.end(), index));
+		return;
+	}
+
+	for(int y = en.y1; y <= en.y2; ++y) {
+		for(int x = en.x1; x <= en.x2; ++x) {
+			std::vector<int>& cell = cells_[std::pair<int, int>(x, y)];
+			std::vector<int>::iterator i = std::find(cell.begin(), cell.end(), index);
+			ASSERT_LOG(i != cell.end(), "SOLID OBJECT MISSING FROM ITS GRID CELL");
+			*i = cell.back();
+			cell.pop_back();
+		}
+	}
+}
+
+void solid_char_grid::rename_entry(int from, int to)
+{
+	//moves the entry at 'from' to the unused slot 'to'.
+	unfile_entry(from);
+	entries_[to] = entries_[from];
+	file_entry(to);
+
+	foreach(solid_char_grid_link::grid_index& link, entries_[to].e->solid_char_grid_link_.grids_) {
+		if(link.first == this) {
+			link.second = to;
+		}
+	}
+}
+
+BENCHMARK_ARG(solid_char_grid_collisions, const std::string& obj_type)
+{
+	//hundreds of solid objects wandering about, each checking for
+	//collisions every time it moves as it would during a cycle.
+	const int NumObjects = 400;
+	static level* lvl = NULL;
+	static std::vector<entity_ptr> objects;
+	if(!lvl) {
+		lvl = new level("titlescreen.cfg");
+		static variant holder(lvl);
+		lvl->finish_loading();
+		lvl->set_as_current_level();
+
+		for(int n = 0; n != NumObjects; ++n) {
+			entity_ptr obj(new custom_object(obj_type, rng::generate()%4000, rng::generate()%2000, true));
+			obj->set_distinct_label();
+			lvl->add_character(obj);
+			objects.push_back(obj);
+		}
+	}
+
+	BENCHMARK_LOOP {
+		foreach(const entity_ptr& obj, objects) {
+			obj->set_pos(obj->x() + rng::generate()%3 - 1, obj->y() + rng::generate()%3 - 1);
+			entity_collides(*lvl, *obj, MOVE_NONE);
+		}
+	}
+}
+
+BENCHMARK_ARG_CALL_COMMAND_LINE(solid_char_grid_collisions);
@@ -0,0 +1,111 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SOLID_CHAR_GRID_HPP_INCLUDED
+#define SOLID_CHAR_GRID_HPP_INCLUDED
+
+#include <utility>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include "entity_fwd.hpp"
+#include "geometry.hpp"
+
+class solid_char_grid;
+
+//The grids an entity is held in. An entity tells its grids when its rects
+//change. A copy of an entity isn't in any grid.
+class solid_char_grid_link
+{
+public:
+	solid_char_grid_link() {}
+	solid_char_grid_link(const solid_char_grid_link&) {}
+	solid_char_grid_link& operator=(const solid_char_grid_link&) { return *this; }
+	~solid_char_grid_link();
+
+	void update(const entity& e);
+
+private:
+	friend class solid_char_grid;
+	typedef std::pair<solid_char_grid*, int> grid_index;
+	std::vector<grid_index> grids_;
+};
+
+//Broad phase for the solid and platform objects of a level. Each object is
+//filed under the square cells covered by its solid rect and platform
+//bounds, and moves between cells as those change, so a collision query
+//only visits the objects near the area it asks about. The grid doesn't
+//own the objects; an object leaves its grids when it is destroyed.
+class solid_char_grid
+{
+public:
+	solid_char_grid();
+
+	//a copy of a grid starts out empty.
+	solid_char_grid(const solid_char_grid&);
+	~solid_char_grid();
+
+	//makes the grid hold exactly 'chars'. Objects already held keep their
+	//cells. Queries return objects in the order given here.
+	void assign(const std::vector<entity_ptr>& chars);
+
+	//adds an object after all the others held, if it isn't held already.
+	void add(entity& e);
+	void remove(const entity& e);
+
+	//appends the objects whose solid rect or platform bounds may
+	//intersect 'area' to 'result', in order.
+	void query(const rect& area, std::vector<entity*>* result) const;
+
+	int size() const { return entries_.size(); }
+
+private:
+	void operator=(const solid_char_grid&);
+
+	friend class solid_char_grid_link;
+
+	struct entry {
+		entity* e;
+		int order;
+
+		//the cells the entry is filed under, inclusive. Empty if x1 > x2.
+		//Entries covering too many cells are in large_ instead.
+		int x1, y1, x2, y2;
+		bool large;
+	};
+
+	void update_entry(int index, const entity& e);
+	void remove_entry(int index);
+	void file_entry(int index);
+	void unfile_entry(int index);
+	void rename_entry(int from, int to);
+
+	std::vector<entry> entries_;
+
+	typedef boost::unordered_map<std::pair<int, int>, std::vector<int> > cell_map;
+	cell_map cells_;
+	std::vector<int> large_;
+
+	int next_order_;
+
+	//used to return each entry only once per query, sorted by order.
+	mutable std::vector<unsigned int> seen_;
+	mutable unsigned int query_id_;
+	mutable std::vector<std::pair<int, int> > found_;
+};
+
+#endif
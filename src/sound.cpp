@@ -14,11 +14,13 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <vector>
 
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "asserts.hpp"
@@ -30,6 +32,7 @@
 #include "graphics.hpp"
 
 #include "sound.hpp"
+#include "sound_mixer.hpp"
 
 #if TARGET_IPHONE_SIMULATOR || TARGET_OS_IPHONE
 #include "iphone_sound.h"
@@ -42,6 +45,10 @@ namespace sound {
 namespace {
 
 	PREF_BOOL(assert_on_missing_sound, false, "If true, missing sounds will be treated as a fatal error");
+	PREF_INT(sound_voices, 32, "Number of sound effects which can play at once");
+#ifdef USE_LIBVORBIS
+	PREF_INT(sound_stream_threshold_ms, 4000, "Ogg sound effects longer than this many milliseconds are decoded as they play instead of being loaded into memory");
+#endif
 
 struct MusicInfo {
 	MusicInfo() : volume(1.0) {}
@@ -107,24 +114,20 @@ void on_music_finished()
 //record which channels sounds are playing on, in case we
 //want to cancel a sound.
 struct sound_playing {
+	sound_playing() : object(NULL), loops(0), volume(1.0f), fade_in_time(0.0f),
+	                  left(1.0f), right(1.0f), priority(0)
+	{}
 	std::string file;
 	const void* object;
 	int	loops;		//not strictly boolean.  -1=true, 0=false
 	float volume;
 	float fade_in_time;
-	float time_cnt;
-	float fade_out_time;
+	float left, right;
+	int priority;
 };
 
 std::vector<sound_playing> channels_to_sounds_playing, queued_sounds;
 
-void on_sound_finished(int channel)
-{
-	if(channel >= 0 && channel < channels_to_sounds_playing.size()) {
-		channels_to_sounds_playing[channel].object = NULL;
-	}
-}
-
 #if TARGET_IPHONE_SIMULATOR || TARGET_OS_IPHONE
 
 class sound; //so mixer can make pointers to it
@@ -294,7 +297,50 @@ int sdl_play_sound (sound *s, int loops)
 #endif
 	
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-typedef std::map<std::string, Mix_Chunk*> cache_map;
+//a sound effect is either decoded up front or, if it's long, opened for
+//streaming each time it plays. Neither set means the sound is missing.
+struct cached_sound {
+	sample_buffer_ptr buffer;
+	std::string stream_path;
+};
+
+typedef std::map<std::string, cached_sound> cache_map;
+
+//sound effects are mixed by us rather than on SDL_mixer channels, and added
+//on top of SDL_mixer's output, which is then only playing music.
+boost::scoped_ptr<voice_mixer> g_mixer;
+int g_mixer_rate = SampleRate;
+
+//if the device isn't 16-bit stereo, voices are mixed as 16-bit stereo
+//into a buffer of our own, converted, and then added to the stream.
+bool g_convert_mix = false;
+SDL_AudioCVT g_mix_cvt;
+Uint16 g_device_format = AUDIO_S16SYS;
+int g_device_channels = 2;
+std::vector<Uint8> g_mix_convert_buf;
+
+void mixer_callback(void* udata, Uint8* stream, int len)
+{
+	if(!g_convert_mix) {
+		g_mixer->mix(reinterpret_cast<short*>(stream), len/(2*sizeof(short)));
+		return;
+	}
+
+	const int nframes = len/((SDL_AUDIO_BITSIZE(g_device_format)/8)*g_device_channels);
+	const int mix_len = nframes*2*sizeof(short);
+	if(g_mix_convert_buf.size() < mix_len*g_mix_cvt.len_mult) {
+		g_mix_convert_buf.resize(mix_len*g_mix_cvt.len_mult);
+	}
+
+	std::fill(g_mix_convert_buf.begin(), g_mix_convert_buf.begin() + mix_len, 0);
+	g_mixer->mix(reinterpret_cast<short*>(&g_mix_convert_buf[0]), nframes);
+
+	g_mix_cvt.buf = &g_mix_convert_buf[0];
+	g_mix_cvt.len = mix_len;
+	if(SDL_ConvertAudio(&g_mix_cvt) == 0) {
+		SDL_MixAudioFormat(stream, &g_mix_convert_buf[0], g_device_format, std::min(len, g_mix_cvt.len_cvt), SDL_MIX_MAXVOLUME);
+	}
+}
 #else
 typedef std::map<std::string, sound> cache_map;
 #endif
@@ -309,14 +355,57 @@ bool sound_init = false;
 void thread_load(const std::string& file)
 {
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
+	cached_sound snd;
+	const std::string path = module::map_file("sounds/" + file);
+#if defined(USE_LIBVORBIS) && !defined(__ANDROID__)
+	if(path.size() > 4 && path.compare(path.size() - 4, 4, ".ogg") == 0) {
+		const int length = ogg_stream_length(path, g_mixer_rate);
+		if(length > static_cast<int64_t>(g_sound_stream_threshold_ms)*g_mixer_rate/1000) {
+			snd.stream_path = path;
+		}
+	}
+#endif
+
+	if(snd.stream_path.empty()) {
 #if defined(__ANDROID__)
-	Mix_Chunk* chunk = Mix_LoadWAV_RW(sys::read_sdl_rw_from_asset(module::map_file("sounds/" + file).c_str()),1);
+		Mix_Chunk* chunk = Mix_LoadWAV_RW(sys::read_sdl_rw_from_asset(path.c_str()),1);
 #else
-	Mix_Chunk* chunk = Mix_LoadWAV(module::map_file("sounds/" + file).c_str());
+		Mix_Chunk* chunk = Mix_LoadWAV(path.c_str());
 #endif
+		if(chunk) {
+			//SDL_mixer has converted the sound to the device format. The
+			//mixer works in stereo 16-bit, so convert it again if the
+			//device is anything else.
+			boost::shared_ptr<sample_buffer> buf(new sample_buffer);
+			if(g_convert_mix) {
+				SDL_AudioCVT cvt;
+				if(SDL_BuildAudioCVT(&cvt, g_device_format, g_device_channels, g_mixer_rate, AUDIO_S16SYS, 2, g_mixer_rate) >= 0) {
+					std::vector<Uint8> converted(chunk->alen*cvt.len_mult);
+					std::copy(chunk->abuf, chunk->abuf + chunk->alen, converted.begin());
+					cvt.buf = &converted[0];
+					cvt.len = chunk->alen;
+					if(SDL_ConvertAudio(&cvt) == 0) {
+						const short* samples = reinterpret_cast<const short*>(&converted[0]);
+						buf->samples.assign(samples, samples + cvt.len_cvt/sizeof(short));
+					}
+				}
+
+				if(buf->samples.empty()) {
+					std::cerr << "failed to convert sound " << path << ": " << SDL_GetError() << "\n";
+				}
+			} else {
+				const short* samples = reinterpret_cast<const short*>(chunk->abuf);
+				buf->samples.assign(samples, samples + chunk->alen/sizeof(short));
+			}
+
+			Mix_FreeChunk(chunk);
+			snd.buffer = buf;
+		}
+	}
+
 	{
 		threading::lock l(cache_mutex);
-		threaded_cache[file] = chunk;
+		threaded_cache[file] = snd;
 	}
 
 #else
@@ -358,10 +447,37 @@ manager::manager()
 		return;
 	}
 
-	Mix_AllocateChannels(NumChannels);
+	int frequency = 0, nchannels = 0;
+	Uint16 format = 0;
+	if(Mix_QuerySpec(&frequency, &format, &nchannels) == 0) {
+		sound_ok = false;
+		std::cerr << "failed to query audio format!\n";
+		Mix_CloseAudio();
+		return;
+	}
+
+	Mix_AllocateChannels(0);
+	g_mixer_rate = frequency;
+	g_mixer.reset(new voice_mixer(frequency, std::max<int>(g_sound_voices, 1)));
+	channels_to_sounds_playing.resize(g_mixer->num_voices());
+
+	g_device_format = format;
+	g_device_channels = nchannels;
+	g_convert_mix = format != AUDIO_S16SYS || nchannels != 2;
+	if(g_convert_mix && SDL_BuildAudioCVT(&g_mix_cvt, AUDIO_S16SYS, 2, frequency, format, nchannels, frequency) < 0) {
+		//music still plays, sound effects are silent.
+		std::cerr << "cannot convert sound effects to the audio format: " << SDL_GetError() << "\n";
+	} else {
+		if(g_convert_mix) {
+			std::cerr << "converting sound effects to audio format " << format << " with " << nchannels << " channels\n";
+			g_mix_convert_buf.resize(BufferSize*2*sizeof(short)*g_mix_cvt.len_mult);
+		}
+
+		Mix_SetPostMix(mixer_callback, NULL);
+	}
+
 	sound_ok = true;
 
-	Mix_ChannelFinished(on_sound_finished);
 	Mix_HookMusicFinished(on_music_finished);
 	Mix_VolumeMusic(MIX_MAX_VOLUME);
 #else
@@ -399,8 +515,10 @@ manager::~manager()
 
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
 	Mix_HookMusicFinished(NULL);
+	Mix_SetPostMix(NULL, NULL);
 	next_music().clear();
 	Mix_CloseAudio();
+	g_mixer.reset();
 #else
 	iphone_kill_music();
 #endif
@@ -441,7 +559,7 @@ void preload(const std::string& file)
 
 namespace {
 
-int play_internal(const std::string& file, int loops, const void* object, float volume, float fade_in_time)
+int play_internal(const std::string& file, int loops, const void* object, float volume, float fade_in_time, int priority)
 {
 	if(!sound_ok) {
 		return -1;
@@ -455,22 +573,33 @@ int play_internal(const std::string& file, int loops, const void* object, float
 		queued_sounds.back().object = object;
 		queued_sounds.back().volume = volume;
 		queued_sounds.back().fade_in_time = fade_in_time;
+		queued_sounds.back().priority = priority;
 		
 		return -1;
 	}
 
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-	Mix_Chunk* chunk = cache[file];
-	if(chunk == NULL) {
+	const cached_sound& snd = cache[file];
+
+	voice_mixer::play_params params;
+	params.loops = loops;
+	params.left = volume*sfx_volume*g_stereo_left;
+	params.right = volume*sfx_volume*g_stereo_right;
+	params.fade_in_time = fade_in_time;
+	params.priority = priority;
+
+	int result = -1;
+	if(snd.buffer) {
+		result = g_mixer->play(snd.buffer, params);
+#ifdef USE_LIBVORBIS
+	} else if(!snd.stream_path.empty()) {
+		result = g_mixer->play(open_ogg_stream(snd.stream_path, g_mixer->rate(), loops), params);
+#endif
+	} else {
 		ASSERT_LOG(!g_assert_on_missing_sound, "FATAL: Sound file: " << file << " missing");
 		return -1;
 	}
 
-	int result = Mix_PlayChannel(-1, chunk, loops);
-	if(result >= 0) {
-		Mix_SetPanning(result, 255*g_stereo_left, 255*g_stereo_right);
-	}
-
 #else
 	sound& s = cache[file];
 	if(s == NULL) {
@@ -485,21 +614,14 @@ int play_internal(const std::string& file, int loops, const void* object, float
 		if(channels_to_sounds_playing.size() <= result) {
 			channels_to_sounds_playing.resize(result + 1);
 		}
-#if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-		if(fade_in_time == 0.0f) {
-			Mix_Volume(result, volume*sfx_volume*MIX_MAX_VOLUME); //start sound at full volume
-		} else {
-			Mix_Volume(result, 0); 
-		}
-#endif
-
 		channels_to_sounds_playing[result].file = file;
 		channels_to_sounds_playing[result].object = object;
 		channels_to_sounds_playing[result].loops = loops;
 		channels_to_sounds_playing[result].volume = volume;
 		channels_to_sounds_playing[result].fade_in_time = fade_in_time;
-		channels_to_sounds_playing[result].time_cnt = 0.0f;
-		channels_to_sounds_playing[result].fade_out_time = 0.0f;
+		channels_to_sounds_playing[result].left = g_stereo_left;
+		channels_to_sounds_playing[result].right = g_stereo_right;
+		channels_to_sounds_playing[result].priority = priority;
 	}
 
 	return result;
@@ -525,47 +647,33 @@ void process()
 		std::vector<sound_playing> sounds;
 		sounds.swap(queued_sounds);
 		foreach(const sound_playing& sfx, sounds) {
-			play_internal(sfx.file, sfx.loops, sfx.object, sfx.volume, sfx.fade_in_time);
+			play_internal(sfx.file, sfx.loops, sfx.object, sfx.volume, sfx.fade_in_time, sfx.priority);
 		}
 	}
 
-	for(int n = 0; n != channels_to_sounds_playing.size(); ++n) {
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-		sound_playing& snd = channels_to_sounds_playing[n];
-		snd.time_cnt += 0.02;
-		if(snd.fade_in_time > 0.0f) {
-			float volume = snd.volume;
-			if(snd.time_cnt > snd.fade_in_time) {
-				snd.time_cnt = 0.0f;
-				snd.fade_in_time = 0.0f;
-			} else {
-				volume *= snd.time_cnt / snd.fade_in_time;
-			}
-			//std::cerr << "Sound: " << snd.file << ", " << snd.fade_in_time << " : " << snd.time_cnt << "  " << (volume * sfx_volume) << std::endl;
-			Mix_Volume(n, volume * sfx_volume * MIX_MAX_VOLUME);
-		}
-		if(snd.fade_out_time > 0.0f) {
-			if(snd.time_cnt > snd.fade_out_time) {
-				snd.fade_out_time = 0.0f;
-				snd.object = NULL;
-				Mix_HaltChannel(n);
-			} else {
-				float volume = snd.volume;
-				volume *= (1.0 - snd.time_cnt / snd.fade_out_time);
-				Mix_Volume(n, volume * sfx_volume * MIX_MAX_VOLUME);
-			}
+	if(!g_mixer) {
+		return;
+	}
+
+	//fades are ramped by the mixer itself; all that's needed here is to
+	//top up streams and notice which sounds have finished.
+	g_mixer->update();
+	for(int n = 0; n != channels_to_sounds_playing.size(); ++n) {
+		if(!g_mixer->playing(n)) {
+			channels_to_sounds_playing[n].object = NULL;
 		}
 	}
 #endif
 }
 
-void play(const std::string& file, const void* object, float volume, float fade_in_time)
+void play(const std::string& file, const void* object, float volume, float fade_in_time, int priority)
 {
 	if(preferences::no_sound() || mute_) {
 		return;
 	}
 
-	play_internal(file, 0, object, volume, fade_in_time);
+	play_internal(file, 0, object, volume, fade_in_time, priority);
 }
 
 void stop_sound(const std::string& file, const void* object, float fade_out_time)
@@ -576,12 +684,8 @@ void stop_sound(const std::string& file, const void* object, float fade_out_time
 			if(fade_out_time == 0.0f) {
 				channels_to_sounds_playing[n].object = NULL;
 			}
-			channels_to_sounds_playing[n].fade_out_time = fade_out_time;
-			channels_to_sounds_playing[n].time_cnt = 0.0f;
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-			if(fade_out_time == 0.0f) {
-				Mix_HaltChannel(n);
-			}
+			g_mixer->stop(n, fade_out_time);
 #else
 			sdl_stop_channel(n);
 #endif
@@ -604,7 +708,7 @@ void stop_looped_sounds(const void* object)
 		   || channels_to_sounds_playing[n].object == object) &&
 		   (channels_to_sounds_playing[n].loops != 0)) {
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-			Mix_HaltChannel(n);
+			g_mixer->stop(n);
 #else
 			sdl_stop_channel(n);
 #endif
@@ -632,14 +736,14 @@ void stop_looped_sounds(const void* object)
 	}
 }
 	
-int play_looped(const std::string& file, const void* object, float volume, float fade_in_time)
+int play_looped(const std::string& file, const void* object, float volume, float fade_in_time, int priority)
 {
 	if(preferences::no_sound() || mute_) {
 		return -1;
 	}
 
 
-	const int result = play_internal(file, -1, object, volume, fade_in_time);
+	const int result = play_internal(file, -1, object, volume, fade_in_time, priority);
 	std::cerr << "PLAY: " << object << " " << file << " -> " << result << "\n";
 	return result;
 }
@@ -657,11 +761,10 @@ void change_volume(const void* object, int volume)
 	for(int n = 0; n != channels_to_sounds_playing.size(); ++n) {
 		if(channels_to_sounds_playing[n].object == object) {
 #if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
-			if(channels_to_sounds_playing[n].fade_in_time > 0.0f) {
-				channels_to_sounds_playing[n].fade_in_time = 0.0f;
-				channels_to_sounds_playing[n].time_cnt = 0.0f;
-			}
-			Mix_Volume(n, sfx_volume*volume);
+			//this replaces any fade in which is still in progress.
+			sound_playing& snd = channels_to_sounds_playing[n];
+			snd.volume = volume/static_cast<float>(MIX_MAX_VOLUME);
+			g_mixer->set_gain(n, snd.volume*sfx_volume*snd.left, snd.volume*sfx_volume*snd.right, 0.0f);
 #else
 			mixer.channels[n].volume = sfx_volume*volume;
 #endif
@@ -722,12 +825,16 @@ void set_panning(float left, float right)
 
 void update_panning(const void* obj, const std::string& id, float left, float right)
 {
+#if !TARGET_IPHONE_SIMULATOR && !TARGET_OS_IPHONE
 	for(int n = 0; n != channels_to_sounds_playing.size(); ++n) {
-		const sound_playing& s = channels_to_sounds_playing[n];
+		sound_playing& s = channels_to_sounds_playing[n];
 		if(s.object == obj && s.file == id) {
-			Mix_SetPanning(n, 255*left, 255*right);
+			s.left = left;
+			s.right = right;
+			g_mixer->set_gain(n, s.volume*sfx_volume*left, s.volume*sfx_volume*right, 0.0f);
 		}
 	}
+#endif
 }
 
 namespace {
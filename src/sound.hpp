@@ -41,8 +41,9 @@ void preload(const std::string& file);
 
 //play a sound. 'object' is the object that is playing the sound. It can be
 //used later in stop_sound to specify which object is stopping playing
-//the sound.
-void play(const std::string& file, const void* object=0, float volume=1.0f, float fade_in_time_=0.0f);
+//the sound. When too many sounds are playing, the lowest priority one is cut
+//off to make room, provided it is no higher priority than the new sound.
+void play(const std::string& file, const void* object=0, float volume=1.0f, float fade_in_time_=0.0f, int priority=0);
 
 //stop a sound. object refers to the object that started the sound, and is
 //the same as the object in play().
@@ -69,7 +70,7 @@ void update_panning(const void* obj, const std::string& id, float left, float ri
 	
 // function to play a sound effect over and over in a loop. Will return
 // a handle to the sound effect.
-int play_looped(const std::string& file, const void* object=0, float volume=1.0f, float fade_in_time_=0.0f);
+int play_looped(const std::string& file, const void* object=0, float volume=1.0f, float fade_in_time_=0.0f, int priority=0);
 
 void play_music(const std::string& file);
 void play_music_interrupt(const std::string& file);
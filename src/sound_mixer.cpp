@@ -0,0 +1,630 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef USE_LIBVORBIS
+#include <vorbis/vorbisfile.h>
+#endif
+
+#include "asserts.hpp"
+#include "foreach.hpp"
+#include "sound_mixer.hpp"
+#include "unit_test.hpp"
+
+namespace sound {
+
+namespace {
+
+//gain changes that don't ask for a ramp still get this long a ramp, so
+//that pans, volume changes and hard stops don't click.
+const int DeclickRampDivisor = 200; //1/200th of a second
+
+//accum[n] += src[n]*gain for interleaved stereo, with a left and a right
+//gain. nsamples counts shorts, not frames.
+void mix_constant_gain(float* accum, const short* src, int nsamples, float left, float right)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 g = _mm_setr_ps(left, right, left, right);
+	for(; i + 8 <= nsamples; i += 8) {
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+		const __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+		_mm_storeu_ps(accum + i, _mm_add_ps(_mm_loadu_ps(accum + i), _mm_mul_ps(lo, g)));
+		_mm_storeu_ps(accum + i + 4, _mm_add_ps(_mm_loadu_ps(accum + i + 4), _mm_mul_ps(hi, g)));
+	}
+#endif
+	for(; i < nsamples; i += 2) {
+		accum[i] += src[i]*left;
+		accum[i+1] += src[i+1]*right;
+	}
+}
+
+//out[n] = saturate(out[n] + accum[n])
+void add_saturated(short* out, const float* accum, int nsamples)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	for(; i + 8 <= nsamples; i += 8) {
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i));
+		const __m128i lo = _mm_add_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16),
+		                                 _mm_cvtps_epi32(_mm_loadu_ps(accum + i)));
+		const __m128i hi = _mm_add_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16),
+		                                 _mm_cvtps_epi32(_mm_loadu_ps(accum + i + 4)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for(; i < nsamples; ++i) {
+		const int value = out[i] + static_cast<int>(accum[i]);
+		out[i] = value < -32768 ? -32768 : (value > 32767 ? 32767 : value);
+	}
+}
+
+}
+
+sample_stream::sample_stream(int loops) : ring_(RingFrames*2), loops_(loops)
+{
+	SDL_AtomicSet(&read_pos_, 0);
+	SDL_AtomicSet(&write_pos_, 0);
+	SDL_AtomicSet(&decoder_done_, 0);
+}
+
+sample_stream::~sample_stream()
+{
+}
+
+void sample_stream::fill()
+{
+	if(SDL_AtomicGet(&decoder_done_)) {
+		return;
+	}
+
+	//positions are free-running frame counters; the ring offset is the
+	//counter modulo the ring size, and wrap-around is handled by doing the
+	//arithmetic unsigned.
+	const unsigned int read_pos = SDL_AtomicGet(&read_pos_);
+	unsigned int write_pos = SDL_AtomicGet(&write_pos_);
+	bool decoded_since_rewind = true;
+	while(write_pos - read_pos < RingFrames) {
+		const int offset = write_pos%RingFrames;
+		const int space = std::min<int>(RingFrames - (write_pos - read_pos), RingFrames - offset);
+		const int nframes = decode(&ring_[offset*2], space);
+		if(nframes <= 0) {
+			if(loops_ != 0 && decoded_since_rewind && rewind()) {
+				if(loops_ > 0) {
+					--loops_;
+				}
+				decoded_since_rewind = false;
+				continue;
+			}
+
+			SDL_AtomicSet(&decoder_done_, 1);
+			break;
+		}
+
+		decoded_since_rewind = true;
+		write_pos += nframes;
+		SDL_AtomicSet(&write_pos_, write_pos);
+	}
+}
+
+int sample_stream::read(short* out, int nframes)
+{
+	unsigned int read_pos = SDL_AtomicGet(&read_pos_);
+	const unsigned int write_pos = SDL_AtomicGet(&write_pos_);
+	nframes = std::min<int>(nframes, write_pos - read_pos);
+
+	int copied = 0;
+	while(copied < nframes) {
+		const int offset = read_pos%RingFrames;
+		const int n = std::min<int>(nframes - copied, RingFrames - offset);
+		memcpy(out + copied*2, &ring_[offset*2], n*2*sizeof(short));
+		copied += n;
+		read_pos += n;
+	}
+
+	SDL_AtomicSet(&read_pos_, read_pos);
+	return nframes;
+}
+
+bool sample_stream::finished() const
+{
+	//decoder_done_ is set after the final write position is published, so
+	//check it first.
+	sample_stream* self = const_cast<sample_stream*>(this);
+	return SDL_AtomicGet(&self->decoder_done_) &&
+	       SDL_AtomicGet(&self->read_pos_) == SDL_AtomicGet(&self->write_pos_);
+}
+
+#ifdef USE_LIBVORBIS
+
+namespace {
+
+class ogg_stream : public sample_stream
+{
+public:
+	explicit ogg_stream(int loops) : sample_stream(loops), open_(false), channels_(0)
+	{}
+
+	~ogg_stream() {
+		if(open_) {
+			ov_clear(&file_);
+		}
+	}
+
+	bool open(const std::string& path, int rate) {
+		if(ov_fopen(const_cast<char*>(path.c_str()), &file_) != 0) {
+			return false;
+		}
+
+		open_ = true;
+		const vorbis_info* info = ov_info(&file_, -1);
+		if(!info || info->rate != rate || info->channels < 1 || info->channels > 2) {
+			return false;
+		}
+
+		channels_ = info->channels;
+		return true;
+	}
+
+	int length() {
+		return ov_pcm_total(&file_, -1);
+	}
+
+protected:
+	int decode(short* out, int nframes) {
+		//ov_read returns at most one packet per call, so keep going until
+		//the request is satisfied or the file runs out.
+		int frames = 0;
+		while(frames < nframes) {
+			short* dst = out + frames*2;
+			int bitstream = 0;
+			const long nbytes = ov_read(&file_, reinterpret_cast<char*>(dst),
+			                            (nframes - frames)*channels_*sizeof(short),
+			                            SDL_BYTEORDER == SDL_BIG_ENDIAN ? 1 : 0,
+			                            sizeof(short), 1, &bitstream);
+			if(nbytes == OV_HOLE) {
+				continue;
+			}
+
+			if(nbytes <= 0) {
+				break;
+			}
+
+			const int got = nbytes/(channels_*sizeof(short));
+			if(channels_ == 1) {
+				//expand mono in place, back to front.
+				for(int n = got-1; n >= 0; --n) {
+					dst[n*2+1] = dst[n*2] = dst[n];
+				}
+			}
+
+			frames += got;
+		}
+
+		return frames;
+	}
+
+	bool rewind() {
+		return ov_pcm_seek(&file_, 0) == 0;
+	}
+
+private:
+	OggVorbis_File file_;
+	bool open_;
+	int channels_;
+};
+
+}
+
+int ogg_stream_length(const std::string& path, int rate)
+{
+	ogg_stream stream(0);
+	if(!stream.open(path, rate)) {
+		return -1;
+	}
+
+	return stream.length();
+}
+
+sample_stream_ptr open_ogg_stream(const std::string& path, int rate, int loops)
+{
+	boost::shared_ptr<ogg_stream> stream(new ogg_stream(loops));
+	if(!stream->open(path, rate)) {
+		return sample_stream_ptr();
+	}
+
+	return stream;
+}
+
+#endif
+
+voice_mixer::voice::voice()
+  : position(0), loops(0), ramp_frames(0), stop_after_ramp(false),
+    priority(0), serial(0), playing(false)
+{
+	gain[0] = gain[1] = target[0] = target[1] = step[0] = step[1] = 0.0f;
+}
+
+voice_mixer::voice_mixer(int rate, int nvoices)
+  : rate_(rate), voices_(nvoices), serial_(0)
+{
+	ASSERT_LOG(nvoices > 0, "Sound mixer needs at least one voice");
+}
+
+int voice_mixer::allocate_voice(const play_params& params)
+{
+	int best = -1;
+	float best_loudness = 0.0f;
+	for(int n = 0; n != voices_.size(); ++n) {
+		const voice& v = voices_[n];
+		if(!v.playing) {
+			return n;
+		}
+
+		//voices already fading out are the first to go, then the quietest,
+		//then the oldest.
+		const float loudness = v.stop_after_ramp ? 0.0f : std::max(v.target[0], v.target[1]);
+		if(best == -1 || v.priority < voices_[best].priority ||
+		   (v.priority == voices_[best].priority &&
+		    (loudness < best_loudness ||
+		     (loudness == best_loudness && serial_ - v.serial > serial_ - voices_[best].serial)))) {
+			best = n;
+			best_loudness = loudness;
+		}
+	}
+
+	if(voices_[best].priority > params.priority) {
+		return -1;
+	}
+
+	return best;
+}
+
+void voice_mixer::start_ramp(voice& v, float left, float right, int nframes)
+{
+	v.target[0] = left;
+	v.target[1] = right;
+	if(nframes <= 0) {
+		v.gain[0] = left;
+		v.gain[1] = right;
+		v.ramp_frames = 0;
+		return;
+	}
+
+	v.step[0] = (left - v.gain[0])/nframes;
+	v.step[1] = (right - v.gain[1])/nframes;
+	v.ramp_frames = nframes;
+}
+
+int voice_mixer::play(sample_buffer_ptr buf, const play_params& params)
+{
+	if(!buf || buf->nframes() == 0) {
+		return -1;
+	}
+
+	//whatever the voice played before is destroyed after the lock is
+	//dropped, like in update().
+	sample_buffer_ptr old_buffer;
+	sample_stream_ptr old_stream;
+
+	threading::lock l(mutex_);
+	const int result = allocate_voice(params);
+	if(result == -1) {
+		return -1;
+	}
+
+	voice& v = voices_[result];
+	old_buffer.swap(v.buffer);
+	old_stream.swap(v.stream);
+	v.buffer = buf;
+	v.position = 0;
+	v.loops = params.loops;
+	v.gain[0] = v.gain[1] = 0.0f;
+	start_ramp(v, params.left, params.right, static_cast<int>(params.fade_in_time*rate_));
+	v.stop_after_ramp = false;
+	v.priority = params.priority;
+	v.serial = serial_++;
+	v.playing = true;
+	return result;
+}
+
+int voice_mixer::play(sample_stream_ptr stream, const play_params& params)
+{
+	if(!stream) {
+		return -1;
+	}
+
+	//prime the ring buffer before the audio thread can see the stream.
+	stream->fill();
+
+	sample_buffer_ptr old_buffer;
+	sample_stream_ptr old_stream;
+
+	threading::lock l(mutex_);
+	const int result = allocate_voice(params);
+	if(result == -1) {
+		return -1;
+	}
+
+	voice& v = voices_[result];
+	old_buffer.swap(v.buffer);
+	old_stream.swap(v.stream);
+	v.stream = stream;
+	v.position = 0;
+	v.loops = 0;
+	v.gain[0] = v.gain[1] = 0.0f;
+	start_ramp(v, params.left, params.right, static_cast<int>(params.fade_in_time*rate_));
+	v.stop_after_ramp = false;
+	v.priority = params.priority;
+	v.serial = serial_++;
+	v.playing = true;
+	return result;
+}
+
+void voice_mixer::set_gain(int nvoice, float left, float right, float ramp_time)
+{
+	threading::lock l(mutex_);
+	voice& v = voices_[nvoice];
+	if(!v.playing || v.stop_after_ramp) {
+		return;
+	}
+
+	start_ramp(v, left, right, std::max(static_cast<int>(ramp_time*rate_), rate_/DeclickRampDivisor));
+}
+
+void voice_mixer::stop(int nvoice, float fade_out_time)
+{
+	threading::lock l(mutex_);
+	voice& v = voices_[nvoice];
+	if(!v.playing) {
+		return;
+	}
+
+	start_ramp(v, 0.0f, 0.0f, std::max(static_cast<int>(fade_out_time*rate_), rate_/DeclickRampDivisor));
+	v.stop_after_ramp = true;
+}
+
+bool voice_mixer::playing(int nvoice) const
+{
+	threading::lock l(mutex_);
+	return voices_[nvoice].playing;
+}
+
+void voice_mixer::update()
+{
+	//anything released here is destroyed after the lock is dropped, so
+	//closing a decoder never holds up the audio thread.
+	std::vector<sample_buffer_ptr> released_buffers;
+	std::vector<sample_stream_ptr> streams;
+	{
+		threading::lock l(mutex_);
+		foreach(voice& v, voices_) {
+			if(!v.playing) {
+				if(v.buffer) {
+					released_buffers.push_back(v.buffer);
+					v.buffer.reset();
+				}
+
+				if(v.stream) {
+					streams.push_back(v.stream);
+					v.stream.reset();
+				}
+			} else if(v.stream) {
+				streams.push_back(v.stream);
+			}
+		}
+	}
+
+	foreach(const sample_stream_ptr& stream, streams) {
+		if(stream.use_count() > 1) {
+			stream->fill();
+		}
+	}
+}
+
+void voice_mixer::mix_segment(voice& v, float* accum, const short* src, int nframes)
+{
+	int n = 0;
+	if(v.ramp_frames > 0) {
+		const int nramp = std::min(v.ramp_frames, nframes);
+		for(; n < nramp; ++n) {
+			v.gain[0] += v.step[0];
+			v.gain[1] += v.step[1];
+			accum[n*2] += src[n*2]*v.gain[0];
+			accum[n*2+1] += src[n*2+1]*v.gain[1];
+		}
+
+		v.ramp_frames -= nramp;
+		if(v.ramp_frames == 0) {
+			v.gain[0] = v.target[0];
+			v.gain[1] = v.target[1];
+			if(v.stop_after_ramp) {
+				v.playing = false;
+				return;
+			}
+		}
+	}
+
+	if(n < nframes && (v.gain[0] != 0.0f || v.gain[1] != 0.0f)) {
+		mix_constant_gain(accum + n*2, src + n*2, (nframes - n)*2, v.gain[0], v.gain[1]);
+	}
+}
+
+void voice_mixer::mix_voice(voice& v, float* accum, int nframes)
+{
+	int done = 0;
+	while(done < nframes && v.playing) {
+		const short* src = NULL;
+		int n = 0;
+		if(v.stream) {
+			if(stream_buf_.size() < nframes*2) {
+				stream_buf_.resize(nframes*2);
+			}
+
+			n = v.stream->read(&stream_buf_[0], nframes - done);
+			if(n == 0) {
+				//an underrun just leaves this voice silent until the game
+				//thread catches up.
+				if(v.stream->finished()) {
+					v.playing = false;
+				}
+				break;
+			}
+
+			src = &stream_buf_[0];
+		} else {
+			const int len = v.buffer->nframes();
+			if(v.position >= len) {
+				if(v.loops == 0) {
+					v.playing = false;
+					break;
+				}
+
+				if(v.loops > 0) {
+					--v.loops;
+				}
+
+				v.position = 0;
+			}
+
+			n = std::min(nframes - done, len - v.position);
+			src = &v.buffer->samples[v.position*2];
+			v.position += n;
+		}
+
+		mix_segment(v, accum + done*2, src, n);
+		done += n;
+	}
+}
+
+void voice_mixer::mix(short* stream, int nframes)
+{
+	threading::lock l(mutex_);
+
+	bool active = false;
+	foreach(const voice& v, voices_) {
+		if(v.playing) {
+			active = true;
+			break;
+		}
+	}
+
+	if(!active) {
+		return;
+	}
+
+	if(accum_.size() < nframes*2) {
+		accum_.resize(nframes*2);
+	}
+
+	std::fill(accum_.begin(), accum_.begin() + nframes*2, 0.0f);
+
+	foreach(voice& v, voices_) {
+		if(v.playing) {
+			mix_voice(v, &accum_[0], nframes);
+		}
+	}
+
+	add_saturated(stream, &accum_[0], nframes*2);
+}
+
+}
+
+namespace {
+sound::sample_buffer_ptr make_constant_buffer(int nframes, short value)
+{
+	boost::shared_ptr<sound::sample_buffer> buf(new sound::sample_buffer);
+	buf->samples.resize(nframes*2, value);
+	return buf;
+}
+}
+
+UNIT_TEST(sound_mixer_gain)
+{
+	sound::voice_mixer mixer(44100, 4);
+	sound::voice_mixer::play_params params;
+	params.left = 0.5f;
+	params.right = 0.25f;
+	const int voice = mixer.play(make_constant_buffer(100, 10000), params);
+	CHECK_GE(voice, 0);
+
+	std::vector<short> out(256*2, 0);
+	mixer.mix(&out[0], 256);
+	CHECK_EQ(out[0], 5000);
+	CHECK_EQ(out[1], 2500);
+	CHECK_EQ(out[99*2], 5000);
+	CHECK_EQ(out[100*2], 0);
+	CHECK_EQ(mixer.playing(voice), false);
+
+	//output which is already loud saturates rather than wrapping.
+	params.left = params.right = 1.0f;
+	mixer.play(make_constant_buffer(100, 10000), params);
+	std::fill(out.begin(), out.end(), 30000);
+	mixer.mix(&out[0], 16);
+	CHECK_EQ(out[0], 32767);
+	CHECK_EQ(out[31], 32767);
+	CHECK_EQ(out[32], 30000);
+}
+
+UNIT_TEST(sound_mixer_voice_stealing)
+{
+	sound::voice_mixer mixer(44100, 2);
+	sound::voice_mixer::play_params params;
+	params.loops = -1;
+
+	params.priority = 1;
+	CHECK_EQ(mixer.play(make_constant_buffer(100, 1000), params), 0);
+	params.priority = 0;
+	CHECK_EQ(mixer.play(make_constant_buffer(100, 1000), params), 1);
+
+	//the low priority voice is stolen, and nothing lower may steal.
+	CHECK_EQ(mixer.play(make_constant_buffer(100, 1000), params), 1);
+	params.priority = -1;
+	CHECK_EQ(mixer.play(make_constant_buffer(100, 1000), params), -1);
+}
+
+BENCHMARK(sound_mixer_64_voices)
+{
+	const int NumVoices = 64;
+	sound::voice_mixer mixer(44100, NumVoices);
+
+	boost::shared_ptr<sound::sample_buffer> buf(new sound::sample_buffer);
+	buf->samples.resize(44100*2);
+	for(int n = 0; n != buf->samples.size(); ++n) {
+		buf->samples[n] = (n*7919)%20000 - 10000;
+	}
+
+	for(int n = 0; n != NumVoices; ++n) {
+		sound::voice_mixer::play_params params;
+		params.loops = -1;
+		params.left = (n%8)/8.0f;
+		params.right = 1.0f - params.left;
+		mixer.play(buf, params);
+	}
+
+	std::vector<short> out(1024*2);
+	BENCHMARK_LOOP {
+		std::fill(out.begin(), out.end(), 0);
+		mixer.mix(&out[0], 1024);
+	}
+}
@@ -0,0 +1,176 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SOUND_MIXER_HPP_INCLUDED
+#define SOUND_MIXER_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "graphics.hpp"
+#include "thread.hpp"
+
+namespace sound {
+
+//A fully decoded sound effect: interleaved stereo 16-bit frames at the
+//mixer's sample rate.
+struct sample_buffer {
+	std::vector<short> samples;
+	int nframes() const { return samples.size()/2; }
+};
+
+typedef boost::shared_ptr<const sample_buffer> sample_buffer_ptr;
+
+//A sound which is decoded while it plays rather than up front. The audio
+//thread consumes frames from a small ring buffer which the game thread
+//keeps topped up through voice_mixer::update(). There is exactly one reader
+//and one writer, so the ring itself needs no lock.
+class sample_stream
+{
+public:
+	explicit sample_stream(int loops);
+	virtual ~sample_stream();
+
+	//game thread: decode until the ring buffer is full.
+	void fill();
+
+	//audio thread: copy up to nframes frames into 'out' and return how many
+	//were copied. Returning fewer than asked for is an underrun unless
+	//finished() is also true.
+	int read(short* out, int nframes);
+
+	//true once the decoder is exhausted and the ring has been drained.
+	bool finished() const;
+
+protected:
+	//decode up to nframes interleaved stereo frames, returning the number
+	//decoded. 0 means the end of the data.
+	virtual int decode(short* out, int nframes) = 0;
+
+	//seek back to the start of the data for looping.
+	virtual bool rewind() = 0;
+
+private:
+	sample_stream(const sample_stream&);
+	void operator=(const sample_stream&);
+
+	enum { RingFrames = 16384 };
+	std::vector<short> ring_;
+	SDL_atomic_t read_pos_, write_pos_, decoder_done_;
+	int loops_;
+};
+
+typedef boost::shared_ptr<sample_stream> sample_stream_ptr;
+
+#ifdef USE_LIBVORBIS
+//returns the length in frames of the given ogg file when played at the
+//given rate, or -1 if it can't be streamed at that rate.
+int ogg_stream_length(const std::string& path, int rate);
+
+//opens the given ogg file for streaming. Returns NULL if it can't be
+//streamed at the given rate, in which case the caller should decode it
+//fully instead.
+sample_stream_ptr open_ogg_stream(const std::string& path, int rate, int loops);
+#endif
+
+//Software mixer for sound effects. Voices are mixed into a float
+//accumulator and then added, saturated, on top of whatever the device
+//stream already contains, so the mixer can be hooked into SDL_mixer's
+//post-mix callback and play alongside music. It does not depend on an
+//audio device being open, so it can be benchmarked under SDL's dummy
+//driver or with no driver at all.
+class voice_mixer
+{
+public:
+	voice_mixer(int rate, int nvoices);
+
+	int rate() const { return rate_; }
+	int num_voices() const { return voices_.size(); }
+
+	struct play_params {
+		play_params() : loops(0), left(1.0f), right(1.0f), fade_in_time(0.0f), priority(0)
+		{}
+		//-1 loops forever, otherwise the number of extra repetitions.
+		int loops;
+
+		//per-channel gains including the sound's volume.
+		float left, right;
+		float fade_in_time;
+
+		//when every voice is busy the lowest priority voice is stolen,
+		//provided it isn't higher priority than the new sound.
+		int priority;
+	};
+
+	//start a sound, returning the voice it plays on or -1 if no voice
+	//could be found for it.
+	int play(sample_buffer_ptr buf, const play_params& params);
+	int play(sample_stream_ptr stream, const play_params& params);
+
+	//ramp the gains of a voice to new values over ramp_time seconds.
+	void set_gain(int voice, float left, float right, float ramp_time);
+
+	//stop a voice, fading it out over fade_out_time seconds.
+	void stop(int voice, float fade_out_time=0.0f);
+	bool playing(int voice) const;
+
+	//game thread: release voices which have finished and top up streams.
+	void update();
+
+	//audio thread: add nframes of stereo output on top of 'stream'.
+	void mix(short* stream, int nframes);
+
+private:
+	voice_mixer(const voice_mixer&);
+	void operator=(const voice_mixer&);
+
+	struct voice {
+		voice();
+		sample_buffer_ptr buffer;
+		sample_stream_ptr stream;
+		int position;
+		int loops;
+		float gain[2], target[2], step[2];
+		int ramp_frames;
+		bool stop_after_ramp;
+		int priority;
+		unsigned int serial;
+
+		//set by the game thread when a sound starts and cleared by the audio
+		//thread when it ends. The game thread releases the data afterwards
+		//so that nothing is freed on the audio thread.
+		bool playing;
+	};
+
+	int allocate_voice(const play_params& params);
+	void start_ramp(voice& v, float left, float right, int nframes);
+	void mix_voice(voice& v, float* accum, int nframes);
+	void mix_segment(voice& v, float* accum, const short* src, int nframes);
+
+	int rate_;
+	std::vector<voice> voices_;
+	unsigned int serial_;
+	std::vector<float> accum_;
+	std::vector<short> stream_buf_;
+
+	threading::mutex mutex_;
+};
+
+}
+
+#endif
@@ -128,5 +128,5 @@ void web_server::heartbeat()
 	}
 
 	timer_.expires_from_now(boost::posix_time::seconds(1));
-	timer_.async_wait(boost::bind(&web_server::heartbeat, this));
+	timer_.async_wait(handler_strand().wrap(boost::bind(&web_server::heartbeat, this)));
 }
@@ -14,25 +14,81 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <map>
 #include <vector>
 
 #include "asserts.hpp"
 #include "surface_cache.hpp"
 #include "surface_palette.hpp"
+#include "unit_test.hpp"
 
 namespace graphics
 {
 
 namespace {
 
+typedef std::pair<uint32_t, uint32_t> color_mapping;
+
+bool mapping_source_less(const color_mapping& a, const color_mapping& b)
+{
+	return a.first < b.first;
+}
+
+bool mapping_source_equal(const color_mapping& a, const color_mapping& b)
+{
+	return a.first == b.first;
+}
+
+//A palette is compiled into a table of (source, destination) pairs sorted
+//by source color so a lookup is a binary search over contiguous memory.
 struct palette_definition {
 	std::string name;
-	std::map<uint32_t, uint32_t> mapping;
+	std::vector<color_mapping> mapping;
+
+	//sort the mapping, keeping the first entry given for any color
+	//which appears more than once.
+	void compile() {
+		std::stable_sort(mapping.begin(), mapping.end(), mapping_source_less);
+		std::vector<color_mapping>::iterator end = std::unique(mapping.begin(), mapping.end(), mapping_source_equal);
+		mapping.erase(end, mapping.end());
+	}
+
+	const uint32_t* find(uint32_t c) const {
+		std::vector<color_mapping>::const_iterator i = std::lower_bound(mapping.begin(), mapping.end(), color_mapping(c, 0), mapping_source_less);
+		if(i != mapping.end() && i->first == c) {
+			return &i->second;
+		}
+
+		return NULL;
+	}
 };
 
 std::vector<palette_definition> palettes;
 
+//maps n pixels from src to dst. Sprites are mostly made of runs of a
+//few colors, so the result for the last color seen is kept and the
+//table is only searched when the color changes.
+void map_pixels(const palette_definition& def, const uint32_t* src, uint32_t* dst, int n)
+{
+	if(n <= 0) {
+		return;
+	}
+
+	uint32_t last_src = ~src[0];
+	uint32_t last_dst = 0;
+	for(const uint32_t* end = src + n; src != end; ++src, ++dst) {
+		const uint32_t c = *src;
+		if(c != last_src) {
+			const uint32_t* mapped = def.find(c);
+			last_src = c;
+			last_dst = mapped ? *mapped : c;
+		}
+
+		*dst = last_dst;
+	}
+}
+
 void load_palette_def(const std::string& id)
 {
 	palette_definition def;
@@ -49,10 +105,11 @@ void load_palette_def(const std::string& id)
 
 	const uint32_t* pixels = reinterpret_cast<const uint32_t*>(s->pixels);
 	for(int n = 0; n < s->w*s->h - 1; n += 2) {
-		def.mapping.insert(std::pair<uint32_t,uint32_t>(pixels[0], pixels[1]));
+		def.mapping.push_back(color_mapping(pixels[0], pixels[1]));
 		pixels += 2;
 	}
 
+	def.compile();
 	palettes.push_back(def);
 }
 
@@ -98,25 +155,7 @@ surface map_palette(surface s, int palette)
 
 	ASSERT_LOG(s->format->BytesPerPixel == 4, "SURFACE NOT IN 32bpp PIXEL FORMAT");
 
-	std::cerr << "mapping palette " << palette << "\n";
-
-
-	uint32_t* dst = reinterpret_cast<uint32_t*>(result->pixels);
-	const uint32_t* src = reinterpret_cast<const uint32_t*>(s->pixels);
-
-	const std::map<uint32_t,uint32_t>& mapping = palettes[palette].mapping;
-
-	for(int n = 0; n != s->w*s->h; ++n) {
-		std::map<uint32_t,uint32_t>::const_iterator i = mapping.find(*src);
-		if(i != mapping.end()) {
-			*dst = i->second;
-		} else {
-			*dst = *src;
-		}
-
-		++src;
-		++dst;
-	}
+	map_pixels(palettes[palette], reinterpret_cast<const uint32_t*>(s->pixels), reinterpret_cast<uint32_t*>(result->pixels), s->w*s->h);
 	return result;
 }
 
@@ -126,10 +165,9 @@ color map_palette(const color& c, int palette)
 		return c;
 	}
 
-	const std::map<uint32_t,uint32_t>& mapping = palettes[palette].mapping;
-	std::map<uint32_t,uint32_t>::const_iterator i = mapping.find(c.value());
-	if(i != mapping.end()) {
-		return color(color::convert_pixel_byte_order(i->second));
+	const uint32_t* mapped = palettes[palette].find(c.value());
+	if(mapped) {
+		return color(color::convert_pixel_byte_order(*mapped));
 	} else {
 		return c;
 	}
@@ -142,4 +180,165 @@ SDL_Color map_palette(const SDL_Color& c, int palette)
 	return res;
 }
 
+int num_palettes()
+{
+	return palettes.size();
+}
+
+namespace {
+bool index_is_reserved(int index, const unsigned char* reserved_rgb, int nreserved)
+{
+	for(int n = 0; n != nreserved; ++n) {
+		const unsigned char* rgb = reserved_rgb + n*3;
+		if(rgb[0] == (index&0xFF) && rgb[1] == (index >> 8) && rgb[2] == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+}
+
+surface index_palette_colors(surface s, std::vector<uint32_t>* colors, int max_colors, const unsigned char* reserved_rgb, int nreserved)
+{
+	ASSERT_LOG(max_colors <= 0x10000, "TOO MANY COLORS FOR AN INDEXED SURFACE: " << max_colors);
+
+	surface result(SDL_CreateRGBSurface(0, s->w, s->h, 32, SURFACE_MASK));
+	s = surface(SDL_ConvertSurface(s.get(), result->format, 0));
+
+	ASSERT_LOG(s->format->BytesPerPixel == 4, "SURFACE NOT IN 32bpp PIXEL FORMAT");
+
+	colors->clear();
+	std::map<uint32_t, int> index;
+
+	const uint32_t* src = reinterpret_cast<const uint32_t*>(s->pixels);
+	unsigned char* dst = reinterpret_cast<unsigned char*>(result->pixels);
+
+	uint32_t last_src = 0;
+	int last_index = -1;
+	for(const uint32_t* end = src + s->w*s->h; src != end; ++src, dst += 4) {
+		const unsigned char alpha = reinterpret_cast<const unsigned char*>(src)[3];
+
+		//every fully transparent pixel shares one entry, whatever its color.
+		const uint32_t c = alpha ? *src : 0;
+		if(c != last_src || last_index == -1) {
+			std::map<uint32_t, int>::const_iterator i = index.find(c);
+			if(i == index.end()) {
+				while(index_is_reserved(colors->size(), reserved_rgb, nreserved)) {
+					colors->push_back(0);
+				}
+
+				if(int(colors->size()) >= max_colors) {
+					colors->clear();
+					return surface();
+				}
+
+				i = index.insert(std::pair<uint32_t, int>(c, colors->size())).first;
+				colors->push_back(c);
+			}
+
+			last_src = c;
+			last_index = i->second;
+		}
+
+		dst[0] = last_index&0xFF;
+		dst[1] = last_index >> 8;
+		dst[2] = 0;
+		dst[3] = alpha;
+	}
+
+	return result;
+}
+
+surface build_palette_surface(const std::vector<uint32_t>& colors)
+{
+	const int width = std::max<int>(1, colors.size());
+	surface result(SDL_CreateRGBSurface(0, width, palettes.size() + 1, 32, SURFACE_MASK));
+
+	uint32_t* row = reinterpret_cast<uint32_t*>(result->pixels);
+	std::fill(row, row + width, 0);
+	std::copy(colors.begin(), colors.end(), row);
+
+	for(int n = 0; n != palettes.size(); ++n) {
+		uint32_t* dst = reinterpret_cast<uint32_t*>(reinterpret_cast<unsigned char*>(result->pixels) + (n+1)*result->pitch);
+		std::copy(row, row + width, dst);
+		map_pixels(palettes[n], row, dst, colors.size());
+	}
+
+	return result;
+}
+
+UNIT_TEST(palette_lookup_table)
+{
+	palette_definition def;
+	def.mapping.push_back(color_mapping(5, 50));
+	def.mapping.push_back(color_mapping(1, 10));
+	def.mapping.push_back(color_mapping(3, 30));
+	def.mapping.push_back(color_mapping(1, 99));
+	def.compile();
+
+	CHECK_EQ(def.mapping.size(), 3);
+	CHECK_EQ(*def.find(1), 10);
+	CHECK_EQ(*def.find(5), 50);
+	CHECK(def.find(2) == NULL, "unexpected mapping");
+
+	const uint32_t src[] = { 1, 1, 2, 3, 3, 3, 5, 1, 7 };
+	const uint32_t expected[] = { 10, 10, 2, 30, 30, 30, 50, 10, 7 };
+	const int n = sizeof(src)/sizeof(*src);
+	uint32_t dst[n];
+	map_pixels(def, src, dst, n);
+	for(int i = 0; i != n; ++i) {
+		CHECK_EQ(dst[i], expected[i]);
+	}
+}
+
+UNIT_TEST(palette_indexed_surface)
+{
+	surface s(SDL_CreateRGBSurface(0, 4, 1, 32, SURFACE_MASK));
+	unsigned char* p = reinterpret_cast<unsigned char*>(s->pixels);
+	const unsigned char pixels[] = {
+		10, 20, 30, 255,
+		40, 50, 60, 0,
+		10, 20, 30, 255,
+		70, 80, 90, 0,
+	};
+	std::copy(pixels, pixels + sizeof(pixels), p);
+
+	//index 0 encodes as black, so reserving black moves the colors along.
+	const unsigned char reserved[] = { 0, 0, 0 };
+	std::vector<uint32_t> colors;
+	surface indexed = index_palette_colors(s, &colors, 256, reserved, 1);
+	CHECK(indexed.get() != NULL, "could not index surface");
+	CHECK_EQ(colors.size(), 3);
+
+	const unsigned char* out = reinterpret_cast<const unsigned char*>(indexed->pixels);
+	CHECK_EQ(int(out[0]), 1);
+	CHECK_EQ(int(out[3]), 255);
+	CHECK_EQ(int(out[4]), 2);
+	CHECK_EQ(int(out[7]), 0);
+	CHECK_EQ(int(out[8]), 1);
+	CHECK_EQ(int(out[12]), 2);
+	CHECK_EQ(colors[1], reinterpret_cast<const uint32_t*>(pixels)[0]);
+
+	CHECK(index_palette_colors(s, &colors, 1, NULL, 0).get() == NULL, "indexed a surface with too many colors");
+}
+
+BENCHMARK(palette_map_surface)
+{
+	palette_definition def;
+	for(uint32_t n = 0; n != 64; ++n) {
+		def.mapping.push_back(color_mapping(0xFF000000 | n*3, 0xFF000000 | n*5));
+	}
+	def.compile();
+
+	std::vector<uint32_t> src(256*256), dst(src.size());
+	for(int n = 0; n != src.size(); ++n) {
+		src[n] = 0xFF000000 | ((n/7)%96)*3;
+	}
+
+	BENCHMARK_LOOP {
+		map_pixels(def, &src[0], &dst[0], src.size());
+	}
+}
+
 }
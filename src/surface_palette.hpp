@@ -18,6 +18,7 @@
 #define SURFACE_PALETTE_HPP_INCLUDED
 
 #include <string>
+#include <vector>
 
 #include "color_utils.hpp"
 #include "surface.hpp"
@@ -31,6 +32,21 @@ const std::string& get_palette_name(int id);
 surface map_palette(surface s, int palette);
 color map_palette(const color& c, int palette);
 SDL_Color map_palette(const SDL_Color& c, int palette);
+
+int num_palettes();
+
+//Palettes can be applied at draw time instead of by copying the image.
+//index_palette_colors() returns a copy of 's' where each pixel holds an
+//index into 'colors' in its red (low byte) and green (high byte) channels
+//and keeps its original alpha. Indexes whose encoding would match one of
+//the nreserved rgb triples in reserved_rgb are skipped. Returns a NULL
+//surface if more than max_colors entries would be needed.
+surface index_palette_colors(surface s, std::vector<uint32_t>* colors, int max_colors, const unsigned char* reserved_rgb, int nreserved);
+
+//builds a lookup image for colors returned by index_palette_colors():
+//row 0 holds the colors unchanged and row n+1 holds them with palette n
+//applied.
+surface build_palette_surface(const std::vector<uint32_t>& colors);
 }
 
 #endif
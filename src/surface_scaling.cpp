@@ -15,19 +15,40 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <boost/array.hpp>
+#include <boost/bind.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <cassert>
+#include <cstdlib>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <SDL_image.h>
+
+#include "IMG_savepng.h"
 #include "asserts.hpp"
+#include "filesystem.hpp"
 #include "foreach.hpp"
 #include "json_parser.hpp"
+#include "md5.hpp"
+#include "preferences.hpp"
 #include "string_utils.hpp"
 #include "surface_cache.hpp"
 #include "surface.hpp"
+#include "surface_scaling.hpp"
+#include "thread.hpp"
 #include "unit_test.hpp"
 #include "variant.hpp"
 
+PREF_STRING(scaling_filter, "2xsai", "Filter used to scale images when pretty scaling is on: 2xsai, eagle or xbr");
+PREF_BOOL(cache_scaled_images, true, "Keep images scaled by pretty scaling on disk, so they are only scaled once");
+PREF_INT(scaling_threads, 4, "Number of threads used to scale large images when pretty scaling is on");
+
 namespace graphics {
 
 uint32_t interpolate_pixels (uint32_t sourcePixelOne, uint32_t sourcePixelTwo){
@@ -84,72 +105,262 @@ int calculate_difference(uint32_t sourcePixelOne, uint32_t sourcePixelTwo, uint3
 	
 	
 	
-surface scale_surface_eagle(surface input) {
-	surface result(surface::create(input->w*2, input->h*2));
-	
-	const uint32_t* in = reinterpret_cast<const uint32_t*>(input->pixels);
-	uint32_t* out = reinterpret_cast<uint32_t*>(result->pixels);
-	for(int y = 0; y != input->h; ++y) {
-		for(int x = 0; x != input->w; ++x) {
-			//do nearest neighbor interpolation
-			out[(y*2)*result->w + x*2] = in[y*input->w + x];
-			out[(y*2 + 1)*result->w + x*2] = in[y*input->w + x];
-			out[(y*2 + 1)*result->w + x*2 + 1] = in[y*input->w + x];
-			out[(y*2)*result->w + x*2 + 1] = in[y*input->w + x];
-			
-			if ((y > 0) && (y < input->h - 1) && (x > 0) && (x < input->w - 1)){
-				//do additional eagle interpolation
-				
-				// Eagle is a pixel art scaling algorithm designed to smooth rough edges.  It works as follows:  First, it doubles the scale of the art, turning every source pixel into four destination pixels, just like nearest neighbor scaling would.
-				
-				// Then, to smooth things out, it conditionally alters each of these four pixels.  Each of the four destination pixels represents a quadrant of the source pixel, and likewise a direction pointing away from the center of the source pixel.  To choose if it 'smoothes an edge" in a given direction, it checks additional, adjacent source pixels in the direction represented by the quadrant.  If they're all the same color, it represents a diagonal slope of pixels, and the given quadrant pixel is filled in with the same color to smooth out the diagonal.
-				
-				// The following diagram illustrates first the scaling of a single input pixel into 4 output pixels (left side of diagram), and then the choices made to choose which color the output pixels are given (right side of diagram)
-				
-				//   first:        |Then 
-				//   . . . --\ CC  |S T U  --\ 1 2
-				//   . C . --/ CC  |V C W  --/ 3 4
-				//   . . .         |X Y Z
-				//                 | IF V==S==T => 1=S
-				//                 | IF T==U==W => 2=U
-				//                 | IF V==X==Y => 3=X
-				//                 | IF W==Z==Y => 4=Z
-				
-				const int index_up_left = y*input->w + x - input->w - 1;
-				 const int index_up = y*input->w + x - input->w;
-				 const int index_up_right = y*input->w + x - input->w + 1;
-				 const int index_right = y*input->w + x + 1;
-				 const int index_down_right = y*input->w + x + input->w + 1;
-				 const int index_down = y*input->w + x + input->w;
-				 const int index_down_left = y*input->w + x + input->w - 1;
-				 const int index_left = y*input->w + x - 1;
-				 const int max_index = input->w*input->h;
-				 
-				 assert(index_down_left < max_index);
-				 assert(index_down_right < max_index);
-				 assert(index_down < max_index);
-				 
-				 if ( (in[index_up_left] == in[index_up]) && (in[index_up_left] == in[index_left]) ) {
-				 out[(y*2)*result->w + x*2] = in[index_up_left];
-				 }
-				 if ( (in[index_up_right] == in[index_up]) && (in[index_up_right] == in[index_right]) ) {
-				 out[(y*2)*result->w + x*2 + 1] = in[index_up_right];
-				 }
-				 if ( (in[index_down_left] == in[index_down]) && (in[index_down_left] == in[index_left]) ) {
-				 out[(y*2 + 1)*result->w + x*2] = in[index_down_left];
-				 }
-				 if ( (in[index_down_right] == in[index_down]) && (in[index_down_right] == in[index_right]) ) {
-				 out[(y*2 + 1)*result->w + x*2 + 1] = in[index_down_right];
-				 }
+namespace {
+//The filters below are written as rules which are handed a pixel and the
+//two pairs of output pixels it becomes, already holding the pixel's own
+//color, and which may change them based on the pixels around it. 'in'
+//points at the pixel, in rows 'pitch' pixels long. A rule only runs where
+//its whole neighborhood is inside the surface.
+
+void eagle_rule(const uint32_t* in, int pitch, uint32_t* out0, uint32_t* out1)
+{
+	// Eagle is a pixel art scaling algorithm designed to smooth rough edges.  It works as follows:  First, it doubles the scale of the art, turning every source pixel into four destination pixels, just like nearest neighbor scaling would.
+
+	// Then, to smooth things out, it conditionally alters each of these four pixels.  Each of the four destination pixels represents a quadrant of the source pixel, and likewise a direction pointing away from the center of the source pixel.  To choose if it 'smoothes an edge" in a given direction, it checks additional, adjacent source pixels in the direction represented by the quadrant.  If they're all the same color, it represents a diagonal slope of pixels, and the given quadrant pixel is filled in with the same color to smooth out the diagonal.
+
+	// The following diagram illustrates first the scaling of a single input pixel into 4 output pixels (left side of diagram), and then the choices made to choose which color the output pixels are given (right side of diagram)
+
+	//   first:        |Then
+	//   . . . --\ CC  |S T U  --\ 1 2
+	//   . C . --/ CC  |V C W  --/ 3 4
+	//   . . .         |X Y Z
+	//                 | IF V==S==T => 1=S
+	//                 | IF T==U==W => 2=U
+	//                 | IF V==X==Y => 3=X
+	//                 | IF W==Z==Y => 4=Z
+
+	const uint32_t up_left = in[-pitch - 1];
+	const uint32_t up = in[-pitch];
+	const uint32_t up_right = in[-pitch + 1];
+	const uint32_t right = in[1];
+	const uint32_t down_right = in[pitch + 1];
+	const uint32_t down = in[pitch];
+	const uint32_t down_left = in[pitch - 1];
+	const uint32_t left = in[-1];
+
+	if(up_left == up && up_left == left) {
+		out0[0] = up_left;
+	}
+	if(up_right == up && up_right == right) {
+		out0[1] = up_right;
+	}
+	if(down_left == down && down_left == left) {
+		out1[0] = down_left;
+	}
+	if(down_right == down && down_right == right) {
+		out1[1] = down_right;
+	}
+}
+
+void sai_rule(const uint32_t* in, int pitch, uint32_t* out0, uint32_t* out1)
+{
+	//  2xSai works on a square group of sixteen pixels, rather than the square group of nine that Eagle works on.  In Eagle, the current pixel being upsized is the one in the middle of this square of nine; in 2xSai, the current pixel is the one in the upper-left of the middle four.  The other pixels in this group are all input pixels that are being examined to determine if we have an edge to smooth out.
+
+	//  X X X X  |  0  1  2  3
+	//  X * X X  |  4  5  6  7
+	//  X X X X  |  8  9  10 11
+	//  X X X X  |  12 13 14 15
+	uint32_t p[4][4];	//[y][x]
+	for(int y = 0; y != 4; ++y) {
+		for(int x = 0; x != 4; ++x) {
+			p[y][x] = in[(y - 1)*pitch + x - 1];
+		}
+	}
+
+	// The following blocks are a visual representation of the conditional right above them.  When I have multiple instances of the same number, such as two 1s, then those places are equal.  When I have two different numbers in the same block, then they *must* be inequal - e.g. the value at 2 does not equal the value at 1, and also does not equal the value at 3. When I have a number, and an alphanumeric character in a block, the character does not need to be different from the number, but must equal itself.
+			//  X X X X
+			//  X X X X
+			//  X X X X
+			//  X X X X
+
+	if ( (p[1][1] == p[2][2]) && (p[1][2] != p[2][1]) ) {
+			//  X X X X
+			//  X 1 2 X
+			//  X 3 1 X
+			//  X X X X
+		if ( ((p[1][1] == p[0][1]) && (p[1][2] == p[2][3])) || ((p[1][1] == p[2][1]) && (p[1][1] == p[0][2]) && (p[1][2] != p[0][1]) && (p[1][2] == p[0][3]))){
+			   //  X 1 X X         X 2 1 1
+			   //  X 1 A X         X 1 1 X
+			   //  X X X A   or    X X X X
+			   //  X X X X         X X X X
+			out0[1] = p[1][1];
+		}else{
+			if( ! ((p[1][1] == p[0][1])) ){
+				//  X 2 X X
+				//  X 1 X X
+				//  X X X X
+				//  X X X X
+				out0[1] = interpolate_pixels(p[1][1],p[1][2]);
+			}
+		}
+
+		if ( ((p[1][1] == p[1][0]) && (p[2][1] == p[3][2])) || ((p[1][1] == p[1][2]) && (p[1][1] == p[2][0]) && (p[1][0] != p[2][1]) && (p[2][1] == p[3][0]))){
+			//  X X X X           X X X X
+			//  1 1 X X           2 A A X
+			//  X A X X    or     A 3 X X
+			//  X X A X           X 3 X X
+			out1[0] = p[1][1];
+		}else{
+			if( ! ((p[1][1] == p[1][0])) ){
+					//  X 2 X X
+					//  X 1 X X
+					//  X X X X
+					//  X X X X
+				out1[0] = interpolate_pixels(p[1][1],p[2][1]);
 			}
 		}
+		out1[1] = p[1][1];
+
+
+
+
+	} else if ( (p[1][2] == p[2][1]) && (p[1][1] != p[2][2]) ) {
+			//  X X X X
+			//  X 2 1 X
+			//  X 1 3 X
+			//  X X X X
+
+		if ( ((p[1][2] == p[0][2]) && (p[1][1] == p[2][0])) || ((p[1][2] == p[0][1]) && (p[1][2] == p[2][2]) && (p[1][2] != p[0][2]) && (p[1][1] == p[0][0]))){
+			//  X X 1 X           2 1 1 X
+			//  X A 1 X           X 2 1 X
+			//  A X X X    or     X X 1 X
+			//  X X X X           X X X X
+			out0[1] = p[1][2];
+		}else{
+			out0[1] = interpolate_pixels(p[1][1],p[1][2]);
+		}
+
+		if ( ((p[2][1] == p[2][0]) && (p[1][1] == p[0][2])) || ((p[2][1] == p[1][0]) && (p[2][1] == p[2][2]) && (p[1][1] != p[2][0]) && (p[1][1] == p[0][0]))){
+			//  X X A X           X 2 X X
+			//  X A X X           A 2 X X
+			//  1 1 X X    or     3 A A X
+			//  X X X X           X X X X
+			out1[0] = p[2][1];
+		}else{
+			out1[0] = interpolate_pixels(p[1][1],p[2][1]);
+		}
+		out1[1] = p[1][2];
+
+	}else if ( (p[1][1] == p[2][2]) && (p[1][2] == p[2][1]) ) {/*
+
+		// these are two crossed diagonal pairs of pixels in the inner, center set of four.
+		// If they're the same, then they're just a solid square.
+		// but if they're not the same, then we weigh them against a surrounding ring of pixels, and see which
+		// pair is more different from the ring.
+
+		// The pair that is more different will end up being visually subdued - the result will be only 1/4 that pair, and 3/4 the other.
+
+		//The ring is this asterisked set of pixels:
+		//  X * * X
+		//  * X X *
+		//  * X X *
+		//  X * * X
+		if (p[1][1] == p[1][2]){  //First, check if they're the same.  If so, it's just a solid square.
+				out1[1] = out0[1] = out0[0] = out1[0] = p[1][1];
+
+		} else {
+
+			int difference_direction = 0;
+			//These following lines compare the corners in this order, to the center pixels A and B.
+
+			//  X 1 * X          X * 2 X          X * * X             X * * X
+			//  1 A B *          * A B 2          * A B *             * A B *
+			//  * B A *    then: * B A *    then: * B A 3      then:  4 B A *
+			//  X * * X          X * * X          X * 3 X             X 4 * X
+
+		   	// These get summed up.  If the final sum is positive, then A is the non-matching color and gets subdued.
+			// if the final sum is negative, then B is the non-matching color and gets subdued.
+			difference_direction += calculate_difference(p[1][2],p[1][1],p[0][1],p[1][0]);
+			difference_direction += calculate_difference(p[1][2],p[1][1],p[1][3],p[0][2]);
+			difference_direction += calculate_difference(p[1][2],p[1][1],p[3][2],p[2][3]);
+			difference_direction += calculate_difference(p[1][2],p[1][1],p[2][0],p[3][1]);
+
+			if (difference_direction > 0){
+				out1[1] = out0[1] = out0[0] = out1[0] = interpolate_pixels(p[1][1],p[1][2],p[1][2],p[1][2]);
+			}else if(difference_direction < 0){
+				out1[1] = out0[1] = out0[0] = out1[0] = interpolate_pixels(p[1][1],p[1][1],p[1][1],p[1][2]);
+   								}else{
+				out1[1] = out0[1] = out0[0] = out1[0] = interpolate_pixels(p[1][1],p[1][2],p[2][1],p[2][2]);
+			}
+
+		}
+	*/}
+}
+
+//a distance between two colors, weighting the channels roughly by how
+//much a change in them shows.
+int color_distance(uint32_t a, uint32_t b)
+{
+	const uint8_t* ca = reinterpret_cast<const uint8_t*>(&a);
+	const uint8_t* cb = reinterpret_cast<const uint8_t*>(&b);
+	return 2*abs(ca[0] - cb[0]) + 4*abs(ca[1] - cb[1]) + abs(ca[2] - cb[2]) + 3*abs(ca[3] - cb[3]);
+}
+
+//one corner of an xBR pass. The neighborhood is mirrored so that the
+//corner being smoothed is always the lower right one:
+//
+//      A1 B1 C1
+//   A0  A  B  C  C4
+//   D0  D  E  F  F4
+//   G0  G  H  I  I4
+//      G5 H5 I5
+//
+//If the edge through F and H is more continuous than the one through E
+//and I, the corner is blended toward whichever of F and H is closer to E.
+void xbr_corner(const uint32_t* in, int pitch, int dx, int dy, uint32_t* out)
+{
+	const int row = pitch*dy;
+	const uint32_t E = in[0];
+	const uint32_t F = in[dx];
+	const uint32_t H = in[row];
+	if(E == F || E == H) {
+		return;
+	}
+
+	const uint32_t B = in[-row];
+	const uint32_t C = in[-row + dx];
+	const uint32_t D = in[-dx];
+	const uint32_t G = in[row - dx];
+	const uint32_t I = in[row + dx];
+	const uint32_t F4 = in[dx*2];
+	const uint32_t H5 = in[row*2];
+	const uint32_t I4 = in[row + dx*2];
+	const uint32_t I5 = in[row*2 + dx];
+
+	const int wd1 = color_distance(E, C) + color_distance(E, G) + color_distance(I, F4) + color_distance(I, H5) + 4*color_distance(H, F);
+	const int wd2 = color_distance(H, D) + color_distance(H, I5) + color_distance(F, I4) + color_distance(F, B) + 4*color_distance(E, I);
+	if(wd1 < wd2) {
+		const uint32_t edge = color_distance(E, F) <= color_distance(E, H) ? F : H;
+		*out = interpolate_pixels(*out, edge);
 	}
-	
-	return result;
 }
-	
-	
-	
+
+void xbr_rule(const uint32_t* in, int pitch, uint32_t* out0, uint32_t* out1)
+{
+	xbr_corner(in, pitch, -1, -1, &out0[0]);
+	xbr_corner(in, pitch, 1, -1, &out0[1]);
+	xbr_corner(in, pitch, -1, 1, &out1[0]);
+	xbr_corner(in, pitch, 1, 1, &out1[1]);
+}
+
+typedef void (*scaling_rule)(const uint32_t* in, int pitch, uint32_t* out0, uint32_t* out1);
+
+struct scaling_filter_info {
+	const char* name;
+	scaling_rule rule;
+
+	//how many pixels the rule looks at before and after the pixel being
+	//scaled, both across and down.
+	int before, after;
+};
+
+const scaling_filter_info scaling_filters[] = {
+	{ "2xsai", sai_rule, 1, 2 },
+	{ "eagle", eagle_rule, 1, 1 },
+	{ "xbr", xbr_rule, 2, 2 },
+};
+}
+
 surface scale_surface_v1(surface input) {
 	surface result(surface::create(input->w*2, input->h*2));
 	
@@ -365,198 +576,197 @@ x >= 2 && y < input->h-2 ? in[(y+2)*input->w + x-2] : 0, x >= 1 && y < input->h-
 
 
 
-surface scale_surface(surface input) {
-	surface result(surface::create(input->w*2, input->h*2));
+namespace {
+//copies a row of pixels into two rows twice as wide.
+void expand_row(const uint32_t* src, int width, uint32_t* dst0, uint32_t* dst1)
+{
+	int x = 0;
+#if defined(__SSE2__)
+	for(; x + 4 <= width; x += 4) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+		const __m128i lo = _mm_unpacklo_epi32(v, v);
+		const __m128i hi = _mm_unpackhi_epi32(v, v);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst0 + x*2), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst0 + x*2 + 4), hi);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst1 + x*2), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst1 + x*2 + 4), hi);
+	}
+#endif
+	for(; x < width; ++x) {
+		dst0[x*2] = dst0[x*2 + 1] = dst1[x*2] = dst1[x*2 + 1] = src[x];
+	}
+}
+
+//true if every pixel the filter would look at is the same color as the
+//pixel itself. Every filter leaves such pixels as they are, and most
+//pixels of most sprites are like this.
+bool is_flat(const uint32_t* in, int pitch, const scaling_filter_info& f)
+{
+	for(int y = -f.before; y <= f.after; ++y) {
+		for(int x = -f.before; x <= f.after; ++x) {
+			if(in[y*pitch + x] != in[0]) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
 
+#if defined(__SSE2__)
+//is_flat() for four pixels at once, returning a bit for each.
+int flat_mask(const uint32_t* in, int pitch, const scaling_filter_info& f)
+{
+	const __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+	__m128i same = _mm_set1_epi32(-1);
+	for(int y = -f.before; y <= f.after; ++y) {
+		for(int x = -f.before; x <= f.after; ++x) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + y*pitch + x));
+			same = _mm_and_si128(same, _mm_cmpeq_epi32(v, center));
+		}
+	}
+
+	return _mm_movemask_ps(_mm_castsi128_ps(same));
+}
+#endif
+
+void scale_rows(const scaling_filter_info* f, const SDL_Surface* input, SDL_Surface* result, int begin_row, int end_row)
+{
+	const int w = input->w, h = input->h;
 	const uint32_t* in = reinterpret_cast<const uint32_t*>(input->pixels);
 	uint32_t* out = reinterpret_cast<uint32_t*>(result->pixels);
-	for(int y = 0; y != input->h; ++y) {
-		for(int x = 0; x != input->w; ++x) {
-		  //do nearest neighbor interpolation
-			out[(y*2)*result->w + x*2] = in[y*input->w + x];
-			out[(y*2 + 1)*result->w + x*2] = in[y*input->w + x];
-			out[(y*2 + 1)*result->w + x*2 + 1] = in[y*input->w + x];
-			out[(y*2)*result->w + x*2 + 1] = in[y*input->w + x];
-			
-			if ((y > 0) && (y < input->h - 2) && (x > 0) && (x < input->w - 2)){
-				
-				
-			//do additional 2xSaI interpolation
-				
-			//  2xSai works on a square group of sixteen pixels, rather than the square group of nine that Eagle works on.  In Eagle, the current pixel being upsized is the one in the middle of this square of nine; in 2xSai, the current pixel is the one in the upper-left of the middle four.  The other pixels in this group are all input pixels that are being examined to determine if we have an edge to smooth out.
-			
-			//  X X X X  |  0  1  2  3
-			//  X * X X  |  4  5  6  7
-			//  X X X X  |  8  9  10 11
-			//  X X X X  |  12 13 14 15
-						const int px[4][4] = {{	//[x][y]
-							y*input->w + x - input->w - 1,
-							y*input->w + x - input->w,
-							y*input->w + x - input->w + 1,
-							y*input->w + x - input->w + 2},
-							{y*input->w + x - 1,
-							y*input->w + x,
-							y*input->w + x + 1,
-							y*input->w + x + 2},
-							{y*input->w + x + input->w - 1,
-							y*input->w + x + input->w,
-							y*input->w + x + input->w + 1,
-							y*input->w + x + input->w + 2},
-							{y*input->w + x + 2*input->w - 1,
-							y*input->w + x + 2*input->w,
-							y*input->w + x + 2*input->w + 1,
-							y*input->w + x + 2*input->w + 2}};
-						
-						//these are the four output pixels corresponding to the one input pixel
-						const int upper_left = (y*2)*result->w + x*2;
-						const int upper_right = (y*2)*result->w + x*2 + 1;
-						const int lower_left = (y*2 + 1)*result->w + x*2;
-						const int lower_right = (y*2 + 1)*result->w + x*2 + 1;
-
-						//make sure we're not going out-of-bounds
-						const int max_index = input->w*input->h;
-						assert(px[0][2] < max_index);
-						assert(px[0][3] < max_index);
-						assert(px[1][2] < max_index);
-						assert(px[1][3] < max_index);
-						assert(px[2][0] < max_index);
-						assert(px[2][1] < max_index);
-						assert(px[2][2] < max_index);
-						assert(px[2][3] < max_index);
-						assert(px[3][0] < max_index);
-						assert(px[3][1] < max_index);
-						assert(px[3][2] < max_index);
-						assert(px[3][3] < max_index);
-						
-						
-						
-						// The following blocks are a visual representation of the conditional right above them.  When I have multiple instances of the same number, such as two 1s, then those places are equal.  When I have two different numbers in the same block, then they *must* be inequal - e.g. the value at 2 does not equal the value at 1, and also does not equal the value at 3. When I have a number, and an alphanumeric character in a block, the character does not need to be different from the number, but must equal itself.
-								//  X X X X 
-								//  X X X X 
-								//  X X X X 
-								//  X X X X 
-
-						if ( (in[px[1][1]] == in[px[2][2]]) && (in[px[1][2]] != in[px[2][1]]) ) {
-								//  X X X X    
-								//  X 1 2 X    
-								//  X 3 1 X    
-								//  X X X X    
-							if ( ((in[px[1][1]] == in[px[0][1]]) && (in[px[1][2]] == in[px[2][3]])) || ((in[px[1][1]] == in[px[2][1]]) && (in[px[1][1]] == in[px[0][2]]) && (in[px[1][2]] != in[px[0][1]]) && (in[px[1][2]] == in[px[0][3]]))){
-								   //  X 1 X X         X 2 1 1
-								   //  X 1 A X         X 1 1 X
-								   //  X X X A   or    X X X X
-								   //  X X X X         X X X X
-								out[upper_right] = in[px[1][1]];    
-							}else{
-								if( ! ((in[px[1][1]] == in[px[0][1]])) ){
-									//  X 2 X X 
-									//  X 1 X X 
-									//  X X X X 
-									//  X X X X 
-									out[upper_right] = interpolate_pixels(in[px[1][1]],in[px[1][2]]);
-								}
-							}
-							
-							if ( ((in[px[1][1]] == in[px[1][0]]) && (in[px[2][1]] == in[px[3][2]])) || ((in[px[1][1]] == in[px[1][2]]) && (in[px[1][1]] == in[px[2][0]]) && (in[px[1][0]] != in[px[2][1]]) && (in[px[2][1]] == in[px[3][0]]))){
-								//  X X X X           X X X X 
-								//  1 1 X X           2 A A X 
-								//  X A X X    or     A 3 X X 
-								//  X X A X           X 3 X X 
-								out[lower_left] = in[px[1][1]];
-							}else{
-								if( ! ((in[px[1][1]] == in[px[1][0]])) ){
-										//  X 2 X X 
-										//  X 1 X X 
-										//  X X X X 
-										//  X X X X 
-									out[lower_left] = interpolate_pixels(in[px[1][1]],in[px[2][1]]);
-								}
-							}
-							out[lower_right] = in[px[1][1]];
-							
-							
-							
-							
-						} else if ( (in[px[1][2]] == in[px[2][1]]) && (in[px[1][1]] != in[px[2][2]]) ) {       
-								//  X X X X   
-								//  X 2 1 X   
-								//  X 1 3 X   
-								//  X X X X   
-							
-							if ( ((in[px[1][2]] == in[px[0][2]]) && (in[px[1][1]] == in[px[2][0]])) || ((in[px[1][2]] == in[px[0][1]]) && (in[px[1][2]] == in[px[2][2]]) && (in[px[1][2]] != in[px[0][2]]) && (in[px[1][1]] == in[px[0][0]]))){
-								//  X X 1 X           2 1 1 X 
-								//  X A 1 X           X 2 1 X 
-								//  A X X X    or     X X 1 X 
-								//  X X X X           X X X X 
-								out[upper_right] = in[px[1][2]];
-							}else{
-								out[upper_right] = interpolate_pixels(in[px[1][1]],in[px[1][2]]);
-							}
-							
-							if ( ((in[px[2][1]] == in[px[2][0]]) && (in[px[1][1]] == in[px[0][2]])) || ((in[px[2][1]] == in[px[1][0]]) && (in[px[2][1]] == in[px[2][2]]) && (in[px[1][1]] != in[px[2][0]]) && (in[px[1][1]] == in[px[0][0]]))){
-								//  X X A X           X 2 X X 
-								//  X A X X           A 2 X X 
-								//  1 1 X X    or     3 A A X 
-								//  X X X X           X X X X 
-								out[lower_left] = in[px[2][1]];
-							}else{
-								out[lower_left] = interpolate_pixels(in[px[1][1]],in[px[2][1]]);
-							}
-							out[lower_right] = in[px[1][2]];
-							
-						}else if ( (in[px[1][1]] == in[px[2][2]]) && (in[px[1][2]] == in[px[2][1]]) ) {/*
-						 
-							// these are two crossed diagonal pairs of pixels in the inner, center set of four.
-							// If they're the same, then they're just a solid square.
-							// but if they're not the same, then we weigh them against a surrounding ring of pixels, and see which
-							// pair is more different from the ring.
-							
-							// The pair that is more different will end up being visually subdued - the result will be only 1/4 that pair, and 3/4 the other.
-							
-							//The ring is this asterisked set of pixels:
-							//  X * * X
-							//  * X X *
-							//  * X X *
-							//  X * * X
-							if (in[px[1][1]] == in[px[1][2]]){  //First, check if they're the same.  If so, it's just a solid square.
-									out[lower_right] = out[upper_right] = out[upper_left] = out[lower_left] = in[px[1][1]];
-
-							} else {
-								
-								int difference_direction = 0;
-								//These following lines compare the corners in this order, to the center pixels A and B.
-								
-								//  X 1 * X          X * 2 X          X * * X             X * * X
-								//  1 A B *          * A B 2          * A B *             * A B *
-								//  * B A *    then: * B A *    then: * B A 3      then:  4 B A *
-								//  X * * X          X * * X          X * 3 X             X 4 * X     
-								
-							   	// These get summed up.  If the final sum is positive, then A is the non-matching color and gets subdued.
-								// if the final sum is negative, then B is the non-matching color and gets subdued.
-								difference_direction += calculate_difference(in[px[1][2]],in[px[1][1]],in[px[0][1]],in[px[1][0]]);
-								difference_direction += calculate_difference(in[px[1][2]],in[px[1][1]],in[px[1][3]],in[px[0][2]]);
-								difference_direction += calculate_difference(in[px[1][2]],in[px[1][1]],in[px[3][2]],in[px[2][3]]);
-								difference_direction += calculate_difference(in[px[1][2]],in[px[1][1]],in[px[2][0]],in[px[3][1]]);
-								
-								if (difference_direction > 0){
-									out[lower_right] = out[upper_right] = out[upper_left] = out[lower_left] = interpolate_pixels(in[px[1][1]],in[px[1][2]],in[px[1][2]],in[px[1][2]]);
-								}else if(difference_direction < 0){
-									out[lower_right] = out[upper_right] = out[upper_left] = out[lower_left] = interpolate_pixels(in[px[1][1]],in[px[1][1]],in[px[1][1]],in[px[1][2]]);
-   								}else{
-									out[lower_right] = out[upper_right] = out[upper_left] = out[lower_left] = interpolate_pixels(in[px[1][1]],in[px[1][2]],in[px[2][1]],in[px[2][2]]);
-								}								
-								
-							}
-						*/}
-							
+
+	for(int y = begin_row; y < end_row; ++y) {
+		const uint32_t* src = in + y*w;
+		uint32_t* dst0 = out + y*2*result->w;
+		uint32_t* dst1 = dst0 + result->w;
+
+		//pixels at the edges keep nearest neighbor scaling.
+		expand_row(src, w, dst0, dst1);
+		if(y < f->before || y >= h - f->after) {
+			continue;
+		}
+
+		const int end_x = w - f->after;
+		int x = f->before;
+#if defined(__SSE2__)
+		for(; x + 4 <= end_x; x += 4) {
+			const int flat = flat_mask(src + x, w, *f);
+			if(flat == 0xF) {
+				continue;
+			}
+
+			for(int n = 0; n != 4; ++n) {
+				if((flat & (1 << n)) == 0) {
+					f->rule(src + x + n, w, dst0 + (x + n)*2, dst1 + (x + n)*2);
+				}
+			}
+		}
+#endif
+		for(; x < end_x; ++x) {
+			if(!is_flat(src + x, w, *f)) {
+				f->rule(src + x, w, dst0 + x*2, dst1 + x*2);
 			}
 		}
 	}
+}
+
+//surfaces smaller than this are scaled on the calling thread only.
+const int MinPixelsPerThread = 128*128;
+
+std::string scaled_surface_key(const surface& input, SCALING_FILTER filter)
+{
+	md5::MD5Context ctx;
+	md5::MD5Init(&ctx);
+	const int header[] = { filter, input->w, input->h };
+	md5::MD5Update(&ctx, (unsigned char*)header, sizeof(header));
+	md5::MD5Update(&ctx, (unsigned char*)input->pixels, input->w*input->h*4);
+
+	uint8_t digest[16];
+	md5::MD5Final(digest, &ctx);
+
+	std::ostringstream s;
+	s << scaling_filters[filter].name << "-";
+	for(int n = 0; n != 16; ++n) {
+		s << std::hex << std::setw(2) << std::setfill('0') << int(digest[n]);
+	}
 
+	return s.str();
+}
+
+const std::string& scaled_surface_cache_dir()
+{
+	static const std::string dir = sys::get_dir(std::string(preferences::user_data_path()) + "/scaled_images");
+	return dir;
+}
+}
+
+SCALING_FILTER get_scaling_filter(const std::string& name)
+{
+	for(int n = 0; n != sizeof(scaling_filters)/sizeof(*scaling_filters); ++n) {
+		if(name == scaling_filters[n].name) {
+			return SCALING_FILTER(n);
+		}
+	}
+
+	ASSERT_LOG(false, "UNKNOWN SCALING FILTER: " << name);
+	return SCALING_2XSAI;
+}
+
+surface scale_surface(surface input, SCALING_FILTER filter)
+{
+	surface result(surface::create(input->w*2, input->h*2));
+	const scaling_filter_info* f = &scaling_filters[filter];
+
+	//rows are scaled in bands on separate threads. Each thread only reads
+	//the input and writes its own rows of the output.
+	const int nthreads = std::min(std::min(g_scaling_threads, input->h), input->w*input->h/MinPixelsPerThread);
+	if(nthreads <= 1) {
+		scale_rows(f, input.get(), result.get(), 0, input->h);
+		return result;
+	}
+
+	const int band = (input->h + nthreads - 1)/nthreads;
+	std::vector<boost::shared_ptr<threading::thread> > threads;
+	for(int n = 1; n < nthreads; ++n) {
+		const int begin_row = n*band;
+		const int end_row = std::min(input->h, begin_row + band);
+		threads.push_back(boost::shared_ptr<threading::thread>(new threading::thread("scale_surface", boost::bind(scale_rows, f, input.get(), result.get(), begin_row, end_row))));
+	}
+
+	scale_rows(f, input.get(), result.get(), 0, std::min(input->h, band));
+
+	//joins the threads.
+	threads.clear();
 	return result;
 }
 
-BENCHMARK(surface_scaling)
+surface scale_surface(surface input)
+{
+	const SCALING_FILTER filter = get_scaling_filter(g_scaling_filter);
+	if(!g_cache_scaled_images || scaled_surface_cache_dir().empty()) {
+		return scale_surface(input, filter);
+	}
+
+	const std::string path = scaled_surface_cache_dir() + "/" + scaled_surface_key(input, filter) + ".png";
+	if(sys::file_exists(path)) {
+		surface cached(IMG_Load(path.c_str()));
+		if(cached.get() && cached->w == input->w*2 && cached->h == input->h*2) {
+			surface result(surface::create(cached->w, cached->h));
+			SDL_SetSurfaceBlendMode(cached.get(), SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(cached.get(), NULL, result.get(), NULL);
+			return result;
+		}
+	}
+
+	surface result = scale_surface(input, filter);
+
+	//compression is kept low, since the cache is there to save time.
+	IMG_SavePNG(path.c_str(), result.get(), 1);
+	return result;
+}
+
+BENCHMARK_ARG(surface_scaling, const std::string& filter)
 {
 	surface s(graphics::surface_cache::get("characters/frogatto-spritesheet1.png"));
 	assert(s.get());
@@ -564,8 +774,50 @@ BENCHMARK(surface_scaling)
 	surface target(SDL_CreateRGBSurface(0,s->w,s->h,32,SURFACE_MASK));
 	SDL_SetSurfaceBlendMode(s.get(), SDL_BLENDMODE_NONE);
 	SDL_BlitSurface(s.get(), NULL, target.get(), NULL);
+	const SCALING_FILTER f = get_scaling_filter(filter);
 	BENCHMARK_LOOP {
-		scale_surface(target);
+		scale_surface(target, f);
+	}
+}
+
+BENCHMARK_ARG_CALL(surface_scaling, 2xsai, "2xsai");
+BENCHMARK_ARG_CALL(surface_scaling, eagle, "eagle");
+BENCHMARK_ARG_CALL(surface_scaling, xbr, "xbr");
+
+UNIT_TEST(surface_scaling_flat_pixels)
+{
+	//a filter must give the same result whether or not flat pixels are
+	//skipped, and skipping them must give nearest neighbor scaling.
+	surface input(surface::create(9, 9));
+	uint32_t* pixels = reinterpret_cast<uint32_t*>(input->pixels);
+	for(int n = 0; n != 81; ++n) {
+		pixels[n] = 0xFF000000;
+	}
+
+	//a diagonal line for the filters to smooth.
+	for(int n = 0; n != 9; ++n) {
+		pixels[n*9 + n] = 0xFFFFFFFF;
+	}
+
+	for(int filter = 0; filter != sizeof(scaling_filters)/sizeof(*scaling_filters); ++filter) {
+		const scaling_filter_info& f = scaling_filters[filter];
+		surface result = scale_surface(input, SCALING_FILTER(filter));
+		const uint32_t* out = reinterpret_cast<const uint32_t*>(result->pixels);
+
+		for(int y = f.before; y < 9 - f.after; ++y) {
+			for(int x = f.before; x < 9 - f.after; ++x) {
+				uint32_t expected[2][2] = {{pixels[y*9 + x], pixels[y*9 + x]}, {pixels[y*9 + x], pixels[y*9 + x]}};
+				f.rule(pixels + y*9 + x, 9, expected[0], expected[1]);
+				CHECK_EQ(out[y*2*18 + x*2], expected[0][0]);
+				CHECK_EQ(out[y*2*18 + x*2 + 1], expected[0][1]);
+				CHECK_EQ(out[(y*2 + 1)*18 + x*2], expected[1][0]);
+				CHECK_EQ(out[(y*2 + 1)*18 + x*2 + 1], expected[1][1]);
+			}
+		}
+
+		//the far corners are flat, so they are scaled to plain squares.
+		CHECK_EQ(out[17], 0xFF000000);
+		CHECK_EQ(out[17*18], 0xFF000000);
 	}
 }
 
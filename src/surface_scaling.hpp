@@ -0,0 +1,43 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SURFACE_SCALING_HPP_INCLUDED
+#define SURFACE_SCALING_HPP_INCLUDED
+
+#include <string>
+
+#include "surface.hpp"
+
+namespace graphics {
+
+//Filters for doubling the size of pixel art without blurring it.
+enum SCALING_FILTER { SCALING_2XSAI, SCALING_EAGLE, SCALING_XBR };
+
+//looks up a filter by its name: "2xsai", "eagle" or "xbr".
+SCALING_FILTER get_scaling_filter(const std::string& name);
+
+//returns a copy of the input scaled to twice its size with the filter.
+//The input must be a 32-bit surface. Large surfaces are scaled on
+//several threads.
+surface scale_surface(surface input, SCALING_FILTER filter);
+
+//scales with the filter chosen in preferences, reusing the result of an
+//earlier scale of the same pixels stored on disk where there is one.
+surface scale_surface(surface input);
+
+}
+
+#endif
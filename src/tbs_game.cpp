@@ -17,7 +17,9 @@
 #include <algorithm>
 #include <string>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 
+#include <ctype.h>
 #include <stdio.h>
 
 #include "asserts.hpp"
@@ -34,6 +36,8 @@
 #include "tbs_game.hpp"
 #include "tbs_web_server.hpp"
 #include "string_utils.hpp"
+#include "thread.hpp"
+#include "thread_local.hpp"
 #include "unit_test.hpp"
 #include "variant_utils.hpp"
 #include "wml_formula_callable.hpp"
@@ -44,11 +48,56 @@ void flush_all_backed_maps();
 
 namespace tbs {
 
+namespace {
+//FFL classes, the library and singleton() objects are shared by every
+//thread. Game types whose code names them may reach that state, so all
+//their games are kept in one shard.
+bool is_identifier_char(char c)
+{
+	return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool word_in_string(const std::string& s, const std::string& word)
+{
+	for(std::string::size_type pos = s.find(word); pos != std::string::npos; pos = s.find(word, pos+1)) {
+		const bool starts = pos == 0 || !is_identifier_char(s[pos-1]);
+		const bool ends = pos + word.size() == s.size() || !is_identifier_char(s[pos + word.size()]);
+		if(starts && ends) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool code_uses_shared_state(const variant& v)
+{
+	if(v.is_string()) {
+		const std::string& s = v.as_string();
+		return word_in_string(s, "construct") || word_in_string(s, "singleton") || word_in_string(s, "lib");
+	} else if(v.is_list()) {
+		for(int n = 0; n != v.num_elements(); ++n) {
+			if(code_uses_shared_state(v[n])) {
+				return true;
+			}
+		}
+	} else if(v.is_map()) {
+		foreach(const variant& key, v.get_keys().as_list()) {
+			if(code_uses_shared_state(v[key])) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+}
+
 struct game_type {
-	game_type() {
+	game_type() : uses_shared_state(false) {
 	}
 
-	explicit game_type(const variant& value)
+	explicit game_type(const variant& value) : uses_shared_state(code_uses_shared_state(value))
 	{
 		variant functions_var = value["functions"];
 		if(functions_var.is_string()) {
@@ -67,6 +116,7 @@ struct game_type {
 	std::string name;
 	boost::shared_ptr<game_logic::function_symbol_table> functions;
 	std::map<std::string, game_logic::const_formula_ptr> handlers;
+	bool uses_shared_state;
 };
 
 std::map<std::string, game_type> generate_game_types() {
@@ -82,7 +132,7 @@ std::map<std::string, game_type> generate_game_types() {
 			boost::algorithm::to_lower(type);
 			result[type] = game_type(json::parse_from_file("data/tbs/" + fname));
 			result[type].name = type;
-			std::cerr << "LOADED TBS GAME TYPE: " << type << "\n";
+			std::cerr << "LOADED TBS GAME TYPE: " << type << (result[type].uses_shared_state ? " (USES SHARED FFL STATE, PLAYED IN ONE SHARD)" : "") << "\n";
 		}
 	}
 	std::cerr << "DONE GENERATE GAME TYPES\n";
@@ -90,20 +140,44 @@ std::map<std::string, game_type> generate_game_types() {
 	return result;
 }
 
-std::map<std::string, game_type>& all_types() {
-	static std::map<std::string, game_type> types = generate_game_types();
+//each shard of a server has its own copy of every game type. Compiled
+//formulae keep state while they run, so games in shards processed at the
+//same time mustn't share them.
+std::deque<std::map<std::string, game_type> >& all_shard_types() {
+	static std::deque<std::map<std::string, game_type> > types(1, generate_game_types());
 	return types;
 }
 
+std::map<std::string, game_type>& all_types(int shard=0) {
+	return all_shard_types()[shard];
+}
+
 extern std::string global_debug_str;
 
 void game::reload_game_types()
 {
-	all_types() = generate_game_types();
+	for(int n = 0; n != all_shard_types().size(); ++n) {
+		all_shard_types()[n] = generate_game_types();
+	}
+}
+
+bool game::type_uses_shared_state(const std::string& type_name)
+{
+	std::string type = type_name;
+	boost::algorithm::to_lower(type);
+	std::map<std::string, game_type>::const_iterator type_itor = all_types().find(type);
+	return type_itor != all_types().end() && type_itor->second.uses_shared_state;
+}
+
+void game::set_num_shards(int nshards)
+{
+	while(all_shard_types().size() < nshards) {
+		all_shard_types().push_back(generate_game_types());
+	}
 }
 
 namespace {
-game* current_game = NULL;
+THREAD_LOCAL game* current_game = NULL;
 
 int generate_game_id() {
 	static int id = int(time(NULL));
@@ -148,7 +222,7 @@ game* game::current()
 	return current_game;
 }
 
-boost::intrusive_ptr<game> game::create(const variant& v)
+boost::intrusive_ptr<game> game::create(const variant& v, int shard)
 {
 	const variant type_var = v["game_type"];
 	if(!type_var.is_string()) {
@@ -157,8 +231,9 @@ boost::intrusive_ptr<game> game::create(const variant& v)
 
 	std::string type = type_var.as_string();
 	boost::algorithm::to_lower(type);
-	std::map<std::string, game_type>::const_iterator type_itor = all_types().find(type);
-	if(type_itor == all_types().end()) {
+	ASSERT_LOG(shard >= 0 && shard < all_shard_types().size(), "GAME CREATED IN UNKNOWN SHARD: " << shard);
+	std::map<std::string, game_type>::const_iterator type_itor = all_types(shard).find(type);
+	if(type_itor == all_types(shard).end()) {
 		return NULL;
 	}
 
@@ -663,6 +738,75 @@ void create_game_return(const std::string& msg) {
 void start_game_return(const std::string& msg) {
 	std::cerr << "GAME STARTED\n";
 }
+
+void process_bot_games(tbs::internal_server* server, int nshard, const std::vector<tbs::server_base::game_info_ptr>* games, int ncycles)
+{
+	for(int cycle = 0; cycle != ncycles; ++cycle) {
+		const threading::lock lock(server->shard_mutex(nshard));
+		foreach(const tbs::server_base::game_info_ptr& g, *games) {
+			const tbs::game_context context(g->game_state.get());
+			g->game_state->process();
+		}
+	}
+}
+
+//Creates ngames copies of the bot game described by create_game_request,
+//each with its own session ids, spread over nthreads shards, and times
+//ncycles of processing them all, each shard on its own thread. Returns
+//the number of game cycles processed each second.
+double run_bot_game_benchmark(variant create_game_request, int ngames, int ncycles, int nthreads)
+{
+	tbs::internal_server server(nthreads);
+	std::vector<tbs::server_base::game_info_ptr> games;
+
+	int next_session_id = 1;
+	for(int n = 0; n != ngames; ++n) {
+		variant request = deep_copy_variant(create_game_request);
+		variant users = request["users"];
+		for(int i = 0; i != users.num_elements(); ++i) {
+			variant user = users[i];
+			user.add_attr_mutation(variant("session_id"), variant(next_session_id++));
+		}
+
+		tbs::server_base::game_info_ptr g = server.create_game(request);
+		ASSERT_LOG(g, "Could not create game: " << request.write_json());
+
+		const threading::lock lock(server.shard_mutex(g->shard));
+		const tbs::game_context context(g->game_state.get());
+		g->game_state->handle_message(0, json::parse("{type: 'start_game'}"));
+		games.push_back(g);
+	}
+
+	std::vector<std::vector<tbs::server_base::game_info_ptr> > shard_games(nthreads);
+	foreach(const tbs::server_base::game_info_ptr& g, games) {
+		shard_games[g->shard].push_back(g);
+	}
+
+	const Uint64 start_time = SDL_GetPerformanceCounter();
+
+	if(nthreads == 1) {
+		process_bot_games(&server, 0, &shard_games[0], ncycles);
+	} else {
+		std::vector<boost::shared_ptr<threading::thread> > threads;
+		for(int n = 0; n != nthreads; ++n) {
+			threads.push_back(boost::shared_ptr<threading::thread>(new threading::thread(formatter() << "bot_games_" << n, boost::bind(process_bot_games, &server, n, &shard_games[n], ncycles))));
+		}
+
+		foreach(const boost::shared_ptr<threading::thread>& t, threads) {
+			t->join();
+		}
+	}
+
+	const double elapsed_ms = (SDL_GetPerformanceCounter() - start_time)*1000.0/SDL_GetPerformanceFrequency();
+	const double game_cycles_per_second = (ngames*ncycles*1000.0)/std::max(elapsed_ms, 0.001);
+	fprintf(stderr, "PROCESSED %d GAMES FOR %d CYCLES ON %d THREADS IN %.1fms: %.1f GAME CYCLES/S\n",
+	        ngames, ncycles, nthreads, elapsed_ms, game_cycles_per_second);
+
+	//the server's games must go before the server does.
+	shard_games.clear();
+	games.clear();
+	return game_cycles_per_second;
+}
 }
 
 COMMAND_LINE_UTILITY(tbs_bot_game) {
@@ -670,16 +814,43 @@ COMMAND_LINE_UTILITY(tbs_bot_game) {
 	using namespace game_logic;
 
 	bool found_create_game = false;
+	int ngames = 0, ncycles = 1000, nthreads = 1;
 	variant create_game_request = json::parse("{type: 'create_game', game_type: 'citadel', users: [{user: 'a', bot: true, bot_type: 'goblins', session_id: 1}, {user: 'b', bot: true, bot_type: 'goblins', session_id: 2}]}");
 	for(int i = 0; i != args.size(); ++i) {
 		if(args[i] == "--request" && i+1 != args.size()) {
 			create_game_request = json::parse(args[i+1]);
 			found_create_game = true;
+		} else if(args[i] == "--games" && i+1 != args.size()) {
+			ngames = atoi(args[i+1].c_str());
+		} else if(args[i] == "--cycles" && i+1 != args.size()) {
+			ncycles = atoi(args[i+1].c_str());
+		} else if(args[i] == "--threads" && i+1 != args.size()) {
+			nthreads = atoi(args[i+1].c_str());
 		}
 	}
 
 	ASSERT_LOG(found_create_game, "MUST PROVIDE --request");
 
+	if(ngames > 0) {
+		ASSERT_LOG(nthreads > 0, "tbs_bot_game: Must use at least one thread.");
+		if(nthreads == 1) {
+			run_bot_game_benchmark(create_game_request, ngames, ncycles, 1);
+			return;
+		}
+
+		if(game::type_uses_shared_state(create_game_request["game_type"].as_string_default(""))) {
+			fprintf(stderr, "GAME TYPE USES SHARED FFL STATE: ALL GAMES RUN IN ONE SHARD\n");
+		}
+
+		//both runs pay for atomic reference counts, so the comparison
+		//only measures the sharding.
+		threading::enable_atomic_refcounts();
+		const double single = run_bot_game_benchmark(create_game_request, ngames, ncycles, 1);
+		const double sharded = run_bot_game_benchmark(create_game_request, ngames, ncycles, nthreads);
+		fprintf(stderr, "SPEEDUP ON %d THREADS: %.2fx\n", nthreads, sharded/std::max(single, 0.001));
+		return;
+	}
+
 	variant start_game_request = json::parse("{type: 'start_game'}");
 
 	boost::intrusive_ptr<map_formula_callable> callable(new map_formula_callable);
@@ -42,7 +42,15 @@ public:
 	};
 
 	static void reload_game_types();
-	static boost::intrusive_ptr<game> create(const variant& v);
+
+	//compiles a copy of the game types for each of nshards shards. Games
+	//created in different shards may be used by different threads at once.
+	static void set_num_shards(int nshards);
+
+	//true if games of the type may use FFL state every thread shares,
+	//such as FFL classes or the library, so can't go in different shards.
+	static bool type_uses_shared_state(const std::string& type);
+	static boost::intrusive_ptr<game> create(const variant& v, int shard=0);
 	static game* current();
 
 	explicit game(const game_type& type);
@@ -36,8 +36,8 @@ namespace tbs
 
 	boost::asio::io_service internal_server::io_service_;
 
-	internal_server::internal_server()
-		: server_base(io_service_)
+	internal_server::internal_server(int nshards)
+		: server_base(io_service_, nshards)
 	{
 	}
 
@@ -38,7 +38,7 @@ namespace tbs
 	class internal_server : public server_base
 	{
 	public:
-		internal_server();
+		explicit internal_server(int nshards=1);
 		virtual ~internal_server();
 
 		void handle_process();
@@ -116,10 +116,10 @@ public:
 		db_client_ = db_client::create();
 
 		db_timer_.expires_from_now(boost::posix_time::milliseconds(10));
-		db_timer_.async_wait(boost::bind(&matchmaking_server::db_process, this, boost::asio::placeholders::error));
+		db_timer_.async_wait(handler_strand().wrap(boost::bind(&matchmaking_server::db_process, this, boost::asio::placeholders::error)));
 
 		timer_.expires_from_now(boost::posix_time::milliseconds(1000));
-		timer_.async_wait(boost::bind(&matchmaking_server::heartbeat, this, boost::asio::placeholders::error));
+		timer_.async_wait(handler_strand().wrap(boost::bind(&matchmaking_server::heartbeat, this, boost::asio::placeholders::error)));
 
 		for(int i = 0; i != 256; ++i) {
 			available_ports_.push_back(21156+i);
@@ -134,7 +134,7 @@ public:
 	void db_process(const boost::system::error_code& error)
 	{
 		db_timer_.expires_from_now(boost::posix_time::milliseconds(10));
-		db_timer_.async_wait(boost::bind(&matchmaking_server::db_process, this, boost::asio::placeholders::error));
+		db_timer_.async_wait(handler_strand().wrap(boost::bind(&matchmaking_server::db_process, this, boost::asio::placeholders::error)));
 
 		db_client_->process(1000);
 	}
@@ -216,7 +216,7 @@ public:
 		}
 
 		timer_.expires_from_now(boost::posix_time::milliseconds(1000));
-		timer_.async_wait(boost::bind(&matchmaking_server::heartbeat, this, boost::asio::placeholders::error));
+		timer_.async_wait(handler_strand().wrap(boost::bind(&matchmaking_server::heartbeat, this, boost::asio::placeholders::error)));
 	}
 
 
@@ -774,6 +774,7 @@ void matchmaking_server::execute_command(variant cmd)
 
 COMMAND_LINE_UTILITY(tbs_matchmaking_server) {
 	int port = 23456;
+	int nthreads = 1;
 
 	std::deque<std::string> arguments(args.begin(), args.end());
 	while(arguments.empty() == false) {
@@ -784,6 +785,11 @@ COMMAND_LINE_UTILITY(tbs_matchmaking_server) {
 			ASSERT_LOG(!arguments.empty(), "Need another argument after --port");
 			port = atoi(arguments.front().c_str());
 			arguments.pop_front();
+		} else if(arg == "--threads") {
+			ASSERT_LOG(!arguments.empty(), "Need another argument after --threads");
+			nthreads = atoi(arguments.front().c_str());
+			ASSERT_LOG(nthreads > 0, "Must use at least one thread");
+			arguments.pop_front();
 		} else {
 			ASSERT_LOG(false, "Unrecognized argument: " << arg);
 		}
@@ -791,7 +797,7 @@ COMMAND_LINE_UTILITY(tbs_matchmaking_server) {
 
 	boost::asio::io_service io_service;
 	boost::intrusive_ptr<matchmaking_server> server(new matchmaking_server(io_service, port));
-	io_service.run();
+	http::run_io_service(io_service, nthreads);
 }
 
 COMMAND_LINE_UTILITY(db_script) {
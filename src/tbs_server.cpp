@@ -40,9 +40,9 @@ namespace {
 bool g_exit_server = false;
 }
 
-server::game_info::game_info(const variant& value) : nlast_touch(-1), quit_server_on_exit(false)
+server::game_info::game_info(const variant& value, int shard) : nlast_touch(-1), quit_server_on_exit(false), shard(shard)
 {
-	game_state = game::create(value);
+	game_state = game::create(value, shard);
 }
 
 server::game_info::~game_info()
@@ -55,8 +55,8 @@ server::game_info::~game_info()
 server::client_info::client_info() : nplayer(0), last_contact(0)
 {}
 
-server::server(boost::asio::io_service& io_service)
-  : server_base(io_service)
+server::server(boost::asio::io_service& io_service, int nshards)
+  : server_base(io_service, nshards)
 {
 }
 
@@ -160,7 +160,7 @@ void server::send_msg(socket_ptr socket, const std::string& msg)
 
 	boost::shared_ptr<std::string> str_buf(new std::string(header.empty() ? msg : (header + msg)));
 	boost::asio::async_write(*socket, boost::asio::buffer(*str_buf),
-			                         boost::bind(&server::handle_send, this, socket, _1, _2, str_buf, session_id));
+			                         strand().wrap(boost::bind(&server::handle_send, this, socket, _1, _2, str_buf, session_id)));
 }
 
 void server::handle_send(socket_ptr socket, const boost::system::error_code& e, size_t nbytes, boost::shared_ptr<std::string> buf, int session_id)
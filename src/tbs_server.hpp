@@ -37,7 +37,7 @@ typedef boost::shared_ptr<boost::array<char, 1024> > buffer_ptr;
 class server : public server_base
 {
 public:
-	explicit server(boost::asio::io_service& io_service);
+	explicit server(boost::asio::io_service& io_service, int nshards=1);
 	virtual ~server();
 	 
 	void adopt_ajax_socket(socket_ptr socket, int session_id, const variant& msg);
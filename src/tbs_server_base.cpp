@@ -14,9 +14,12 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
+
 #include <boost/bind.hpp>
 #include <boost/asio.hpp>
 
+#include "asserts.hpp"
 #include "filesystem.hpp"
 #include "foreach.hpp"
 #include "formatter.hpp"
@@ -40,9 +43,20 @@ namespace tbs
 		}
 	}
 
-	server_base::server_base(boost::asio::io_service& io_service)
-		: timer_(io_service), nheartbeat_(0), scheduled_write_(0), status_id_(0)
+	server_base::server_base(boost::asio::io_service& io_service, int nshards)
+		: strand_(io_service), timer_(io_service), nheartbeat_(0), scheduled_write_(0), status_id_(0)
 	{
+		ASSERT_LOG(nshards > 0, "A server needs at least one shard");
+		if(nshards > 1) {
+			//games in different shards use FFL at the same time.
+			threading::enable_atomic_refcounts();
+		}
+
+		game::set_num_shards(nshards);
+		for(int n = 0; n != nshards; ++n) {
+			shards_.push_back(boost::shared_ptr<shard>(new shard(io_service)));
+		}
+
 		heartbeat(boost::asio::error::timed_out);
 	}
 
@@ -59,11 +73,35 @@ namespace tbs
 	{
 		games_.clear();
 		clients_.clear();
+
+		//the io_service may have been stopped while shards were processing.
+		foreach(const boost::shared_ptr<shard>& s, shards_) {
+			s->processing = false;
+		}
+	}
+
+	int server_base::choose_shard(const variant& msg) const
+	{
+		//games which may use state all threads share are kept together
+		//so they are never processed at the same time.
+		if(shards_.size() > 1 && game::type_uses_shared_state(msg["game_type"].as_string_default(""))) {
+			return 0;
+		}
+
+		std::vector<int> ngames(shards_.size());
+		foreach(const game_info_ptr& g, games_) {
+			++ngames[g->shard];
+		}
+
+		return std::min_element(ngames.begin(), ngames.end()) - ngames.begin();
 	}
 
 	server_base::game_info_ptr server_base::create_game(variant msg)
 	{
-		game_info_ptr g(new game_info(msg));
+		const int nshard = choose_shard(msg);
+		const threading::lock lock(shard_mutex(nshard));
+
+		game_info_ptr g(new game_info(msg, nshard));
 		if(!g->game_state) {
 			std::cerr << "COULD NOT CREATE GAME TYPE: " << msg["game_type"].as_string() << ": " << msg.write_json() << "\n";
 			return game_info_ptr();
@@ -239,6 +277,8 @@ namespace tbs
 
 	variant server_base::create_game_info_msg(game_info_ptr g) const
 	{
+		const threading::lock lock(shard_mutex(g->shard));
+
 		variant_builder value;
 		value.add("type", "game_info");
 		value.add("id", g->game_state->game_id());
@@ -272,21 +312,29 @@ namespace tbs
 				const bool is_first_client = g->clients.front() == session_id;
 				g->clients.erase(std::remove(g->clients.begin(), g->clients.end(), session_id), g->clients.end());
 
-				if(!g->game_state->started()) {
-					g->game_state->remove_player(cli_info.user);
-					if(is_first_client) {
-						g->clients.clear();
-						//TODO: remove joining clients from the game nicely.
-					} else {
-						const std::string msg = create_game_info_msg(g).write_json(true, variant::JSON_COMPLIANT);
-						foreach(int client, g->clients) {
-							queue_msg(client, msg);
+				bool send_game_info = false;
+				{
+					const threading::lock lock(shard_mutex(g->shard));
+					if(!g->game_state->started()) {
+						g->game_state->remove_player(cli_info.user);
+						if(is_first_client) {
+							g->clients.clear();
+							//TODO: remove joining clients from the game nicely.
+						} else {
+							send_game_info = true;
 						}
+					} else if(g->game_state->get_player_index(cli_info.user) != -1) {
+						std::cerr << "sending quit message...\n";
+						g->game_state->queue_message(formatter() << "<message text=\"" << cli_info.user << " has quit\"/>");
+						flush_game_messages(*g);
+					}
+				}
+
+				if(send_game_info) {
+					const std::string msg = create_game_info_msg(g).write_json(true, variant::JSON_COMPLIANT);
+					foreach(int client, g->clients) {
+						queue_msg(client, msg);
 					}
-				} else if(g->game_state->get_player_index(cli_info.user) != -1) {
-					std::cerr << "sending quit message...\n";
-					g->game_state->queue_message(formatter() << "<message text=\"" << cli_info.user << " has quit\"/>");
-					flush_game_messages(*g);
 				}
 
 				if(g->clients.empty()) {
@@ -307,6 +355,7 @@ namespace tbs
 		}
 	}
 
+	//the caller holds the game's shard lock.
 	void server_base::flush_game_messages(game_info& info)
 	{
 		std::vector<game::message> game_response;
@@ -362,6 +411,7 @@ namespace tbs
 				return;
 			}
 
+			const threading::lock lock(shard_mutex(cli_info.game->shard));
 			const bool game_started = cli_info.game->game_state->started();
 			const game_context context(cli_info.game->game_state.get());
 
@@ -394,11 +444,25 @@ namespace tbs
 			return;
 		}
 		timer_.expires_from_now(boost::posix_time::milliseconds(g_tbs_server_delay_ms));
-		timer_.async_wait(boost::bind(&server_base::heartbeat, this, 
-			boost::asio::placeholders::error));
+		timer_.async_wait(strand_.wrap(boost::bind(&server_base::heartbeat, this, 
+			boost::asio::placeholders::error)));
+
+		//each shard processes its games on its own strand. A shard still
+		//busy with the last heartbeat's processing skips this one.
+		std::vector<boost::shared_ptr<std::vector<game_info_ptr> > > shard_games(shards_.size());
+		foreach(const game_info_ptr& g, games_) {
+			if(!shard_games[g->shard]) {
+				shard_games[g->shard].reset(new std::vector<game_info_ptr>);
+			}
 
-		foreach(game_info_ptr g, games_) {
-			g->game_state->process();
+			shard_games[g->shard]->push_back(g);
+		}
+
+		for(int n = 0; n != shards_.size(); ++n) {
+			if(shard_games[n] && !shards_[n]->processing) {
+				shards_[n]->processing = true;
+				shards_[n]->strand.post(boost::bind(&server_base::process_shard, this, n, shard_games[n]));
+			}
 		}
 
 		nheartbeat_++;
@@ -424,7 +488,16 @@ namespace tbs
 		}
 
 #if !defined(__ANDROID__)
-		sys::pump_file_modifications();
+		if(sys::file_modifications_pending()) {
+			//reloading game types while shards process games would pull
+			//their code out from under them.
+			std::vector<boost::shared_ptr<threading::lock> > locks;
+			for(int n = 0; n != shards_.size(); ++n) {
+				locks.push_back(boost::shared_ptr<threading::lock>(new threading::lock(shard_mutex(n))));
+			}
+
+			sys::pump_file_modifications();
+		}
 #endif
 
 		const bool send_heartbeat = nheartbeat_%100 == 0;
@@ -440,6 +513,27 @@ namespace tbs
 		}
 	}
 
+	void server_base::process_shard(int nshard, boost::shared_ptr<std::vector<game_info_ptr> > games)
+	{
+		{
+			const threading::lock lock(shard_mutex(nshard));
+			foreach(const game_info_ptr& g, *games) {
+				g->game_state->process();
+			}
+
+			//games the server dropped meanwhile are destroyed here, while
+			//the shard is locked.
+			games->clear();
+		}
+
+		strand_.post(boost::bind(&server_base::finish_shard, this, nshard));
+	}
+
+	void server_base::finish_shard(int nshard)
+	{
+		shards_[nshard]->processing = false;
+	}
+
 	variant server_base::create_heartbeat_packet(const client_info& cli_info)
 	{
 		variant_builder doc;
@@ -459,7 +553,13 @@ namespace tbs
 				items.push_back(value.build());
 			}
 
-			foreach(const std::string& ai, cli_info.game->game_state->get_ai_players()) {
+			std::vector<std::string> ai_players;
+			{
+				const threading::lock lock(shard_mutex(cli_info.game->shard));
+				ai_players = cli_info.game->game_state->get_ai_players();
+			}
+
+			foreach(const std::string& ai, ai_players) {
 				variant_builder value;
 
 				value.add("nick", ai);
@@ -18,12 +18,14 @@
 #ifndef TBS_SERVER_VIRT_HPP_INCLUDED
 #define TBS_SERVER_VIRT_HPP_INCLUDED
 
+#include <boost/asio.hpp>
 #include <boost/function.hpp>
 
 #include <map>
 #include <vector>
 
 #include "tbs_game.hpp"
+#include "thread.hpp"
 #include "variant.hpp"
 
 namespace tbs
@@ -35,26 +37,41 @@ namespace tbs
 	class server_base
 	{
 	public:
-		server_base(boost::asio::io_service& io_service);
+		//games are partitioned over nshards shards. Each shard processes
+		//its games on its own strand, so when the io_service runs on
+		//several threads games in different shards run in parallel.
+		explicit server_base(boost::asio::io_service& io_service, int nshards=1);
 		virtual ~server_base();
 		
 		void clear_games();
 		static variant get_server_info();
 
+		//All access to the server's clients and list of games must happen
+		//through this strand, which allows the server to be driven by
+		//an io_service running on several threads.
+		boost::asio::io_service::strand& strand() { return strand_; }
+
 		struct game_info 
 		{
-			explicit game_info(const variant& value);
+			game_info(const variant& value, int shard);
 			~game_info();
 
 			game_ptr game_state;
 			std::vector<int> clients;
 			int nlast_touch;
 			bool quit_server_on_exit;
+
+			//the shard the game belongs to. Its game_state may only be
+			//used with the shard's mutex held.
+			int shard;
 		};
 
 		typedef boost::shared_ptr<game_info> game_info_ptr;
 
 		game_info_ptr create_game(variant msg);
+
+		int num_shards() const { return shards_.size(); }
+		threading::mutex& shard_mutex(int nshard) const { return shards_[nshard]->mutex; }
 	protected:
 
 		struct client_info 
@@ -101,6 +118,10 @@ namespace tbs
 		void handle_message_internal(client_info& cli_info, const variant& msg);
 		void heartbeat(const boost::system::error_code& error);
 
+		int choose_shard(const variant& msg) const;
+		void process_shard(int nshard, boost::shared_ptr<std::vector<game_info_ptr> > games);
+		void finish_shard(int nshard);
+
 		int nheartbeat_;
 		int scheduled_write_;
 		int status_id_;
@@ -108,8 +129,27 @@ namespace tbs
 		std::map<int, client_info> clients_;
 		std::vector<game_info_ptr> games_;
 
+		boost::asio::io_service::strand strand_;
 		boost::asio::deadline_timer timer_;
 
+		struct shard
+		{
+			explicit shard(boost::asio::io_service& io_service) : strand(io_service), processing(false)
+			{}
+
+			boost::asio::io_service::strand strand;
+
+			//held while any of the shard's games are used, whether from
+			//the shard's strand or the server's.
+			threading::mutex mutex;
+
+			//whether the shard is still processing its games for the last
+			//heartbeat. Only accessed through the server's strand.
+			bool processing;
+		};
+
+		std::vector<boost::shared_ptr<shard> > shards_;
+
 		// send_fn's waiting on status info.
 		std::vector<send_function> status_fns_;
 	};
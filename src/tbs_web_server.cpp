@@ -52,11 +52,11 @@ boost::asio::io_service* web_server::service() { return g_service; }
 int web_server::port() { return g_listening_port; }
 
 web_server::web_server(server& serv, boost::asio::io_service& io_service, int port)
-	: http::web_server(io_service, port), server_(serv), timer_(io_service)
+	: http::web_server(io_service, port, &serv.strand()), server_(serv), timer_(io_service)
 {
 	web_server_instance = this;
 	timer_.expires_from_now(boost::posix_time::milliseconds(1000));
-	timer_.async_wait(boost::bind(&web_server::heartbeat, this, boost::asio::placeholders::error));
+	timer_.async_wait(handler_strand().wrap(boost::bind(&web_server::heartbeat, this, boost::asio::placeholders::error)));
 }
 
 web_server::~web_server()
@@ -141,7 +141,7 @@ void web_server::heartbeat(const boost::system::error_code& error)
 	}
 	debug_state_sockets.clear();
 	timer_.expires_from_now(boost::posix_time::milliseconds(1000));
-	timer_.async_wait(boost::bind(&web_server::heartbeat, this, boost::asio::placeholders::error));
+	timer_.async_wait(handler_strand().wrap(boost::bind(&web_server::heartbeat, this, boost::asio::placeholders::error)));
 }
 
 void web_server::handle_get(socket_ptr socket, 
@@ -165,8 +165,11 @@ void web_server::handle_get(socket_ptr socket,
 
 	foreach(const KnownFile& f, known_files) {
 		if(url == f.url) {
-			send_msg(socket, f.type, sys::read_file(f.fname), "");
-			return;
+			http::response_chunk_ptr contents = http::get_cached_file(f.fname);
+			if(contents) {
+				send_msg(socket, f.type, std::vector<http::response_chunk_ptr>(1, contents), "");
+				return;
+			}
 		}
 	}
 
@@ -192,6 +195,7 @@ void on_code_modified()
 
 COMMAND_LINE_UTILITY(tbs_server) {
 	int port = 23456;
+	int nthreads = 1;
 	std::vector<std::string> bot_id;
 	variant config;
 	if(args.size() > 0) {
@@ -204,6 +208,13 @@ COMMAND_LINE_UTILITY(tbs_server) {
 					ASSERT_LOG(port > 0 && port <= 65535, "tbs_server(): Port must lie in the range 1-65535.");
 					++it;
 				}
+			} else if(*it == "--threads") {
+				it++;
+				if(it != args.end()) {
+					nthreads = atoi(it->c_str());
+					ASSERT_LOG(nthreads > 0, "tbs_server(): Must use at least one thread.");
+					++it;
+				}
 			} else if(*it == "--bot") {
 				++it;
 				if(it != args.end()) {
@@ -233,6 +244,9 @@ COMMAND_LINE_UTILITY(tbs_server) {
 		}
 	}
 
+	//bots drive FFL from their own handlers outside of the server's strand.
+	ASSERT_LOG(nthreads == 1 || bot_id.empty(), "tbs_server(): --bot can't be used with --threads");
+
 	std::cerr << "MONITOR URL: " << "http://localhost:" << port << "/tbs_monitor.html\n";
 
 	boost::asio::io_service io_service;
@@ -241,7 +255,8 @@ COMMAND_LINE_UTILITY(tbs_server) {
 	tbs::g_service = &io_service;
 	tbs::g_listening_port = port;
 
-	tbs::server s(io_service);
+	//games are spread over one shard per thread.
+	tbs::server s(io_service, nthreads);
 	tbs::web_server ws(s, io_service, port);
 
 	if(!config.is_null()) {
@@ -313,11 +328,11 @@ COMMAND_LINE_UTILITY(tbs_server) {
 				//	io_service.reset();
 				//	io_service.poll();
 				//}
-				io_service.run();
+				http::run_io_service(io_service, nthreads);
 			}
 			//exit(EXIT_SUCCESS);
 #else
-			io_service.run();
+			http::run_io_service(io_service, nthreads);
 #endif
 		} catch(code_modified_exception&) {
 			s.clear_games();
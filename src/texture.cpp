@@ -29,6 +29,7 @@
 #include "surface_cache.hpp"
 #include "surface_formula.hpp"
 #include "surface_palette.hpp"
+#include "surface_scaling.hpp"
 #include "texture.hpp"
 #include "thread.hpp"
 #include "unit_test.hpp"
@@ -46,7 +47,6 @@ namespace graphics
 										including mip-map generation.");
 
 SDL_threadID graphics_thread_id;
-surface scale_surface(surface input);
 
 namespace {
 	std::set<texture*>& texture_registry() {
@@ -100,6 +100,27 @@ namespace {
 		return cache;
 	}
 
+	//an image stored as palette indexes along with the lookup texture
+	//which gives the color of each index under each palette.
+	struct IndexedCacheEntry {
+		IndexedCacheEntry() : built(false), npalettes(0) {}
+		bool built;
+		CacheEntry entry;
+		std::vector<uint32_t> colors;
+		graphics::texture palette_map;
+		int npalettes;
+	};
+
+	typedef concurrent_cache<std::string,IndexedCacheEntry> indexed_texture_map;
+	indexed_texture_map& indexed_texture_cache() {
+		static indexed_texture_map cache;
+		return cache;
+	}
+
+	//the most colors an indexed image may have. This is the width of its
+	//palette lookup texture.
+	const int MaxIndexedColors = 1024;
+
 	const size_t TextureBufSize = 128;
 	bool graphics_initialized = false;
 
@@ -637,6 +658,50 @@ texture texture::get_palette_mapped(const std::string& str, int palette)
 	return result;
 }
 
+texture texture::get_palette_indexed(const std::string& str, texture* palette_map)
+{
+	//indexes can't be filtered or reduced in precision.
+	if(g_bilinear_textures || preferences::use_16bpp_textures() || preferences::use_pretty_scaling()) {
+		return texture();
+	}
+
+	IndexedCacheEntry indexed = indexed_texture_cache().get(str);
+	if(!indexed.built) {
+		indexed.built = true;
+		surface s = surface_cache::get_no_cache(str, &indexed.entry.path);
+		if(indexed.entry.path.empty() == false) {
+			indexed.entry.mod_time = sys::file_mod_time(indexed.entry.path);
+		}
+
+		if(s.get() != NULL) {
+			//find the transparent pixels now, since the indexes
+			//no longer have the colors which mark them.
+			surface rgba = build_surface_from_key(key(1, s), s->w, s->h);
+			set_alpha_for_transparent_colors_in_rgba_surface(rgba.get(), 0);
+
+			static const unsigned char* AlphaColors = get_alpha_pixel_colors();
+			surface index_surf = index_palette_colors(rgba, &indexed.colors, MaxIndexedColors, AlphaColors, 2);
+			if(index_surf.get() != NULL) {
+				indexed.entry.t = texture(key(1, index_surf));
+			}
+		} else {
+			std::cerr << "COULD NOT FIND IMAGE FOR PALETTE INDEXING: '" << str << "'\n";
+		}
+	}
+
+	//palettes loaded since the lookup texture was built need rows too.
+	if(indexed.entry.t.valid() && indexed.npalettes != num_palettes()) {
+		indexed.palette_map = texture(key(1, build_palette_surface(indexed.colors)));
+		indexed.npalettes = num_palettes();
+		indexed_texture_cache().put(str, indexed);
+	} else if(indexed_texture_cache().count(str) == 0) {
+		indexed_texture_cache().put(str, indexed);
+	}
+
+	*palette_map = indexed.palette_map;
+	return indexed.entry.t;
+}
+
 texture texture::get_no_cache(const key& surfs)
 {
 	return texture(surfs);
@@ -686,7 +751,7 @@ void on_image_file_updated(std::string path)
 void texture::clear_modified_files_from_cache()
 {
 	static int prev_nitems = 0;
-	const int nitems = texture_cache().size() + algorithm_texture_cache().size() + palette_texture_cache().size();
+	const int nitems = texture_cache().size() + algorithm_texture_cache().size() + palette_texture_cache().size() + indexed_texture_cache().size();
 
 	if(prev_nitems == nitems && files_updated.empty()) {
 		return;
@@ -781,6 +846,35 @@ void texture::clear_modified_files_from_cache()
 			}
 		}
 	}
+	foreach(const std::string& k, indexed_texture_cache().get_keys()) {
+		const IndexedCacheEntry old_entry = indexed_texture_cache().get(k);
+		const std::string& path = old_entry.entry.path;
+		if(listening_for_files.count(path) == 0) {
+			sys::notify_on_file_modification(path, boost::bind(on_image_file_updated, path));
+			listening_for_files.insert(path);
+		}
+
+		if(files_updated.count(path)) {
+			std::cerr << "IMAGE UPDATED: " << k << " " << path << "\n";
+
+			try {
+				indexed_texture_cache().erase(k);
+				texture new_palette_map;
+				texture new_texture = get_palette_indexed(k, &new_palette_map);
+				foreach(texture* t, texture_registry()) {
+					if(old_entry.entry.t.valid() && t->id_ == old_entry.entry.t.id_) {
+						*t = new_texture;
+					} else if(old_entry.palette_map.valid() && t->id_ == old_entry.palette_map.id_) {
+						*t = new_palette_map;
+					}
+				}
+			} catch(graphics::load_image_error&) {
+				indexed_texture_cache().put(k, old_entry);
+				error_paths.insert(path);
+			}
+		}
+	}
+
 	std::cerr << "END FILES UPDATED: " << files_updated.size() << "\n";
 
 	files_updated = error_paths;
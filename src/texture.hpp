@@ -75,6 +75,12 @@ public:
 	static texture get(const std::string& str, int options=0);
 	static texture get(const std::string& str, const std::string& algorithm);
 	static texture get_palette_mapped(const std::string& str, int palette);
+
+	//gets the image stored as palette indexes, for drawing with a palette
+	//applied by a shader, and sets palette_map to its lookup texture.
+	//Returns an invalid texture if the image or the texture settings
+	//don't allow it.
+	static texture get_palette_indexed(const std::string& str, texture* palette_map);
 	static texture get_no_cache(const surface& surf);
 	static GLfloat get_coord_x(GLfloat x);
 	static GLfloat get_coord_y(GLfloat y);
@@ -19,16 +19,43 @@
 #include <iostream>
 #include <vector>
 
+#include "reference_counted_object.hpp"
 #include "thread.hpp"
+#include "thread_local.hpp"
 
 namespace {
 
 std::vector<SDL_Thread*> detached_threads;
 
+THREAD_LOCAL std::vector<boost::function<void()> >* exit_handlers = NULL;
+
+void run_exit_handlers()
+{
+	//handlers may register more handlers as they free things.
+	while(exit_handlers != NULL) {
+		boost::scoped_ptr<std::vector<boost::function<void()> > > handlers(exit_handlers);
+		exit_handlers = NULL;
+		for(int n = handlers->size() - 1; n >= 0; --n) {
+			(*handlers)[n]();
+		}
+	}
+}
+
 }
 
 namespace threading {
 
+bool g_atomic_refcounts = false;
+
+void at_thread_exit(boost::function<void()> fn)
+{
+	if(exit_handlers == NULL) {
+		exit_handlers = new std::vector<boost::function<void()> >;
+	}
+
+	exit_handlers->push_back(fn);
+}
+
 manager::~manager()
 {
 	for(std::vector<SDL_Thread*>::iterator i = detached_threads.begin(); i != detached_threads.end(); ++i) {
@@ -42,6 +69,7 @@ int call_boost_function(void* arg)
 {
 	boost::scoped_ptr<boost::function<void()> > fn((boost::function<void()>*)arg);
 	(*fn)();
+	run_exit_handlers();
 	return 0;
 }
 
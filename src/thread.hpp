@@ -21,6 +21,7 @@
 
 #include <list>
 
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/smart_ptr.hpp>
@@ -189,6 +190,26 @@ private:
 	SDL_cond* const cond_;
 };
 
+//calls 'fn' when the calling thread finishes, if it was started by a
+//thread object. Used to free state kept for each thread.
+void at_thread_exit(boost::function<void()> fn);
+
+template<typename T>
+void delete_thread_local(T** p)
+{
+	T* obj = *p;
+	*p = NULL;
+	delete obj;
+}
+
+//deletes the object '*p' points to, and clears '*p', when the calling
+//thread finishes. 'p' should point to a thread local variable.
+template<typename T>
+void delete_at_thread_exit(T** p)
+{
+	at_thread_exit(boost::bind(delete_thread_local<T>, p));
+}
+
 //class which defines an interface for waiting on an asynchronous operation
 class waiter {
 public:
@@ -36,6 +36,11 @@ TestMap& get_test_map()
 	return map;
 }
 
+std::set<std::string>& get_video_tests() {
+	static std::set<std::string> tests;
+	return tests;
+}
+
 typedef std::map<std::string, BenchmarkTest> BenchmarkMap;
 BenchmarkMap& get_benchmark_map()
 {
@@ -64,9 +69,12 @@ std::set<std::string>& get_command_line_utilities() {
 
 }
 
-int register_test(const std::string& name, UnitTest test)
+int register_test(const std::string& name, UnitTest test, bool needs_video)
 {
 	get_test_map()[name] = test;
+	if(needs_video) {
+		get_video_tests().insert(name);
+	}
 	return 0;
 }
 
@@ -90,7 +98,9 @@ bool run_tests(const std::vector<std::string>* tests)
 	std::vector<std::string> all_tests;
 	if(!tests) {
 		for(TestMap::const_iterator i = get_test_map().begin(); i != get_test_map().end(); ++i) {
-			all_tests.push_back(i->first);
+			if(get_video_tests().count(i->first) == 0) {
+				all_tests.push_back(i->first);
+			}
 		}
 
 		tests = &all_tests;
@@ -124,6 +134,16 @@ bool run_tests(const std::vector<std::string>* tests)
 	}
 }
 
+bool run_video_tests()
+{
+	const std::vector<std::string> tests(get_video_tests().begin(), get_video_tests().end());
+	if(tests.empty()) {
+		return true;
+	}
+
+	return run_tests(&tests);
+}
+
 int register_benchmark(const std::string& name, BenchmarkTest test)
 {
 	get_benchmark_map()[name] = test;
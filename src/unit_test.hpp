@@ -33,12 +33,17 @@ typedef boost::function<void (int)> BenchmarkTest;
 typedef boost::function<void (int, const std::string&)> CommandLineBenchmarkTest;
 typedef boost::function<void (const std::vector<std::string>&)> UtilityProgram;
 
-int register_test(const std::string& name, UnitTest test);
+int register_test(const std::string& name, UnitTest test, bool needs_video=false);
 int register_benchmark(const std::string& name, BenchmarkTest test);
 int register_benchmark_cl(const std::string& name, CommandLineBenchmarkTest test);
 int register_utility(const std::string& name, UtilityProgram utility, bool needs_video);
 bool utility_needs_video(const std::string& name);
+//runs the given tests, or if none are given, every test which doesn't
+//need video.
 bool run_tests(const std::vector<std::string>* tests=NULL);
+
+//runs the tests which need video, once video and the game's data are set up.
+bool run_video_tests();
 void run_benchmarks(const std::vector<std::string>* benchmarks=NULL);
 void run_command_line_benchmark(const std::string& benchmark_name, const std::string& arg);
 void run_utility(const std::string& utility_name, const std::vector<std::string>& arg);
@@ -64,6 +69,9 @@ std::string run_benchmark(const std::string& name, BenchmarkTest fn);
 #define UNIT_TEST(name) \
 	void TEST_##name()
 
+#define VIDEO_UNIT_TEST(name) \
+	void TEST_##name()
+
 #define BENCHMARK(name) \
 	void BENCHMARK_##name(int benchmark_iterations)
 
@@ -88,6 +96,13 @@ std::string run_benchmark(const std::string& name, BenchmarkTest fn);
 	static int TEST_VAR_##name = test::register_test(#name, TEST_##name); \
 	void TEST_##name()
 
+//a unit test which needs textures, and so is run after video is set up
+//rather than at startup.
+#define VIDEO_UNIT_TEST(name) \
+	void TEST_##name(); \
+	static int TEST_VAR_##name = test::register_test(#name, TEST_##name, true); \
+	void TEST_##name()
+
 #define BENCHMARK(name) \
 	void BENCHMARK_##name(int benchmark_iterations); \
 	static int BENCHMARK_VAR_##name = test::register_benchmark(#name, BENCHMARK_##name); \
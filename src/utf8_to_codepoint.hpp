@@ -51,7 +51,8 @@ namespace utils
 			{
 				char32_t codepoint = 0;
 				std::string::const_iterator it(it_);
-				auto c = *it++;
+				// unsigned, so the arithmetic below works where char is signed.
+				uint8_t c = *it++;
 				if(c & utf8_bitmask_1) {
 					if(c & utf8_bitmask_3) {
 						if(c & utf8_bitmask_4) {
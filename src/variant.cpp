@@ -35,6 +35,8 @@
 #include "formula_object.hpp"
 
 #include "i18n.hpp"
+#include "thread.hpp"
+#include "thread_local.hpp"
 #include "unit_test.hpp"
 #include "variant.hpp"
 #include "variant_type.hpp"
@@ -60,43 +62,69 @@ variant::TYPE variant::string_to_type(const std::string& str) {
 }
 
 namespace {
-std::set<variant*> callable_variants_loading, delayed_variants_loading;
+//state kept between calls while evaluating FFL. Each thread has its own
+//so that several threads may evaluate FFL at once, such as a server
+//processing games in parallel. Created on first use and never freed.
+struct thread_state {
+	std::set<variant*> callable_variants_loading, delayed_variants_loading;
 
-std::vector<CallStackEntry> call_stack;
+	std::vector<CallStackEntry> call_stack;
+
+	variant last_failed_query_map, last_failed_query_key;
+	variant last_query_map;
+};
+
+THREAD_LOCAL thread_state* current_thread_state;
+
+thread_state& get_thread_state()
+{
+	if(current_thread_state == NULL) {
+		current_thread_state = new thread_state;
+		threading::delete_at_thread_exit(&current_thread_state);
+	}
+
+	return *current_thread_state;
+}
+
+std::set<variant*>& callable_variants_loading() { return get_thread_state().callable_variants_loading; }
+std::set<variant*>& delayed_variants_loading() { return get_thread_state().delayed_variants_loading; }
+std::vector<CallStackEntry>& call_stack() { return get_thread_state().call_stack; }
+variant& last_failed_query_map() { return get_thread_state().last_failed_query_map; }
+variant& last_failed_query_key() { return get_thread_state().last_failed_query_key; }
+variant& last_query_map() { return get_thread_state().last_query_map; }
 
-variant last_failed_query_map, last_failed_query_key;
-variant last_query_map;
 variant UnfoundInMapNullVariant;
 }
 
 void init_call_stack(int min_size)
 {
-	call_stack.reserve(min_size);
+	call_stack().reserve(min_size);
 }
 
 void swap_variants_loading(std::set<variant*>& v)
 {
-	callable_variants_loading.swap(v);
+	callable_variants_loading().swap(v);
 }
 
 void push_call_stack(const game_logic::formula_expression* frame, const game_logic::formula_callable* callable)
 {
-	call_stack.resize(call_stack.size()+1);
-	call_stack.back().expression = frame;
-	call_stack.back().callable = callable;
-	ASSERT_LOG(call_stack.size() < 4096, "FFL Recursion too deep (Exceeds 4096 frames)");
+	std::vector<CallStackEntry>& stack = call_stack();
+	stack.resize(stack.size()+1);
+	stack.back().expression = frame;
+	stack.back().callable = callable;
+	ASSERT_LOG(stack.size() < 4096, "FFL Recursion too deep (Exceeds 4096 frames)");
 }
 
 void pop_call_stack()
 {
-	call_stack.pop_back();
+	call_stack().pop_back();
 }
 
 std::string get_call_stack()
 {
 	variant current_frame;
 	std::string res;
-	std::vector<CallStackEntry> reversed_call_stack = call_stack;
+	std::vector<CallStackEntry> reversed_call_stack = call_stack();
 	std::reverse(reversed_call_stack.begin(), reversed_call_stack.end());
 	for(std::vector<CallStackEntry>::const_iterator i = reversed_call_stack.begin(); i != reversed_call_stack.end(); ++i) {
 		const game_logic::formula_expression* p = i->expression;
@@ -116,18 +144,18 @@ std::string get_call_stack()
 
 const std::vector<CallStackEntry>& get_expression_call_stack()
 {
-	return call_stack;
+	return call_stack();
 }
 
 std::string get_full_call_stack()
 {
 	std::string res;
-	for(std::vector<CallStackEntry>::const_iterator i = call_stack.begin();
-	    i != call_stack.end(); ++i) {
+	for(std::vector<CallStackEntry>::const_iterator i = call_stack().begin();
+	    i != call_stack().end(); ++i) {
 		if(!i->expression) {
 			continue;
 		}
-		res += formatter() << "  FRAME " << (i - call_stack.begin()) << ": " << i->expression->str() << "\n";
+		res += formatter() << "  FRAME " << (i - call_stack().begin()) << ": " << i->expression->str() << "\n";
 	}
 	return res;
 }
@@ -137,8 +165,8 @@ std::string output_formula_error_info();
 namespace {
 void generate_error(std::string message)
 {
-	if(call_stack.empty() == false && call_stack.back().expression) {
-		message += "\n" + call_stack.back().expression->debug_pinpoint_location();
+	if(call_stack().empty() == false && call_stack().back().expression) {
+		message += "\n" + call_stack().back().expression->debug_pinpoint_location();
 	}
 
 	std::ostringstream s;
@@ -151,8 +179,8 @@ void generate_error(std::string message)
 }
 
 type_error::type_error(const std::string& str) : message(str) {
-	if(call_stack.empty() == false && call_stack.back().expression) {
-		message += "\n" + call_stack.back().expression->debug_pinpoint_location();
+	if(call_stack().empty() == false && call_stack().back().expression) {
+		message += "\n" + call_stack().back().expression->debug_pinpoint_location();
 	}
 
 	std::cerr << "ERROR: " << message << "\n" << get_call_stack();
@@ -193,7 +221,7 @@ struct variant_list {
 	boost::intrusive_ptr<const game_logic::formula_expression> expression;
 	std::vector<variant> elements;
 	std::vector<variant>::iterator begin, end;
-	int refcount;
+	refcount_int refcount;
 	variant_list* storage;
 };
 
@@ -206,7 +234,7 @@ struct variant_string {
 	variant_string(const variant_string& o) : str(o.str), translated_from(o.translated_from), refcount(1)
 	{}
 	std::string str, translated_from;
-	int refcount;
+	refcount_int refcount;
 
 	std::vector<const game_logic::formula*> formulae_using_this;
 
@@ -224,7 +252,7 @@ struct variant_map {
 	{}
 
 	std::map<variant,variant> elements;
-	int refcount;
+	refcount_int refcount;
 	int modcount;
 private:
 	void operator=(const variant_map&);
@@ -245,7 +273,7 @@ struct variant_fn {
 	std::vector<variant> bound_args;
 
 	int base_slot;
-	int refcount;
+	refcount_int refcount;
 };
 
 struct variant_generic_fn {
@@ -267,14 +295,14 @@ struct variant_generic_fn {
 	mutable std::map<std::vector<std::string>, variant> cache;
 
 	int base_slot;
-	int refcount;
+	refcount_int refcount;
 };
 
 struct variant_multi_fn {
 	variant_multi_fn() : refcount(0)
 	{}
 
-	int refcount;
+	refcount_int refcount;
 
 	std::vector<variant> functions;
 };
@@ -301,7 +329,7 @@ game_logic::const_formula_callable_ptr callable;
 bool has_result;
 variant result;
 
-int refcount;
+refcount_int refcount;
 };
 
 void variant::increment_refcount()
@@ -320,7 +348,7 @@ case VARIANT_TYPE_CALLABLE:
 intrusive_ptr_add_ref(callable_);
 break;
 case VARIANT_TYPE_CALLABLE_LOADING:
-callable_variants_loading.insert(this);
+callable_variants_loading().insert(this);
 break;
 case VARIANT_TYPE_FUNCTION:
 ++fn_->refcount;
@@ -332,7 +360,7 @@ case VARIANT_TYPE_MULTI_FUNCTION:
 ++multi_fn_->refcount;
 break;
 case VARIANT_TYPE_DELAYED:
-delayed_variants_loading.insert(this);
+delayed_variants_loading().insert(this);
 ++delayed_->refcount;
 break;
 
@@ -368,7 +396,7 @@ case VARIANT_TYPE_CALLABLE:
 intrusive_ptr_release(callable_);
 break;
 case VARIANT_TYPE_CALLABLE_LOADING:
-callable_variants_loading.erase(this);
+callable_variants_loading().erase(this);
 break;
 case VARIANT_TYPE_FUNCTION:
 if(--fn_->refcount == 0) {
@@ -386,7 +414,7 @@ if(--multi_fn_->refcount == 0) {
 }
 break;
 case VARIANT_TYPE_DELAYED:
-delayed_variants_loading.erase(this);
+delayed_variants_loading().erase(this);
 if(--delayed_->refcount == 0) {
 	delete delayed_;
 }
@@ -484,14 +512,14 @@ variant variant::create_delayed(game_logic::const_formula_ptr f, game_logic::con
 
 void variant::resolve_delayed()
 {
-	std::set<variant*> items = delayed_variants_loading;
+	std::set<variant*> items = delayed_variants_loading();
 	foreach(variant* v, items) {
 		v->delayed_->calculate_result();
 		variant res = v->delayed_->result;
 		*v = res;
 	}
 
-	delayed_variants_loading.clear();
+	delayed_variants_loading().clear();
 }
 
 variant variant::create_function_overload(const std::vector<variant>& fn)
@@ -689,13 +717,13 @@ const variant& variant::operator[](const variant v) const
 		std::map<variant,variant>::const_iterator i = map_->elements.find(v);
 		if (i == map_->elements.end())
 		{
-			last_failed_query_map = *this;
-			last_failed_query_key = v;
+			last_failed_query_map() = *this;
+			last_failed_query_key() = v;
 
 			return UnfoundInMapNullVariant;
 		}
 
-		last_query_map = *this;
+		last_query_map() = *this;
 		return i->second;
 	} else if(type_ == VARIANT_TYPE_LIST) {
 		return operator[](v.as_int());
@@ -1190,7 +1218,7 @@ bool variant::is_unmodified_single_reference() const
 
 variant variant::add_attr(variant key, variant value)
 {
-	last_query_map = variant();
+	last_query_map() = variant();
 
 	if(is_map()) {
 		if(map_->refcount > 1) {
@@ -1209,7 +1237,7 @@ variant variant::add_attr(variant key, variant value)
 
 variant variant::remove_attr(variant key)
 {
-	last_query_map = variant();
+	last_query_map() = variant();
 
 	if(is_map()) {
 		if(map_->refcount > 1) {
@@ -1798,34 +1826,34 @@ bool variant::operator>(const variant& v) const
 void variant::throw_type_error(variant::TYPE t) const
 {
 	if(this == &UnfoundInMapNullVariant) {
-		const debug_info* info = last_failed_query_map.get_debug_info();
+		const debug_info* info = last_failed_query_map().get_debug_info();
 		if(info) {
-			generate_error(formatter() << "In object at " << *info->filename << " " << info->line << " (column " << info->column << ") did not find attribute " << last_failed_query_key << " which was expected to be a " << variant_type_to_string(t));
-		} else if(last_failed_query_map.get_source_expression()) {
-			generate_error(formatter() << "Map object generated in FFL was expected to have key '" << last_failed_query_key << "' of type " << variant_type_to_string(t) << " but this key wasn't found. The map was generated by this expression:\n" << last_failed_query_map.get_source_expression()->debug_pinpoint_location());
+			generate_error(formatter() << "In object at " << *info->filename << " " << info->line << " (column " << info->column << ") did not find attribute " << last_failed_query_key() << " which was expected to be a " << variant_type_to_string(t));
+		} else if(last_failed_query_map().get_source_expression()) {
+			generate_error(formatter() << "Map object generated in FFL was expected to have key '" << last_failed_query_key() << "' of type " << variant_type_to_string(t) << " but this key wasn't found. The map was generated by this expression:\n" << last_failed_query_map().get_source_expression()->debug_pinpoint_location());
 		}
 	}
 
-	if(last_query_map.is_map() && last_query_map.get_debug_info()) {
-		for(std::map<variant,variant>::const_iterator i = last_query_map.map_->elements.begin(); i != last_query_map.map_->elements.end(); ++i) {
+	if(last_query_map().is_map() && last_query_map().get_debug_info()) {
+		for(std::map<variant,variant>::const_iterator i = last_query_map().map_->elements.begin(); i != last_query_map().map_->elements.end(); ++i) {
 			if(this == &i->second) {
 				const debug_info* info = i->first.get_debug_info();
 				if(info == NULL) {
-					info = last_query_map.get_debug_info();
+					info = last_query_map().get_debug_info();
 				}
 				generate_error(formatter() << "In object at " << *info->filename << " " << info->line << " (column " << info->column << ") attribute for " << i->first << " was " << *this << ", which is a " << variant_type_to_string(type_) << ", must be a " << variant_type_to_string(t));
 				
 			}
 		}
-	} else if(last_query_map.is_map() && last_query_map.get_source_expression()) {
-		for(std::map<variant,variant>::const_iterator i = last_query_map.map_->elements.begin(); i != last_query_map.map_->elements.end(); ++i) {
+	} else if(last_query_map().is_map() && last_query_map().get_source_expression()) {
+		for(std::map<variant,variant>::const_iterator i = last_query_map().map_->elements.begin(); i != last_query_map().map_->elements.end(); ++i) {
 			if(this == &i->second) {
 				std::ostringstream expression;
-				if(last_failed_query_map.get_source_expression()) {
-					expression << " The map was generated by this expression:\n" << last_failed_query_map.get_source_expression()->debug_pinpoint_location();
+				if(last_failed_query_map().get_source_expression()) {
+					expression << " The map was generated by this expression:\n" << last_failed_query_map().get_source_expression()->debug_pinpoint_location();
 				}
 
-				generate_error(formatter() << "Map object generated in FFL was expected to have key '" << last_failed_query_key << "' of type " << variant_type_to_string(t) << " but this key was of type " << variant_type_to_string(i->second.type_) << " instead." << expression.str());
+				generate_error(formatter() << "Map object generated in FFL was expected to have key '" << last_failed_query_key() << "' of type " << variant_type_to_string(t) << " but this key was of type " << variant_type_to_string(i->second.type_) << " instead." << expression.str());
 			}
 		}
 	}
@@ -29,6 +29,7 @@
 #include "json_parser.hpp"
 #include "module.hpp"
 #include "string_utils.hpp"
+#include "thread_local.hpp"
 #include "unit_test.hpp"
 #include "variant_type.hpp"
 #include "voxel_object.hpp"
@@ -1855,6 +1856,84 @@ bool variant_types_might_match(variant_type_ptr to, variant_type_ptr from)
 	return to->is_compatible(from) || from->is_compatible(to) || from->maybe_convertible_to(to);
 }
 
+namespace {
+THREAD_LOCAL const write_type_proof* g_write_proof = NULL;
+THREAD_LOCAL const variant* g_write_proof_value = NULL;
+
+std::vector<type_check_counter*>& type_check_counters()
+{
+	static std::vector<type_check_counter*> instance;
+	return instance;
+}
+}
+
+write_type_proof::write_type_proof(variant_type_ptr value_type)
+  : value_type_(value_type)
+{
+	//a value of type any proves nothing, so don't bother checking it
+	//against every target.
+	if(value_type_ && value_type_->is_any()) {
+		value_type_.reset();
+	}
+}
+
+bool write_type_proof::proves(const variant_type_ptr& target) const
+{
+	if(!value_type_ || !target) {
+		return false;
+	}
+
+	if(proven_target_ == target) {
+		return true;
+	}
+
+	if(variant_types_compatible(target, value_type_)) {
+		proven_target_ = target;
+		return true;
+	}
+
+	return false;
+}
+
+write_type_proof_scope::write_type_proof_scope(const write_type_proof& proof, const variant& value)
+  : old_proof_(g_write_proof), old_value_(g_write_proof_value)
+{
+	g_write_proof = &proof;
+	g_write_proof_value = &value;
+}
+
+write_type_proof_scope::~write_type_proof_scope()
+{
+	g_write_proof = old_proof_;
+	g_write_proof_value = old_value_;
+}
+
+bool write_type_proven(const variant& value, const variant_type_ptr& target)
+{
+	return g_write_proof_value == &value && g_write_proof->proves(target);
+}
+
+type_check_counter::type_check_counter(const char* module)
+  : module(module), checked(0), proven(0)
+{
+	type_check_counters().push_back(this);
+}
+
+std::string type_check_report()
+{
+	std::ostringstream s;
+	foreach(const type_check_counter* c, type_check_counters()) {
+		const int total = c->checked + c->proven;
+		s << c->module << ": " << c->proven << " of " << total << " property write type checks proven statically";
+#ifdef FFL_ELIDE_PROVEN_TYPE_CHECKS
+		s << " and elided";
+#endif
+		s << "\n";
+	}
+
+	return s.str();
+}
+
 bool parse_variant_constant(const variant& original_str,
                                const formula_tokenizer::token*& i1,
                                const formula_tokenizer::token* i2,
@@ -2663,3 +2742,23 @@ UNIT_TEST(variant_type) {
 
 #undef TYPES_COMPAT	
 }
+
+UNIT_TEST(write_type_proof) {
+	const write_type_proof int_proof(parse_variant_type(variant("int")));
+	const write_type_proof any_proof(parse_variant_type(variant("any")));
+	const variant_type_ptr int_or_null = parse_variant_type(variant("int|null"));
+	const variant_type_ptr str = parse_variant_type(variant("string"));
+
+	CHECK_EQ(int_proof.proves(int_or_null), true);
+	CHECK_EQ(int_proof.proves(str), false);
+	CHECK_EQ(any_proof.proves(int_or_null), false);
+
+	const variant value(5), other(5);
+	CHECK_EQ(write_type_proven(value, int_or_null), false);
+	{
+		const write_type_proof_scope scope(int_proof, value);
+		CHECK_EQ(write_type_proven(value, int_or_null), true);
+		CHECK_EQ(write_type_proven(other, int_or_null), false);
+	}
+	CHECK_EQ(write_type_proven(value, int_or_null), false);
+}
@@ -141,6 +141,65 @@ std::string variant_type_is_class_or_null(variant_type_ptr type);
 bool variant_types_compatible(variant_type_ptr to, variant_type_ptr from, std::ostringstream* why=NULL);
 bool variant_types_might_match(variant_type_ptr to, variant_type_ptr from);
 
+//The static type of a value being written by an assignment command. A
+//property write which is handed one of these can skip its runtime type
+//check if the static type is compatible with the property's type. The
+//last type proven against is remembered, so repeated writes from the same
+//place in a formula to the same kind of property cost a pointer compare.
+class write_type_proof
+{
+public:
+	explicit write_type_proof(variant_type_ptr value_type=variant_type_ptr());
+	bool proves(const variant_type_ptr& target) const;
+private:
+	variant_type_ptr value_type_;
+	mutable variant_type_ptr proven_target_;
+};
+
+//Makes a proof available to the property write of 'value' performed while
+//the scope is live. Writes of any other value, such as those made by a
+//setter, don't see it.
+class write_type_proof_scope
+{
+public:
+	write_type_proof_scope(const write_type_proof& proof, const variant& value);
+	~write_type_proof_scope();
+private:
+	const write_type_proof* old_proof_;
+	const variant* old_value_;
+};
+
+//true if the write of 'value' now being performed was proven statically
+//to be compatible with 'target'.
+bool write_type_proven(const variant& value, const variant_type_ptr& target);
+
+//Counts, per module, the property write type checks which were run and
+//those which were proven unnecessary. With FFL_ELIDE_PROVEN_TYPE_CHECKS
+//defined the proven ones are skipped; otherwise they are still run and
+//the count shows what the build mode would save.
+struct type_check_counter
+{
+	explicit type_check_counter(const char* module);
+
+	//records a check, returning false if it can be skipped.
+	bool need_check(bool is_proven) {
+		if(is_proven) {
+			++proven;
+#ifdef FFL_ELIDE_PROVEN_TYPE_CHECKS
+			return false;
+#endif
+		} else {
+			++checked;
+		}
+		return true;
+	}
+
+	const char* module;
+	int checked, proven;
+};
+
+std::string type_check_report();
+
 variant_type_ptr parse_variant_type(const variant& original_str,
                                     const formula_tokenizer::token*& i1,
                                     const formula_tokenizer::token* i2,
@@ -18,6 +18,7 @@
 
 #include "asserts.hpp"
 #include "font.hpp"
+#include "glyph_atlas.hpp"
 #include "i18n.hpp"
 #include "raster.hpp"
 #include "string_utils.hpp"
@@ -30,7 +31,8 @@ vector_text::vector_text(const variant& node)
 	visible_(node["visible"].as_bool(true)),
 	size_(node["size"].as_int(12)),
 	font_(node["font"].as_string_default()),
-	align_(ALIGN_LEFT)
+	align_(ALIGN_LEFT),
+	queue_epoch_(-1)
 {
 	std::vector<int> r = node["rect"].as_list_int();
 	draw_area_ = rect(r[0], r[1], r[2], r[3]);
@@ -59,14 +61,42 @@ vector_text::vector_text(const variant& node)
 
 void vector_text::handle_draw() const
 {
-	foreach(const offset_texture& tex, textures_) {
-		graphics::blit_texture(tex.first, x() + tex.second.x, y() + tex.second.y);
+	font::glyph_atlas& atlas = font::glyph_atlas::get(size_, font_);
+	if(queue_.empty() || queue_epoch_ != atlas.epoch() || queue_pos_ != point(x(), y())) {
+		queue_.clear();
+		foreach(const offset_line& line, lines_) {
+			if(!atlas.layout(line.first, x() + line.second.x, y() + line.second.y, &queue_)) {
+				queue_.clear();
+				break;
+			}
+		}
+
+		queue_epoch_ = atlas.epoch();
+		queue_pos_ = point(x(), y());
 	}
+
+	if(queue_.empty()) {
+		//the text doesn't fit in the atlas, or has nothing to draw.
+		foreach(const offset_line& line, lines_) {
+			graphics::blit_texture(font::render_text(line.first, color_, size_, font_), x() + line.second.x, y() + line.second.y);
+		}
+		return;
+	}
+
+	atlas.prepare_draw();
+	queue_.set_texture(atlas.texture_id());
+
+	glColor4ub(color_.r, color_.g, color_.b, 255);
+	queue_.do_blit();
+	glColor4ub(255, 255, 255, 255);
 }
 
 void vector_text::recalculate_texture()
 {
-	textures_.clear();
+	lines_.clear();
+	queue_.clear();
+
+	font::glyph_atlas& atlas = font::glyph_atlas::get(size_, font_);
 
 	size_t tex_y = 0;
 	int letter_size = font::char_width(size(), font_);
@@ -94,15 +124,16 @@ void vector_text::recalculate_texture()
 
 	foreach(const std::string line, lines) {
 		if(tex_y < height()) {
-			graphics::texture tex = font::render_text(line, color_, size_, font_);
+			rect area;
+			atlas.layout(line, 0, 0, NULL, &area);
 			if(align_ == ALIGN_LEFT) {
-				textures_.push_back(offset_texture(tex, point(0,tex_y)));
+				lines_.push_back(offset_line(line, point(0,tex_y)));
 			} else if(align_ == ALIGN_CENTER) {
-				textures_.push_back(offset_texture(tex, point((width() - tex.width())/2,tex_y)));
+				lines_.push_back(offset_line(line, point((width() - area.w())/2,tex_y)));
 			} else {
-				textures_.push_back(offset_texture(tex, point(width() - tex.width(),tex_y)));
+				lines_.push_back(offset_line(line, point(width() - area.w(),tex_y)));
 			}
-			tex_y += tex.height();
+			tex_y += atlas.line_height();
 		} else {
 			std::cerr << "vector_text::recalculate_texture(): Ignored line: \"" 
 				<< line << "\" line is outside the maximum area" << std::endl;
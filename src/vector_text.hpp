@@ -24,12 +24,12 @@
 #include "formula_callable.hpp"
 #include "geometry.hpp"
 #include "graphics.hpp"
-#include "texture.hpp"
+#include "raster.hpp"
 #include "variant.hpp"
 
 namespace gui {
 
-typedef std::pair<graphics::texture, point> offset_texture;
+typedef std::pair<std::string, point> offset_line;
 
 class vector_text : public game_logic::formula_callable
 {
@@ -68,12 +68,18 @@ private:
 
 	bool visible_;
 	int size_;
-	std::vector<offset_texture> textures_;
+	std::vector<offset_line> lines_;
 	std::string text_;
 	std::string font_;
 	SDL_Color color_;
 	rect draw_area_;
 	TEXT_ALIGNMENT align_;
+
+	//the lines laid out as quads in the font's glyph atlas. Rebuilt when
+	//the text moves or the atlas evicts glyphs.
+	mutable graphics::blit_queue queue_;
+	mutable int queue_epoch_;
+	mutable point queue_pos_;
 };
 
 typedef boost::intrusive_ptr<vector_text> vector_text_ptr;
@@ -25,6 +25,7 @@
 
 #include "graphics.hpp"
 #include "json_parser.hpp"
+#include "shaders.hpp"
 #include "variant_utils.hpp"
 #include "voxel_model.hpp"
 
@@ -60,6 +61,50 @@ namespace
 		}
 		return res;
 	}
+
+	//the locations used by the program voxel models were last drawn with.
+	//Uniforms of one of our programs are set through it, so it knows the
+	//values they hold.
+	struct voxel_program_info
+	{
+		voxel_program_info() : id(0), u_mvp(-1), u_normal(-1), a_position(-1), a_color(-1)
+		{}
+		GLint id;
+		gles2::program_ptr program;
+		gles2::actives_map_iterator mvp, normal;
+		GLint u_mvp, u_normal, a_position, a_color;
+	};
+
+	const voxel_program_info& get_voxel_program(GLint id)
+	{
+		static voxel_program_info info;
+		if(info.id == id) {
+			return info;
+		}
+
+		info = voxel_program_info();
+		info.id = id;
+		for(auto p : gles2::program::get_shaders()) {
+			if(p.second->get() == id) {
+				info.program = p.second;
+				break;
+			}
+		}
+
+		info.u_mvp = glGetUniformLocation(id, "mvp_matrix");
+		info.u_normal = glGetUniformLocation(id, "u_normal");
+		info.a_position = glGetAttribLocation(id, "a_position");
+		info.a_color = glGetAttribLocation(id, "a_color");
+		if(info.program) {
+			if(info.u_mvp != -1) {
+				info.mvp = info.program->get_uniform_reference("mvp_matrix");
+			}
+			if(info.u_normal != -1) {
+				info.normal = info.program->get_uniform_reference("u_normal");
+			}
+		}
+		return info;
+	}
 }
 
 bool operator==(VoxelPos const& p1, VoxelPos const& p2)
@@ -825,26 +870,19 @@ void voxel_model::draw(graphics::lighting_ptr lighting, camera_callable_ptr came
 		GLint cur_program;
 		glGetIntegerv(GL_CURRENT_PROGRAM, &cur_program);
 
-		static GLuint u_mvp = -1;
-		if(u_mvp == -1) {
-			u_mvp = glGetUniformLocation(cur_program, "mvp_matrix");
-		}
-		static GLuint u_normal = -1;
-		if(u_normal == -1) {
-			u_normal = glGetUniformLocation(cur_program, "u_normal");
-		}
-		static GLuint a_position = -1;
-		if(a_position == -1) {
-			a_position = glGetAttribLocation(cur_program, "a_position");
-		}
-		static GLuint a_color = -1;
-		if(a_color == -1) {
-			a_color = glGetAttribLocation(cur_program, "a_color");
-		}
+		const voxel_program_info& info = get_voxel_program(cur_program);
+		const GLuint a_position = info.a_position;
+		const GLuint a_color = info.a_color;
 
 		glm::mat4 mdl = model * model_;
 		glm::mat4 mvp = camera->projection_mat() * camera->view_mat() * mdl;
-		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+		if(info.u_mvp != -1) {
+			if(info.program) {
+				info.program->set_uniform(info.mvp, 1, glm::value_ptr(mvp));
+			} else {
+				glUniformMatrix4fv(info.u_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+			}
+		}
 
 		if(lighting) {
 			lighting->set_modelview_matrix(mdl, camera->view_mat());
@@ -854,8 +892,12 @@ void voxel_model::draw(graphics::lighting_ptr lighting, camera_callable_ptr came
 		glEnableVertexAttribArray(a_position);
 		glEnableVertexAttribArray(a_color);
 		for(int n = FACE_LEFT; n != MAX_FACES; ++n) {
-			if(u_normal != -1) {
-				glUniform3fv(u_normal, 1, glm::value_ptr(normal_vectors()[n]));
+			if(info.u_normal != -1) {
+				if(info.program) {
+					info.program->set_uniform(info.normal, 1, glm::value_ptr(normal_vectors()[n]));
+				} else {
+					glUniform3fv(info.u_normal, 1, glm::value_ptr(normal_vectors()[n]));
+				}
 			}
 			glVertexAttribPointer(a_position, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const GLfloat*>(vattrib_offsets_[n]));
 			glVertexAttribPointer(a_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, reinterpret_cast<const GLfloat*>(cattrib_offsets_[n]));
@@ -23,6 +23,7 @@
 #include "tooltip.hpp"
 #include "i18n.hpp"
 #include "widget.hpp"
+#include "widget_render_cache.hpp"
 #include "widget_settings_dialog.hpp"
 #include "iphone_controls.hpp"
 
@@ -30,6 +31,15 @@
 
 namespace gui {
 
+namespace {
+unsigned int change_counter = 0;
+
+void hash_render_state(unsigned int* h, unsigned int value)
+{
+	*h ^= value + 0x9e3779b9 + (*h << 6) + (*h >> 2);
+}
+}
+
 widget::widget() 
 	: x_(0), y_(0), w_(0), h_(0), align_h_(HALIGN_LEFT), align_v_(VALIGN_TOP),
 	true_x_(0), true_y_(0), disabled_(false), disabled_opacity_(127),
@@ -37,7 +47,8 @@ widget::widget()
 	tooltip_display_delay_(0), tooltip_ticks_(INT_MAX), resolution_(0),
 	display_alpha_(256), pad_h_(0), pad_w_(0), claim_mouse_events_(true),
 	draw_with_object_shader_(true), tooltip_fontsize_(18),
-	swallow_all_events_(false), tab_stop_(0), has_focus_(false)
+	swallow_all_events_(false), tab_stop_(0), has_focus_(false),
+	changed_at_(++change_counter)
 	{
 		tooltip_color_.r = tooltip_color_.g = tooltip_color_.b = tooltip_color_.a = 255;
 	}
@@ -50,7 +61,8 @@ widget::widget(const variant& v, game_logic::formula_callable* e)
 	resolution_(v["frame_size"].as_int(0)), display_alpha_(v["alpha"].as_int(256)),
 	pad_w_(0), pad_h_(0), claim_mouse_events_(v["claim_mouse_events"].as_bool(true)),
 	draw_with_object_shader_(v["draw_with_object_shader"].as_bool(true)), tooltip_fontsize_(18),
-	swallow_all_events_(false), tab_stop_(v["tab_stop"].as_int(0)), has_focus_(false)
+	swallow_all_events_(false), tab_stop_(v["tab_stop"].as_int(0)), has_focus_(false),
+	changed_at_(++change_counter)
 {
 	set_alpha(display_alpha_ < 0 ? 0 : (display_alpha_ > 256 ? 256 : display_alpha_));
 	if(v.has_key("width")) {
@@ -311,6 +323,12 @@ void widget::draw() const
 #if !defined(USE_SHADERS)
 			glGetIntegerv(GL_BLEND_SRC, &src);
 			glGetIntegerv(GL_BLEND_DST, &dst);
+#endif
+#if defined(USE_SHADERS)
+		if(widget_render_cache::rendering()) {
+			//a cached copy keeps its alpha, and its colors premultiplied.
+			glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		} else
 #endif
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		if(disabled_) {
@@ -337,6 +355,90 @@ void widget::draw() const
 	}
 }
 
+void widget::draw_cached() const
+{
+	unsigned int version = 0;
+	if(!visible_ || !render_version(&version)) {
+		render_cache_.reset();
+		if(visible_) {
+			widget_render_cache::record_uncached();
+		}
+		draw();
+		return;
+	}
+
+	if(!render_cache_) {
+		render_cache_.reset(new widget_render_cache);
+	}
+
+	const rect area = render_bounds();
+	if(!render_cache_->valid(area, version)) {
+		if(!render_cache_->begin(area)) {
+			widget_render_cache::record_uncached();
+			draw();
+			return;
+		}
+
+		draw();
+		render_cache_->end(version);
+	}
+
+	render_cache_->draw();
+}
+
+void widget::invalidate()
+{
+	changed_at_ = ++change_counter;
+}
+
+rect widget::render_bounds() const
+{
+	if(frame_set_ == NULL) {
+		return rect(x(), y(), width(), height());
+	}
+
+	const int border_w = get_pad_width() + frame_set_->corner_height();
+	const int border_h = get_pad_height() + frame_set_->corner_height();
+	return rect(x() - border_w, y() - border_h, width() + border_w*2, height() + border_h*2);
+}
+
+bool widget::render_version(unsigned int* version) const
+{
+	//widgets with a process hook may change without telling us.
+	if(!is_render_cacheable() || on_process_) {
+		return false;
+	}
+
+	hash_render_state(version, changed_at_);
+	hash_render_state(version, render_state());
+	hash_render_state(version, x_);
+	hash_render_state(version, y_);
+	hash_render_state(version, w_);
+	hash_render_state(version, h_);
+	hash_render_state(version, visible_);
+	hash_render_state(version, disabled_);
+	hash_render_state(version, disabled_opacity_);
+	hash_render_state(version, display_alpha_);
+	hash_render_state(version, pad_w_);
+	hash_render_state(version, pad_h_);
+	hash_render_state(version, static_cast<unsigned int>(reinterpret_cast<size_t>(frame_set_.get())));
+	hash_render_state(version, resolution_);
+	if(clip_area_) {
+		hash_render_state(version, clip_area_->x());
+		hash_render_state(version, clip_area_->y());
+		hash_render_state(version, clip_area_->w());
+		hash_render_state(version, clip_area_->h());
+	}
+
+	foreach(const widget_ptr& child, get_children()) {
+		if(child && !child->render_version(version)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 int widget::x() const
 {
 	return x_;
@@ -56,6 +56,7 @@ struct color_save_context
 };
 
 class widget_settings_dialog;
+class widget_render_cache;
 class dialog;
 typedef boost::intrusive_ptr<dialog> dialog_ptr;
 
@@ -68,6 +69,17 @@ public:
 	bool process_event(const SDL_Event& event, bool claimed);
 	void draw() const;
 
+	//draws the widget like draw(), but from an offscreen copy which is only
+	//redrawn when the widget or one of its children has changed. Widgets
+	//which can't be cached are drawn directly.
+	void draw_cached() const;
+
+	//marks the widget as changed, so a cached copy of it is redrawn.
+	void invalidate();
+
+	//the area everything the widget and its children draw lies within.
+	virtual rect render_bounds() const;
+
 	virtual void set_loc(int x, int y) { true_x_ = x_ = x; true_y_ = y_ = y; recalc_loc(); }
 	virtual void set_dim(int w, int h) { w_ = w; h_ = h; recalc_loc(); }
 
@@ -167,6 +179,15 @@ protected:
 
 	virtual void handle_draw() const = 0;
 
+	//true if the widget only draws differently after a call to
+	//invalidate() or a change in render_state(), so it may be drawn from
+	//a cached copy.
+	virtual bool is_render_cacheable() const { return false; }
+
+	//a summary of state which changes how the widget draws but which
+	//doesn't call invalidate() when it changes.
+	virtual unsigned int render_state() const { return 0; }
+
 private:
 DECLARE_CALLABLE(widget);
 	virtual void visit_values(game_logic::formula_callable_visitor& visitor) {}
@@ -210,6 +231,10 @@ DECLARE_CALLABLE(widget);
 	bool swallow_all_events_;
 
 	boost::shared_ptr<rect> clip_area_;
+
+	bool render_version(unsigned int* version) const;
+	unsigned int changed_at_;
+	mutable boost::shared_ptr<widget_render_cache> render_cache_;
 };
 
 // Functor to sort widgets by z-ordering.
@@ -0,0 +1,239 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "asserts.hpp"
+#include "raster.hpp"
+#include "texture.hpp"
+#include "widget_render_cache.hpp"
+
+namespace gui {
+
+namespace {
+bool is_rendering = false;
+
+//set if a copy couldn't be made, after which widgets are drawn directly.
+bool framebuffer_failed = false;
+
+int cache_draws = 0, cache_renders = 0, uncached_draws = 0;
+
+void current_color(GLfloat* color)
+{
+#if defined(USE_SHADERS)
+	memcpy(color, gles2::get_color(), sizeof(GLfloat)*4);
+#else
+	glGetFloatv(GL_CURRENT_COLOR, color);
+#endif
+}
+}
+
+widget_render_cache::widget_render_cache()
+  : framebuffer_(0), texture_(0), depth_stencil_(0),
+    texture_width_(0), texture_height_(0), version_(0), filled_(false),
+    old_framebuffer_(0)
+{
+	std::fill(color_, color_ + 4, 0.0f);
+	std::fill(old_viewport_, old_viewport_ + 4, 0);
+}
+
+widget_render_cache::~widget_render_cache()
+{
+	release();
+}
+
+void widget_render_cache::release()
+{
+#if defined(USE_SHADERS)
+	if(framebuffer_) {
+		glDeleteFramebuffers(1, &framebuffer_);
+		glDeleteRenderbuffers(1, &depth_stencil_);
+		glDeleteTextures(1, &texture_);
+	}
+#endif
+
+	framebuffer_ = texture_ = depth_stencil_ = 0;
+	texture_width_ = texture_height_ = 0;
+	filled_ = false;
+}
+
+bool widget_render_cache::valid(const rect& area, unsigned int version) const
+{
+	if(!filled_ || version != version_ || area != area_) {
+		return false;
+	}
+
+	GLfloat color[4];
+	current_color(color);
+	return std::equal(color, color + 4, color_);
+}
+
+bool widget_render_cache::begin(const rect& area)
+{
+#if defined(USE_SHADERS)
+	//drawing into the copy can't be clipped by an enclosing clip scope,
+	//whose stencil is in the screen's buffer, and copies don't nest.
+	if(is_rendering || framebuffer_failed || graphics::clip_scope::active() || area.w() <= 0 || area.h() <= 0) {
+		return false;
+	}
+
+	if(area.w() > texture_width_ || area.h() > texture_height_) {
+		release();
+
+		texture_width_ = area.w();
+		texture_height_ = area.h();
+		if(!graphics::texture::allows_npot()) {
+			texture_width_ = graphics::texture::next_power_of_2(texture_width_);
+			texture_height_ = graphics::texture::next_power_of_2(texture_height_);
+		}
+
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer_);
+
+		glGenTextures(1, &texture_);
+		graphics::texture::set_current_texture(texture_);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width_, texture_height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+		//widgets such as grids clip with the stencil buffer, so the copy
+		//needs one of its own.
+		glGenRenderbuffers(1, &depth_stencil_);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil_);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, texture_width_, texture_height_);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer_);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stencil_);
+		const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer_);
+
+		if(status != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "WIDGET RENDER CACHE: FRAMEBUFFER INCOMPLETE: " << status << "\n";
+			release();
+			framebuffer_failed = true;
+			return false;
+		}
+	}
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_framebuffer_);
+	glGetIntegerv(GL_VIEWPORT, old_viewport_);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glViewport(0, 0, texture_width_, texture_height_);
+
+	GLfloat clear_color[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+	//the top of the area is put at the top of the texture, so the copy is
+	//drawn with its texture coordinates flipped.
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadMatrixf(glm::value_ptr(glm::ortho(0.0f, GLfloat(texture_width_), GLfloat(texture_height_), 0.0f)));
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glTranslatef(-GLfloat(area.x()), -GLfloat(area.y()), 0.0f);
+
+	area_ = area;
+	filled_ = false;
+	is_rendering = true;
+	++cache_renders;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void widget_render_cache::end(unsigned int version)
+{
+	ASSERT_LOG(is_rendering, "widget_render_cache::end() CALLED WITHOUT begin()");
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+
+#if defined(USE_SHADERS)
+	glBindFramebuffer(GL_FRAMEBUFFER, old_framebuffer_);
+#endif
+	glViewport(old_viewport_[0], old_viewport_[1], old_viewport_[2], old_viewport_[3]);
+
+	version_ = version;
+	current_color(color_);
+	filled_ = true;
+	is_rendering = false;
+}
+
+void widget_render_cache::draw() const
+{
+	if(!filled_) {
+		return;
+	}
+
+	++cache_draws;
+
+	const GLfloat u = GLfloat(area_.w())/texture_width_;
+	const GLfloat v = GLfloat(texture_height_ - area_.h())/texture_height_;
+
+	graphics::blit_queue queue;
+	queue.set_texture(texture_);
+	queue.add(area_.x(), area_.y(), 0.0f, 1.0f);
+	queue.add(area_.x2(), area_.y(), u, 1.0f);
+	queue.add(area_.x(), area_.y2(), 0.0f, v);
+	queue.add(area_.x2(), area_.y2(), u, v);
+
+	//the copy already has the color it was drawn in applied.
+	GLfloat color[4];
+	current_color(color);
+	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	queue.do_blit();
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glColor4f(color[0], color[1], color[2], color[3]);
+}
+
+bool widget_render_cache::rendering()
+{
+	return is_rendering;
+}
+
+void widget_render_cache::record_uncached()
+{
+	++uncached_draws;
+}
+
+std::string widget_render_cache::report()
+{
+	std::ostringstream s;
+	s << "WIDGET RENDER CACHE: " << (cache_draws - cache_renders) << " DRAWN FROM CACHE, "
+	  << cache_renders << " REDRAWN, " << uncached_draws << " NOT CACHEABLE";
+	return s.str();
+}
+
+}
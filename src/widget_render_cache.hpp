@@ -0,0 +1,78 @@
+/*
+	Copyright (C) 2003-2013 by David White <davewx7@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef WIDGET_RENDER_CACHE_HPP_INCLUDED
+#define WIDGET_RENDER_CACHE_HPP_INCLUDED
+
+#include <string>
+
+#include "geometry.hpp"
+#include "graphics.hpp"
+
+namespace gui {
+
+//An offscreen copy of what a widget tree drew, kept in a texture so that
+//a tree which hasn't changed since the last frame is drawn as one quad.
+//The copy is stored with premultiplied alpha, which lets it be composited
+//over the screen exactly as the widgets would have blended onto it.
+class widget_render_cache
+{
+public:
+	widget_render_cache();
+	~widget_render_cache();
+
+	//true if the copy holds 'area' drawn at 'version' in the current color.
+	bool valid(const rect& area, unsigned int version) const;
+
+	//redirects drawing into the copy, with 'area' mapped onto it, until
+	//end() is called. Returns false if no offscreen target is available,
+	//in which case the caller must draw directly.
+	bool begin(const rect& area);
+	void end(unsigned int version);
+
+	//draws the copy over the area it was made from.
+	void draw() const;
+
+	//true while drawing into a copy. Widgets then blend their alpha so
+	//the copy ends up premultiplied.
+	static bool rendering();
+
+	//counts the widgets drawn from a copy, drawn into a new copy and drawn
+	//directly because they can't be cached.
+	static void record_uncached();
+	static std::string report();
+
+private:
+	widget_render_cache(const widget_render_cache&);
+	void operator=(const widget_render_cache&);
+
+	void release();
+
+	GLuint framebuffer_, texture_, depth_stencil_;
+	int texture_width_, texture_height_;
+
+	rect area_;
+	unsigned int version_;
+	GLfloat color_[4];
+	bool filled_;
+
+	GLint old_framebuffer_;
+	GLint old_viewport_[4];
+};
+
+}
+
+#endif
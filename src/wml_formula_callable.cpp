@@ -26,6 +26,8 @@
 #include "foreach.hpp"
 #include "formula_object.hpp"
 #include "json_parser.hpp"
+#include "thread.hpp"
+#include "thread_local.hpp"
 #include "variant_utils.hpp"
 #include "wml_formula_callable.hpp"
 
@@ -41,7 +43,19 @@ struct scope_info {
 	std::set<const_wml_serializable_formula_callable_ptr> objects_to_write, objects_written;
 };
 
-std::stack<scope_info, std::vector<scope_info> > scopes;
+typedef std::stack<scope_info, std::vector<scope_info> > scope_stack;
+
+//each thread serializing objects has its own scopes, created on first use.
+THREAD_LOCAL scope_stack* g_scopes;
+
+scope_stack& scopes() {
+	if(g_scopes == NULL) {
+		g_scopes = new scope_stack;
+		threading::delete_at_thread_exit(&g_scopes);
+	}
+
+	return *g_scopes;
+}
 
 std::map<std::string, std::function<variant(variant)> >& type_registry() {
 	static std::map<std::string, std::function<variant(variant)> > instance;
@@ -86,23 +100,23 @@ variant wml_serializable_formula_callable::write_to_wml() const
 
 void wml_formula_callable_serialization_scope::register_serialized_object(const_wml_serializable_formula_callable_ptr ptr)
 {
-	ASSERT_LOG(scopes.empty() == false, "register_serialized_object() called when there is no wml_formula_callable_serialization_scope");
-	scopes.top().objects_written.insert(ptr);
+	ASSERT_LOG(scopes().empty() == false, "register_serialized_object() called when there is no wml_formula_callable_serialization_scope");
+	scopes().top().objects_written.insert(ptr);
 }
 
 bool wml_formula_callable_serialization_scope::is_active()
 {
-	return scopes.empty() == false;
+	return scopes().empty() == false;
 }
 
 wml_formula_callable_serialization_scope::wml_formula_callable_serialization_scope()
 {
-	scopes.push(scope_info());
+	scopes().push(scope_info());
 }
 
 wml_formula_callable_serialization_scope::~wml_formula_callable_serialization_scope()
 {
-	scopes.pop();
+	scopes().pop();
 }
 
 namespace {
@@ -157,21 +171,33 @@ variant wml_formula_callable_serialization_scope::write_objects(variant obj, int
 }
 
 namespace {
-std::map<intptr_t, wml_serializable_formula_callable_ptr> registered_objects;
+typedef std::map<intptr_t, wml_serializable_formula_callable_ptr> registered_objects_map;
+
+//the objects read in this thread's read scopes, created on first use.
+THREAD_LOCAL registered_objects_map* g_registered_objects;
+
+registered_objects_map& registered_objects() {
+	if(g_registered_objects == NULL) {
+		g_registered_objects = new registered_objects_map;
+		threading::delete_at_thread_exit(&g_registered_objects);
+	}
+
+	return *g_registered_objects;
+}
 }
 
 void wml_formula_callable_read_scope::register_serialized_object(intptr_t addr, wml_serializable_formula_callable_ptr ptr)
 {
 	//fprintf(stderr, "REGISTER SERIALIZED: 0x%x\n", (int)addr);
 	if(ptr.get() != NULL) {
-		registered_objects[addr] = ptr;
+		registered_objects()[addr] = ptr;
 	}
 }
 
 wml_serializable_formula_callable_ptr wml_formula_callable_read_scope::get_serialized_object(intptr_t addr)
 {
-	auto itor = registered_objects.find(addr);
-	if(itor != registered_objects.end()) {
+	auto itor = registered_objects().find(addr);
+	if(itor != registered_objects().end()) {
 		return itor->second;
 	} else {
 		return wml_serializable_formula_callable_ptr();
@@ -179,7 +205,7 @@ wml_serializable_formula_callable_ptr wml_formula_callable_read_scope::get_seria
 }
 
 namespace {
-int g_nformula_callable_read_scope = 0;
+THREAD_LOCAL int g_nformula_callable_read_scope = 0;
 }
 
 wml_formula_callable_read_scope::wml_formula_callable_read_scope()
@@ -195,8 +221,8 @@ wml_formula_callable_read_scope::~wml_formula_callable_read_scope()
 	for(std::set<variant*>::iterator i = v.begin(); i != v.end(); ++i) {
 		variant& var = **i;
 		//fprintf(stderr, "LOAD SERIALIZED: 0x%x\n", (int)var.as_callable_loading());
-		auto itor = registered_objects.find(var.as_callable_loading());
-		if(itor == registered_objects.end()) {
+		auto itor = registered_objects().find(var.as_callable_loading());
+		if(itor == registered_objects().end()) {
 			unfound_variants.insert(*i);
 		} else {
 			var = variant(itor->second.get());
@@ -210,14 +236,14 @@ wml_formula_callable_read_scope::~wml_formula_callable_read_scope()
 	}
 
 	if(--g_nformula_callable_read_scope == 0) {
-		registered_objects.clear();
+		registered_objects().clear();
 	}
 }
 
 bool wml_formula_callable_read_scope::try_load_object(intptr_t id, variant& v)
 {
-	std::map<intptr_t, wml_serializable_formula_callable_ptr>::const_iterator itor = registered_objects.find(id);
-	if(itor != registered_objects.end()) {
+	std::map<intptr_t, wml_serializable_formula_callable_ptr>::const_iterator itor = registered_objects().find(id);
+	if(itor != registered_objects().end()) {
 		v = variant(itor->second.get());
 		return true;
 	} else {